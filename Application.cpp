@@ -2,17 +2,130 @@
 #include "Device.h"
 #include "Window.h"
 #include "Camera.h"
+#include "MarchingCubes.h"
+#include "BrickCache.h"
+#include "ProxyGeometry.h"
+#include "ThreadPool.h"
+#include "VolumeProjections.h"
+#include "VolumeCropper.h"
+#include "VolumeFilter.h"
+#include "DicomLoader.h"
+#include "VolumeFile.h"
 
 #include "D3D12MemAlloc.h"
 
+#include <algorithm>
 #include <vector>
 #include <chrono>
+#include <cmath>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <array>
 
 #define DX_ASSERT(hr) { if FAILED(hr) assert(false);}
 
+static constexpr uint8_t BONE_ISO_VALUE = 80;
+
+// page the volume through the brick atlas even when it would fit in video memory
+static constexpr bool FORCE_BRICK_PAGING = false;
+static constexpr uint32_t BRICK_APRON = 1;
+static constexpr uint32_t ATLAS_BRICK_SIZE = BRICK_SIZE + 2 * BRICK_APRON;
+static constexpr uint32_t MAX_BRICK_UPLOADS_PER_FRAME = 64;
+
+// bricks whose values never go above this are left out of the proxy geometry, opacity is the density itself
+static constexpr uint8_t EMPTY_SPACE_THRESHOLD = 8;
+static constexpr uint32_t CUBE_VERTEX_COUNT = 36;
+
+// bytes the strided preview read may take, a few milliseconds from a slow disk, the rest loads in the background
+static constexpr uint64_t PREVIEW_READ_BUDGET = 1024 * 1024;
+
+// the air around a scan is cut off every level before it's uploaded, the box comes from the preview and keeps a few voxels of margin
+static constexpr bool CROP_VOLUME = true;
+static constexpr uint8_t CROP_THRESHOLD = EMPTY_SPACE_THRESHOLD;
+static constexpr uint32_t CROP_MARGIN = 2;
+
+// every level is filtered on the loader thread once it's cropped, low-dose CT is too grainy to ray march as it is
+enum class DenoiseFilter { None, Gaussian, Median, Bilateral };
+static constexpr DenoiseFilter DENOISE_FILTER = DenoiseFilter::None;
+static constexpr float DENOISE_GAUSSIAN_SIGMA = 0.8f;
+static constexpr uint32_t DENOISE_MEDIAN_RADIUS = 1;
+static constexpr float DENOISE_SPATIAL_SIGMA = 0.5f;
+static constexpr float DENOISE_RANGE_SIGMA = 20.0f;
+
+// the projections of every loaded dataset are written next to it for the dataset browser, at most this big
+static constexpr bool WRITE_PROJECTIONS = true;
+static constexpr uint32_t PROJECTION_IMAGE_SIZE = 256;
+
+// light volume resolution along the longest axis, the ray marcher's step length (in texture space) for converting opacity
+static constexpr uint32_t ILLUMINATION_RESOLUTION = 128;
+static constexpr float RAY_STEP_LENGTH = 0.05f;
+static constexpr float LIGHT_ELEVATION = 0.8f;
+static constexpr float LIGHT_ROTATION_SPEED = 1.0f;
+
+// readbacks in flight before captures get dropped, and encoded images allowed to queue up behind the disk
+static constexpr uint32_t CAPTURE_SLOT_COUNT = FRAMES_IN_FLIGHT + 1;
+static constexpr size_t MAX_PENDING_CAPTURES = 8;
+
+// n writes the memory report, it's also written every this many frames unless that's 0
+static constexpr uint32_t MEMORY_REPORT_INTERVAL = 0;
+static constexpr const char* MEMORY_REPORT_PATH = "memory_report.json";
+
+static constexpr uint32_t SLICE_SIZE = 512;
+static constexpr float SLAB_THICKNESS = 16.0f;
+
+// unit cube, scaled to the proxy bounds for the ray marching pass
+static constexpr DirectX::XMFLOAT3 CUBE_VERTICES[36] = {
+	{1.0f, -1.0f, 1.0f},
+	{1.0f, -1.0f, -1.0f},
+	{-1.0f, -1.0f, 1.0f},
+	{-1.0f, -1.0f, 1.0f},
+	{1.0f, -1.0f, -1.0f},
+	{-1.0f, -1.0f, -1.0f},
+	{1.0f, 1.0f, -1.0f},
+	{1.0f, 1.0f, 1.0f},
+	{-1.0f, 1.0f, -1.0f},
+	{-1.0f, 1.0f, -1.0f},
+	{1.0f, 1.0f, 1.0f},
+	{-1.0f, 1.0f, 1.0f},
+	{-1.0f, -1.0f, -1.0f},
+	{-1.0f, 1.0f, -1.0f},
+	{-1.0f, -1.0f, 1.0f},
+	{-1.0f, -1.0f, 1.0f},
+	{-1.0f, 1.0f, -1.0f},
+	{-1.0f, 1.0f, 1.0f},
+	{-1.0f, -1.0f, 1.0f},
+	{-1.0f, 1.0f, 1.0f},
+	{1.0f, -1.0f, 1.0f},
+	{1.0f, -1.0f, 1.0f},
+	{-1.0f, 1.0f, 1.0f},
+	{1.0f, 1.0f, 1.0f},
+	{1.0f, -1.0f, 1.0f},
+	{1.0f, 1.0f, 1.0f},
+	{1.0f, -1.0f, -1.0f},
+	{1.0f, -1.0f, -1.0f},
+	{1.0f, 1.0f, 1.0f},
+	{1.0f, 1.0f, -1.0f},
+	{1.0f, -1.0f, -1.0f},
+	{1.0f, 1.0f, -1.0f},
+	{-1.0f, -1.0f, -1.0f},
+	{-1.0f, -1.0f, -1.0f},
+	{1.0f, 1.0f, -1.0f},
+	{-1.0f, 1.0f, -1.0f},
+	};
+
+// will be put into Context class when I get around to making it !!!
+static void AddBarrier(std::vector<TransitionBarrier>& barriers, Resource* resource, D3D12_RESOURCE_STATES newState)
+{
+	if (resource->mCurrentState == newState)
+		return;
+	barriers.push_back({
+		.resource = resource,
+		.stateBefore = static_cast<uint32_t>(resource->mCurrentState),
+		.stateAfter = static_cast<uint32_t>(newState) });
+	resource->mCurrentState = newState;
+}
+
 Application::Application()
 	: mInput(Input())
 {
@@ -21,11 +134,15 @@ Application::Application()
 Application::~Application()
 {
 	mDevice->WaitForIdle();
+	if (mFrameCapture)
+		PollCaptures();
 }
 
 void Application::Initialize()
 {
 	mDevice = std::make_unique<Device>();
+	mFrameCapture = std::make_unique<FrameCapture>(CAPTURE_SLOT_COUNT, MAX_PENDING_CAPTURES);
+	mCaptureReadbacks.resize(CAPTURE_SLOT_COUNT);
 
 	TextureDescription depthBufferDesc{
 		.textureDescriptor = DescriptorType::Dsv,
@@ -33,7 +150,8 @@ void Application::Initialize()
 		.initialState = D3D12_RESOURCE_STATE_DEPTH_WRITE,
 		.flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL,
 		.width = Window::GetWidth(),
-		.height = Window::GetHeight() };
+		.height = Window::GetHeight(),
+		.memoryCategory = MemoryCategory::RenderTarget };
 
 	mDepthBuffer = mDevice->CreateTexture(depthBufferDesc);
 
@@ -43,12 +161,21 @@ void Application::Initialize()
 		.initialState = D3D12_RESOURCE_STATE_RENDER_TARGET,
 		.flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET,
 		.width = Window::GetWidth(),
-		.height = Window::GetHeight()
+		.height = Window::GetHeight(),
+		.memoryCategory = MemoryCategory::RenderTarget
 	};
 
 	mCubeFront = mDevice->CreateTexture(cubeRenderDesc);
 	mCubeBack = mDevice->CreateTexture(cubeRenderDesc);
 
+	TextureDescription sliceDesc{
+		.textureDescriptor = DescriptorType::Srv,
+		.format = DXGI_FORMAT_R8_UNORM,
+		.initialState = D3D12_RESOURCE_STATE_COPY_DEST,
+		.width = SLICE_SIZE,
+		.height = SLICE_SIZE,
+		.memoryCategory = MemoryCategory::Other };
+	mSliceTexture = mDevice->CreateTexture(sliceDesc);
 
 	InitializePipelines();
 	LoadVolumeData();
@@ -57,21 +184,17 @@ void Application::Initialize()
 		.bufferDescriptor = DescriptorType::Cbv,
 		.heapType = D3D12_HEAP_TYPE_UPLOAD,
 		.size = sizeof(PerFrameConstantBuffer),
-		.count = 1 };
-	mPerFrameConstantBuffer = mDevice->CreateBuffer(bufferDesc);
-	mPerFrameConstantBuffer->mResource->Map(0, nullptr, &mPerFrameConstantBuffer->mMapped);
-
-	mPerFrameConstantBufferData = {
-		.cameraDimensions = DirectX::XMFLOAT2(Window::GetWidth(), Window::GetHeight()),
-		.frontDescriptorIndex = mCubeFront->mDescriptorIndex,
-		.backDescriptorIndex = mCubeBack->mDescriptorIndex,
-		.cubeDescriptorIndex = mCube->mDescriptorIndex,
-		.volumeDataDescriptor = mVolumeTexture->mDescriptorIndex
-		};
-	DirectX::XMStoreFloat4x4(&mPerFrameConstantBufferData.modelMatrix,
-		DirectX::XMMatrixIdentity());
-
-	memcpy(mPerFrameConstantBuffer->mMapped, &mPerFrameConstantBufferData, sizeof(PerFrameConstantBuffer));
+		.count = 1,
+		.memoryCategory = MemoryCategory::Constants };
+	mPerFrameConstantBuffers.resize(FRAMES_IN_FLIGHT);
+	for (std::unique_ptr<BufferResource>& constantBuffer : mPerFrameConstantBuffers)
+	{
+		constantBuffer = mDevice->CreateBuffer(bufferDesc);
+		constantBuffer->mResource->Map(0, nullptr, &constantBuffer->mMapped);
+	}
+
+	mPerFrameConstantBufferData.cameraDimensions = DirectX::XMFLOAT2(Window::GetWidth(), Window::GetHeight());
+	UpdatePerFrameConstants();
 
 	mCamera = std::make_unique<Camera>(*mDevice.get(), mInput);
 
@@ -80,25 +203,760 @@ void Application::Initialize()
 
 void Application::LoadVolumeData()
 {
-	std::vector<uint8_t> data = utils::LoadFileIntoVector<uint8_t>(std::filesystem::path(RESOURCE_DIR "/foot_256x256x256_uint8.raw"));
+	// a new dataset replaces everything allocated for the previous one, which frees its arena blocks for it
+	mPendingVolumeLevel.reset();
+	mVolumeData = VoxelBuffer();
+	mFusedVolumeData = VoxelBuffer();
+	// a secondary volume was registered to the previous dataset
+	mSecondaryVolume.clear();
+	mDevice->Release(std::move(mFusedVolumeTexture));
+
+	// a DICOM series or a volume file that isn't 8 bit raw is decoded in one go, raw bytes stream in coarse to fine
+	std::optional<VolumeLevel> decodedLevel;
+	VolumeDimensions dimensions = { .width = 256, .height = 256, .depth = 256 };
+	std::filesystem::path rawPath(RESOURCE_DIR "/foot_256x256x256_uint8.raw");
+	uint64_t rawOffset = 0;
+	bool isBundledVolume = true;
+	if (!mDicomDirectory.empty())
+	{
+		decodedLevel = ReadDicomSeries(mDicomDirectory);
+		isBundledVolume = !decodedLevel;
+	}
+	else if (!mVolumeFilePath.empty())
+	{
+		std::optional<VolumeFileInfo> info = VolumeFile::ReadHeader(mVolumeFilePath);
+		if (!info)
+			std::cerr << "Couldn't read the header of " << mVolumeFilePath << std::endl;
+		else if (VolumeFile::IsDirectlyReadable(*info))
+		{
+			dimensions = info->dimensions;
+			rawPath = info->dataPath;
+			rawOffset = info->dataOffset;
+			isBundledVolume = false;
+		}
+		else
+		{
+			decodedLevel = ReadVolumeFile(*info);
+			isBundledVolume = !decodedLevel;
+		}
+	}
+
+	VolumeLevel level;
+	if (decodedLevel)
+	{
+		mVolumeLoader.reset();
+		dimensions = decodedLevel->dimensions;
+		level = std::move(*decodedLevel);
+		mCropBox = FindCropBox(level, dimensions);
+		CropVolumeLevel(level);
+		DenoiseVolumeLevel(level);
+	}
+	else
+	{
+		// already cropped and denoised on the loader thread
+		level = LoadRawVolume(rawPath, rawOffset, dimensions);
+	}
+
+	mFullVolumeDimensions = dimensions;
+	if (!IsBrickPagingNeeded(level))
+	{
+		mVolumeTexture = CreateVolumeTexture(level.dimensions);
+		mVolumeUploadedSlices = 0;
+	}
+	SetVolumeLevel(std::move(level));
+
+	// a segmentation of the volume is picked up if there is one next to it
+	const std::filesystem::path labelPath(RESOURCE_DIR "/foot_labels_256x256x256_uint8.raw");
+	if (isBundledVolume && std::filesystem::exists(labelPath))
+	{
+		std::vector<uint8_t> labels = utils::LoadFileIntoVector<uint8_t>(labelPath);
+		SetLabelVolume(labels.data(), dimensions);
+	}
+}
+
+VolumeLevel Application::LoadRawVolume(const std::filesystem::path& volumePath, uint64_t offset, const VolumeDimensions& dimensions)
+{
+	// only the preview is waited for, the finer levels are swapped in by UpdateVolumeLoading as they arrive
+	mVolumeLoader = std::make_unique<ProgressiveLoader>(ProgressiveLoader::ReadFromFile(volumePath, offset), dimensions, PREVIEW_READ_BUDGET);
+	// The crop box comes from the preview and is only read after that, the main thread first looks at it
+	// once WaitForLevel returns the preview. Every level is cropped and denoised on the loader thread as it's read.
+	const uint32_t previewStride = mVolumeLoader->GetPreviewStride();
+	mVolumeLoader->SetLevelFunction([this, dimensions, previewStride](VolumeLevel& level) {
+		if (level.stride == previewStride)
+			mCropBox = FindCropBox(level, dimensions);
+		CropVolumeLevel(level);
+		DenoiseVolumeLevel(level);
+	});
+	if (WRITE_PROJECTIONS)
+	{
+		// built from the full resolution read as it streams in, owned by the loader's thread
+		std::shared_ptr<VolumeProjections> projections = std::make_shared<VolumeProjections>();
+		projections->Initialize(dimensions);
+		mVolumeLoader->SetFullResolutionSlabFunction([projections, volumePath](const uint8_t* slices, uint32_t firstSlice, uint32_t sliceCount) {
+			projections->AddSlab(slices, firstSlice, sliceCount);
+			if (projections->IsComplete() && !projections->WriteImages(volumePath, PROJECTION_IMAGE_SIZE))
+				std::cerr << "Couldn't write the projections of " << volumePath << std::endl;
+		});
+	}
+	mVolumeLoader->Start();
+	return mVolumeLoader->WaitForLevel();
+}
+
+std::optional<VolumeLevel> Application::ReadDicomSeries(const std::filesystem::path& directory)
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::optional<DicomSeries> series = DicomLoader::Scan(directory);
+	if (!series)
+	{
+		std::cerr << "No DICOM series found in " << directory << std::endl;
+		return std::nullopt;
+	}
+	const std::chrono::steady_clock::time_point scanned = std::chrono::steady_clock::now();
+
+	VolumeLevel level{ .dimensions = series->dimensions };
+	level.data.resize(series->dimensions.GetVoxelCount());
+	if (!DicomLoader::Read(*series, 0, series->dimensions.depth, level.data.data()))
+		std::cerr << "Some slices of " << directory << " couldn't be decoded" << std::endl;
+	const std::chrono::steady_clock::time_point decoded = std::chrono::steady_clock::now();
+
+	// printed in every build, it's what loading a series costs
+	const float scanMilliseconds = std::chrono::duration_cast<std::chrono::microseconds>(scanned - start).count() / 1000.0f;
+	const float decodeMilliseconds = std::chrono::duration_cast<std::chrono::microseconds>(decoded - scanned).count() / 1000.0f;
+	level.loadMilliseconds = scanMilliseconds + decodeMilliseconds;
+	std::cout << "DICOM series: " << series->dimensions.depth << " slices of " << series->dimensions.width << "x" << series->dimensions.height
+		<< ", headers scanned in " << scanMilliseconds << " ms, decoded in " << decodeMilliseconds << " ms, "
+		<< series->dimensions.depth * 1000.0f / std::max(level.loadMilliseconds, 0.001f) << " slices/s" << std::endl;
+	return level;
+}
+
+std::optional<VolumeLevel> Application::ReadVolumeFile(const VolumeFileInfo& info)
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	VolumeLevel level{ .dimensions = info.dimensions };
+	level.data.resize(info.dimensions.GetVoxelCount());
+	if (!VolumeFile::Read(info, level.data.data()))
+	{
+		std::cerr << "Couldn't read the voxels of " << info.dataPath << std::endl;
+		return std::nullopt;
+	}
+
+	// printed in every build like the DICOM timings, throughput is in stored (inflated) bytes
+	level.loadMilliseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000.0f;
+	const float storedMegabytes = info.dimensions.GetVoxelCount() * VolumeFile::GetVoxelSize(info.type) / (1024.0f * 1024.0f);
+	std::cout << "Volume file: " << info.dimensions.width << "x" << info.dimensions.height << "x" << info.dimensions.depth
+		<< ", " << VolumeFile::GetVoxelSize(info.type) * 8 << " bit voxels read in " << level.loadMilliseconds << " ms, "
+		<< storedMegabytes * 1000.0f / std::max(level.loadMilliseconds, 0.001f) << " MB/s" << std::endl;
+	return level;
+}
+
+bool Application::IsBrickPagingNeeded(const VolumeLevel& level) const
+{
+	// previews are small by construction, paging them would only slow down the first frame
+	if (level.stride > 1)
+		return false;
+	return FORCE_BRICK_PAGING || level.data.size() > mDevice->GetAvailableVideoMemory() / 2;
+}
+
+VolumeBox Application::FindCropBox(const VolumeLevel& level, const VolumeDimensions& dimensions) const
+{
+	VolumeBox cropBox = { .maxX = dimensions.width, .maxY = dimensions.height, .maxZ = dimensions.depth };
+	if (!CROP_VOLUME)
+		return cropBox;
+
+	const VolumeBox bounds = VolumeCropper::FindBounds(level.data.data(), level.dimensions, CROP_THRESHOLD);
+	if (!bounds.IsEmpty())
+	{
+		// the preview skips stride - 1 voxels between its samples, whatever is there is kept too
+		const VolumeBox fullBounds = {
+			.minX = bounds.minX * level.stride,
+			.minY = bounds.minY * level.stride,
+			.minZ = bounds.minZ * level.stride,
+			.maxX = bounds.maxX * level.stride,
+			.maxY = bounds.maxY * level.stride,
+			.maxZ = bounds.maxZ * level.stride };
+		cropBox = VolumeCropper::Expand(fullBounds, level.stride - 1 + CROP_MARGIN, dimensions);
+	}
+#ifdef _DEBUG
+	std::cout << "Cropped to " << cropBox.maxX - cropBox.minX << "x" << cropBox.maxY - cropBox.minY << "x" << cropBox.maxZ - cropBox.minZ
+		<< ", " << dimensions.GetVoxelCount() - cropBox.GetVoxelCount() << " bytes of background left out" << std::endl;
+#endif
+	return cropBox;
+}
+
+VolumeBox Application::GetLevelCropBox(uint32_t stride) const
+{
+	// level voxel i is voxel i * stride, the level keeps the ones landing inside the crop box
+	auto first = [stride](uint32_t voxel) { return (voxel + stride - 1) / stride; };
+	return {
+		.minX = first(mCropBox.minX),
+		.minY = first(mCropBox.minY),
+		.minZ = first(mCropBox.minZ),
+		.maxX = first(mCropBox.maxX),
+		.maxY = first(mCropBox.maxY),
+		.maxZ = first(mCropBox.maxZ) };
+}
+
+void Application::CropVolumeLevel(VolumeLevel& level) const
+{
+	const VolumeBox box = GetLevelCropBox(level.stride);
+	if (box.GetVoxelCount() == level.dimensions.GetVoxelCount())
+		return;
 
-	//mVolumeData.resize(d.size(), 0.0f);
-	//for (uint32_t i = 0; i < mVolumeData.size(); i++)
-	//{
-	//	mVolumeData[i] = (static_cast<float>(d[i]) / UINT8_MAX);
-	//}
+	VolumeCropper::Crop(level.data.data(), level.dimensions, box, level.data.data());
+	level.data.resize(box.GetVoxelCount());
+	level.dimensions = { .width = box.maxX - box.minX, .height = box.maxY - box.minY, .depth = box.maxZ - box.minZ };
+}
+
+void Application::DenoiseVolumeLevel(VolumeLevel& level) const
+{
+	if (DENOISE_FILTER == DenoiseFilter::None)
+		return;
+
+#ifdef _DEBUG
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#endif
+	// the filters don't run in place, the result goes to arena memory that needn't be zeroed and replaces the level's
+	VoxelBuffer filtered;
+	filtered.resize(level.data.size());
+	switch (DENOISE_FILTER)
+	{
+	case DenoiseFilter::Gaussian:
+		VolumeFilter::Gaussian(level.data.data(), level.dimensions, DENOISE_GAUSSIAN_SIGMA, filtered.data());
+		break;
+	case DenoiseFilter::Median:
+		VolumeFilter::Median(level.data.data(), level.dimensions, DENOISE_MEDIAN_RADIUS, filtered.data());
+		break;
+	case DenoiseFilter::Bilateral:
+		VolumeFilter::Bilateral(level.data.data(), level.dimensions, DENOISE_SPATIAL_SIGMA, DENOISE_RANGE_SIGMA, filtered.data());
+		break;
+	case DenoiseFilter::None:
+		break;
+	}
+	level.data = std::move(filtered);
 
+#ifdef _DEBUG
+	const float milliseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000.0f;
+	std::cout << "Denoised level 1/" << level.stride << " in " << milliseconds << "ms, "
+		<< level.data.size() / 1000.0f / std::max(milliseconds, 0.001f) << " Mvoxels/s" << std::endl;
+#endif
+}
+
+std::unique_ptr<TextureResource> Application::CreateVolumeTexture(const VolumeDimensions& dimensions)
+{
 	TextureDescription desc{
 		.textureDescriptor = DescriptorType::Srv,
 		.dimension = D3D12_RESOURCE_DIMENSION_TEXTURE3D,
 		.format = DXGI_FORMAT_R8_UNORM,
 		.initialState = D3D12_RESOURCE_STATE_COPY_DEST,
-		.width = 256,
-		.height = 256,
-		.depthOrArraySize = 256};
-	mVolumeTexture = mDevice->CreateTexture(desc);
+		.width = dimensions.width,
+		.height = dimensions.height,
+		.depthOrArraySize = static_cast<uint16_t>(dimensions.depth),
+		.memoryCategory = MemoryCategory::VolumeTexture };
+	return mDevice->CreateTexture(desc);
+}
+
+void Application::SetVolumeLevel(VolumeLevel&& level)
+{
+#ifdef _DEBUG
+	std::cout << "Volume level 1/" << level.stride << " (" << level.dimensions.width << "x" << level.dimensions.height << "x"
+		<< level.dimensions.depth << ") read after " << level.loadMilliseconds << " ms" << std::endl;
+#endif
+
+	mVolumeData = std::move(level.data);
+	mVolumeDimensions = level.dimensions;
+	mVolumeStride = level.stride;
+
+	if (!mVolumeTexture && !mBrickCache)
+	{
+		InitializeBrickCache(mDevice->GetAvailableVideoMemory());
+		mVolumeUploadedSlices = mVolumeDimensions.depth;
+	}
+
+	// everything derived from the voxels is rebuilt, edits made on a coarser level are lost
+	mMinMaxGrid.Build(mVolumeData.data(), mVolumeDimensions);
+	mDirtyRegions.Initialize(mVolumeDimensions);
+
+	// the ray marcher uses the density as opacity per step, rescaled here to one light volume voxel of travel
+	mIlluminationVolume.Initialize(mVolumeDimensions, ILLUMINATION_RESOLUTION);
+	IlluminationVolume::OpacityTable opacityTable;
+	for (uint32_t density = 0; density < opacityTable.size(); density++)
+	{
+		opacityTable[density] = 1.0f - std::pow(1.0f - density / 255.0f, 1.0f / (ILLUMINATION_RESOLUTION * RAY_STEP_LENGTH));
+	}
+	mIlluminationVolume.SetOpacityTable(opacityTable);
+
+	const VolumeDimensions& illuminationDimensions = mIlluminationVolume.GetDimensions();
+	TextureDescription illuminationDesc{
+		.textureDescriptor = DescriptorType::Srv,
+		.dimension = D3D12_RESOURCE_DIMENSION_TEXTURE3D,
+		.format = DXGI_FORMAT_R8_UNORM,
+		.initialState = D3D12_RESOURCE_STATE_COPY_DEST,
+		.width = illuminationDimensions.width,
+		.height = illuminationDimensions.height,
+		.depthOrArraySize = static_cast<uint16_t>(illuminationDimensions.depth),
+		.memoryCategory = MemoryCategory::Lighting };
+	mDevice->Release(std::move(mIlluminationTexture));
+	mIlluminationTexture = mDevice->CreateTexture(illuminationDesc);
+
+	// the base step is RAY_STEP_LENGTH of texture space, which is that much of the longest axis in voxels
+	const StepGridSettings stepGridSettings{
+		.baseStepVoxels = RAY_STEP_LENGTH * std::max({ mVolumeDimensions.width, mVolumeDimensions.height, mVolumeDimensions.depth }) };
+	mStepGrid.Build(mVolumeData.data(), mVolumeDimensions, stepGridSettings);
+
+	const VolumeDimensions& stepGridDimensions = mStepGrid.GetDimensions();
+	TextureDescription stepGridDesc{
+		.textureDescriptor = DescriptorType::Srv,
+		.dimension = D3D12_RESOURCE_DIMENSION_TEXTURE3D,
+		.format = DXGI_FORMAT_R8_UINT,
+		.initialState = D3D12_RESOURCE_STATE_COPY_DEST,
+		.width = stepGridDimensions.width,
+		.height = stepGridDimensions.height,
+		.depthOrArraySize = static_cast<uint16_t>(stepGridDimensions.depth),
+		.memoryCategory = MemoryCategory::Acceleration };
+	mDevice->Release(std::move(mStepGridTexture));
+	mStepGridTexture = mDevice->CreateTexture(stepGridDesc);
+	mIsStepGridDirty = true;
+	mIsStepGridUploaded = false;
+
+	if (!mSecondaryVolume.empty())
+		FuseVolumes();
+
+	BuildProxyGeometry();
+	ExtractIsosurface(BONE_ISO_VALUE);
+}
 
-	mDevice->ImmediateUploadToGpu(mVolumeTexture.get(), data.data());
+void Application::UpdatePerFrameConstants()
+{
+	mPerFrameConstantBufferData.frontDescriptorIndex = mCubeFront->mDescriptorIndex;
+	mPerFrameConstantBufferData.backDescriptorIndex = mCubeBack->mDescriptorIndex;
+	mPerFrameConstantBufferData.cubeDescriptorIndex = mCube->mDescriptorIndex;
+	mPerFrameConstantBufferData.volumeDataDescriptor = mVolumeTexture ? mVolumeTexture->mDescriptorIndex : UINT_MAX;
+	if (IsFusionVisible())
+		mPerFrameConstantBufferData.volumeDataDescriptor = mFusedVolumeTexture->mDescriptorIndex;
+	mPerFrameConstantBufferData.isosurfaceVertexDescriptor = mIsosurfaceVertices->mDescriptorIndex;
+	mPerFrameConstantBufferData.isosurfaceIndexDescriptor = mIsosurfaceIndices->mDescriptorIndex;
+	mPerFrameConstantBufferData.volumeDimensions = { mVolumeDimensions.width, mVolumeDimensions.height, mVolumeDimensions.depth };
+
+	// the unit cube of a cropped level is moved back to where the box sits in the unit cube of the whole level
+	const VolumeBox levelBox = GetLevelCropBox(mVolumeStride);
+	const DirectX::XMFLOAT3 levelDimensions(
+		static_cast<float>((mFullVolumeDimensions.width + mVolumeStride - 1) / mVolumeStride),
+		static_cast<float>((mFullVolumeDimensions.height + mVolumeStride - 1) / mVolumeStride),
+		static_cast<float>((mFullVolumeDimensions.depth + mVolumeStride - 1) / mVolumeStride));
+	const DirectX::XMMATRIX modelMatrix =
+		DirectX::XMMatrixScaling(
+			(levelBox.maxX - levelBox.minX) / levelDimensions.x,
+			(levelBox.maxY - levelBox.minY) / levelDimensions.y,
+			(levelBox.maxZ - levelBox.minZ) / levelDimensions.z) *
+		DirectX::XMMatrixTranslation(
+			(levelBox.minX + levelBox.maxX) / levelDimensions.x - 1.0f,
+			(levelBox.minY + levelBox.maxY) / levelDimensions.y - 1.0f,
+			(levelBox.minZ + levelBox.maxZ) / levelDimensions.z - 1.0f);
+	DirectX::XMStoreFloat4x4(&mPerFrameConstantBufferData.modelMatrix, DirectX::XMMatrixTranspose(modelMatrix));
+
+	mPerFrameConstantBufferData.sliceDescriptor = mSliceTexture->mDescriptorIndex;
+	mPerFrameConstantBufferData.illuminationDescriptor = mIsIlluminationEnabled ? mIlluminationTexture->mDescriptorIndex : UINT_MAX;
+
+	// a new grid texture is only used once its first upload is recorded, later edits are at most a frame late
+	const bool isStepGridUsed = mIsAdaptiveStepEnabled && mStepGridTexture && mIsStepGridUploaded;
+	mPerFrameConstantBufferData.stepGridDescriptor = isStepGridUsed ? mStepGridTexture->mDescriptorIndex : UINT_MAX;
+	const VolumeDimensions& stepGridDimensions = mStepGrid.GetDimensions();
+	mPerFrameConstantBufferData.stepGridDimensions = { stepGridDimensions.width, stepGridDimensions.height, stepGridDimensions.depth };
+
+	const bool isLabelUploaded = mLabelBuffer && mLabelUploadedBytes == mLabelVolume.GetPacked().size();
+	mPerFrameConstantBufferData.labelDescriptor = isLabelUploaded ? mLabelBuffer->mDescriptorIndex : UINT_MAX;
+	if (isLabelUploaded)
+	{
+		const VolumeDimensions& labelDimensions = mLabelVolume.GetDimensions();
+		mPerFrameConstantBufferData.labelBitsPerVoxel = mLabelVolume.GetBitsPerLabel();
+		mPerFrameConstantBufferData.labelDimensions = { labelDimensions.width, labelDimensions.height, labelDimensions.depth };
+		mPerFrameConstantBufferData.labelCount = mLabelVolume.GetLabelCount();
+
+		const LabelVolume::LabelMask visibleLabels = mLabelVolume.GetVisibleLabels();
+		memcpy(mPerFrameConstantBufferData.labelVisibility, visibleLabels.data(), sizeof(mPerFrameConstantBufferData.labelVisibility));
+		for (uint32_t label = 0; label < LabelVolume::MAX_LABEL_COUNT; label++)
+		{
+			const LabelStyle& style = mLabelVolume.GetStyle(static_cast<uint8_t>(label));
+			auto toByte = [](float value) { return static_cast<uint32_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f); };
+			mPerFrameConstantBufferData.labelColors[label] =
+				toByte(style.red) | (toByte(style.green) << 8) | (toByte(style.blue) << 16) | (toByte(style.opacity) << 24);
+		}
+	}
+	if (mBrickCache)
+	{
+		mPerFrameConstantBufferData.pageTableDescriptor = mPageTable->mDescriptorIndex;
+		mPerFrameConstantBufferData.brickGridDimensions = {
+			static_cast<uint32_t>(mPageTable->mDesc.Width),
+			mPageTable->mDesc.Height,
+			mPageTable->mDesc.DepthOrArraySize };
+		mPerFrameConstantBufferData.brickAtlasDescriptor = mBrickAtlas->mDescriptorIndex;
+		mPerFrameConstantBufferData.atlasSlotDimensions = {
+			static_cast<uint32_t>(mBrickAtlas->mDesc.Width / ATLAS_BRICK_SIZE),
+			mBrickAtlas->mDesc.Height / ATLAS_BRICK_SIZE,
+			mBrickAtlas->mDesc.DepthOrArraySize / ATLAS_BRICK_SIZE };
+		mPerFrameConstantBufferData.brickFeedbackDescriptor = mBrickFeedback->mUavDescriptor.mHeapIndex;
+	}
+}
+
+void Application::RecordInput()
+{
+	mInputRecorder = std::make_unique<InputRecorder>();
+}
+
+bool Application::SaveInputRecording(const std::filesystem::path& filePath) const
+{
+	assert(mInputRecorder && "Input isn't being recorded");
+	return mInputRecorder->Save(filePath);
+}
+
+void Application::ReplayInput(std::vector<InputFrame> frames, float fixedTimestep)
+{
+	mInputReplay = std::make_unique<InputReplay>(std::move(frames), fixedTimestep);
+}
+
+uint32_t Application::GetPixelShaderFeatures() const
+{
+	uint32_t features = 0;
+	if (mPerFrameConstantBufferData.pageTableDescriptor != UINT_MAX)
+		features |= PIXEL_SHADER_PAGED;
+	if (mPerFrameConstantBufferData.illuminationDescriptor != UINT_MAX)
+		features |= PIXEL_SHADER_LIT;
+	if (mPerFrameConstantBufferData.labelDescriptor != UINT_MAX)
+		features |= PIXEL_SHADER_LABELED;
+	if (mIsEarlyTerminationEnabled)
+		features |= PIXEL_SHADER_EARLY_TERMINATION;
+	if (mPerFrameConstantBufferData.stepGridDescriptor != UINT_MAX)
+		features |= PIXEL_SHADER_ADAPTIVE_STEP;
+	if (IsFusionVisible())
+		features |= PIXEL_SHADER_FUSED;
+	return features;
+}
+
+void Application::EditVolume(const VolumeBox& box, const std::function<void(uint32_t, uint32_t, uint32_t, uint8_t&)>& edit)
+{
+	const VolumeBox clipped = {
+		.minX = box.minX,
+		.minY = box.minY,
+		.minZ = box.minZ,
+		.maxX = std::min(box.maxX, mVolumeDimensions.width),
+		.maxY = std::min(box.maxY, mVolumeDimensions.height),
+		.maxZ = std::min(box.maxZ, mVolumeDimensions.depth) };
+	if (clipped.IsEmpty())
+		return;
+
+	ThreadPool::Get().ParallelFor(clipped.maxZ - clipped.minZ, [&](uint32_t slice) {
+		const uint32_t z = clipped.minZ + slice;
+		for (uint32_t y = clipped.minY; y < clipped.maxY; y++)
+		{
+			for (uint32_t x = clipped.minX; x < clipped.maxX; x++)
+				edit(x, y, z, mVolumeData[mVolumeDimensions.GetIndex(x, y, z)]);
+		}
+	});
+	if (!mFusedVolumeData.empty())
+	{
+		// only the volume's own channel changes, the dirty regions upload both textures
+		ThreadPool::Get().ParallelFor(clipped.maxZ - clipped.minZ, [&](uint32_t slice) {
+			const uint32_t z = clipped.minZ + slice;
+			for (uint32_t y = clipped.minY; y < clipped.maxY; y++)
+			{
+				for (uint32_t x = clipped.minX; x < clipped.maxX; x++)
+					mFusedVolumeData[mVolumeDimensions.GetIndex(x, y, z) * 2] = mVolumeData[mVolumeDimensions.GetIndex(x, y, z)];
+			}
+		});
+	}
+	mDirtyRegions.MarkDirty(clipped);
+	mIlluminationVolume.InvalidateOpacity();
+	mStepGrid.Update(mVolumeData.data(), mVolumeDimensions, clipped);
+	mIsStepGridDirty = true;
+
+	// derived data is only recomputed where the voxels changed
+	const std::vector<uint8_t> previousMax = mMinMaxGrid.GetMaxValues();
+	mMinMaxGrid.Update(mVolumeData.data(), mVolumeDimensions, clipped);
+
+	bool isOccupancyChanged = false;
+	const std::vector<uint8_t>& currentMax = mMinMaxGrid.GetMaxValues();
+	for (size_t brick = 0; brick < currentMax.size(); brick++)
+		isOccupancyChanged |= (currentMax[brick] > EMPTY_SPACE_THRESHOLD) != (previousMax[brick] > EMPTY_SPACE_THRESHOLD);
+
+	// the surface can only have moved in edited bricks that reach the iso value before or after the edit
+	bool isIsosurfaceChanged = false;
+	for (uint32_t z = clipped.minZ / BRICK_SIZE; z <= (clipped.maxZ - 1) / BRICK_SIZE && !isIsosurfaceChanged; z++)
+	{
+		for (uint32_t y = clipped.minY / BRICK_SIZE; y <= (clipped.maxY - 1) / BRICK_SIZE && !isIsosurfaceChanged; y++)
+		{
+			for (uint32_t x = clipped.minX / BRICK_SIZE; x <= (clipped.maxX - 1) / BRICK_SIZE && !isIsosurfaceChanged; x++)
+			{
+				const size_t brick = mMinMaxGrid.GetDimensions().GetIndex(x, y, z);
+				isIsosurfaceChanged = std::max(currentMax[brick], previousMax[brick]) >= BONE_ISO_VALUE;
+			}
+		}
+	}
+
+	if (!isOccupancyChanged && !isIsosurfaceChanged)
+		return;
+
+	// the proxy and the isosurface are replaced wholesale, the old buffers go once the frames in flight are done
+	if (isOccupancyChanged)
+		BuildProxyGeometry();
+	if (isIsosurfaceChanged)
+		ExtractIsosurface(BONE_ISO_VALUE);
+	UpdatePerFrameConstants();
+}
+
+void Application::SetSecondaryVolume(const uint8_t* data, const VolumeDimensions& dimensions, const AffineTransform& primaryToSecondary)
+{
+	mSecondaryVolume.assign(data, data + dimensions.GetVoxelCount());
+	mSecondaryDimensions = dimensions;
+	mPrimaryToSecondary = primaryToSecondary;
+	FuseVolumes();
+	UpdatePerFrameConstants();
+}
+
+void Application::FuseVolumes()
+{
+	// paged volumes go through the single channel brick atlas and are drawn without the secondary
+	if (mBrickCache)
+	{
+		mFusedVolumeData = VoxelBuffer();
+		mDevice->Release(std::move(mFusedVolumeTexture));
+		return;
+	}
+
+	// voxel i of a cropped level is voxel (i + box min) * stride of the full resolution volume
+	const VolumeBox levelBox = GetLevelCropBox(mVolumeStride);
+	const float stride = static_cast<float>(mVolumeStride);
+	const AffineTransform levelToSecondary = mPrimaryToSecondary * AffineTransform::FromSpacing({ stride, stride, stride },
+		{ levelBox.minX * stride, levelBox.minY * stride, levelBox.minZ * stride });
+
+	mFusedVolumeData.resize(mVolumeData.size() * 2);
+	VolumeResampler::Fuse(mVolumeData.data(), mVolumeDimensions, mSecondaryVolume.data(), mSecondaryDimensions, levelToSecondary, mFusedVolumeData.data());
+
+	TextureDescription desc{
+		.textureDescriptor = DescriptorType::Srv,
+		.dimension = D3D12_RESOURCE_DIMENSION_TEXTURE3D,
+		.format = DXGI_FORMAT_R8G8_UNORM,
+		.initialState = D3D12_RESOURCE_STATE_COPY_DEST,
+		.width = mVolumeDimensions.width,
+		.height = mVolumeDimensions.height,
+		.depthOrArraySize = static_cast<uint16_t>(mVolumeDimensions.depth),
+		.memoryCategory = MemoryCategory::VolumeTexture };
+	mDevice->Release(std::move(mFusedVolumeTexture));
+	mFusedVolumeTexture = mDevice->CreateTexture(desc);
+	mFusedUploadedSlices = 0;
+}
+
+bool Application::IsFusionVisible() const
+{
+	return mIsFusionEnabled && mFusedVolumeTexture && mFusedUploadedSlices == mVolumeDimensions.depth;
+}
+
+void Application::UploadFusedVolume(RenderCommandList* commandList)
+{
+	std::vector<TransitionBarrier> barriers;
+	AddBarrier(barriers, mFusedVolumeTexture.get(), D3D12_RESOURCE_STATE_COPY_DEST);
+	if (!barriers.empty())
+		commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+
+	const VolumeBox box = {
+		.minZ = mFusedUploadedSlices,
+		.maxX = mVolumeDimensions.width,
+		.maxY = mVolumeDimensions.height,
+		.maxZ = mVolumeDimensions.depth };
+	mFusedUploadedSlices = UploadVolumeBox(commandList, mFusedVolumeTexture.get(), mFusedVolumeData.data(), mVolumeDimensions, box, 2);
+
+	barriers.clear();
+	AddBarrier(barriers, mFusedVolumeTexture.get(), D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+	commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+
+	// the overlay only shows up once all of it is on the GPU
+	if (mFusedUploadedSlices == mVolumeDimensions.depth)
+		UpdatePerFrameConstants();
+}
+
+void Application::SetLabelVolume(const uint8_t* labels, const VolumeDimensions& dimensions, uint32_t labelCount)
+{
+	// labels of the whole dataset are cut to the volume's crop box
+	std::vector<uint8_t> croppedLabels;
+	VolumeDimensions labelDimensions = dimensions;
+	if (dimensions == mFullVolumeDimensions && mCropBox.GetVoxelCount() < dimensions.GetVoxelCount())
+	{
+		croppedLabels.resize(mCropBox.GetVoxelCount());
+		VolumeCropper::Crop(labels, dimensions, mCropBox, croppedLabels.data());
+		labels = croppedLabels.data();
+		labelDimensions = { .width = mCropBox.maxX - mCropBox.minX, .height = mCropBox.maxY - mCropBox.minY, .depth = mCropBox.maxZ - mCropBox.minZ };
+	}
+
+	mLabelVolume.Build(labels, labelDimensions, labelCount);
+	// label 0 is the background of a segmentation
+	mLabelVolume.SetStyle(0, { .isVisible = false });
+
+	const VoxelBuffer& packed = mLabelVolume.GetPacked();
+	BufferDescription desc{
+		.bufferDescriptor = DescriptorType::Srv,
+		.heapType = D3D12_HEAP_TYPE_DEFAULT,
+		.initialState = D3D12_RESOURCE_STATE_COPY_DEST,
+		.size = static_cast<uint32_t>(packed.size()),
+		.count = static_cast<uint32_t>(packed.size() / sizeof(uint32_t)),
+		.stride = sizeof(uint32_t),
+		.isRaw = true,
+		.memoryCategory = MemoryCategory::Labels };
+	mDevice->Release(std::move(mLabelBuffer));
+	mLabelBuffer = mDevice->CreateBuffer(desc);
+	mLabelUploadedBytes = 0;
+
+#ifdef _DEBUG
+	std::cout << "Label volume: " << mLabelVolume.GetLabelCount() << " labels at " << mLabelVolume.GetBitsPerLabel() << " bits, "
+		<< packed.size() << " bytes" << std::endl;
+#endif
+
+	BuildProxyGeometry();
+	UpdatePerFrameConstants();
+}
+
+void Application::SetLabelStyle(uint8_t label, const LabelStyle& style)
+{
+	const bool isVisibilityChanged = mLabelVolume.GetStyle(label).isVisible != style.isVisible ||
+		(mLabelVolume.GetStyle(label).opacity > 0.0f) != (style.opacity > 0.0f);
+	mLabelVolume.SetStyle(label, style);
+	if (isVisibilityChanged && mLabelBuffer)
+		BuildProxyGeometry();
+	UpdatePerFrameConstants();
+}
+
+void Application::UploadLabels(RenderCommandList* commandList)
+{
+	const VoxelBuffer& packed = mLabelVolume.GetPacked();
+
+	// whatever doesn't fit this frame's upload memory follows next frame, the shader only sees complete labels
+	while (mLabelUploadedBytes < packed.size())
+	{
+		uint64_t size = packed.size() - mLabelUploadedBytes;
+		UploadAllocation upload = mDevice->AllocateUpload(size);
+		while (upload.mCpuAddress == nullptr && size > D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT)
+		{
+			size /= 2;
+			upload = mDevice->AllocateUpload(size);
+		}
+		if (upload.mCpuAddress == nullptr)
+			break;
+
+		memcpy(upload.mCpuAddress, packed.data() + mLabelUploadedBytes, size);
+		commandList->CopyBufferRegion(mLabelBuffer.get(), mLabelUploadedBytes, mDevice->GetUploadBuffer(), upload.mOffset, size);
+		mLabelUploadedBytes += size;
+	}
+
+	if (mLabelUploadedBytes == packed.size())
+	{
+		std::vector<TransitionBarrier> barriers;
+		AddBarrier(barriers, mLabelBuffer.get(), D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+		commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+		UpdatePerFrameConstants();
+	}
+}
+
+void Application::BuildProxyGeometry()
+{
+#ifdef _DEBUG
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#endif
+
+	// bricks holding nothing but hidden labels are empty space too, once the labels match the loaded level
+	std::vector<uint8_t> visibleBricks;
+	if (mLabelBuffer && mLabelVolume.GetDimensions() == mVolumeDimensions)
+		visibleBricks = mLabelVolume.GetVisibleBricks();
+	const std::vector<uint8_t>* brickMask = visibleBricks.empty() ? nullptr : &visibleBricks;
+
+	ProxyMesh proxy = ProxyGeometry::Generate(mMinMaxGrid, mVolumeDimensions, EMPTY_SPACE_THRESHOLD, brickMask);
+
+#ifdef _DEBUG
+	float milliseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000.0f;
+	RayLengthEstimate rayLength = ProxyGeometry::EstimateRayLength(mMinMaxGrid, mVolumeDimensions, EMPTY_SPACE_THRESHOLD, brickMask);
+	std::cout << "Proxy geometry: " << proxy.vertices.size() / 3 << " triangles in " << milliseconds << "ms, ray length "
+		<< 100.0 * rayLength.proxyLength / rayLength.cubeLength << "% of the unit cube" << std::endl;
+#endif
+
+	// the bounding box goes first, the tight proxy used for the ray start/end positions follows it
+	std::vector<DirectX::XMFLOAT3> vertices(CUBE_VERTEX_COUNT + proxy.vertices.size());
+	for (uint32_t i = 0; i < CUBE_VERTEX_COUNT; i++)
+	{
+		vertices[i] = {
+			CUBE_VERTICES[i].x < 0.0f ? proxy.boundsMin.x : proxy.boundsMax.x,
+			CUBE_VERTICES[i].y < 0.0f ? proxy.boundsMin.y : proxy.boundsMax.y,
+			CUBE_VERTICES[i].z < 0.0f ? proxy.boundsMin.z : proxy.boundsMax.z };
+	}
+	for (size_t i = 0; i < proxy.vertices.size(); i++)
+	{
+		vertices[CUBE_VERTEX_COUNT + i] = { proxy.vertices[i].x, proxy.vertices[i].y, proxy.vertices[i].z };
+	}
+	mProxyVertexCount = static_cast<uint32_t>(proxy.vertices.size());
+
+	BufferDescription desc{
+		.bufferDescriptor = DescriptorType::Srv,
+		.heapType = D3D12_HEAP_TYPE_UPLOAD,
+		.size = static_cast<uint32_t>(sizeof(DirectX::XMFLOAT3) * vertices.size()),
+		.count = static_cast<uint32_t>(vertices.size()),
+		.stride = sizeof(DirectX::XMFLOAT3),
+		.isRaw = true,
+		.memoryCategory = MemoryCategory::Geometry };
+	mDevice->Release(std::move(mCube));
+	mCube = mDevice->CreateBuffer(desc);
+
+	void* data;
+	mCube->mResource->Map(0, nullptr, &data);
+	memcpy(data, vertices.data(), sizeof(DirectX::XMFLOAT3) * vertices.size());
+	mCube->mResource->Unmap(0, nullptr);
+}
+
+void Application::ExtractIsosurface(uint8_t isoValue)
+{
+#ifdef _DEBUG
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#endif
+
+	static const MarchingCubes marchingCubes;
+	IsosurfaceMesh mesh = marchingCubes.Extract(mVolumeData.data(), mVolumeDimensions, isoValue);
+
+#ifdef _DEBUG
+	float milliseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000.0f;
+	std::cout << "Isosurface: " << mesh.indices.size() / 3 << " triangles in " << milliseconds << "ms" << std::endl;
+#endif
+
+	// keep the buffers valid (and the descriptors stable) even if nothing crosses the iso value
+	uint32_t vertexBufferSize = static_cast<uint32_t>(std::max<size_t>(mesh.vertices.size(), 1) * sizeof(Float3));
+	uint32_t indexBufferSize = static_cast<uint32_t>(std::max<size_t>(mesh.indices.size(), 1) * sizeof(uint32_t));
+
+	BufferDescription vertexDesc{
+		.bufferDescriptor = DescriptorType::Srv,
+		.heapType = D3D12_HEAP_TYPE_UPLOAD,
+		.size = vertexBufferSize,
+		.count = vertexBufferSize / static_cast<uint32_t>(sizeof(Float3)),
+		.stride = sizeof(Float3),
+		.isRaw = true,
+		.memoryCategory = MemoryCategory::Geometry };
+	mDevice->Release(std::move(mIsosurfaceVertices));
+	mIsosurfaceVertices = mDevice->CreateBuffer(vertexDesc);
+
+	BufferDescription indexDesc{
+		.bufferDescriptor = DescriptorType::Srv,
+		.heapType = D3D12_HEAP_TYPE_UPLOAD,
+		.size = indexBufferSize,
+		.count = indexBufferSize / static_cast<uint32_t>(sizeof(uint32_t)),
+		.stride = sizeof(uint32_t),
+		.isRaw = true,
+		.memoryCategory = MemoryCategory::Geometry };
+	mDevice->Release(std::move(mIsosurfaceIndices));
+	mIsosurfaceIndices = mDevice->CreateBuffer(indexDesc);
+
+	void* data;
+	mIsosurfaceVertices->mResource->Map(0, nullptr, &data);
+	memcpy(data, mesh.vertices.data(), mesh.vertices.size() * sizeof(Float3));
+	mIsosurfaceVertices->mResource->Unmap(0, nullptr);
+
+	mIsosurfaceIndices->mResource->Map(0, nullptr, &data);
+	memcpy(data, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+	mIsosurfaceIndices->mResource->Unmap(0, nullptr);
+
+	mIsosurfaceIndexCount = static_cast<uint32_t>(mesh.indices.size());
 }
 
 void Application::InitializePipelines()
@@ -131,9 +989,10 @@ void Application::InitializePipelines()
 
 
 	ComPtr<ID3DBlob> vertexBlob;
-	ComPtr<ID3DBlob> pixelBlob;
+	std::array<ComPtr<ID3DBlob>, PIXEL_SHADER_PERMUTATION_COUNT> pixelBlobs;
 	DX_ASSERT(D3DReadFileToBlob(L"VertexShader.cso", &vertexBlob));
-	DX_ASSERT(D3DReadFileToBlob(L"PixelShader.cso", &pixelBlob));
+	for (uint32_t permutation = 0; permutation < PIXEL_SHADER_PERMUTATION_COUNT; permutation++)
+		DX_ASSERT(D3DReadFileToBlob(PIXEL_SHADER_PERMUTATIONS[permutation], &pixelBlobs[permutation]));
 
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC pipelineDesc{
 		.pRootSignature = mRootSignature.Get(),
@@ -141,8 +1000,8 @@ void Application::InitializePipelines()
 			.pShaderBytecode = vertexBlob->GetBufferPointer(),
 			.BytecodeLength = vertexBlob->GetBufferSize()},
 		.PS = {
-			.pShaderBytecode = pixelBlob->GetBufferPointer(),
-			.BytecodeLength = pixelBlob->GetBufferSize()},
+			.pShaderBytecode = pixelBlobs[0]->GetBufferPointer(),
+			.BytecodeLength = pixelBlobs[0]->GetBufferSize()},
 		.SampleMask = 0xFFFFFFFF,
 		.RasterizerState = {
 			.FillMode = D3D12_FILL_MODE_SOLID,
@@ -197,7 +1056,64 @@ void Application::InitializePipelines()
 		pipelineDesc.RTVFormats[i] = mDevice->GetBackbuffer(i).mTextureFormat;
 	}
 
-	DX_ASSERT(mDevice->GetDevice()->CreateGraphicsPipelineState(&pipelineDesc, IID_PPV_ARGS(&mGraphicsPipeline)));
+	for (uint32_t permutation = 0; permutation < PIXEL_SHADER_PERMUTATION_COUNT; permutation++)
+	{
+		pipelineDesc.PS = {
+			.pShaderBytecode = pixelBlobs[permutation]->GetBufferPointer(),
+			.BytecodeLength = pixelBlobs[permutation]->GetBufferSize() };
+		DX_ASSERT(mDevice->GetDevice()->CreateGraphicsPipelineState(&pipelineDesc, IID_PPV_ARGS(&mVolumePipelines[permutation])));
+	}
+
+	// opaque isosurface, depth tested the usual way (cleared to 1 in surface mode)
+	{
+		ComPtr<ID3DBlob> vertBlob;
+		ComPtr<ID3DBlob> pixBlob;
+		DX_ASSERT(D3DReadFileToBlob(L"IsosurfaceVertex.cso", &vertBlob));
+		DX_ASSERT(D3DReadFileToBlob(L"IsosurfacePixel.cso", &pixBlob));
+
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC isosurfaceDesc = pipelineDesc;
+		isosurfaceDesc.VS = {
+			.pShaderBytecode = vertBlob->GetBufferPointer(),
+			.BytecodeLength = vertBlob->GetBufferSize() };
+		isosurfaceDesc.PS = {
+			.pShaderBytecode = pixBlob->GetBufferPointer(),
+			.BytecodeLength = pixBlob->GetBufferSize() };
+		isosurfaceDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
+
+		for (uint32_t i = 0; i < NUM_BACK_BUFFERS; i++)
+		{
+			isosurfaceDesc.BlendState.RenderTarget[i] = defaultRenderTargetBlendDesc;
+		}
+
+		DX_ASSERT(mDevice->GetDevice()->CreateGraphicsPipelineState(&isosurfaceDesc, IID_PPV_ARGS(&mIsosurfacePipeline)));
+	}
+
+	// slice overlay, a single screen triangle in its own viewport
+	{
+		ComPtr<ID3DBlob> vertBlob;
+		ComPtr<ID3DBlob> pixBlob;
+		DX_ASSERT(D3DReadFileToBlob(L"SliceVertex.cso", &vertBlob));
+		DX_ASSERT(D3DReadFileToBlob(L"SlicePixel.cso", &pixBlob));
+
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC sliceDesc = pipelineDesc;
+		sliceDesc.VS = {
+			.pShaderBytecode = vertBlob->GetBufferPointer(),
+			.BytecodeLength = vertBlob->GetBufferSize() };
+		sliceDesc.PS = {
+			.pShaderBytecode = pixBlob->GetBufferPointer(),
+			.BytecodeLength = pixBlob->GetBufferSize() };
+		sliceDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+		sliceDesc.DepthStencilState = {
+			.DepthEnable = FALSE,
+			.StencilEnable = FALSE };
+
+		for (uint32_t i = 0; i < NUM_BACK_BUFFERS; i++)
+		{
+			sliceDesc.BlendState.RenderTarget[i] = defaultRenderTargetBlendDesc;
+		}
+
+		DX_ASSERT(mDevice->GetDevice()->CreateGraphicsPipelineState(&sliceDesc, IID_PPV_ARGS(&mSlicePipeline)));
+	}
 
 	{
 		ComPtr<ID3DBlob> vertBlob;
@@ -211,243 +1127,993 @@ void Application::InitializePipelines()
 		pipelineDesc.PS = {
 				.pShaderBytecode = pixBlob->GetBufferPointer(),
 				.BytecodeLength = pixBlob->GetBufferSize() };
+		// the proxy isn't convex, so the front pass keeps the nearest and the back pass the farthest face
 		pipelineDesc.DepthStencilState = {
-			.DepthEnable = FALSE,
+			.DepthEnable = TRUE,
+			.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL,
+			.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL,
 			.StencilEnable = FALSE };
 
 		for (uint32_t i = 0; i < NUM_BACK_BUFFERS; i++)
 		{
 			pipelineDesc.RTVFormats[i] = DXGI_FORMAT_R8G8B8A8_UNORM;
+			pipelineDesc.BlendState.RenderTarget[i] = defaultRenderTargetBlendDesc;
 		}
 
 		DX_ASSERT(mDevice->GetDevice()->CreateGraphicsPipelineState(&pipelineDesc, IID_PPV_ARGS(&mCullBackFacePipeline)));
 
 		pipelineDesc.RasterizerState.CullMode = D3D12_CULL_MODE_FRONT;
+		pipelineDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_GREATER_EQUAL;
 		DX_ASSERT(mDevice->GetDevice()->CreateGraphicsPipelineState(&pipelineDesc, IID_PPV_ARGS(&mCullFrontFacePipeline)));
 	}
+}
 
-	// Cube
-	{
-		DirectX::XMFLOAT3 meshVertices[36] = {
-			{1.0f, -1.0f, 1.0f},
-			{1.0f, -1.0f, -1.0f},
-			{-1.0f, -1.0f, 1.0f},
-			{-1.0f, -1.0f, 1.0f},
-			{1.0f, -1.0f, -1.0f},
-			{-1.0f, -1.0f, -1.0f},
-			{1.0f, 1.0f, -1.0f},
-			{1.0f, 1.0f, 1.0f},
-			{-1.0f, 1.0f, -1.0f},
-			{-1.0f, 1.0f, -1.0f},
-			{1.0f, 1.0f, 1.0f},
-			{-1.0f, 1.0f, 1.0f},
-			{-1.0f, -1.0f, -1.0f},
-			{-1.0f, 1.0f, -1.0f},
-			{-1.0f, -1.0f, 1.0f},
-			{-1.0f, -1.0f, 1.0f},
-			{-1.0f, 1.0f, -1.0f},
-			{-1.0f, 1.0f, 1.0f},
-			{-1.0f, -1.0f, 1.0f},
-			{-1.0f, 1.0f, 1.0f},
-			{1.0f, -1.0f, 1.0f},
-			{1.0f, -1.0f, 1.0f},
-			{-1.0f, 1.0f, 1.0f},
-			{1.0f, 1.0f, 1.0f},
-			{1.0f, -1.0f, 1.0f},
-			{1.0f, 1.0f, 1.0f},
-			{1.0f, -1.0f, -1.0f},
-			{1.0f, -1.0f, -1.0f},
-			{1.0f, 1.0f, 1.0f},
-			{1.0f, 1.0f, -1.0f},
-			{1.0f, -1.0f, -1.0f},
-			{1.0f, 1.0f, -1.0f},
-			{-1.0f, -1.0f, -1.0f},
-			{-1.0f, -1.0f, -1.0f},
-			{1.0f, 1.0f, -1.0f},
-			{-1.0f, 1.0f, -1.0f},
-		};
-
-		BufferDescription desc{
-			.bufferDescriptor = DescriptorType::Srv,
-			.heapType = D3D12_HEAP_TYPE_UPLOAD,
-			.size = sizeof(DirectX::XMFLOAT3) * 36,
-			.count = 36,
-			.stride = sizeof(DirectX::XMFLOAT3),
-			.isRaw = true };
-		mCube = mDevice->CreateBuffer(desc, meshVertices);
-
-		void* data;
-		mCube->mResource->Map(0, nullptr, &data);
-		for (uint32_t i = 0; i < 36; i++)
+void Application::CaptureScreenshot(const std::filesystem::path& filePath)
+{
+	mScreenshotPath = filePath;
+}
+
+void Application::StartContinuousCapture(const std::filesystem::path& directory)
+{
+	std::filesystem::create_directories(directory);
+	mCaptureDirectory = directory;
+	mCapturedFrameCount = 0;
+}
+
+void Application::StopContinuousCapture()
+{
+	mCaptureDirectory.reset();
+}
+
+void Application::UseNullBackend()
+{
+	// the tracked resource states follow the null backend from here on, they no longer match the GPU
+	mNullCommandList = std::make_unique<NullCommandList>();
+}
+
+void Application::CaptureTexture(RenderCommandList* commandList, TextureResource* texture, std::filesystem::path filePath)
+{
+	const D3D12_RESOURCE_DESC textureDesc = texture->mResource->GetDesc();
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint;
+	uint64_t totalSize = 0;
+	mDevice->GetDevice()->GetCopyableFootprints(&textureDesc, 0, 1, 0, &footprint, nullptr, nullptr, &totalSize);
+
+	std::optional<uint32_t> slot = mFrameCapture->Request(std::move(filePath), footprint.Footprint.Width, footprint.Footprint.Height,
+		footprint.Footprint.RowPitch, mDevice->GetNextFenceValue());
+	if (!slot)
+		return;
+
+	// slots only come back once the GPU is done with them, a larger target just replaces the buffer
+	std::unique_ptr<BufferResource>& readback = mCaptureReadbacks[*slot];
+	if (!readback || readback->mDesc.Width < totalSize)
+	{
+		mDevice->Release(std::move(readback));
+		BufferDescription readbackDesc{
+			.heapType = D3D12_HEAP_TYPE_READBACK,
+			.initialState = D3D12_RESOURCE_STATE_COPY_DEST,
+			.size = static_cast<uint32_t>(totalSize),
+			.memoryCategory = MemoryCategory::Readback };
+		readback = mDevice->CreateBuffer(readbackDesc);
+		readback->mResource->Map(0, nullptr, &readback->mMapped);
+	}
+
+	std::vector<TransitionBarrier> barriers;
+	AddBarrier(barriers, texture, D3D12_RESOURCE_STATE_COPY_SOURCE);
+	if (!barriers.empty())
+		commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+
+	const BufferFootprint readbackFootprint{
+		.offset = footprint.Offset,
+		.format = footprint.Footprint.Format,
+		.width = footprint.Footprint.Width,
+		.height = footprint.Footprint.Height,
+		.depth = footprint.Footprint.Depth,
+		.rowPitch = footprint.Footprint.RowPitch };
+	commandList->CopyTextureToBuffer(readback.get(), readbackFootprint, texture);
+}
+
+void Application::PollCaptures()
+{
+	mFrameCapture->Poll(mDevice->GetCompletedFenceValue(), [this](uint32_t slot) {
+		return static_cast<const uint8_t*>(mCaptureReadbacks[slot]->mMapped);
+	});
+}
+
+void Application::InitializeBrickCache(uint64_t availableVideoMemory)
+{
+	const uint32_t gridWidth = (mVolumeDimensions.width + BRICK_SIZE - 1) / BRICK_SIZE;
+	const uint32_t gridHeight = (mVolumeDimensions.height + BRICK_SIZE - 1) / BRICK_SIZE;
+	const uint32_t gridDepth = (mVolumeDimensions.depth + BRICK_SIZE - 1) / BRICK_SIZE;
+	const uint32_t brickCount = gridWidth * gridHeight * gridDepth;
+
+	// the atlas gets half of what's left of the budget, the rest is headroom for everything else
+	constexpr uint64_t slotSize = ATLAS_BRICK_SIZE * ATLAS_BRICK_SIZE * ATLAS_BRICK_SIZE;
+	constexpr uint32_t maxSlotsPerAxis = D3D12_REQ_TEXTURE3D_U_V_OR_W_DIMENSION / ATLAS_BRICK_SIZE;
+	uint64_t slotCount = std::min<uint64_t>({
+		std::max<uint64_t>(availableVideoMemory / 2 / slotSize, 1),
+		brickCount,
+		static_cast<uint64_t>(maxSlotsPerAxis) * maxSlotsPerAxis * maxSlotsPerAxis });
+
+	const uint32_t slotsX = std::min(static_cast<uint32_t>(std::ceil(std::cbrt(static_cast<double>(slotCount)))), maxSlotsPerAxis);
+	const uint32_t slotsY = slotsX;
+	const uint32_t slotsZ = std::min(static_cast<uint32_t>((slotCount + slotsX * slotsY - 1) / (slotsX * slotsY)), maxSlotsPerAxis);
+	CreateBrickAtlas(slotsX, slotsY, slotsZ);
+
+	TextureDescription pageTableDesc{
+		.textureDescriptor = DescriptorType::Srv,
+		.dimension = D3D12_RESOURCE_DIMENSION_TEXTURE3D,
+		.format = DXGI_FORMAT_R32_UINT,
+		.initialState = D3D12_RESOURCE_STATE_COPY_DEST,
+		.width = gridWidth,
+		.height = gridHeight,
+		.depthOrArraySize = static_cast<uint16_t>(gridDepth),
+		.memoryCategory = MemoryCategory::BrickCache };
+	mPageTable = mDevice->CreateTexture(pageTableDesc);
+
+	BufferDescription feedbackDesc{
+		.bufferDescriptor = DescriptorType::Uav,
+		.heapType = D3D12_HEAP_TYPE_DEFAULT,
+		.initialState = D3D12_RESOURCE_STATE_COPY_DEST,
+		.size = brickCount * static_cast<uint32_t>(sizeof(uint32_t)),
+		.count = brickCount,
+		.stride = sizeof(uint32_t),
+		.isRaw = true,
+		.memoryCategory = MemoryCategory::BrickCache };
+	mBrickFeedback = mDevice->CreateBuffer(feedbackDesc);
+
+	BufferDescription clearDesc{
+		.heapType = D3D12_HEAP_TYPE_UPLOAD,
+		.size = feedbackDesc.size,
+		.memoryCategory = MemoryCategory::BrickCache };
+	mBrickFeedbackClear = mDevice->CreateBuffer(clearDesc);
+	void* data;
+	mBrickFeedbackClear->mResource->Map(0, nullptr, &data);
+	memset(data, 0, feedbackDesc.size);
+	mBrickFeedbackClear->mResource->Unmap(0, nullptr);
+
+	BufferDescription readbackDesc{
+		.heapType = D3D12_HEAP_TYPE_READBACK,
+		.initialState = D3D12_RESOURCE_STATE_COPY_DEST,
+		.size = feedbackDesc.size,
+		.memoryCategory = MemoryCategory::Readback };
+	mBrickFeedbackReadback.resize(FRAMES_IN_FLIGHT);
+	mIsBrickFeedbackPending.assign(FRAMES_IN_FLIGHT, false);
+	for (std::unique_ptr<BufferResource>& readback : mBrickFeedbackReadback)
+	{
+		readback = mDevice->CreateBuffer(readbackDesc);
+		readback->mResource->Map(0, nullptr, &readback->mMapped);
+	}
+
+	mBrickCache = std::make_unique<BrickCache>(brickCount, slotsX * slotsY * slotsZ);
+
+	// nothing has been seen yet, so just start streaming in from the first brick
+	for (uint32_t brick = 0; brick < std::min(brickCount, slotsX * slotsY * slotsZ); brick++)
+	{
+		mBrickCache->RequestBrick(brick);
+	}
+}
+
+void Application::CreateBrickAtlas(uint32_t slotsX, uint32_t slotsY, uint32_t slotsZ)
+{
+	TextureDescription atlasDesc{
+		.textureDescriptor = DescriptorType::Srv,
+		.dimension = D3D12_RESOURCE_DIMENSION_TEXTURE3D,
+		.format = DXGI_FORMAT_R8_UNORM,
+		.initialState = D3D12_RESOURCE_STATE_COPY_DEST,
+		.width = slotsX * ATLAS_BRICK_SIZE,
+		.height = slotsY * ATLAS_BRICK_SIZE,
+		.depthOrArraySize = static_cast<uint16_t>(slotsZ * ATLAS_BRICK_SIZE),
+		.memoryCategory = MemoryCategory::BrickCache };
+	mBrickAtlas = mDevice->CreateTexture(atlasDesc);
+}
+
+void Application::ShrinkBrickAtlas(uint64_t overBudgetBytes)
+{
+	const uint32_t slotsX = static_cast<uint32_t>(mBrickAtlas->mDesc.Width / ATLAS_BRICK_SIZE);
+	const uint32_t slotsY = mBrickAtlas->mDesc.Height / ATLAS_BRICK_SIZE;
+	const uint32_t slotsZ = mBrickAtlas->mDesc.DepthOrArraySize / ATLAS_BRICK_SIZE;
+	const uint64_t layerSize = static_cast<uint64_t>(slotsX) * slotsY * ATLAS_BRICK_SIZE * ATLAS_BRICK_SIZE * ATLAS_BRICK_SIZE;
+	const uint32_t droppedLayers = static_cast<uint32_t>(std::min<uint64_t>((overBudgetBytes + layerSize - 1) / layerSize, slotsZ - 1));
+	if (droppedLayers == 0)
+		return;
+
+	// The slots are numbered layer by layer, but the new atlas starts out empty all the same, there's no
+	// copy from texture to texture. The least recently used bricks are the ones left out, the page table
+	// is rewritten and the rest are uploaded again over the next frames, most recently used first.
+	const uint32_t slotCount = slotsX * slotsY * (slotsZ - droppedLayers);
+	mBrickCache->SetSlotBudget(slotCount);
+	const std::vector<uint32_t> residentBricks = mBrickCache->GetResidentBricks();
+	const uint32_t brickCount = static_cast<uint32_t>(mBrickCache->GetPageTable().size());
+
+	mDevice->Release(std::move(mBrickAtlas));
+	mBrickAtlasReleaseFence = mDevice->GetNextFenceValue();
+	CreateBrickAtlas(slotsX, slotsY, slotsZ - droppedLayers);
+	mBrickCache = std::make_unique<BrickCache>(brickCount, slotCount);
+	for (uint32_t brick : residentBricks)
+		mBrickCache->RequestBrick(brick);
+	UpdatePerFrameConstants();
+}
+
+bool Application::UploadBrick(RenderCommandList* commandList, uint32_t brick, uint32_t slot)
+{
+	const uint32_t rowPitch = utils::AlignU32(ATLAS_BRICK_SIZE, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
+	UploadAllocation upload = mDevice->AllocateUpload(rowPitch * ATLAS_BRICK_SIZE * ATLAS_BRICK_SIZE);
+	if (upload.mCpuAddress == nullptr)
+		return false;
+
+	const uint32_t gridWidth = static_cast<uint32_t>(mPageTable->mDesc.Width);
+	const uint32_t gridHeight = mPageTable->mDesc.Height;
+	const int32_t originX = static_cast<int32_t>((brick % gridWidth) * BRICK_SIZE) - static_cast<int32_t>(BRICK_APRON);
+	const int32_t originY = static_cast<int32_t>(((brick / gridWidth) % gridHeight) * BRICK_SIZE) - static_cast<int32_t>(BRICK_APRON);
+	const int32_t originZ = static_cast<int32_t>((brick / (gridWidth * gridHeight)) * BRICK_SIZE) - static_cast<int32_t>(BRICK_APRON);
+
+	// the apron is copied from the neighbouring bricks (clamped at the volume border) so filtering never reads another slot
+	uint8_t* destination = static_cast<uint8_t*>(upload.mCpuAddress);
+	for (uint32_t z = 0; z < ATLAS_BRICK_SIZE; z++)
+	{
+		uint32_t sourceZ = static_cast<uint32_t>(std::clamp<int32_t>(originZ + static_cast<int32_t>(z), 0, static_cast<int32_t>(mVolumeDimensions.depth) - 1));
+		for (uint32_t y = 0; y < ATLAS_BRICK_SIZE; y++)
 		{
-			memcpy(data, &meshVertices[i], sizeof(DirectX::XMFLOAT3));
-			data = static_cast<char*>(data) + sizeof(DirectX::XMFLOAT3);
+			uint32_t sourceY = static_cast<uint32_t>(std::clamp<int32_t>(originY + static_cast<int32_t>(y), 0, static_cast<int32_t>(mVolumeDimensions.height) - 1));
+			uint8_t* row = destination + (z * ATLAS_BRICK_SIZE + y) * rowPitch;
+			for (uint32_t x = 0; x < ATLAS_BRICK_SIZE; x++)
+			{
+				uint32_t sourceX = static_cast<uint32_t>(std::clamp<int32_t>(originX + static_cast<int32_t>(x), 0, static_cast<int32_t>(mVolumeDimensions.width) - 1));
+				row[x] = mVolumeData[mVolumeDimensions.GetIndex(sourceX, sourceY, sourceZ)];
+			}
 		}
-		mCube->mResource->Unmap(0, nullptr);
 	}
+
+	const uint32_t slotsX = static_cast<uint32_t>(mBrickAtlas->mDesc.Width / ATLAS_BRICK_SIZE);
+	const uint32_t slotsY = mBrickAtlas->mDesc.Height / ATLAS_BRICK_SIZE;
+
+	const BufferFootprint footprint{
+		.offset = upload.mOffset,
+		.format = DXGI_FORMAT_R8_UNORM,
+		.width = ATLAS_BRICK_SIZE,
+		.height = ATLAS_BRICK_SIZE,
+		.depth = ATLAS_BRICK_SIZE,
+		.rowPitch = rowPitch };
+
+	commandList->CopyBufferToTexture(mBrickAtlas.get(),
+		(slot % slotsX) * ATLAS_BRICK_SIZE,
+		((slot / slotsX) % slotsY) * ATLAS_BRICK_SIZE,
+		(slot / (slotsX * slotsY)) * ATLAS_BRICK_SIZE,
+		mDevice->GetUploadBuffer(), footprint);
+	return true;
 }
 
-// will be put into Context class when I get around to making it !!!
-static void AddBarrier(std::vector<D3D12_RESOURCE_BARRIER>& barriers, Resource* resource, D3D12_RESOURCE_STATES newState)
+void Application::UpdateBrickResidency(RenderCommandList* commandList)
 {
-	if (resource->mCurrentState == newState)
+	const uint32_t frameIndex = mDevice->GetFrameIndex();
+	const uint32_t brickCount = static_cast<uint32_t>(mBrickCache->GetPageTable().size());
+
+	// the readback for this frame index was written FRAMES_IN_FLIGHT frames ago and BeginFrame waited on it
+	mBrickCache->BeginFrame();
+	if (mIsBrickFeedbackPending[frameIndex])
+	{
+		mBrickCache->ProcessFeedback(static_cast<const uint32_t*>(mBrickFeedbackReadback[frameIndex]->mMapped), brickCount);
+		mIsBrickFeedbackPending[frameIndex] = false;
+	}
+
+	// while the video memory in use is over the budget the atlas gives some of it back, it never grows again
+	if (mDevice->GetCompletedFenceValue() > mBrickAtlasReleaseFence)
+	{
+		const uint64_t overBudgetBytes = mDevice->GetVideoMemoryOverBudget();
+		if (overBudgetBytes > 0)
+			ShrinkBrickAtlas(overBudgetBytes);
+	}
+
+	std::vector<BrickUpload> uploads = mBrickCache->ScheduleUploads(MAX_BRICK_UPLOADS_PER_FRAME);
+
+	// Out of upload memory the uploads that didn't fit are cancelled and scheduled again next frame, last
+	// one first so they keep their order. The page table's memory is taken before any brick's: without it
+	// the GPU keeps the old table, which may still point at the slots the new bricks would go to.
+	auto cancelUploads = [&](size_t first) {
+		for (size_t i = uploads.size(); i-- > first;)
+			mBrickCache->CancelUpload(uploads[i]);
+		uploads.resize(first);
+	};
+	const uint32_t gridWidth = static_cast<uint32_t>(mPageTable->mDesc.Width);
+	const uint32_t gridHeight = mPageTable->mDesc.Height;
+	const uint32_t gridDepth = mPageTable->mDesc.DepthOrArraySize;
+	const uint32_t pageTableRowPitch = utils::AlignU32(gridWidth * sizeof(uint32_t), D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
+	UploadAllocation pageTableUpload;
+	if (mBrickCache->IsPageTableDirty())
+	{
+		pageTableUpload = mDevice->AllocateUpload(static_cast<uint64_t>(pageTableRowPitch) * gridHeight * gridDepth);
+		if (pageTableUpload.mCpuAddress == nullptr)
+			cancelUploads(0);
+	}
+
+	std::vector<TransitionBarrier> barriers;
+	AddBarrier(barriers, mBrickFeedback.get(), D3D12_RESOURCE_STATE_COPY_DEST);
+	if (!uploads.empty())
+		AddBarrier(barriers, mBrickAtlas.get(), D3D12_RESOURCE_STATE_COPY_DEST);
+	if (pageTableUpload.mCpuAddress != nullptr)
+		AddBarrier(barriers, mPageTable.get(), D3D12_RESOURCE_STATE_COPY_DEST);
+	if (!barriers.empty())
+		commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+
+	commandList->CopyBufferRegion(mBrickFeedback.get(), 0, mBrickFeedbackClear.get(), 0, brickCount * sizeof(uint32_t));
+
+	for (size_t i = 0; i < uploads.size(); i++)
+	{
+		if (!UploadBrick(commandList, uploads[i].brick, uploads[i].slot))
+		{
+			cancelUploads(i);
+			break;
+		}
+	}
+
+	// written after the cancelled uploads gave their slots back
+	if (pageTableUpload.mCpuAddress != nullptr)
+	{
+		const std::vector<uint32_t>& pageTable = mBrickCache->GetPageTable();
+		for (uint32_t row = 0; row < gridHeight * gridDepth; row++)
+		{
+			memcpy(static_cast<uint8_t*>(pageTableUpload.mCpuAddress) + row * pageTableRowPitch, &pageTable[row * gridWidth], gridWidth * sizeof(uint32_t));
+		}
+
+		const BufferFootprint footprint{
+			.offset = pageTableUpload.mOffset,
+			.format = DXGI_FORMAT_R32_UINT,
+			.width = gridWidth,
+			.height = gridHeight,
+			.depth = gridDepth,
+			.rowPitch = pageTableRowPitch };
+
+		commandList->CopyBufferToTexture(mPageTable.get(), 0, 0, 0, mDevice->GetUploadBuffer(), footprint);
+		mBrickCache->ClearPageTableDirty();
+	}
+
+	barriers.clear();
+	AddBarrier(barriers, mBrickFeedback.get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	AddBarrier(barriers, mBrickAtlas.get(), D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+	AddBarrier(barriers, mPageTable.get(), D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+	if (!barriers.empty())
+		commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+}
+
+void Application::FlushDirtyRegions(RenderCommandList* commandList)
+{
+	std::vector<VolumeBox> boxes = mDirtyRegions.Flush();
+
+	// paged volumes just re-upload the resident bricks the boxes (and their aprons) reach
+	if (mBrickCache)
+	{
+		const uint32_t gridWidth = static_cast<uint32_t>(mPageTable->mDesc.Width);
+		const uint32_t gridHeight = mPageTable->mDesc.Height;
+		const uint32_t gridDepth = mPageTable->mDesc.DepthOrArraySize;
+		for (const VolumeBox& box : boxes)
+		{
+			const uint32_t endX = std::min((box.maxX + BRICK_APRON - 1) / BRICK_SIZE, gridWidth - 1);
+			const uint32_t endY = std::min((box.maxY + BRICK_APRON - 1) / BRICK_SIZE, gridHeight - 1);
+			const uint32_t endZ = std::min((box.maxZ + BRICK_APRON - 1) / BRICK_SIZE, gridDepth - 1);
+			for (uint32_t z = (box.minZ - std::min(box.minZ, BRICK_APRON)) / BRICK_SIZE; z <= endZ; z++)
+				for (uint32_t y = (box.minY - std::min(box.minY, BRICK_APRON)) / BRICK_SIZE; y <= endY; y++)
+					for (uint32_t x = (box.minX - std::min(box.minX, BRICK_APRON)) / BRICK_SIZE; x <= endX; x++)
+						mBrickCache->InvalidateBrick(x + gridWidth * (y + gridHeight * z));
+		}
 		return;
-	D3D12_RESOURCE_BARRIER barrier{
-		.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
-		.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
-		.Transition = {
-			.pResource = resource->mResource.Get(),
-			.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
-			.StateBefore = resource->mCurrentState,
-			.StateAfter = newState} };
+	}
 
-	resource->mCurrentState = newState;
+	std::vector<TransitionBarrier> barriers;
+	AddBarrier(barriers, mVolumeTexture.get(), D3D12_RESOURCE_STATE_COPY_DEST);
+	if (mFusedVolumeTexture)
+		AddBarrier(barriers, mFusedVolumeTexture.get(), D3D12_RESOURCE_STATE_COPY_DEST);
+	if (!barriers.empty())
+		commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+
+	uint64_t uploadedBytes = 0;
+	for (const VolumeBox& box : boxes)
+	{
+		// boxes that don't fit into this frame's upload memory are finished next frame
+		uint32_t uploadedEnd = UploadVolumeBox(commandList, mVolumeTexture.get(), mVolumeData.data(), mVolumeDimensions, box);
+		if (mFusedVolumeTexture)
+		{
+			const VolumeBox uploadedBox = { .minX = box.minX, .minY = box.minY, .minZ = box.minZ, .maxX = box.maxX, .maxY = box.maxY, .maxZ = uploadedEnd };
+			uploadedEnd = UploadVolumeBox(commandList, mFusedVolumeTexture.get(), mFusedVolumeData.data(), mVolumeDimensions, uploadedBox, 2);
+		}
+		if (uploadedEnd < box.maxZ)
+			mDirtyRegions.MarkDirty({ .minX = box.minX, .minY = box.minY, .minZ = uploadedEnd, .maxX = box.maxX, .maxY = box.maxY, .maxZ = box.maxZ });
+		uploadedBytes += static_cast<uint64_t>(box.maxX - box.minX) * (box.maxY - box.minY) * (uploadedEnd - box.minZ);
+	}
+
+	barriers.clear();
+	AddBarrier(barriers, mVolumeTexture.get(), D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+	if (mFusedVolumeTexture)
+		AddBarrier(barriers, mFusedVolumeTexture.get(), D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+	commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+
+#ifdef _DEBUG
+	const DirtyRegions::Stats& stats = mDirtyRegions.GetStats();
+	std::cout << "Volume edit: uploaded " << uploadedBytes << " bytes in " << boxes.size() << " boxes, "
+		<< stats.flushedVoxels << " of " << mVolumeData.size() << " voxels re-uploaded since load" << std::endl;
+#endif
+}
+
+uint32_t Application::UploadVolumeBox(RenderCommandList* commandList, TextureResource* texture, const uint8_t* data,
+	const VolumeDimensions& dimensions, const VolumeBox& box, uint32_t channelCount)
+{
+	assert(channelCount == 1 || channelCount == 2);
+	const uint32_t width = box.maxX - box.minX;
+	const uint32_t height = box.maxY - box.minY;
+	const uint32_t rowSize = width * channelCount;
+	const uint32_t rowPitch = utils::AlignU32(rowSize, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
+	const uint64_t sliceSize = static_cast<uint64_t>(rowPitch) * height;
+
+	uint32_t z = box.minZ;
+	while (z < box.maxZ)
+	{
+		uint32_t depth = box.maxZ - z;
+		UploadAllocation upload = mDevice->AllocateUpload(sliceSize * depth);
+		while (upload.mCpuAddress == nullptr && depth > 1)
+		{
+			depth /= 2;
+			upload = mDevice->AllocateUpload(sliceSize * depth);
+		}
+		if (upload.mCpuAddress == nullptr)
+			break;
+
+		uint8_t* destination = static_cast<uint8_t*>(upload.mCpuAddress);
+		for (uint32_t slice = 0; slice < depth; slice++)
+		{
+			for (uint32_t y = 0; y < height; y++)
+				memcpy(destination + slice * sliceSize + y * rowPitch, &data[dimensions.GetIndex(box.minX, box.minY + y, z + slice) * channelCount], rowSize);
+		}
+
+		const BufferFootprint footprint{
+			.offset = upload.mOffset,
+			.format = channelCount == 2 ? DXGI_FORMAT_R8G8_UNORM : DXGI_FORMAT_R8_UNORM,
+			.width = width,
+			.height = height,
+			.depth = depth,
+			.rowPitch = rowPitch };
+
+		const CopyBox sourceBox{
+			.left = 0,
+			.top = 0,
+			.front = 0,
+			.right = width,
+			.bottom = height,
+			.back = depth };
+
+		commandList->CopyBufferToTexture(texture, box.minX, box.minY, z, mDevice->GetUploadBuffer(), footprint, &sourceBox);
+		z += depth;
+	}
+	return z;
+}
+
+void Application::UploadVolumeLevels(RenderCommandList* commandList)
+{
+	// the first level is displayed while it uploads, later ones only once they are complete
+	TextureResource* texture = mVolumeTexture.get();
+	const uint8_t* data = mVolumeData.data();
+	const VolumeDimensions* dimensions = &mVolumeDimensions;
+	uint32_t* uploadedSlices = &mVolumeUploadedSlices;
+	if (mVolumeUploadedSlices == mVolumeDimensions.depth)
+	{
+		texture = mPendingVolumeTexture.get();
+		data = mPendingVolumeLevel->data.data();
+		dimensions = &mPendingVolumeLevel->dimensions;
+		uploadedSlices = &mPendingVolumeUploadedSlices;
+	}
+
+	std::vector<TransitionBarrier> barriers;
+	AddBarrier(barriers, texture, D3D12_RESOURCE_STATE_COPY_DEST);
+	if (!barriers.empty())
+		commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+
+	const VolumeBox box = {
+		.minZ = *uploadedSlices,
+		.maxX = dimensions->width,
+		.maxY = dimensions->height,
+		.maxZ = dimensions->depth };
+	*uploadedSlices = UploadVolumeBox(commandList, texture, data, *dimensions, box);
+
+	barriers.clear();
+	AddBarrier(barriers, texture, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+	commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+}
+
+void Application::UpdateVolumeLoading()
+{
+	if (mPendingVolumeLevel)
+	{
+		if (mPendingVolumeUploadedSlices < mPendingVolumeLevel->dimensions.depth)
+			return;
+
+		// the last copy was recorded last frame, so the next frame sees the complete level
+		mDevice->Release(std::move(mVolumeTexture));
+		mVolumeTexture = std::move(mPendingVolumeTexture);
+		mVolumeUploadedSlices = mPendingVolumeUploadedSlices;
+		SetVolumeLevel(std::move(*mPendingVolumeLevel));
+		mPendingVolumeLevel.reset();
+		UpdatePerFrameConstants();
+		return;
+	}
+
+	std::optional<VolumeLevel> level = mVolumeLoader->TakeLevel();
+	if (!level)
+	{
+		if (mVolumeLoader->IsFinished())
+			mVolumeLoader.reset();
+		return;
+	}
+
+	// paged volumes stream their bricks in by themselves once swapped in
+	if (IsBrickPagingNeeded(*level))
+	{
+		mPendingVolumeUploadedSlices = level->dimensions.depth;
+	}
+	else
+	{
+		mPendingVolumeTexture = CreateVolumeTexture(level->dimensions);
+		mPendingVolumeUploadedSlices = 0;
+	}
+	mPendingVolumeLevel = std::move(level);
+}
+
+void Application::UpdateIllumination(RenderCommandList* commandList)
+{
+	mIlluminationSettings.lightDirection = {
+		std::cos(mLightAzimuth),
+		-LIGHT_ELEVATION,
+		std::sin(mLightAzimuth) };
+
+	// only repeats the parts the changes invalidated, usually nothing
+	if (mIlluminationVolume.Update(mVolumeData.data(), mIlluminationSettings))
+		mIsIlluminationUploadPending = true;
+	if (!mIsIlluminationUploadPending)
+		return;
+
+	// out of upload memory the light that's already there stays for another frame
+	const VolumeDimensions& dimensions = mIlluminationVolume.GetDimensions();
+	const uint32_t rowPitch = utils::AlignU32(dimensions.width, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
+	UploadAllocation upload = mDevice->AllocateUpload(static_cast<uint64_t>(rowPitch) * dimensions.height * dimensions.depth);
+	if (upload.mCpuAddress == nullptr)
+		return;
+
+	const std::vector<uint8_t>& light = mIlluminationVolume.GetLight();
+	for (uint32_t row = 0; row < dimensions.height * dimensions.depth; row++)
+	{
+		memcpy(static_cast<uint8_t*>(upload.mCpuAddress) + static_cast<size_t>(row) * rowPitch, &light[static_cast<size_t>(row) * dimensions.width], dimensions.width);
+	}
+
+	std::vector<TransitionBarrier> barriers;
+	AddBarrier(barriers, mIlluminationTexture.get(), D3D12_RESOURCE_STATE_COPY_DEST);
+	if (!barriers.empty())
+		commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+
+	const BufferFootprint footprint{
+		.offset = upload.mOffset,
+		.format = DXGI_FORMAT_R8_UNORM,
+		.width = dimensions.width,
+		.height = dimensions.height,
+		.depth = dimensions.depth,
+		.rowPitch = rowPitch };
+
+	commandList->CopyBufferToTexture(mIlluminationTexture.get(), 0, 0, 0, mDevice->GetUploadBuffer(), footprint);
+
+	barriers.clear();
+	AddBarrier(barriers, mIlluminationTexture.get(), D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+	commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+
+	mIsIlluminationUploadPending = false;
+}
+
+void Application::UploadStepGrid(RenderCommandList* commandList)
+{
+	// out of upload memory the grid stays dirty and is uploaded next frame
+	const VolumeDimensions& dimensions = mStepGrid.GetDimensions();
+	const uint32_t rowPitch = utils::AlignU32(dimensions.width, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
+	UploadAllocation upload = mDevice->AllocateUpload(static_cast<uint64_t>(rowPitch) * dimensions.height * dimensions.depth);
+	if (upload.mCpuAddress == nullptr)
+		return;
+
+	const std::vector<uint8_t>& scales = mStepGrid.GetScales();
+	for (uint32_t row = 0; row < dimensions.height * dimensions.depth; row++)
+	{
+		memcpy(static_cast<uint8_t*>(upload.mCpuAddress) + static_cast<size_t>(row) * rowPitch, &scales[static_cast<size_t>(row) * dimensions.width], dimensions.width);
+	}
+
+	std::vector<TransitionBarrier> barriers;
+	AddBarrier(barriers, mStepGridTexture.get(), D3D12_RESOURCE_STATE_COPY_DEST);
+	if (!barriers.empty())
+		commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+
+	const BufferFootprint footprint{
+		.offset = upload.mOffset,
+		.format = DXGI_FORMAT_R8_UINT,
+		.width = dimensions.width,
+		.height = dimensions.height,
+		.depth = dimensions.depth,
+		.rowPitch = rowPitch };
+
+	commandList->CopyBufferToTexture(mStepGridTexture.get(), 0, 0, 0, mDevice->GetUploadBuffer(), footprint);
+
+	barriers.clear();
+	AddBarrier(barriers, mStepGridTexture.get(), D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+	commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+
+	mIsStepGridDirty = false;
+	if (!mIsStepGridUploaded)
+	{
+		mIsStepGridUploaded = true;
+		UpdatePerFrameConstants();
+	}
+}
+
+void Application::UpdateSlice(RenderCommandList* commandList)
+{
+	const Float3 center = {
+		0.5f * (mVolumeDimensions.width - 1),
+		0.5f * (mVolumeDimensions.height - 1),
+		0.5f * (mVolumeDimensions.depth - 1) };
+
+	Float3 right = { 1.0f, 0.0f, 0.0f };
+	Float3 up = { 0.0f, 1.0f, 0.0f };
+	switch (mSliceOrientation)
+	{
+	case SliceOrientation::Axial:
+		break;
+	case SliceOrientation::Coronal:
+		up = { 0.0f, 0.0f, 1.0f };
+		break;
+	case SliceOrientation::Sagittal:
+		right = { 0.0f, 1.0f, 0.0f };
+		up = { 0.0f, 0.0f, 1.0f };
+		break;
+	case SliceOrientation::Oblique:
+		up = { 0.0f, std::cos(DirectX::XM_PI / 6.0f), std::sin(DirectX::XM_PI / 6.0f) };
+		break;
+	}
+
+	SlicePlane plane = Reslicer::MakePlane(mVolumeDimensions, center, right, up, SLICE_SIZE, SLICE_SIZE);
+	Reslicer::SetSlab(plane, SLAB_THICKNESS, mSlabMode);
+
+	// resliced straight into the upload buffer, no intermediate image
+	const uint32_t rowPitch = utils::AlignU32(SLICE_SIZE, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
+	UploadAllocation upload = mDevice->AllocateUpload(static_cast<uint64_t>(rowPitch) * SLICE_SIZE);
+	// out of upload memory the slice keeps last frame's image, it's resliced again next frame
+	if (upload.mCpuAddress == nullptr)
+		return;
+	Reslicer::Reslice(mVolumeData.data(), mVolumeDimensions, plane, SLICE_SIZE, SLICE_SIZE, static_cast<uint8_t*>(upload.mCpuAddress), rowPitch);
+
+	std::vector<TransitionBarrier> barriers;
+	AddBarrier(barriers, mSliceTexture.get(), D3D12_RESOURCE_STATE_COPY_DEST);
+	if (!barriers.empty())
+		commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+
+	const BufferFootprint footprint{
+		.offset = upload.mOffset,
+		.format = DXGI_FORMAT_R8_UNORM,
+		.width = SLICE_SIZE,
+		.height = SLICE_SIZE,
+		.depth = 1,
+		.rowPitch = rowPitch };
+
+	commandList->CopyBufferToTexture(mSliceTexture.get(), 0, 0, 0, mDevice->GetUploadBuffer(), footprint);
 
-	barriers.push_back(barrier);
+	barriers.clear();
+	AddBarrier(barriers, mSliceTexture.get(), D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+	commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
 }
 
 static std::chrono::high_resolution_clock::time_point prev = std::chrono::steady_clock::now();
 
 void Application::Update()
 {
+	// input is sampled as late as the frame pacer allows
+	mDevice->WaitForNextFrame();
 	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
 	float deltaTime = std::chrono::duration_cast<std::chrono::microseconds>(now - prev).count() / 1000000.0f;
 	prev = now;
 
+	if (mInputReplay)
+	{
+		if (!mInputReplay->IsFinished())
+			deltaTime = mInputReplay->Next(mInput);
+	}
+	else
+	{
+		POINT cursor;
+		GetCursorPos(&cursor);
+		mInput.cursorX = static_cast<float>(cursor.x);
+		mInput.cursorY = static_cast<float>(cursor.y);
+	}
+	if (mInputRecorder)
+		mInputRecorder->Record(mInput, deltaTime);
+
+	if (mVolumeLoader)
+		UpdateVolumeLoading();
+
+	bool isSurfaceKeyPressed = mInput.keys['i' - 'a'];
+	if (isSurfaceKeyPressed && !mWasSurfaceKeyPressed)
+		mIsSurfaceMode = !mIsSurfaceMode;
+	mWasSurfaceKeyPressed = isSurfaceKeyPressed;
+
+	// m cycles hidden -> axial -> coronal -> sagittal -> oblique -> hidden, p cycles thin -> MIP -> average slabs
+	bool isSliceKeyPressed = mInput.keys['m' - 'a'];
+	if (isSliceKeyPressed && !mWasSliceKeyPressed)
+	{
+		if (!mIsSliceVisible)
+		{
+			mIsSliceVisible = true;
+			mSliceOrientation = SliceOrientation::Axial;
+		}
+		else if (mSliceOrientation == SliceOrientation::Oblique)
+			mIsSliceVisible = false;
+		else
+			mSliceOrientation = static_cast<SliceOrientation>(static_cast<uint8_t>(mSliceOrientation) + 1);
+	}
+	mWasSliceKeyPressed = isSliceKeyPressed;
+
+	// l toggles the light volume, o switches it between shadows and ambient occlusion, j/k rotate the light
+	bool isIlluminationKeyPressed = mInput.keys['l' - 'a'];
+	if (isIlluminationKeyPressed && !mWasIlluminationKeyPressed)
+	{
+		mIsIlluminationEnabled = !mIsIlluminationEnabled;
+		UpdatePerFrameConstants();
+	}
+	mWasIlluminationKeyPressed = isIlluminationKeyPressed;
+
+	bool isOcclusionKeyPressed = mInput.keys['o' - 'a'];
+	if (isOcclusionKeyPressed && !mWasOcclusionKeyPressed)
+	{
+		mIlluminationSettings.mode = mIlluminationSettings.mode == IlluminationMode::Directional
+			? IlluminationMode::AmbientOcclusion
+			: IlluminationMode::Directional;
+	}
+	mWasOcclusionKeyPressed = isOcclusionKeyPressed;
+
+	if (mInput.keys['j' - 'a'])
+		mLightAzimuth -= LIGHT_ROTATION_SPEED * deltaTime;
+	if (mInput.keys['k' - 'a'])
+		mLightAzimuth += LIGHT_ROTATION_SPEED * deltaTime;
+
+	bool isSlabKeyPressed = mInput.keys['p' - 'a'];
+	if (isSlabKeyPressed && !mWasSlabKeyPressed)
+		mSlabMode = static_cast<SlabMode>((static_cast<uint8_t>(mSlabMode) + 1) % 3);
+	mWasSlabKeyPressed = isSlabKeyPressed;
+
+	// t toggles early ray termination, without it every ray marches through the whole volume
+	bool isEarlyTerminationKeyPressed = mInput.keys['t' - 'a'];
+	if (isEarlyTerminationKeyPressed && !mWasEarlyTerminationKeyPressed)
+		mIsEarlyTerminationEnabled = !mIsEarlyTerminationEnabled;
+	mWasEarlyTerminationKeyPressed = isEarlyTerminationKeyPressed;
+
+	// g toggles the per brick step lengths, without them every ray takes the base step
+	bool isAdaptiveStepKeyPressed = mInput.keys['g' - 'a'];
+	if (isAdaptiveStepKeyPressed && !mWasAdaptiveStepKeyPressed)
+	{
+		mIsAdaptiveStepEnabled = !mIsAdaptiveStepEnabled;
+		UpdatePerFrameConstants();
+	}
+	mWasAdaptiveStepKeyPressed = isAdaptiveStepKeyPressed;
+
+	// f shows and hides the secondary volume
+	bool isFusionKeyPressed = mInput.keys['f' - 'a'];
+	if (isFusionKeyPressed && !mWasFusionKeyPressed)
+	{
+		mIsFusionEnabled = !mIsFusionEnabled;
+		UpdatePerFrameConstants();
+	}
+	mWasFusionKeyPressed = isFusionKeyPressed;
+
+	// c saves a screenshot, v starts and stops capturing every frame
+	bool isScreenshotKeyPressed = mInput.keys['c' - 'a'];
+	if (isScreenshotKeyPressed && !mWasScreenshotKeyPressed)
+		CaptureScreenshot("screenshot_" + std::to_string(mScreenshotCount++) + ".bmp");
+	mWasScreenshotKeyPressed = isScreenshotKeyPressed;
+
+	bool isCaptureKeyPressed = mInput.keys['v' - 'a'];
+	if (isCaptureKeyPressed && !mWasCaptureKeyPressed)
+	{
+		if (mCaptureDirectory)
+			StopContinuousCapture();
+		else
+			StartContinuousCapture("capture");
+	}
+	mWasCaptureKeyPressed = isCaptureKeyPressed;
+
+	bool isMemoryReportKeyPressed = mInput.keys['n' - 'a'];
+	const bool isMemoryReportDue = MEMORY_REPORT_INTERVAL > 0 && ++mMemoryReportFrameCount % MEMORY_REPORT_INTERVAL == 0;
+	if ((isMemoryReportKeyPressed && !mWasMemoryReportKeyPressed) || isMemoryReportDue)
+		WriteMemoryReport(MEMORY_REPORT_PATH);
+	mWasMemoryReportKeyPressed = isMemoryReportKeyPressed;
+
 	mCamera->Update(mInput, deltaTime);
 }
 
+void Application::WriteMemoryReport(const std::filesystem::path& filePath)
+{
+	const GpuMemoryStatistics gpuStatistics = mDevice->GetGpuMemoryStatistics();
+	std::ofstream file(filePath);
+	file << MemoryTracker::Get().ToJson(&gpuStatistics);
+	if (!file)
+		std::cerr << "Couldn't write the memory report " << filePath << std::endl;
+}
+
 void Application::Render()
 {
 	mDevice->BeginFrame();
-	ComPtr<ID3D12GraphicsCommandList5> mCommandList = mDevice->mCommandList;
-	ID3D12DescriptorHeap* heaps[] = { mDevice->GetSrvHeap(), mDevice->GetSamplerHeap() };
-	mCommandList->SetDescriptorHeaps(static_cast<uint32_t>(std::size(heaps)), heaps);
+	if (mNullCommandList)
+	{
+		mNullCommandList->BeginFrame();
+		RecordFrame(mNullCommandList.get());
+	}
+	else
+	{
+		RecordFrame(mDevice->GetCommandList());
+	}
+	mDevice->EndFrame();
+}
+
+void Application::RecordFrame(RenderCommandList* commandList)
+{
+	PollCaptures();
+	commandList->SetDescriptorHeaps();
+
+	if (mVolumeUploadedSlices < mVolumeDimensions.depth || (mPendingVolumeLevel && mPendingVolumeUploadedSlices < mPendingVolumeLevel->dimensions.depth))
+		UploadVolumeLevels(commandList);
+	if (mLabelBuffer && mLabelUploadedBytes < mLabelVolume.GetPacked().size())
+		UploadLabels(commandList);
+	if (mDirtyRegions.IsDirty())
+		FlushDirtyRegions(commandList);
+	if (mBrickCache)
+		UpdateBrickResidency(commandList);
+	if (mIsSliceVisible)
+		UpdateSlice(commandList);
+	if (mIsIlluminationEnabled)
+		UpdateIllumination(commandList);
+	if (mIsStepGridDirty)
+		UploadStepGrid(commandList);
+	if (mFusedVolumeTexture && mFusedUploadedSlices < mVolumeDimensions.depth)
+		UploadFusedVolume(commandList);
+
+	// Every frame in flight has its own copy of the constants, so they can change between any two frames.
+	// The uploads above can finish a resource and update the constants, so the copy and the pixel shader
+	// permutation picked from it both come after them.
+	BufferResource* perFrameConstantBuffer = mPerFrameConstantBuffers[mDevice->GetFrameIndex()].get();
+	memcpy(perFrameConstantBuffer->mMapped, &mPerFrameConstantBufferData, sizeof(PerFrameConstantBuffer));
+	const uint32_t pixelShaderFeatures = GetPixelShaderFeatures();
 
 	{
-		std::vector<D3D12_RESOURCE_BARRIER> barriers;
+		std::vector<TransitionBarrier> barriers;
 		AddBarrier(barriers, mCubeFront.get(), D3D12_RESOURCE_STATE_RENDER_TARGET);
 		AddBarrier(barriers, mCubeBack.get(), D3D12_RESOURCE_STATE_RENDER_TARGET);
 		if (!barriers.empty()) 
-			mCommandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+			commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
 	}
 
+	const Viewport viewPort{
+		.width = static_cast<float>(Window::GetWidth()),
+		.height = static_cast<float>(Window::GetHeight()) };
+	const ScissorRect scissor{
+		.right = static_cast<int32_t>(Window::GetWidth()),
+		.bottom = static_cast<int32_t>(Window::GetHeight()) };
+
 	 //render cube front
+	if (!mIsSurfaceMode)
 	{
 		float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
-		mCommandList->ClearRenderTargetView(mCubeFront->mRtvDescriptor.mCpuHandle, clearColor, 0, nullptr);
+		commandList->ClearRenderTarget(mCubeFront.get(), clearColor);
+		commandList->ClearDepth(mDepthBuffer.get(), 1.0f);
 
-		D3D12_CPU_DESCRIPTOR_HANDLE renderTargets[] = { mCubeFront->mRtvDescriptor.mCpuHandle };
-		mCommandList->OMSetRenderTargets(static_cast<uint32_t>(std::size(renderTargets)), renderTargets, false, nullptr);
+		TextureResource* renderTargets[] = { mCubeFront.get() };
+		commandList->SetRenderTargets(static_cast<uint32_t>(std::size(renderTargets)), renderTargets, mDepthBuffer.get());
 
-		mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
-		mCommandList->SetPipelineState(mCullBackFacePipeline.Get());
-		mCommandList->SetGraphicsRootConstantBufferView(0, mCamera->mConstantBuffer->mResource->GetGPUVirtualAddress());
-		mCommandList->SetGraphicsRootConstantBufferView(1, mPerFrameConstantBuffer->mResource->GetGPUVirtualAddress());
-
-		D3D12_VIEWPORT viewPort{
-		.TopLeftX = 0,
-		.TopLeftY = 0,
-		.Width = static_cast<float>(Window::GetWidth()),
-		.Height = static_cast<float>(Window::GetHeight()),
-		.MinDepth = 0.0f,
-		.MaxDepth = 1.0f };
-
-		D3D12_RECT scissor{
-			.left = 0,
-			.top = 0,
-			.right = static_cast<LONG>(viewPort.Width),
-			.bottom = static_cast<LONG>(viewPort.Height) };
+		commandList->SetRootSignature(mRootSignature.Get());
+		commandList->SetPipelineState(mCullBackFacePipeline.Get());
+		commandList->SetRootConstantBuffer(0, mCamera->mConstantBuffer.get());
+		commandList->SetRootConstantBuffer(1, perFrameConstantBuffer);
 
-		mCommandList->RSSetViewports(1, &viewPort);
-		mCommandList->RSSetScissorRects(1, &scissor);
-		mCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-		mCommandList->DrawInstanced(36, 1, 0, 0);
+		commandList->SetViewport(viewPort);
+		commandList->SetScissorRect(scissor);
+		commandList->SetPrimitiveTopology(PrimitiveTopology::TriangleList);
+		commandList->Draw(mProxyVertexCount, 1, CUBE_VERTEX_COUNT, 0);
 	}
 	// render cube back
+	if (!mIsSurfaceMode)
 	{
 
 		float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
-		mCommandList->ClearRenderTargetView(mCubeBack->mRtvDescriptor.mCpuHandle, clearColor, 0, nullptr);
-
-		D3D12_CPU_DESCRIPTOR_HANDLE renderTargets[] = { mCubeBack->mRtvDescriptor.mCpuHandle };
-		mCommandList->OMSetRenderTargets(static_cast<uint32_t>(std::size(renderTargets)), renderTargets, false, nullptr);
+		commandList->ClearRenderTarget(mCubeBack.get(), clearColor);
+		commandList->ClearDepth(mDepthBuffer.get(), 0.0f);
 
-		mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
-		mCommandList->SetPipelineState(mCullFrontFacePipeline.Get());
-		mCommandList->SetGraphicsRootConstantBufferView(0, mCamera->mConstantBuffer->mResource->GetGPUVirtualAddress());
-		mCommandList->SetGraphicsRootConstantBufferView(1, mPerFrameConstantBuffer->mResource->GetGPUVirtualAddress());
+		TextureResource* renderTargets[] = { mCubeBack.get() };
+		commandList->SetRenderTargets(static_cast<uint32_t>(std::size(renderTargets)), renderTargets, mDepthBuffer.get());
 
-		D3D12_VIEWPORT viewPort{
-		.TopLeftX = 0,
-		.TopLeftY = 0,
-		.Width = static_cast<float>(Window::GetWidth()),
-		.Height = static_cast<float>(Window::GetHeight()),
-		.MinDepth = 0.0f,
-		.MaxDepth = 1.0f };
+		commandList->SetRootSignature(mRootSignature.Get());
+		commandList->SetPipelineState(mCullFrontFacePipeline.Get());
+		commandList->SetRootConstantBuffer(0, mCamera->mConstantBuffer.get());
+		commandList->SetRootConstantBuffer(1, perFrameConstantBuffer);
 
-		D3D12_RECT scissor{
-			.left = 0,
-			.top = 0,
-			.right = static_cast<LONG>(viewPort.Width),
-			.bottom = static_cast<LONG>(viewPort.Height) };
-
-		mCommandList->RSSetViewports(1, &viewPort);
-		mCommandList->RSSetScissorRects(1, &scissor);
-		mCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-		mCommandList->DrawInstanced(36, 1, 0, 0);
+		commandList->SetViewport(viewPort);
+		commandList->SetScissorRect(scissor);
+		commandList->SetPrimitiveTopology(PrimitiveTopology::TriangleList);
+		commandList->Draw(mProxyVertexCount, 1, CUBE_VERTEX_COUNT, 0);
 	}
 	// barriers
+	if (!mIsSurfaceMode)
 	{
-		std::vector<D3D12_RESOURCE_BARRIER> barriers;
+		std::vector<TransitionBarrier> barriers;
 		AddBarrier(barriers, mCubeFront.get(), D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
 		AddBarrier(barriers, mCubeBack.get(), D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
 		if (!barriers.empty())
-			mCommandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+			commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
 	}
 
 	TextureResource& currentBackbuffer = mDevice->GetCurrentBackbuffer();
 
-	std::vector<D3D12_RESOURCE_BARRIER> barriers;
+	std::vector<TransitionBarrier> barriers;
 	AddBarrier(barriers, &currentBackbuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
 	AddBarrier(barriers, mDepthBuffer.get(), D3D12_RESOURCE_STATE_DEPTH_WRITE);
-	mCommandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+	if (!barriers.empty())
+		commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
 
 	float clearColor[4] = { 0.02f, 0.02f, 0.02f, 1.0f };
-	mCommandList->ClearRenderTargetView(currentBackbuffer.mRtvDescriptor.mCpuHandle, clearColor, 0, nullptr);
-	mCommandList->ClearDepthStencilView(mDepthBuffer->mDsvDescriptor.mCpuHandle, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 0.0f, 0, 0, nullptr);
+	commandList->ClearRenderTarget(&currentBackbuffer, clearColor);
+	commandList->ClearDepth(mDepthBuffer.get(), mIsSurfaceMode ? 1.0f : 0.0f);
 
-	D3D12_CPU_DESCRIPTOR_HANDLE renderTargets[] = { currentBackbuffer.mRtvDescriptor.mCpuHandle };
-	mCommandList->OMSetRenderTargets(static_cast<uint32_t>(std::size(renderTargets)), renderTargets, false, &mDepthBuffer->mDsvDescriptor.mCpuHandle);
+	TextureResource* renderTargets[] = { &currentBackbuffer };
+	commandList->SetRenderTargets(static_cast<uint32_t>(std::size(renderTargets)), renderTargets, mDepthBuffer.get());
 
-	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
-	mCommandList->SetPipelineState(mGraphicsPipeline.Get());
-	mCommandList->SetGraphicsRootConstantBufferView(0, mCamera->mConstantBuffer->mResource->GetGPUVirtualAddress());
-	mCommandList->SetGraphicsRootConstantBufferView(1, mPerFrameConstantBuffer->mResource->GetGPUVirtualAddress());
+	commandList->SetRootSignature(mRootSignature.Get());
+	commandList->SetPipelineState(mIsSurfaceMode ? mIsosurfacePipeline.Get() : mVolumePipelines[pixelShaderFeatures].Get());
+	commandList->SetRootConstantBuffer(0, mCamera->mConstantBuffer.get());
+	commandList->SetRootConstantBuffer(1, perFrameConstantBuffer);
 
-	D3D12_VIEWPORT viewPort{
-		.TopLeftX = 0,
-		.TopLeftY = 0,
-		.Width = static_cast<float>(Window::GetWidth()),
-		.Height = static_cast<float>(Window::GetHeight()),
-		.MinDepth = 0.0f,
-		.MaxDepth = 1.0f };
+	commandList->SetViewport(viewPort);
+	commandList->SetScissorRect(scissor);
+	commandList->SetPrimitiveTopology(PrimitiveTopology::TriangleList);
 
-	D3D12_RECT scissor{
-		.left = 0,
-		.top = 0,
-		.right = static_cast<LONG>(viewPort.Width),
-		.bottom = static_cast<LONG>(viewPort.Height) };
+	if (mIsSurfaceMode)
+		commandList->Draw(mIsosurfaceIndexCount, 1, 0, 0);
+	else
+		commandList->Draw(CUBE_VERTEX_COUNT, 1, 0, 0);
 
-	mCommandList->RSSetViewports(1, &viewPort);
-	mCommandList->RSSetScissorRects(1, &scissor);
-	mCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	if (mIsSliceVisible)
+	{
+		const float sliceSize = viewPort.height / 3.0f;
+		const Viewport sliceViewPort{
+			.x = viewPort.width - sliceSize,
+			.y = viewPort.height - sliceSize,
+			.width = sliceSize,
+			.height = sliceSize };
+
+		commandList->SetPipelineState(mSlicePipeline.Get());
+		commandList->SetViewport(sliceViewPort);
+		commandList->Draw(3, 1, 0, 0);
+	}
 
-	mCommandList->DrawInstanced(36, 1, 0, 0);
+	if (mScreenshotPath)
+	{
+		CaptureTexture(commandList, &currentBackbuffer, *mScreenshotPath);
+		mScreenshotPath.reset();
+	}
+	if (mCaptureDirectory)
+	{
+		char fileName[32];
+		snprintf(fileName, sizeof(fileName), "frame_%06u.bmp", mCapturedFrameCount++);
+		CaptureTexture(commandList, &currentBackbuffer, *mCaptureDirectory / fileName);
+	}
 
 	barriers.resize(0);
 	AddBarrier(barriers, &currentBackbuffer, D3D12_RESOURCE_STATE_PRESENT);
-	mCommandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+	bool shouldReadBrickFeedback = mBrickCache && !mIsSurfaceMode;
+	if (shouldReadBrickFeedback)
+		AddBarrier(barriers, mBrickFeedback.get(), D3D12_RESOURCE_STATE_COPY_SOURCE);
+	if (!barriers.empty())
+		commandList->ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
 
-	mDevice->EndFrame();
+	if (shouldReadBrickFeedback)
+	{
+		uint32_t frameIndex = mDevice->GetFrameIndex();
+		commandList->CopyBufferRegion(mBrickFeedbackReadback[frameIndex].get(), 0, mBrickFeedback.get(), 0,
+			mBrickCache->GetPageTable().size() * sizeof(uint32_t));
+		mIsBrickFeedbackPending[frameIndex] = true;
+	}
 }
\ No newline at end of file
@@ -1,39 +1,132 @@
 #pragma once
 
 #include "Types.h"
+#include "VolumeTypes.h"
+#include "MinMaxGrid.h"
+#include "StepGrid.h"
+#include "VolumeResampler.h"
+#include "Reslicer.h"
+#include "DirtyRegions.h"
+#include "IlluminationVolume.h"
+#include "ProgressiveLoader.h"
+#include "LabelVolume.h"
+#include "PixelShaderPermutations.h"
+#include "Input.h"
+#include "FrameCapture.h"
+#include "RenderInterface.h"
+#include "NullCommandList.h"
 
 #include <array>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <vector>
 
 class Device;
 class Camera;
-struct TextureResource;
-struct BufferResource;
-
-struct Input {
-	Input()
-	{
-		
-	}
+class BrickCache;
 
-	std::array<bool, 26> keys{};
+enum class SliceOrientation : uint8_t {
+	Axial,
+	Coronal,
+	Sagittal,
+	Oblique
 };
+struct TextureResource;
+struct BufferResource;
+struct VolumeFileInfo;
 
 class Application {
 public:
 	Application();
 	~Application();
 
+	// loads the largest DICOM series found in directory instead of the bundled volume, set before Initialize
+	void UseDicomSeries(const std::filesystem::path& directory) { mDicomDirectory = directory; }
+	// loads a NRRD, NIfTI or MetaImage volume instead of the bundled one, set before Initialize
+	void UseVolumeFile(const std::filesystem::path& filePath) { mVolumeFilePath = filePath; }
 	void Initialize();
 
 	Camera& GetCamera() { return *mCamera.get(); }
 
 	void Render();
 	void Update();
+
+	// edit(x, y, z, value) runs for every voxel of the box, only the touched bricks get uploaded again
+	void EditVolume(const VolumeBox& box, const std::function<void(uint32_t, uint32_t, uint32_t, uint8_t&)>& edit);
+
+	// segmentation of the full resolution volume, a labelCount of 0 takes the highest label + 1
+	void SetLabelVolume(const uint8_t* labels, const VolumeDimensions& dimensions, uint32_t labelCount = 0);
+	void SetLabelStyle(uint8_t label, const LabelStyle& style);
+
+	// co-registered scan (PET/MR) overlaid on the volume, primaryToSecondary maps full resolution voxel
+	// coordinates of the volume to voxel coordinates of data. It's resampled onto every level of the volume.
+	void SetSecondaryVolume(const uint8_t* data, const VolumeDimensions& dimensions, const AffineTransform& primaryToSecondary);
+
+	// records the input of every frame until it's saved
+	void RecordInput();
+	bool SaveInputRecording(const std::filesystem::path& filePath) const;
+	// drives the application from a recording instead of the window, a fixedTimestep of 0 keeps the recorded frame times
+	void ReplayInput(std::vector<InputFrame> frames, float fixedTimestep);
+	bool IsReplayFinished() const { return mInputReplay && mInputReplay->IsFinished(); }
+
+	// the back buffer of the next frame is written to filePath once the GPU is done with it
+	void CaptureScreenshot(const std::filesystem::path& filePath);
+	// every frame until stopped goes to directory as frame_<number>.bmp
+	void StartContinuousCapture(const std::filesystem::path& directory);
+	void StopContinuousCapture();
+
+	// frames are recorded into the null backend from now on, nothing reaches the GPU again
+	void UseNullBackend();
+	const NullCommandList* GetNullCommandList() const { return mNullCommandList.get(); }
 private:
 	void InitializePipelines();
 	void LoadVolumeData();
+	// the preview level of raw 8 bit voxels starting at offset in the file, the rest streams in through mVolumeLoader
+	VolumeLevel LoadRawVolume(const std::filesystem::path& volumePath, uint64_t offset, const VolumeDimensions& dimensions);
+	std::optional<VolumeLevel> ReadDicomSeries(const std::filesystem::path& directory);
+	std::optional<VolumeLevel> ReadVolumeFile(const VolumeFileInfo& info);
+	bool IsBrickPagingNeeded(const VolumeLevel& level) const;
+	std::unique_ptr<TextureResource> CreateVolumeTexture(const VolumeDimensions& dimensions);
+	// the crop box of a volume of these full resolution dimensions, from its first level
+	VolumeBox FindCropBox(const VolumeLevel& level, const VolumeDimensions& dimensions) const;
+	// the crop box in a level's voxels, and the level cut down to it
+	VolumeBox GetLevelCropBox(uint32_t stride) const;
+	void CropVolumeLevel(VolumeLevel& level) const;
+	void DenoiseVolumeLevel(VolumeLevel& level) const;
+	void SetVolumeLevel(VolumeLevel&& level);
+	void UpdateVolumeLoading();
+	void UploadVolumeLevels(RenderCommandList* commandList);
+	void FuseVolumes();
+	void UploadFusedVolume(RenderCommandList* commandList);
+	bool IsFusionVisible() const;
+	// copies as much of the box as fits into this frame's upload memory, returns the first slice that didn't fit
+	uint32_t UploadVolumeBox(RenderCommandList* commandList, TextureResource* texture, const uint8_t* data,
+		const VolumeDimensions& dimensions, const VolumeBox& box, uint32_t channelCount = 1);
+	// points the constants at the current resources, the next frame picks them up
+	void UpdatePerFrameConstants();
+	// the ray marching variant for what the constants currently point at
+	uint32_t GetPixelShaderFeatures() const;
+	void BuildProxyGeometry();
+	void ExtractIsosurface(uint8_t isoValue);
+	void InitializeBrickCache(uint64_t availableVideoMemory);
+	void CreateBrickAtlas(uint32_t slotsX, uint32_t slotsY, uint32_t slotsZ);
+	// drops enough layers of slots to get back under the video memory budget, the bricks that still fit are streamed in again
+	void ShrinkBrickAtlas(uint64_t overBudgetBytes);
+	void UpdateBrickResidency(RenderCommandList* commandList);
+	// false when this frame's upload memory is used up
+	bool UploadBrick(RenderCommandList* commandList, uint32_t brick, uint32_t slot);
+	void UpdateSlice(RenderCommandList* commandList);
+	void FlushDirtyRegions(RenderCommandList* commandList);
+	void UpdateIllumination(RenderCommandList* commandList);
+	void UploadLabels(RenderCommandList* commandList);
+	void UploadStepGrid(RenderCommandList* commandList);
+	// copies the first subresource of an RGBA8 texture into the next capture slot, nothing waits on it
+	void CaptureTexture(RenderCommandList* commandList, TextureResource* texture, std::filesystem::path filePath);
+	void PollCaptures();
+	// live and peak bytes of every memory category and the allocator's statistics, as JSON
+	void WriteMemoryReport(const std::filesystem::path& filePath);
+	void RecordFrame(RenderCommandList* commandList);
 
 public:
 	bool mIsInitialized = false;
@@ -42,11 +135,20 @@ public:
 private:
 	std::unique_ptr<Device> mDevice = nullptr;
 
-	ComPtr<ID3D12PipelineState> mGraphicsPipeline = nullptr;
+	std::unique_ptr<NullCommandList> mNullCommandList = nullptr;
+
+	std::unique_ptr<InputRecorder> mInputRecorder = nullptr;
+	std::unique_ptr<InputReplay> mInputReplay = nullptr;
+
+	// ray marching variants indexed by their PixelShaderFeature bits
+	std::array<ComPtr<ID3D12PipelineState>, PIXEL_SHADER_PERMUTATION_COUNT> mVolumePipelines{};
+	bool mIsEarlyTerminationEnabled = true;
+	bool mWasEarlyTerminationKeyPressed = false;
 	ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
 
 	std::unique_ptr<TextureResource> mDepthBuffer = nullptr;
-	std::unique_ptr<BufferResource> mCube = nullptr;
+	std::unique_ptr<BufferResource> mCube = nullptr; // bounding box followed by the tight proxy mesh
+	uint32_t mProxyVertexCount = 0;
 
 	std::unique_ptr<TextureResource> mCubeFront = nullptr;
 	std::unique_ptr<TextureResource> mCubeBack = nullptr;
@@ -55,9 +157,101 @@ private:
 	ComPtr<ID3D12PipelineState> mCullBackFacePipeline = nullptr;
 	std::unique_ptr<Camera> mCamera = nullptr;
 
-	std::vector<float> mVolumeData;
+	VoxelBuffer mVolumeData;
+	VolumeDimensions mVolumeDimensions{};
+	MinMaxGrid mMinMaxGrid;
+	DirtyRegions mDirtyRegions;
 	std::unique_ptr<TextureResource> mVolumeTexture = nullptr;
+	uint32_t mVolumeUploadedSlices = 0;
+	uint32_t mVolumeStride = 1;
+	// part of the full resolution volume that's kept, every level and the labels are cut down to it
+	VolumeDimensions mFullVolumeDimensions{};
+	VolumeBox mCropBox{};
+
+	// secondary volume resampled onto the volume's grid, interleaved with it so the ray marcher fetches both at once
+	std::vector<uint8_t> mSecondaryVolume;
+	VolumeDimensions mSecondaryDimensions{};
+	AffineTransform mPrimaryToSecondary{};
+	VoxelBuffer mFusedVolumeData;
+	std::unique_ptr<TextureResource> mFusedVolumeTexture = nullptr;
+	uint32_t mFusedUploadedSlices = 0;
+	bool mIsFusionEnabled = true;
+	bool mWasFusionKeyPressed = false;
+
+	// loaded instead of the bundled volume when set
+	std::filesystem::path mDicomDirectory;
+	std::filesystem::path mVolumeFilePath;
+
+	// the volume is read coarse to fine, each finer level uploads into its own texture and replaces the current one when complete
+	std::unique_ptr<ProgressiveLoader> mVolumeLoader = nullptr;
+	std::optional<VolumeLevel> mPendingVolumeLevel;
+	std::unique_ptr<TextureResource> mPendingVolumeTexture = nullptr;
+	uint32_t mPendingVolumeUploadedSlices = 0;
+
+	// surface mode rasterizes a marching cubes isosurface instead of ray marching the volume
+	ComPtr<ID3D12PipelineState> mIsosurfacePipeline = nullptr;
+	std::unique_ptr<BufferResource> mIsosurfaceVertices = nullptr;
+	std::unique_ptr<BufferResource> mIsosurfaceIndices = nullptr;
+	uint32_t mIsosurfaceIndexCount = 0;
+	bool mIsSurfaceMode = false;
+	bool mWasSurfaceKeyPressed = false;
+
+	// volumes that don't fit the video memory budget are paged through a brick atlas
+	std::unique_ptr<BrickCache> mBrickCache = nullptr;
+	std::unique_ptr<TextureResource> mBrickAtlas = nullptr;
+	// the replaced atlas still counts against the budget until the frame that released it retires
+	uint64_t mBrickAtlasReleaseFence = 0;
+	std::unique_ptr<TextureResource> mPageTable = nullptr;
+	std::unique_ptr<BufferResource> mBrickFeedback = nullptr;
+	std::unique_ptr<BufferResource> mBrickFeedbackClear = nullptr;
+	std::vector<std::unique_ptr<BufferResource>> mBrickFeedbackReadback; // one per frame in flight
+	std::vector<bool> mIsBrickFeedbackPending;
+
+	// 2D reformatted slice drawn in a corner next to the 3D view, resliced on the CPU every frame
+	ComPtr<ID3D12PipelineState> mSlicePipeline = nullptr;
+	std::unique_ptr<TextureResource> mSliceTexture = nullptr;
+	SliceOrientation mSliceOrientation = SliceOrientation::Axial;
+	SlabMode mSlabMode = SlabMode::Thin;
+	bool mIsSliceVisible = false;
+	bool mWasSliceKeyPressed = false;
+	bool mWasSlabKeyPressed = false;
+
+	// shadows/ambient occlusion from a low resolution light volume, swept on the CPU when the light moves
+	IlluminationVolume mIlluminationVolume;
+	IlluminationSettings mIlluminationSettings{};
+	std::unique_ptr<TextureResource> mIlluminationTexture = nullptr;
+	bool mIsIlluminationUploadPending = false;
+	float mLightAzimuth = 0.0f;
+	bool mIsIlluminationEnabled = false;
+	bool mWasIlluminationKeyPressed = false;
+	bool mWasOcclusionKeyPressed = false;
+
+	// ray marching step length per brick, long through homogeneous regions and short at edges
+	StepGrid mStepGrid;
+	std::unique_ptr<TextureResource> mStepGridTexture = nullptr;
+	bool mIsStepGridDirty = false;
+	bool mIsStepGridUploaded = false;
+	bool mIsAdaptiveStepEnabled = true;
+	bool mWasAdaptiveStepKeyPressed = false;
+
+	// bit packed label map tinting the volume, its brick masks keep hidden labels out of the proxy geometry
+	LabelVolume mLabelVolume;
+	std::unique_ptr<BufferResource> mLabelBuffer = nullptr;
+	uint64_t mLabelUploadedBytes = 0;
+
+	// readbacks of captured frames, encoded and written on the capture's own thread
+	std::unique_ptr<FrameCapture> mFrameCapture = nullptr;
+	std::vector<std::unique_ptr<BufferResource>> mCaptureReadbacks; // one per capture slot
+	std::optional<std::filesystem::path> mScreenshotPath;
+	std::optional<std::filesystem::path> mCaptureDirectory;
+	uint32_t mCapturedFrameCount = 0;
+	uint32_t mScreenshotCount = 0;
+	bool mWasScreenshotKeyPressed = false;
+	bool mWasCaptureKeyPressed = false;
+
+	uint32_t mMemoryReportFrameCount = 0;
+	bool mWasMemoryReportKeyPressed = false;
 
 	PerFrameConstantBuffer mPerFrameConstantBufferData{};
-	std::unique_ptr<BufferResource> mPerFrameConstantBuffer = nullptr;
+	std::vector<std::unique_ptr<BufferResource>> mPerFrameConstantBuffers; // one per frame in flight
 };
\ No newline at end of file
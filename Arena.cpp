@@ -0,0 +1,196 @@
+#include "Arena.h"
+#include "MemoryTracker.h"
+#include "ThreadPool.h"
+
+#include <cassert>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+static constexpr size_t SMALL_PAGE_SIZE = 4096;
+
+static size_t AlignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+Arena::Arena(size_t blockSize)
+	: mBlockSize(AlignUp(blockSize, LARGE_PAGE_SIZE))
+{
+}
+
+Arena::~Arena()
+{
+	Release();
+}
+
+Arena& Arena::Get()
+{
+	static Arena arena;
+	return arena;
+}
+
+void* Arena::Allocate(size_t size, size_t alignment)
+{
+	assert((alignment & (alignment - 1)) == 0 && "Alignment has to be a power of two");
+	std::lock_guard lock(mMutex);
+
+	// there are only ever a few blocks, the first one with room is good enough
+	for (Block& block : mBlocks)
+	{
+		const size_t offset = AlignUp(block.offset, alignment);
+		if (offset + size <= block.size)
+		{
+			block.offset = offset + size;
+			block.liveCount++;
+			return block.memory + offset;
+		}
+	}
+
+	Block block = AllocateBlock(std::max(mBlockSize, AlignUp(size, LARGE_PAGE_SIZE)));
+	assert(block.memory && "Arena couldn't get memory from the OS");
+	MemoryTracker::Get().Add(MemoryCategory::CpuVolume, block.size);
+	block.offset = size;
+	block.liveCount = 1;
+	mBlocks.push_back(block);
+	return block.memory;
+}
+
+void Arena::Deallocate(void* memory)
+{
+	if (!memory)
+		return;
+
+	std::lock_guard lock(mMutex);
+	for (Block& block : mBlocks)
+	{
+		if (memory < block.memory || memory >= block.memory + block.size)
+			continue;
+
+		assert(block.liveCount > 0 && "Freeing more than was allocated from the block");
+		if (--block.liveCount == 0)
+			block.offset = 0;
+		return;
+	}
+	assert(false && "Freeing memory that isn't from this arena");
+}
+
+void Arena::Release()
+{
+	std::lock_guard lock(mMutex);
+	for (const Block& block : mBlocks)
+	{
+		FreeBlock(block);
+		MemoryTracker::Get().Remove(MemoryCategory::CpuVolume, block.size);
+	}
+	mBlocks.clear();
+}
+
+void Arena::FirstTouch(void* data, size_t size, size_t slabSize)
+{
+	uint8_t* begin = static_cast<uint8_t*>(data);
+	const uint32_t slabCount = static_cast<uint32_t>((size + slabSize - 1) / slabSize);
+	ThreadPool::Get().ParallelFor(slabCount, [&](uint32_t slab) {
+		const size_t slabBegin = slab * slabSize;
+		const size_t slabEnd = std::min(slabBegin + slabSize, size);
+		// the content is about to be overwritten anyway, a write per page is enough to fault it in
+		for (size_t offset = slabBegin; offset < slabEnd; offset += SMALL_PAGE_SIZE)
+			begin[offset] = 0;
+	});
+}
+
+size_t Arena::GetAllocatedBytes() const
+{
+	std::lock_guard lock(mMutex);
+	size_t bytes = 0;
+	for (const Block& block : mBlocks)
+		bytes += block.offset;
+	return bytes;
+}
+
+size_t Arena::GetReservedBytes() const
+{
+	std::lock_guard lock(mMutex);
+	size_t bytes = 0;
+	for (const Block& block : mBlocks)
+		bytes += block.size;
+	return bytes;
+}
+
+size_t Arena::GetLargePageBytes() const
+{
+	std::lock_guard lock(mMutex);
+	size_t bytes = 0;
+	for (const Block& block : mBlocks)
+		bytes += block.isLargePage ? block.size : 0;
+	return bytes;
+}
+
+size_t Arena::GetLargePageRequestedBytes() const
+{
+	std::lock_guard lock(mMutex);
+	size_t bytes = 0;
+	for (const Block& block : mBlocks)
+		bytes += block.isLargePageRequested ? block.size : 0;
+	return bytes;
+}
+
+#ifdef _WIN32
+
+Arena::Block Arena::AllocateBlock(size_t size)
+{
+	// large pages need the lock pages privilege, without it this fails and regular pages are used
+	const size_t largePageMinimum = GetLargePageMinimum();
+	if (largePageMinimum > 0)
+	{
+		const size_t largeSize = AlignUp(size, largePageMinimum);
+		void* memory = VirtualAlloc(nullptr, largeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (memory)
+			return { .memory = static_cast<uint8_t*>(memory), .size = largeSize, .isLargePage = true, .isLargePageRequested = true };
+	}
+
+	void* memory = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	return { .memory = static_cast<uint8_t*>(memory), .size = memory ? size : 0 };
+}
+
+void Arena::FreeBlock(const Block& block)
+{
+	VirtualFree(block.memory, 0, MEM_RELEASE);
+}
+
+#else
+
+Arena::Block Arena::AllocateBlock(size_t size)
+{
+	// reserved huge pages first, this fails straight away when the system has none set aside
+	void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (memory != MAP_FAILED)
+		return { .memory = static_cast<uint8_t*>(memory), .size = size, .isLargePage = true, .isLargePageRequested = true };
+
+	// otherwise transparent huge pages, which only back 2 MB aligned ranges
+	const size_t mappedSize = size + LARGE_PAGE_SIZE;
+	memory = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED)
+		return {};
+
+	uint8_t* mapped = static_cast<uint8_t*>(memory);
+	uint8_t* aligned = reinterpret_cast<uint8_t*>(AlignUp(reinterpret_cast<uintptr_t>(mapped), LARGE_PAGE_SIZE));
+	if (aligned > mapped)
+		munmap(mapped, aligned - mapped);
+	if (mapped + mappedSize > aligned + size)
+		munmap(aligned + size, mapped + mappedSize - (aligned + size));
+
+	// accepting the advice doesn't mean the kernel backs the range with huge pages, only that it may
+	const bool isLargePageRequested = madvise(aligned, size, MADV_HUGEPAGE) == 0;
+	return { .memory = aligned, .size = size, .isLargePageRequested = isLargePageRequested };
+}
+
+void Arena::FreeBlock(const Block& block)
+{
+	munmap(block.memory, block.size);
+}
+
+#endif
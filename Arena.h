@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for volume sized buffers. Memory comes from the OS in large blocks backed by 2 MB
+// pages where the system allows it (MAP_HUGETLB or transparent huge pages on Linux, large pages on
+// Windows) and is never cleared by us, so loading a dataset costs a few TLB entries per gigabyte
+// instead of one per 4 KB. A block counts its live allocations and is rewound once all of them are
+// freed, so the levels of a progressive load and the datasets after it reuse the same blocks.
+class Arena {
+public:
+	static constexpr size_t LARGE_PAGE_SIZE = 2 * 1024 * 1024;
+	static constexpr size_t DEFAULT_ALIGNMENT = 64;
+
+	explicit Arena(size_t blockSize = 128 * LARGE_PAGE_SIZE);
+	~Arena();
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	// the arena volume data is allocated from by default
+	static Arena& Get();
+
+	void* Allocate(size_t size, size_t alignment = DEFAULT_ALIGNMENT);
+	// the memory is only reused once everything else allocated from its block was freed as well
+	void Deallocate(void* memory);
+
+	// gives every block back to the OS, invalidates everything allocated so far
+	void Release();
+
+	// Faults the pages in slab by slab on the thread pool, so on NUMA systems each slab lands on the
+	// node of a worker instead of all of them on the node of the thread that happens to write first.
+	static void FirstTouch(void* data, size_t size, size_t slabSize);
+
+	size_t GetAllocatedBytes() const;
+	size_t GetReservedBytes() const;
+	// blocks the OS backed with large pages when it handed them out (MAP_HUGETLB, MEM_LARGE_PAGES)
+	size_t GetLargePageBytes() const;
+	// blocks large pages were at least asked for, the ones above included, for transparent huge pages the
+	// kernel decides as they're faulted in (AnonHugePages in /proc/self/smaps tells what it did)
+	size_t GetLargePageRequestedBytes() const;
+
+private:
+	struct Block {
+		uint8_t* memory = nullptr;
+		size_t size = 0;
+		size_t offset = 0;
+		size_t liveCount = 0;
+		bool isLargePage = false;
+		bool isLargePageRequested = false;
+	};
+
+	static Block AllocateBlock(size_t size);
+	static void FreeBlock(const Block& block);
+
+private:
+	size_t mBlockSize = 0;
+	mutable std::mutex mMutex; // levels are allocated on the loader thread
+	std::vector<Block> mBlocks;
+};
+
+// std::allocator replacement that takes its memory from an arena. Value initialization is skipped,
+// so resize() doesn't clear.
+template<typename T>
+class ArenaAllocator {
+public:
+	using value_type = T;
+
+	ArenaAllocator() : mArena(&Arena::Get()) {}
+	explicit ArenaAllocator(Arena& arena) : mArena(&arena) {}
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : mArena(other.GetArena()) {}
+
+	T* allocate(size_t count)
+	{
+		return static_cast<T*>(mArena->Allocate(count * sizeof(T), std::max(alignof(T), Arena::DEFAULT_ALIGNMENT)));
+	}
+	void deallocate(T* pointer, size_t) { mArena->Deallocate(pointer); }
+
+	template<typename U>
+	void construct(U* pointer) noexcept(std::is_nothrow_default_constructible_v<U>)
+	{
+		::new (static_cast<void*>(pointer)) U;
+	}
+	template<typename U, typename... Args>
+	void construct(U* pointer, Args&&... args)
+	{
+		::new (static_cast<void*>(pointer)) U(std::forward<Args>(args)...);
+	}
+
+	Arena* GetArena() const { return mArena; }
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return mArena == other.GetArena(); }
+
+private:
+	Arena* mArena = nullptr;
+};
+
+// voxels of a volume or one of its levels
+using VoxelBuffer = std::vector<uint8_t, ArenaAllocator<uint8_t>>;
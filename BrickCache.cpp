@@ -0,0 +1,210 @@
+#include "BrickCache.h"
+
+#include <algorithm>
+#include <cassert>
+
+BrickCache::BrickCache(uint32_t brickCount, uint32_t slotCapacity)
+	: mPageTable(brickCount, NOT_RESIDENT)
+	, mSlots(slotCapacity)
+	, mIsRequested(brickCount, false)
+	, mIsStale(brickCount, false)
+	, mSlotBudget(slotCapacity)
+{
+	mFreeSlots.reserve(slotCapacity);
+	for (uint32_t slot = slotCapacity; slot > 0; slot--)
+		mFreeSlots.push_back(slot - 1);
+}
+
+void BrickCache::SetSlotBudget(uint32_t slotBudget)
+{
+	mSlotBudget = std::min(slotBudget, static_cast<uint32_t>(mSlots.size()));
+	while (mResidentCount > mSlotBudget)
+		Evict(mLeastRecent);
+}
+
+std::vector<uint32_t> BrickCache::GetResidentBricks() const
+{
+	std::vector<uint32_t> bricks;
+	bricks.reserve(mResidentCount);
+	for (uint32_t slot = mMostRecent; slot != INVALID; slot = mSlots[slot].next)
+		bricks.push_back(mSlots[slot].brick);
+	return bricks;
+}
+
+void BrickCache::ProcessFeedback(const uint32_t* feedback, uint32_t count)
+{
+	assert(count <= mPageTable.size());
+	for (uint32_t brick = 0; brick < count; brick++)
+	{
+		if (feedback[brick] == 0)
+			continue;
+
+		if (mPageTable[brick] != NOT_RESIDENT)
+		{
+			mStats.hits++;
+			TouchBrick(brick);
+		}
+		else
+		{
+			mStats.misses++;
+			RequestBrick(brick);
+		}
+	}
+}
+
+void BrickCache::RequestBrick(uint32_t brick)
+{
+	if (mIsRequested[brick] || mPageTable[brick] != NOT_RESIDENT)
+		return;
+
+	mIsRequested[brick] = true;
+	mRequests.push_back(brick);
+}
+
+void BrickCache::TouchBrick(uint32_t brick)
+{
+	uint32_t slot = mPageTable[brick];
+	if (slot == NOT_RESIDENT)
+		return;
+
+	mSlots[slot].lastUsedFrame = mFrame;
+	if (slot != mMostRecent)
+	{
+		Unlink(slot);
+		PushFront(slot);
+	}
+}
+
+void BrickCache::InvalidateBrick(uint32_t brick)
+{
+	if (mIsStale[brick] || mPageTable[brick] == NOT_RESIDENT)
+		return;
+
+	mIsStale[brick] = true;
+	mStaleBricks.push_back(brick);
+}
+
+std::vector<BrickUpload> BrickCache::ScheduleUploads(uint32_t maxUploads)
+{
+	std::vector<BrickUpload> uploads;
+
+	// stale bricks keep their slot, so the page table doesn't change for them
+	while (uploads.size() < maxUploads && !mStaleBricks.empty())
+	{
+		uint32_t brick = mStaleBricks.back();
+		mStaleBricks.pop_back();
+		mIsStale[brick] = false;
+		if (mPageTable[brick] == NOT_RESIDENT)
+			continue;
+
+		mStats.uploads++;
+		uploads.push_back({ .brick = brick, .slot = mPageTable[brick], .isStale = true });
+	}
+
+	while (uploads.size() < maxUploads && !mRequests.empty())
+	{
+		uint32_t brick = mRequests.front();
+		if (mPageTable[brick] != NOT_RESIDENT)
+		{
+			mIsRequested[brick] = false;
+			mRequests.pop_front();
+			continue;
+		}
+
+		uint32_t slot = INVALID;
+		if (mResidentCount < mSlotBudget && !mFreeSlots.empty())
+		{
+			slot = mFreeSlots.back();
+			mFreeSlots.pop_back();
+		}
+		else if (mLeastRecent != INVALID && mSlots[mLeastRecent].lastUsedFrame < mFrame)
+		{
+			slot = mLeastRecent;
+			Evict(slot);
+			mFreeSlots.pop_back();
+		}
+		else
+		{
+			// everything resident is in use this frame, keep the request for later
+			break;
+		}
+
+		mIsRequested[brick] = false;
+		mRequests.pop_front();
+
+		mSlots[slot].brick = brick;
+		mSlots[slot].lastUsedFrame = mFrame;
+		PushFront(slot);
+		mPageTable[brick] = slot;
+		mResidentCount++;
+		mIsPageTableDirty = true;
+		mStats.uploads++;
+
+		uploads.push_back({ .brick = brick, .slot = slot });
+	}
+
+	return uploads;
+}
+
+void BrickCache::CancelUpload(const BrickUpload& upload)
+{
+	assert(mPageTable[upload.brick] == upload.slot && "Cancelling an upload that wasn't scheduled");
+	mStats.uploads--;
+	if (upload.isStale)
+	{
+		InvalidateBrick(upload.brick);
+		return;
+	}
+
+	Unlink(upload.slot);
+	mSlots[upload.slot].brick = INVALID;
+	mFreeSlots.push_back(upload.slot);
+	mPageTable[upload.brick] = NOT_RESIDENT;
+	mResidentCount--;
+	mIsPageTableDirty = true;
+
+	mIsRequested[upload.brick] = true;
+	mRequests.push_front(upload.brick);
+}
+
+void BrickCache::Unlink(uint32_t slot)
+{
+	Slot& entry = mSlots[slot];
+	if (entry.previous != INVALID)
+		mSlots[entry.previous].next = entry.next;
+	else
+		mMostRecent = entry.next;
+
+	if (entry.next != INVALID)
+		mSlots[entry.next].previous = entry.previous;
+	else
+		mLeastRecent = entry.previous;
+
+	entry.previous = entry.next = INVALID;
+}
+
+void BrickCache::PushFront(uint32_t slot)
+{
+	Slot& entry = mSlots[slot];
+	entry.previous = INVALID;
+	entry.next = mMostRecent;
+	if (mMostRecent != INVALID)
+		mSlots[mMostRecent].previous = slot;
+	mMostRecent = slot;
+	if (mLeastRecent == INVALID)
+		mLeastRecent = slot;
+}
+
+void BrickCache::Evict(uint32_t slot)
+{
+	Slot& entry = mSlots[slot];
+	assert(entry.brick != INVALID && "Evicting an empty slot");
+
+	Unlink(slot);
+	mPageTable[entry.brick] = NOT_RESIDENT;
+	entry.brick = INVALID;
+	mFreeSlots.push_back(slot);
+	mResidentCount--;
+	mIsPageTableDirty = true;
+	mStats.evictions++;
+}
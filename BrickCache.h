@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+struct BrickUpload {
+	uint32_t brick = 0;
+	uint32_t slot = 0;
+	bool isStale = false; // already resident, uploaded again into the slot it has
+};
+
+// Residency bookkeeping for a paged volume: a page table mapping every virtual brick to a slot
+// in the brick atlas, LRU replacement over the slots and aggregation of the per-brick feedback
+// written by the ray marcher. Knows nothing about the GPU, the renderer does the actual copies.
+class BrickCache {
+public:
+	static constexpr uint32_t NOT_RESIDENT = UINT32_MAX;
+
+	struct Stats {
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t uploads = 0;
+		uint64_t evictions = 0;
+	};
+
+	BrickCache(uint32_t brickCount, uint32_t slotCapacity);
+
+	// the budget can move at runtime (other apps, driver), shrinking it evicts least recently used bricks
+	void SetSlotBudget(uint32_t slotBudget);
+	uint32_t GetSlotBudget() const { return mSlotBudget; }
+	uint32_t GetSlotCapacity() const { return static_cast<uint32_t>(mSlots.size()); }
+	uint32_t GetResidentCount() const { return mResidentCount; }
+	// most recently used first
+	std::vector<uint32_t> GetResidentBricks() const;
+
+	void BeginFrame() { mFrame++; }
+
+	// one entry per virtual brick, non zero means a ray touched the brick
+	void ProcessFeedback(const uint32_t* feedback, uint32_t count);
+	void RequestBrick(uint32_t brick);
+	void TouchBrick(uint32_t brick);
+
+	// the brick's voxels changed, a resident brick is uploaded again into the slot it already has
+	void InvalidateBrick(uint32_t brick);
+
+	// Re-uploads invalidated bricks first, then assigns slots to pending requests, oldest request first. Bricks used during the current
+	// frame are never evicted so a working set larger than the cache can't thrash within a frame.
+	std::vector<BrickUpload> ScheduleUploads(uint32_t maxUploads);
+	// The renderer couldn't record the upload (out of upload memory), so it's scheduled again first thing
+	// next time. A new brick gives its slot back meanwhile, so no ray reads the slot's old contents.
+	void CancelUpload(const BrickUpload& upload);
+
+	uint32_t GetSlot(uint32_t brick) const { return mPageTable[brick]; }
+	const std::vector<uint32_t>& GetPageTable() const { return mPageTable; }
+	bool IsPageTableDirty() const { return mIsPageTableDirty; }
+	void ClearPageTableDirty() { mIsPageTableDirty = false; }
+
+	const Stats& GetStats() const { return mStats; }
+	void ResetStats() { mStats = {}; }
+
+private:
+	static constexpr uint32_t INVALID = UINT32_MAX;
+
+	struct Slot {
+		uint32_t brick = INVALID;
+		uint32_t previous = INVALID; // towards most recently used
+		uint32_t next = INVALID; // towards least recently used
+		uint64_t lastUsedFrame = 0;
+	};
+
+	void Unlink(uint32_t slot);
+	void PushFront(uint32_t slot);
+	void Evict(uint32_t slot);
+
+private:
+	std::vector<uint32_t> mPageTable;
+	std::vector<Slot> mSlots;
+	std::vector<uint32_t> mFreeSlots;
+	std::vector<bool> mIsRequested;
+	std::deque<uint32_t> mRequests;
+	std::vector<bool> mIsStale;
+	std::vector<uint32_t> mStaleBricks;
+
+	uint32_t mMostRecent = INVALID;
+	uint32_t mLeastRecent = INVALID;
+	uint32_t mSlotBudget = 0;
+	uint32_t mResidentCount = 0;
+	uint64_t mFrame = 1;
+	bool mIsPageTableDirty = true;
+
+	Stats mStats{};
+};
@@ -19,7 +19,8 @@ Camera::Camera(Device& device, Input& input)
 			.bufferDescriptor = DescriptorType::Cbv,
 			.heapType = D3D12_HEAP_TYPE_UPLOAD,
 			.size = sizeof(CameraConstantBuffer),
-			.count = 1 };
+			.count = 1,
+			.memoryCategory = MemoryCategory::Constants };
 
 	mConstantBuffer = device.CreateBuffer(desc);
 
@@ -35,15 +36,17 @@ Camera::Camera(Device& device, Input& input)
 	UpdateViewMatrix();
 }
 
-void Camera::Update(Input& input, float deltaTime)
+void Camera::Update(const Input& input, float deltaTime)
 {
-	if (mRmbIsPressed)
-		CalculateMouseDelta(deltaTime);
+	if (input.isRightButtonPressed)
+		CalculateMouseDelta(input, deltaTime);
+	else
+		mPrevDragState.inProgress = false;
 	UpdatePosition(input, deltaTime);
 	UpdateViewMatrix();
 }
 
-void Camera::UpdatePosition(Input& input, float deltaTime)
+void Camera::UpdatePosition(const Input& input, float deltaTime)
 {
 	using namespace DirectX;
 	if (input.keys['w' - 'a'])
@@ -64,29 +67,26 @@ void Camera::UpdatePosition(Input& input, float deltaTime)
 	}
 }
 
-void Camera::CalculateMouseDelta(float deltaTime)
+void Camera::CalculateMouseDelta(const Input& input, float deltaTime)
 {
-	POINT cursorPos;
-	GetCursorPos(&cursorPos);
-
 	if (!mPrevDragState.inProgress)
 	{
-		mPrevDragState.x = cursorPos.x;
-		mPrevDragState.y = cursorPos.y;
+		mPrevDragState.x = input.cursorX;
+		mPrevDragState.y = input.cursorY;
 		mPrevDragState.inProgress = true;
 		return;
 	}
 
-	float deltaX = (cursorPos.x - mPrevDragState.x) * deltaTime * 100.0f;
-	float deltaY = (mPrevDragState.y - cursorPos.y) * deltaTime * 100.0f;
+	float deltaX = (input.cursorX - mPrevDragState.x) * deltaTime * 100.0f;
+	float deltaY = (mPrevDragState.y - input.cursorY) * deltaTime * 100.0f;
 
 	mYaw += deltaX;
 	mPitch += deltaY;
 
 	mPitch = std::min(90.0f - 0.5f, std::max(mPitch, -90.0f + 0.5f));
 
-	mPrevDragState.x = cursorPos.x;
-	mPrevDragState.y = cursorPos.y;
+	mPrevDragState.x = input.cursorX;
+	mPrevDragState.y = input.cursorY;
 	mPrevDragState.deltaX = deltaX;
 	mPrevDragState.deltaY = deltaY;
 }
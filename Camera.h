@@ -20,17 +20,16 @@ public:
 	Camera(Device& device, Input& input);
 	~Camera();
 
-	void Update(Input& input, float deltaTime);
+	void Update(const Input& input, float deltaTime);
 
 private:
 	void UpdateViewMatrix();
-	void UpdatePosition(Input& input, float deltaTime);
-	void CalculateMouseDelta(float deltaTime);
+	void UpdatePosition(const Input& input, float deltaTime);
+	void CalculateMouseDelta(const Input& input, float deltaTime);
 
 public:
 	std::unique_ptr<BufferResource> mConstantBuffer;
 	PrevDragState mPrevDragState{};
-	bool mRmbIsPressed = false;
 
 private:
 	Device& mDevice;
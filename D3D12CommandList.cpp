@@ -0,0 +1,174 @@
+#include "D3D12CommandList.h"
+#include "Device.h"
+
+#include <algorithm>
+#include <cassert>
+
+static_assert(RESOURCE_STATE_COMMON == D3D12_RESOURCE_STATE_COMMON);
+static_assert(RESOURCE_STATE_RENDER_TARGET == D3D12_RESOURCE_STATE_RENDER_TARGET);
+static_assert(RESOURCE_STATE_DEPTH_WRITE == D3D12_RESOURCE_STATE_DEPTH_WRITE);
+static_assert(RESOURCE_STATE_COPY_DEST == D3D12_RESOURCE_STATE_COPY_DEST);
+static_assert(RESOURCE_STATE_COPY_SOURCE == D3D12_RESOURCE_STATE_COPY_SOURCE);
+
+static constexpr uint32_t MAX_BATCHED_BARRIERS = 16;
+
+static D3D12_TEXTURE_COPY_LOCATION GetFootprintLocation(Resource* buffer, const BufferFootprint& footprint)
+{
+	D3D12_TEXTURE_COPY_LOCATION location = {};
+	location.pResource = buffer->mResource.Get();
+	location.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+	location.PlacedFootprint.Offset = footprint.offset;
+	location.PlacedFootprint.Footprint = {
+		.Format = static_cast<DXGI_FORMAT>(footprint.format),
+		.Width = footprint.width,
+		.Height = footprint.height,
+		.Depth = footprint.depth,
+		.RowPitch = footprint.rowPitch };
+	return location;
+}
+
+static D3D12_TEXTURE_COPY_LOCATION GetSubresourceLocation(Resource* texture)
+{
+	D3D12_TEXTURE_COPY_LOCATION location = {};
+	location.pResource = texture->mResource.Get();
+	location.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+	location.SubresourceIndex = 0;
+	return location;
+}
+
+D3D12CommandList::D3D12CommandList(Device& device, ID3D12GraphicsCommandList5* commandList)
+	: mDevice(device)
+	, mCommandList(commandList)
+{
+}
+
+void D3D12CommandList::ResourceBarrier(uint32_t count, const TransitionBarrier* barriers)
+{
+	// translated in batches on the stack, the barrier lists are short
+	D3D12_RESOURCE_BARRIER batch[MAX_BATCHED_BARRIERS];
+	for (uint32_t first = 0; first < count; first += MAX_BATCHED_BARRIERS)
+	{
+		const uint32_t batchSize = std::min(count - first, MAX_BATCHED_BARRIERS);
+		for (uint32_t i = 0; i < batchSize; i++)
+		{
+			const TransitionBarrier& barrier = barriers[first + i];
+			batch[i] = {
+				.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+				.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
+				.Transition = {
+					.pResource = barrier.resource->mResource.Get(),
+					.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+					.StateBefore = static_cast<D3D12_RESOURCE_STATES>(barrier.stateBefore),
+					.StateAfter = static_cast<D3D12_RESOURCE_STATES>(barrier.stateAfter)} };
+		}
+		mCommandList->ResourceBarrier(batchSize, batch);
+	}
+}
+
+void D3D12CommandList::CopyBufferRegion(Resource* destination, uint64_t destinationOffset, Resource* source, uint64_t sourceOffset, uint64_t size)
+{
+	mCommandList->CopyBufferRegion(destination->mResource.Get(), destinationOffset, source->mResource.Get(), sourceOffset, size);
+}
+
+void D3D12CommandList::CopyBufferToTexture(Resource* destination, uint32_t x, uint32_t y, uint32_t z,
+	Resource* source, const BufferFootprint& footprint, const CopyBox* sourceBox)
+{
+	const D3D12_TEXTURE_COPY_LOCATION destinationLocation = GetSubresourceLocation(destination);
+	const D3D12_TEXTURE_COPY_LOCATION sourceLocation = GetFootprintLocation(source, footprint);
+	if (sourceBox)
+	{
+		const D3D12_BOX box{
+			.left = sourceBox->left,
+			.top = sourceBox->top,
+			.front = sourceBox->front,
+			.right = sourceBox->right,
+			.bottom = sourceBox->bottom,
+			.back = sourceBox->back };
+		mCommandList->CopyTextureRegion(&destinationLocation, x, y, z, &sourceLocation, &box);
+	}
+	else
+	{
+		mCommandList->CopyTextureRegion(&destinationLocation, x, y, z, &sourceLocation, nullptr);
+	}
+}
+
+void D3D12CommandList::CopyTextureToBuffer(Resource* destination, const BufferFootprint& footprint, Resource* source)
+{
+	const D3D12_TEXTURE_COPY_LOCATION destinationLocation = GetFootprintLocation(destination, footprint);
+	const D3D12_TEXTURE_COPY_LOCATION sourceLocation = GetSubresourceLocation(source);
+	mCommandList->CopyTextureRegion(&destinationLocation, 0, 0, 0, &sourceLocation, nullptr);
+}
+
+void D3D12CommandList::ClearRenderTarget(TextureResource* renderTarget, const float color[4])
+{
+	mCommandList->ClearRenderTargetView(renderTarget->mRtvDescriptor.mCpuHandle, color, 0, nullptr);
+}
+
+void D3D12CommandList::ClearDepth(TextureResource* depthStencil, float depth)
+{
+	mCommandList->ClearDepthStencilView(depthStencil->mDsvDescriptor.mCpuHandle, D3D12_CLEAR_FLAG_DEPTH, depth, 0, 0, nullptr);
+}
+
+void D3D12CommandList::SetRenderTargets(uint32_t count, TextureResource* const* renderTargets, TextureResource* depthStencil)
+{
+	D3D12_CPU_DESCRIPTOR_HANDLE handles[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT];
+	assert(count <= D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT);
+	for (uint32_t i = 0; i < count; i++)
+		handles[i] = renderTargets[i]->mRtvDescriptor.mCpuHandle;
+	mCommandList->OMSetRenderTargets(count, handles, false, depthStencil ? &depthStencil->mDsvDescriptor.mCpuHandle : nullptr);
+}
+
+void D3D12CommandList::SetDescriptorHeaps()
+{
+	ID3D12DescriptorHeap* heaps[] = { mDevice.GetSrvHeap(), mDevice.GetSamplerHeap() };
+	mCommandList->SetDescriptorHeaps(static_cast<uint32_t>(std::size(heaps)), heaps);
+}
+
+void D3D12CommandList::SetRootSignature(ID3D12RootSignature* rootSignature)
+{
+	mCommandList->SetGraphicsRootSignature(rootSignature);
+}
+
+void D3D12CommandList::SetPipelineState(ID3D12PipelineState* pipelineState)
+{
+	mCommandList->SetPipelineState(pipelineState);
+}
+
+void D3D12CommandList::SetRootConstantBuffer(uint32_t rootIndex, Resource* buffer)
+{
+	mCommandList->SetGraphicsRootConstantBufferView(rootIndex, buffer->mResource->GetGPUVirtualAddress());
+}
+
+void D3D12CommandList::SetViewport(const Viewport& viewport)
+{
+	const D3D12_VIEWPORT d3dViewport{
+		.TopLeftX = viewport.x,
+		.TopLeftY = viewport.y,
+		.Width = viewport.width,
+		.Height = viewport.height,
+		.MinDepth = viewport.minDepth,
+		.MaxDepth = viewport.maxDepth };
+	mCommandList->RSSetViewports(1, &d3dViewport);
+}
+
+void D3D12CommandList::SetScissorRect(const ScissorRect& scissorRect)
+{
+	const D3D12_RECT rect{
+		.left = scissorRect.left,
+		.top = scissorRect.top,
+		.right = scissorRect.right,
+		.bottom = scissorRect.bottom };
+	mCommandList->RSSetScissorRects(1, &rect);
+}
+
+void D3D12CommandList::SetPrimitiveTopology(PrimitiveTopology topology)
+{
+	mCommandList->IASetPrimitiveTopology(topology == PrimitiveTopology::TriangleStrip
+		? D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP
+		: D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+}
+
+void D3D12CommandList::Draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance)
+{
+	mCommandList->DrawInstanced(vertexCount, instanceCount, firstVertex, firstInstance);
+}
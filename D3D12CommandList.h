@@ -0,0 +1,36 @@
+#pragma once
+
+#include "RenderInterface.h"
+
+class Device;
+
+// RenderCommandList recording into the device's D3D12 command list
+class D3D12CommandList : public RenderCommandList {
+public:
+	D3D12CommandList(Device& device, ID3D12GraphicsCommandList5* commandList);
+
+	void ResourceBarrier(uint32_t count, const TransitionBarrier* barriers) override;
+
+	void CopyBufferRegion(Resource* destination, uint64_t destinationOffset, Resource* source, uint64_t sourceOffset, uint64_t size) override;
+	void CopyBufferToTexture(Resource* destination, uint32_t x, uint32_t y, uint32_t z,
+		Resource* source, const BufferFootprint& footprint, const CopyBox* sourceBox = nullptr) override;
+	void CopyTextureToBuffer(Resource* destination, const BufferFootprint& footprint, Resource* source) override;
+
+	void ClearRenderTarget(TextureResource* renderTarget, const float color[4]) override;
+	void ClearDepth(TextureResource* depthStencil, float depth) override;
+	void SetRenderTargets(uint32_t count, TextureResource* const* renderTargets, TextureResource* depthStencil) override;
+
+	void SetDescriptorHeaps() override;
+	void SetRootSignature(ID3D12RootSignature* rootSignature) override;
+	void SetPipelineState(ID3D12PipelineState* pipelineState) override;
+	void SetRootConstantBuffer(uint32_t rootIndex, Resource* buffer) override;
+	void SetViewport(const Viewport& viewport) override;
+	void SetScissorRect(const ScissorRect& scissorRect) override;
+	void SetPrimitiveTopology(PrimitiveTopology topology) override;
+
+	void Draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) override;
+
+private:
+	Device& mDevice;
+	ID3D12GraphicsCommandList5* mCommandList = nullptr;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+// Keeps retired objects alive until the GPU is past the fence value that was pending when they were
+// retired. Everything retired against the same fence value shares one batch, so a frame's worth of
+// garbage goes away in one step. Nothing in here talks to the GPU, the caller passes in fence values.
+template<typename T>
+class DeferredReleaseQueue {
+public:
+	// fenceValue is the first value whose completion guarantees the GPU no longer uses the item,
+	// values are expected to never go down
+	void Retire(T&& item, uint64_t fenceValue)
+	{
+		if (mBatches.empty() || mBatches.back().fenceValue != fenceValue)
+		{
+			Batch& batch = mBatches.emplace_back();
+			batch.fenceValue = fenceValue;
+			if (!mFreeItemVectors.empty())
+			{
+				batch.items = std::move(mFreeItemVectors.back());
+				mFreeItemVectors.pop_back();
+			}
+		}
+		mBatches.back().items.push_back(std::move(item));
+		mPendingCount++;
+	}
+
+	// onRelease(item) runs for every item whose fence value completed before it is destroyed,
+	// returns how many were released
+	template<typename Function>
+	size_t Release(uint64_t completedFenceValue, Function&& onRelease)
+	{
+		size_t releasedCount = 0;
+		while (!mBatches.empty() && mBatches.front().fenceValue <= completedFenceValue)
+		{
+			std::vector<T>& items = mBatches.front().items;
+			for (T& item : items)
+				onRelease(item);
+			releasedCount += items.size();
+
+			// the batch storage is reused, so steady churn doesn't allocate
+			items.clear();
+			mFreeItemVectors.push_back(std::move(items));
+			mBatches.pop_front();
+		}
+		mPendingCount -= releasedCount;
+		return releasedCount;
+	}
+
+	size_t Release(uint64_t completedFenceValue)
+	{
+		return Release(completedFenceValue, [](T&) {});
+	}
+
+	size_t GetPendingCount() const { return mPendingCount; }
+	bool IsEmpty() const { return mPendingCount == 0; }
+
+private:
+	struct Batch {
+		uint64_t fenceValue = 0;
+		std::vector<T> items;
+	};
+
+	std::deque<Batch> mBatches;
+	std::vector<std::vector<T>> mFreeItemVectors;
+	size_t mPendingCount = 0;
+};
@@ -22,13 +22,22 @@ DescriptorHeap::DescriptorHeap(ComPtr<ID3D12Device> device, D3D12_DESCRIPTOR_HEA
 	}
 
 	mDescriptorHandleSize = device->GetDescriptorHandleIncrementSize(mType);
+	mTrackedMemory = TrackedMemory(MemoryCategory::Descriptors, static_cast<uint64_t>(mDescriptorCount) * mDescriptorHandleSize);
 }
 
 Descriptor DescriptorHeap::GetDescriptor()
 {
-	assert(mCurrentHandle < mDescriptorCount && "Ran out of descriptor handles in heap");
-
-	uint32_t handleId = mCurrentHandle++;
+	uint32_t handleId;
+	if (!mFreeHandles.empty())
+	{
+		handleId = mFreeHandles.back();
+		mFreeHandles.pop_back();
+	}
+	else
+	{
+		assert(mCurrentHandle < mDescriptorCount && "Ran out of descriptor handles in heap");
+		handleId = mCurrentHandle++;
+	}
 
 	Descriptor descriptor{};
 	descriptor.mHeapIndex = handleId;
@@ -39,4 +48,13 @@ Descriptor DescriptorHeap::GetDescriptor()
 	}
 
 	return descriptor;
+}
+
+void DescriptorHeap::FreeDescriptor(const Descriptor& descriptor)
+{
+	if (descriptor.mHeapIndex == UINT_MAX)
+		return;
+
+	assert(descriptor.mHeapIndex < mCurrentHandle);
+	mFreeHandles.push_back(descriptor.mHeapIndex);
 }
\ No newline at end of file
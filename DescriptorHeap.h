@@ -2,6 +2,8 @@
 
 #include "Types.h"
 
+#include <vector>
+
 class DescriptorHeap {
 public:
 	DescriptorHeap(ComPtr<ID3D12Device> device, D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t count, bool isShaderVisible);
@@ -9,6 +11,8 @@ public:
 	ID3D12DescriptorHeap* GetHeap() { return mDescriptorHeap.Get(); }
 
 	Descriptor GetDescriptor();
+	// the slot is handed out again, so nothing may still be using the descriptor
+	void FreeDescriptor(const Descriptor& descriptor);
 
 private:
 	ComPtr<ID3D12DescriptorHeap> mDescriptorHeap = nullptr;
@@ -17,5 +21,7 @@ private:
 	uint32_t mDescriptorCount;
 	uint32_t mDescriptorHandleSize;
 	uint32_t mCurrentHandle;
+	std::vector<uint32_t> mFreeHandles;
 	bool mIsShaderVisible;
+	TrackedMemory mTrackedMemory;
 };
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "Device.h"
+#include "D3D12CommandList.h"
 #include "DescriptorHeap.h"
 #include "Queue.h"
 #include "Window.h"
@@ -24,6 +25,10 @@ Device::Device()
 Device::~Device()
 {
 	WaitForIdle();
+	if (mFrameLatencyWaitable)
+		CloseHandle(mFrameLatencyWaitable);
+	if (mSleepTimer)
+		CloseHandle(mSleepTimer);
 }
 
 void Device::WaitForIdle()
@@ -136,11 +141,13 @@ void Device::InitializeDeviceResources()
 		.Scaling = DXGI_SCALING_NONE,
 		.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD,
 		.AlphaMode = DXGI_ALPHA_MODE_UNSPECIFIED,
-		.Flags = 0 };
+		.Flags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT };
 
 	ComPtr<IDXGISwapChain1> swapChain = nullptr;
 	DX_ASSERT(mFactory->CreateSwapChainForHwnd(mGraphicsQueue->GetQueue(), Window::GetHwnd(), &swapChainDesc, nullptr, nullptr, &swapChain));
 	DX_ASSERT(swapChain->QueryInterface(__uuidof(IDXGISwapChain3), static_cast<void**>(&mSwapChain)));
+	DX_ASSERT(mSwapChain->SetMaximumFrameLatency(MAX_FRAME_LATENCY));
+	mFrameLatencyWaitable = mSwapChain->GetFrameLatencyWaitableObject();
 
 	for (uint32_t bufferIndex = 0; bufferIndex < NUM_BACK_BUFFERS; bufferIndex++)
 	{
@@ -171,13 +178,38 @@ void Device::InitializeDeviceResources()
 	}
 
 	DX_ASSERT(mDevice->CreateCommandList1(0, D3D12_COMMAND_LIST_TYPE_DIRECT, D3D12_COMMAND_LIST_FLAG_NONE, IID_PPV_ARGS(&mCommandList)));
+	mRenderCommandList = std::make_unique<D3D12CommandList>(*this, mCommandList.Get());
 
 	BufferDescription bufferDesc = {
 		.heapType = D3D12_HEAP_TYPE_UPLOAD,
-		.size = 1024 * 1024 * 32};
+		.size = UPLOAD_BUFFER_SIZE,
+		.memoryCategory = MemoryCategory::Upload };
 
 	mUploadBuffer = CreateBuffer(bufferDesc);
 	mUploadBuffer->mResource->Map(0, nullptr, reinterpret_cast<void**>(&mUploadBuffer->mMapped));
+
+	D3D12_QUERY_HEAP_DESC timestampHeapDesc{
+		.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP,
+		.Count = FRAMES_IN_FLIGHT * 2 };
+	DX_ASSERT(mDevice->CreateQueryHeap(&timestampHeapDesc, IID_PPV_ARGS(&mTimestampHeap)));
+	DX_ASSERT(mGraphicsQueue->GetQueue()->GetTimestampFrequency(&mTimestampFrequency));
+
+	BufferDescription timestampReadbackDesc{
+		.heapType = D3D12_HEAP_TYPE_READBACK,
+		.initialState = D3D12_RESOURCE_STATE_COPY_DEST,
+		.size = FRAMES_IN_FLIGHT * 2 * sizeof(uint64_t),
+		.memoryCategory = MemoryCategory::Readback };
+	mTimestampReadback = CreateBuffer(timestampReadbackDesc);
+	mTimestampReadback->mResource->Map(0, nullptr, &mTimestampReadback->mMapped);
+
+	LARGE_INTEGER performanceFrequency{};
+	QueryPerformanceFrequency(&performanceFrequency);
+	mPerformanceFrequency = static_cast<uint64_t>(performanceFrequency.QuadPart);
+	// the default timer only wakes up every few milliseconds, older Windows versions don't have the high resolution one
+	mSleepTimer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (!mSleepTimer)
+		mSleepTimer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+	mFramePacer.SetMinFrameInterval(MIN_FRAME_MILLISECONDS / 1000.0);
 }
 
 std::unique_ptr<BufferResource> Device::CreateBuffer(BufferDescription& bufferDesc, void* data)
@@ -195,7 +227,8 @@ std::unique_ptr<BufferResource> Device::CreateBuffer(BufferDescription& bufferDe
 		.MipLevels = 1,
 		.Format = bufferDesc.format,
 		.SampleDesc = {.Count = 1, .Quality = 0},
-		.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR };
+		.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+		.Flags = (bufferDesc.bufferDescriptor & DescriptorType::Uav) ? D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS : D3D12_RESOURCE_FLAG_NONE };
 
 	DX_ASSERT(mAllocator->CreateResource(
 		&allocDesc,
@@ -209,6 +242,7 @@ std::unique_ptr<BufferResource> Device::CreateBuffer(BufferDescription& bufferDe
 	buffer->mStride = bufferDesc.stride;
 	buffer->mCurrentState = bufferDesc.initialState;
 	buffer->mSize = desc.Width;
+	buffer->mTrackedMemory = TrackedMemory(bufferDesc.memoryCategory, buffer->mAllocation->GetSize());
 
 	uint32_t numElements = bufferDesc.stride > 0 ? (bufferDesc.size / bufferDesc.stride) : 1;
 
@@ -312,7 +346,16 @@ std::unique_ptr<TextureResource> Device::CreateTexture(TextureDescription& textu
 
 	texture->mDesc = desc;
 	texture->mCurrentState = textureDesc.initialState;
-	texture->mSize = desc.Width * desc.Height * desc.DepthOrArraySize; // also should add mip map size
+	// every mip (and array slice) counts, a 3D texture's subresources are its mips with all of their slices
+	const uint32_t subresourceCount = desc.MipLevels * (desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ? 1 : desc.DepthOrArraySize);
+	std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints(subresourceCount);
+	std::vector<UINT> rowCounts(subresourceCount);
+	std::vector<uint64_t> rowSizes(subresourceCount);
+	mDevice->GetCopyableFootprints(&desc, 0, subresourceCount, 0, footprints.data(), rowCounts.data(), rowSizes.data(), nullptr);
+	texture->mSize = 0;
+	for (uint32_t subresource = 0; subresource < subresourceCount; subresource++)
+		texture->mSize += rowSizes[subresource] * rowCounts[subresource] * footprints[subresource].Footprint.Depth;
+	texture->mTrackedMemory = TrackedMemory(textureDesc.memoryCategory, texture->mAllocation->GetSize());
 
 	if ((textureDesc.textureDescriptor & DescriptorType::Dsv) == DescriptorType::Dsv)
 	{
@@ -377,84 +420,170 @@ std::unique_ptr<TextureResource> Device::CreateTexture(TextureDescription& textu
 	return texture;
 }
 
+uint64_t Device::GetAvailableVideoMemory()
+{
+	D3D12MA::Budget localBudget{};
+	mAllocator->GetBudget(&localBudget, nullptr);
+	return localBudget.BudgetBytes > localBudget.UsageBytes ? localBudget.BudgetBytes - localBudget.UsageBytes : 0;
+}
+
+uint64_t Device::GetVideoMemoryOverBudget()
+{
+	D3D12MA::Budget localBudget{};
+	mAllocator->GetBudget(&localBudget, nullptr);
+	return localBudget.UsageBytes > localBudget.BudgetBytes ? localBudget.UsageBytes - localBudget.BudgetBytes : 0;
+}
+
+GpuMemoryStatistics Device::GetGpuMemoryStatistics()
+{
+	D3D12MA::Budget localBudget{};
+	mAllocator->GetBudget(&localBudget, nullptr);
+	D3D12MA::TotalStatistics statistics{};
+	mAllocator->CalculateStatistics(&statistics);
+	return {
+		.budgetBytes = localBudget.BudgetBytes,
+		.usageBytes = localBudget.UsageBytes,
+		.blockBytes = statistics.Total.Stats.BlockBytes,
+		.allocationBytes = statistics.Total.Stats.AllocationBytes,
+		.blockCount = statistics.Total.Stats.BlockCount,
+		.allocationCount = statistics.Total.Stats.AllocationCount };
+}
+
+UploadAllocation Device::AllocateUpload(uint64_t size, uint64_t alignment)
+{
+	constexpr uint64_t frameSliceSize = UPLOAD_BUFFER_SIZE / FRAMES_IN_FLIGHT;
+	const uint64_t sliceEnd = (mFrameIndex + 1) * frameSliceSize;
+
+	uint64_t offset = (mUploadOffset + alignment - 1) & ~(alignment - 1);
+	if (offset + size > sliceEnd)
+		return {};
+
+	mUploadOffset = offset + size;
+	return {
+		.mCpuAddress = static_cast<uint8_t*>(mUploadBuffer->mMapped) + offset,
+		.mOffset = offset };
+}
+
+RenderCommandList* Device::GetCommandList()
+{
+	return mRenderCommandList.get();
+}
+
+uint64_t Device::GetNextFenceValue() const
+{
+	return mGraphicsQueue->GetNextFenceValue();
+}
+
+uint64_t Device::GetCompletedFenceValue()
+{
+	return mGraphicsQueue->GetCompletedFenceValue();
+}
+
+void Device::Release(std::unique_ptr<BufferResource> buffer)
+{
+	if (buffer)
+		mReleaseQueue.Retire({ .mBuffer = std::move(buffer) }, mGraphicsQueue->GetNextFenceValue());
+}
+
+void Device::Release(std::unique_ptr<TextureResource> texture)
+{
+	if (texture)
+		mReleaseQueue.Retire({ .mTexture = std::move(texture) }, mGraphicsQueue->GetNextFenceValue());
+}
+
+void Device::FreeDescriptors(RetiredResource& resource)
+{
+	if (resource.mBuffer)
+	{
+		mSRVDescriptorHeap->FreeDescriptor(resource.mBuffer->mSrvDescriptor);
+		mSRVDescriptorHeap->FreeDescriptor(resource.mBuffer->mCbvDescriptor);
+		mSRVDescriptorHeap->FreeDescriptor(resource.mBuffer->mUavDescriptor);
+	}
+	if (resource.mTexture)
+	{
+		mSRVDescriptorHeap->FreeDescriptor(resource.mTexture->mSrvDescriptor);
+		mSRVDescriptorHeap->FreeDescriptor(resource.mTexture->mUavDescriptor);
+		mRTVDescriptorHeap->FreeDescriptor(resource.mTexture->mRtvDescriptor);
+		mDSVDescriptorHeap->FreeDescriptor(resource.mTexture->mDsvDescriptor);
+	}
+}
+
+void Device::WaitForNextFrame()
+{
+	WaitForSingleObjectEx(mFrameLatencyWaitable, 1000, TRUE);
+	ReadGpuFrameTimes();
+	SleepUntil(mFramePacer.GetNextFrameStart(GetTime()));
+	mFramePacer.OnFrameStarted(GetTime());
+}
+
 void Device::BeginFrame()
 {
 	mGraphicsQueue->WaitForQueueCpuBlocking(mFenceValues[mFrameIndex]);
+	// this frame index's timestamps are resolved again at the end of the frame
+	ReadGpuFrameTimes();
+	mReleaseQueue.Release(mGraphicsQueue->GetCompletedFenceValue(), [this](RetiredResource& resource) { FreeDescriptors(resource); });
+	mUploadOffset = mFrameIndex * (UPLOAD_BUFFER_SIZE / FRAMES_IN_FLIGHT);
 	mCommandAllocators[mFrameIndex]->Reset();
 	mCommandList->Reset(mCommandAllocators[mFrameIndex].Get(), nullptr);
+	mCommandList->EndQuery(mTimestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, mFrameIndex * 2);
 }
 
 void Device::EndFrame()
 {
+	mCommandList->EndQuery(mTimestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, mFrameIndex * 2 + 1);
+	mCommandList->ResolveQueryData(mTimestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, mFrameIndex * 2, 2,
+		mTimestampReadback->mResource.Get(), mFrameIndex * 2 * sizeof(uint64_t));
 	mGraphicsQueue->Submit(mCommandList.Get());
+	mFramePacer.OnFrameSubmitted(GetTime());
 
 	mSwapChain->Present(0, 0);
 
 	mFenceValues[mFrameIndex] = mGraphicsQueue->Signal();
+	mTimedFrames.push_back(mFrameIndex);
 	mFrameIndex = (mFrameIndex + 1) % FRAMES_IN_FLIGHT;
 }
 
-void Device::ImmediateUploadToGpu(Resource* resource, void* data)
+void Device::ReadGpuFrameTimes()
 {
-	uint64_t arraySize = resource->mDesc.DepthOrArraySize;
-	uint64_t mipLevels = resource->mDesc.MipLevels;
-	if (resource->mDesc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D)
+	const uint64_t completedFenceValue = mGraphicsQueue->GetCompletedFenceValue();
+	if (mTimedFrames.empty() || mFenceValues[mTimedFrames.front()] > completedFenceValue)
+		return;
+
+	// the GPU's end timestamp moved onto the CPU clock through a pair sampled at the same moment
+	uint64_t gpuCalibration = 0;
+	uint64_t cpuCalibration = 0;
+	DX_ASSERT(mGraphicsQueue->GetQueue()->GetClockCalibration(&gpuCalibration, &cpuCalibration));
+	const double cpuCalibrationTime = static_cast<double>(cpuCalibration) / mPerformanceFrequency;
+	while (!mTimedFrames.empty() && mFenceValues[mTimedFrames.front()] <= completedFenceValue)
 	{
-		arraySize = 1;
+		const uint64_t* timestamps = static_cast<const uint64_t*>(mTimestampReadback->mMapped) + mTimedFrames.front() * 2;
+		const double gpuSeconds = static_cast<double>(timestamps[1] - timestamps[0]) / mTimestampFrequency;
+		const double completionTime = cpuCalibrationTime - static_cast<double>(static_cast<int64_t>(gpuCalibration - timestamps[1])) / mTimestampFrequency;
+		mFramePacer.OnFrameCompleted(completionTime, gpuSeconds);
+		mTimedFrames.pop_front();
 	}
+}
 
-	static constexpr uint32_t MAX_TEXTURE_SUBRESOURCE_COUNT = 32;
-	UINT numRows[MAX_TEXTURE_SUBRESOURCE_COUNT];
-	uint64_t rowSizesInBytes[MAX_TEXTURE_SUBRESOURCE_COUNT];
-	std::array<D3D12_PLACED_SUBRESOURCE_FOOTPRINT, MAX_TEXTURE_SUBRESOURCE_COUNT> subResourceLayouts{}; // this should be a part of TextureResource
-	uint32_t numSubresources = static_cast<uint32_t>(mipLevels * arraySize); // so basically, if its a 3d texture, you don't want to multiply by depthOrArraySize, otherwise yes
-	uint64_t dataSize = 0;
-
-	mDevice->GetCopyableFootprints(&resource->mDesc, 0, numSubresources, 0, subResourceLayouts.data(), numRows, rowSizesInBytes, &dataSize);
+double Device::GetTime() const
+{
+	LARGE_INTEGER counter{};
+	QueryPerformanceCounter(&counter);
+	return static_cast<double>(counter.QuadPart) / mPerformanceFrequency;
+}
 
-	uint8_t* sourceSubResourceMemory = static_cast<uint8_t*>(data);
-	for (uint64_t arrayIndex = 0; arrayIndex < arraySize; arrayIndex++)
+void Device::SleepUntil(double time)
+{
+	// the timer can wake up late by a fraction of a millisecond, the last stretch is spun instead
+	constexpr double SPIN_SECONDS = 0.001;
+	const double sleepSeconds = time - GetTime() - SPIN_SECONDS;
+	if (sleepSeconds > 0.0 && mSleepTimer)
 	{
-		for (uint64_t mipIndex = 0; mipIndex < mipLevels; mipIndex++)
-		{
-			const uint64_t subResourceIndex = mipIndex + (arrayIndex * mipLevels);
-			const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& subResourceLayout = subResourceLayouts[subResourceIndex];
-			const uint64_t subResourceHeight = numRows[subResourceIndex];
-			const uint64_t subResourcePitch = utils::AlignU32(subResourceLayout.Footprint.RowPitch, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
-			const uint64_t subResourceDepth = subResourceLayout.Footprint.Depth;
-			uint8_t* destinationSubResourceMemory = static_cast<uint8_t*>(mUploadBuffer->mMapped) + subResourceLayout.Offset;
-
-			for (uint64_t sliceIndex = 0; sliceIndex < subResourceDepth; sliceIndex++)
-			{
-				for (uint64_t height = 0; height < subResourceHeight; height++)
-				{
-					memcpy(destinationSubResourceMemory, sourceSubResourceMemory, subResourcePitch);
-					destinationSubResourceMemory += subResourcePitch;
-					sourceSubResourceMemory += (resource->mDesc.Width * sizeof(uint8_t)); // this is not good enough for generic use obviously (need a stride variable attached to resource)
-				}
-			}
-		}
+		// negative due times are relative, in 100 ns units
+		LARGE_INTEGER dueTime{};
+		dueTime.QuadPart = -static_cast<LONGLONG>(sleepSeconds * 10000000.0);
+		if (SetWaitableTimerEx(mSleepTimer, &dueTime, 0, nullptr, nullptr, nullptr, 0))
+			WaitForSingleObject(mSleepTimer, INFINITE);
 	}
-
-
-
-	mCommandAllocators[mFrameIndex]->Reset();
-	mCommandList->Reset(mCommandAllocators[mFrameIndex].Get(), nullptr);
-
-	D3D12_TEXTURE_COPY_LOCATION destinationLocation = {};
-	destinationLocation.pResource = resource->mResource.Get();
-	destinationLocation.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-	destinationLocation.SubresourceIndex = 0;
-
-	D3D12_TEXTURE_COPY_LOCATION sourceLocation = {};
-	sourceLocation.pResource = mUploadBuffer->mResource.Get();
-	sourceLocation.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
-	sourceLocation.PlacedFootprint = subResourceLayouts[0];
-
-	memcpy(mUploadBuffer->mMapped, data, resource->mSize);
-	mCommandList->CopyTextureRegion(&destinationLocation, 0, 0, 0, &sourceLocation, nullptr);
-
-	mGraphicsQueue->Submit(mCommandList.Get());
-	mFenceValues[mFrameIndex] = mGraphicsQueue->Signal();
-	mGraphicsQueue->WaitForQueueCpuBlocking(mFenceValues[mFrameIndex]);
-}
\ No newline at end of file
+	while (GetTime() < time)
+		YieldProcessor();
+}
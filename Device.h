@@ -2,20 +2,30 @@
 
 #include "Types.h"
 #include "DescriptorHeap.h"
+#include "DeferredReleaseQueue.h"
+#include "FramePacer.h"
 
 #include <memory>
 #include <array>
+#include <deque>
 
 namespace D3D12MA {
 	class Allocator;
 }
 
 class Queue;
+class D3D12CommandList;
+class RenderCommandList;
 class Camera;/*TEMP*/
 struct Input;
 
 constexpr uint32_t FRAMES_IN_FLIGHT = 2;
+// presents the swap chain lets the CPU queue, the frame pacer keeps the queue shorter than that when the GPU is the bottleneck
+constexpr uint32_t MAX_FRAME_LATENCY = 2;
+// 0 leaves the frame rate uncapped, 1000 / 60 stops the GPU from running flat out for frames nobody sees
+constexpr float MIN_FRAME_MILLISECONDS = 0.0f;
 constexpr uint32_t NUM_BACK_BUFFERS = 3;
+constexpr uint32_t UPLOAD_BUFFER_SIZE = 1024 * 1024 * 32;
 
 class Device {
 public:
@@ -27,19 +37,55 @@ public:
 	TextureResource& GetCurrentBackbuffer() { return mBackBuffers[mSwapChain->GetCurrentBackBufferIndex()]; }
 	ID3D12DescriptorHeap* GetSrvHeap() { return mSRVDescriptorHeap->GetHeap(); }
 	ID3D12DescriptorHeap* GetSamplerHeap() { return mSamplerDescriptorHeap->GetHeap(); }
+	BufferResource* GetUploadBuffer() { return mUploadBuffer.get(); }
+	// records into mCommandList
+	RenderCommandList* GetCommandList();
+	uint32_t GetFrameIndex() const { return mFrameIndex; }
 	void WaitForIdle();
 
+	// the fence value the frame being recorded signals when the GPU finishes it
+	uint64_t GetNextFenceValue() const;
+	uint64_t GetCompletedFenceValue();
+
+	// bytes of local video memory left before going over the budget the OS gives us
+	uint64_t GetAvailableVideoMemory();
+	// bytes of local video memory used beyond that budget, 0 while we're within it
+	uint64_t GetVideoMemoryOverBudget();
+	// walks every allocator block, meant for reports rather than every frame
+	GpuMemoryStatistics GetGpuMemoryStatistics();
+
 	std::unique_ptr<BufferResource> CreateBuffer(BufferDescription& desc, void* data = nullptr);
 	std::unique_ptr<TextureResource> CreateTexture(TextureDescription& desc);
+
+	// Destroys the resource and frees its descriptors once the GPU finished the frame being recorded,
+	// so replacing a resource doesn't need a WaitForIdle
+	void Release(std::unique_ptr<BufferResource> buffer);
+	void Release(std::unique_ptr<TextureResource> texture);
 	
+	// Blocks until the swap chain has room for another frame, then sleeps until the frame pacer's
+	// start so the frame reaches the GPU just as it runs out of work. Call before sampling input.
+	void WaitForNextFrame();
 	void BeginFrame();
 	void EndFrame();
 
-	void ImmediateUploadToGpu(Resource* resource, void* data);
+	// Linear allocation from the current frame's slice of the upload buffer, only valid until the
+	// frame is submitted. Returns an empty allocation when the slice is used up.
+	UploadAllocation AllocateUpload(uint64_t size, uint64_t alignment = D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
 
 private:
+	struct RetiredResource {
+		std::unique_ptr<BufferResource> mBuffer = nullptr;
+		std::unique_ptr<TextureResource> mTexture = nullptr;
+	};
+
 	void InitializeDevice();
 	void InitializeDeviceResources();
+	void FreeDescriptors(RetiredResource& resource);
+	// hands the GPU time of every finished frame to the frame pacer
+	void ReadGpuFrameTimes();
+	// seconds on the performance counter, the clock the GPU timestamps are calibrated against
+	double GetTime() const;
+	void SleepUntil(double time);
 
 
 public:
@@ -58,9 +104,24 @@ private:
 	std::unique_ptr<DescriptorHeap> mDSVDescriptorHeap = nullptr;
 	std::unique_ptr<DescriptorHeap> mSamplerDescriptorHeap = nullptr;
 	std::unique_ptr<Queue> mGraphicsQueue = nullptr;
+	std::unique_ptr<D3D12CommandList> mRenderCommandList = nullptr;
 
 	std::array<uint64_t, FRAMES_IN_FLIGHT> mFenceValues;
 	std::array<TextureResource, NUM_BACK_BUFFERS> mBackBuffers;
 
 	std::unique_ptr<BufferResource> mUploadBuffer = nullptr;
+	uint64_t mUploadOffset = 0;
+
+	DeferredReleaseQueue<RetiredResource> mReleaseQueue;
+
+	FramePacer mFramePacer{ MAX_FRAME_LATENCY };
+	HANDLE mFrameLatencyWaitable = nullptr;
+	HANDLE mSleepTimer = nullptr;
+	uint64_t mPerformanceFrequency = 1;
+	// a timestamp at the start and end of every frame in flight, resolved into the readback at the end of the frame
+	ComPtr<ID3D12QueryHeap> mTimestampHeap = nullptr;
+	std::unique_ptr<BufferResource> mTimestampReadback = nullptr;
+	uint64_t mTimestampFrequency = 1;
+	// frame indices submitted with timestamps the pacer hasn't seen yet, oldest first
+	std::deque<uint32_t> mTimedFrames;
 };
\ No newline at end of file
@@ -0,0 +1,854 @@
+#include "DicomLoader.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <tuple>
+
+static constexpr uint32_t MakeTag(uint16_t group, uint16_t element) { return (static_cast<uint32_t>(group) << 16) | element; }
+
+static constexpr uint32_t TAG_TRANSFER_SYNTAX = MakeTag(0x0002, 0x0010);
+static constexpr uint32_t TAG_SERIES_UID = MakeTag(0x0020, 0x000E);
+static constexpr uint32_t TAG_INSTANCE_NUMBER = MakeTag(0x0020, 0x0013);
+static constexpr uint32_t TAG_IMAGE_POSITION = MakeTag(0x0020, 0x0032);
+static constexpr uint32_t TAG_IMAGE_ORIENTATION = MakeTag(0x0020, 0x0037);
+static constexpr uint32_t TAG_SAMPLES_PER_PIXEL = MakeTag(0x0028, 0x0002);
+static constexpr uint32_t TAG_FRAME_COUNT = MakeTag(0x0028, 0x0008);
+static constexpr uint32_t TAG_ROWS = MakeTag(0x0028, 0x0010);
+static constexpr uint32_t TAG_COLUMNS = MakeTag(0x0028, 0x0011);
+static constexpr uint32_t TAG_PIXEL_SPACING = MakeTag(0x0028, 0x0030);
+static constexpr uint32_t TAG_BITS_ALLOCATED = MakeTag(0x0028, 0x0100);
+static constexpr uint32_t TAG_BITS_STORED = MakeTag(0x0028, 0x0101);
+static constexpr uint32_t TAG_PIXEL_REPRESENTATION = MakeTag(0x0028, 0x0103);
+static constexpr uint32_t TAG_WINDOW_CENTER = MakeTag(0x0028, 0x1050);
+static constexpr uint32_t TAG_WINDOW_WIDTH = MakeTag(0x0028, 0x1051);
+static constexpr uint32_t TAG_RESCALE_INTERCEPT = MakeTag(0x0028, 0x1052);
+static constexpr uint32_t TAG_RESCALE_SLOPE = MakeTag(0x0028, 0x1053);
+static constexpr uint32_t TAG_PIXEL_DATA = MakeTag(0x7FE0, 0x0010);
+static constexpr uint32_t TAG_ITEM = MakeTag(0xFFFE, 0xE000);
+static constexpr uint32_t TAG_SEQUENCE_DELIMITER = MakeTag(0xFFFE, 0xE0DD);
+static constexpr uint32_t UNDEFINED_LENGTH = 0xFFFFFFFF;
+
+// header values are small, anything bigger than this is skipped without reading it
+static constexpr uint32_t MAX_HEADER_VALUE_SIZE = 1024;
+
+// everything the scan needs from one file before the slices are grouped into series
+struct SliceHeader {
+	DicomSlice slice;
+	std::string seriesUid;
+	uint32_t rows = 0;
+	uint32_t columns = 0;
+	uint32_t samplesPerPixel = 1;
+	uint32_t frameCount = 1;
+	uint32_t bitsAllocated = 0;
+	uint32_t bitsStored = 0;
+	bool isSigned = false;
+	bool hasPosition = false;
+	bool hasOrientation = false;
+	float imagePosition[3] = {};
+	float imageOrientation[6] = {};
+	float pixelSpacing[2] = { 1.0f, 1.0f };
+	bool hasWindow = false;
+	float windowCenter = 0.0f;
+	float windowWidth = 0.0f;
+};
+
+static std::string TrimValue(const std::string& value)
+{
+	const size_t end = value.find_last_not_of(std::string(" \0", 2));
+	const size_t begin = value.find_first_not_of(' ');
+	return end == std::string::npos ? std::string() : value.substr(begin, end - begin + 1);
+}
+
+// backslash separated decimal strings, returns how many were parsed
+static uint32_t ParseDecimals(const std::string& value, float* values, uint32_t maxCount)
+{
+	uint32_t count = 0;
+	const char* text = value.c_str();
+	while (count < maxCount && *text != '\0')
+	{
+		char* end = nullptr;
+		const float parsed = std::strtof(text, &end);
+		if (end == text)
+			break;
+		values[count++] = parsed;
+		text = end;
+		while (*text == ' ')
+			text++;
+		if (*text != '\\')
+			break;
+		text++;
+	}
+	return count;
+}
+
+static uint16_t ReadUint16(const std::string& value)
+{
+	uint16_t result = 0;
+	if (value.size() >= sizeof(result))
+		memcpy(&result, value.data(), sizeof(result));
+	return result;
+}
+
+static void ParseHeaderValue(uint32_t tag, const std::string& value, SliceHeader& header)
+{
+	float decimal = 0.0f;
+	switch (tag)
+	{
+	case TAG_SERIES_UID: header.seriesUid = TrimValue(value); break;
+	case TAG_INSTANCE_NUMBER: header.slice.instanceNumber = std::atoi(TrimValue(value).c_str()); break;
+	case TAG_IMAGE_POSITION: header.hasPosition = ParseDecimals(value, header.imagePosition, 3) == 3; break;
+	case TAG_IMAGE_ORIENTATION: header.hasOrientation = ParseDecimals(value, header.imageOrientation, 6) == 6; break;
+	case TAG_SAMPLES_PER_PIXEL: header.samplesPerPixel = ReadUint16(value); break;
+	case TAG_FRAME_COUNT: header.frameCount = std::max(1, std::atoi(TrimValue(value).c_str())); break;
+	case TAG_ROWS: header.rows = ReadUint16(value); break;
+	case TAG_COLUMNS: header.columns = ReadUint16(value); break;
+	case TAG_PIXEL_SPACING: ParseDecimals(value, header.pixelSpacing, 2); break;
+	case TAG_BITS_ALLOCATED: header.bitsAllocated = ReadUint16(value); break;
+	case TAG_BITS_STORED: header.bitsStored = ReadUint16(value); break;
+	case TAG_PIXEL_REPRESENTATION: header.isSigned = ReadUint16(value) != 0; break;
+	// several windows may be listed, the first one is the default
+	case TAG_WINDOW_CENTER: header.hasWindow = ParseDecimals(value, &header.windowCenter, 1) == 1; break;
+	case TAG_WINDOW_WIDTH: ParseDecimals(value, &header.windowWidth, 1); break;
+	case TAG_RESCALE_INTERCEPT: if (ParseDecimals(value, &decimal, 1) == 1) header.slice.rescaleIntercept = decimal; break;
+	case TAG_RESCALE_SLOPE: if (ParseDecimals(value, &decimal, 1) == 1 && decimal != 0.0f) header.slice.rescaleSlope = decimal; break;
+	}
+}
+
+static bool IsHeaderTag(uint32_t tag)
+{
+	switch (tag)
+	{
+	case TAG_TRANSFER_SYNTAX: case TAG_SERIES_UID: case TAG_INSTANCE_NUMBER: case TAG_IMAGE_POSITION: case TAG_IMAGE_ORIENTATION:
+	case TAG_SAMPLES_PER_PIXEL: case TAG_FRAME_COUNT: case TAG_ROWS: case TAG_COLUMNS: case TAG_PIXEL_SPACING: case TAG_BITS_ALLOCATED:
+	case TAG_BITS_STORED: case TAG_PIXEL_REPRESENTATION: case TAG_WINDOW_CENTER: case TAG_WINDOW_WIDTH: case TAG_RESCALE_INTERCEPT:
+	case TAG_RESCALE_SLOPE:
+		return true;
+	}
+	return false;
+}
+
+// explicit VRs with a 4 byte length after 2 reserved bytes
+static bool IsLongVr(const char vr[2])
+{
+	static constexpr const char* LONG_VRS[] = { "OB", "OD", "OF", "OL", "OV", "OW", "SQ", "SV", "UC", "UN", "UR", "UT", "UV" };
+	for (const char* longVr : LONG_VRS)
+	{
+		if (vr[0] == longVr[0] && vr[1] == longVr[1])
+			return true;
+	}
+	return false;
+}
+
+// little endian syntaxes only, big endian and deflated data sets are left out like the lossy codecs
+static bool GetEncoding(const std::string& transferSyntax, bool& isExplicit, DicomEncoding& encoding)
+{
+	isExplicit = true;
+	if (transferSyntax.empty() || transferSyntax == "1.2.840.10008.1.2")
+		isExplicit = false;
+	else if (transferSyntax == "1.2.840.10008.1.2.1")
+		encoding = DicomEncoding::Native;
+	else if (transferSyntax == "1.2.840.10008.1.2.5")
+		encoding = DicomEncoding::Rle;
+	else if (transferSyntax == "1.2.840.10008.1.2.4.57" || transferSyntax == "1.2.840.10008.1.2.4.70")
+		encoding = DicomEncoding::JpegLossless;
+	else
+		return false;
+	return true;
+}
+
+template<typename T>
+static bool ReadValue(std::ifstream& file, T& value)
+{
+	return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+// the fragments of an encapsulated frame, after the basic offset table
+static bool ReadFragments(std::ifstream& file, DicomSlice& slice)
+{
+	bool isOffsetTable = true;
+	while (true)
+	{
+		uint16_t tagParts[2];
+		uint32_t length = 0;
+		if (!ReadValue(file, tagParts) || !ReadValue(file, length))
+			return false;
+		const uint32_t tag = MakeTag(tagParts[0], tagParts[1]);
+		if (tag == TAG_SEQUENCE_DELIMITER)
+			return !slice.pixelOffsets.empty();
+		if (tag != TAG_ITEM || length == UNDEFINED_LENGTH)
+			return false;
+		if (!isOffsetTable)
+		{
+			slice.pixelOffsets.push_back(static_cast<uint64_t>(file.tellg()));
+			slice.pixelSizes.push_back(length);
+		}
+		isOffsetTable = false;
+		file.seekg(length, std::ios::cur);
+	}
+}
+
+// Walks the data elements up to the pixel data. Values inside sequences are skipped, items of
+// undefined length sequences are walked through and only counted so their tags aren't taken
+// for the slice's own.
+static bool ReadSliceHeader(const std::filesystem::path& path, SliceHeader& header)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	header.slice.path = path;
+	char preamble[132];
+	bool isMeta = file.read(preamble, sizeof(preamble)) && memcmp(preamble + 128, "DICM", 4) == 0;
+	bool isExplicit = isMeta;
+	if (!isMeta)
+	{
+		// files without the part 10 header are implicit little endian from the start
+		file.clear();
+		file.seekg(0);
+	}
+
+	std::string transferSyntax;
+	uint32_t sequenceDepth = 0;
+	while (true)
+	{
+		uint16_t tagParts[2];
+		if (!ReadValue(file, tagParts))
+			return false;
+		const uint32_t tag = MakeTag(tagParts[0], tagParts[1]);
+
+		// the transfer syntax takes over after the meta group
+		if (isMeta && tagParts[0] != 0x0002)
+		{
+			isMeta = false;
+			if (!GetEncoding(transferSyntax, isExplicit, header.slice.encoding))
+				return false;
+		}
+
+		uint32_t length = 0;
+		if (tagParts[0] == 0xFFFE)
+		{
+			if (!ReadValue(file, length))
+				return false;
+			if (tag == TAG_SEQUENCE_DELIMITER && sequenceDepth > 0)
+				sequenceDepth--;
+			continue;
+		}
+		if (isExplicit)
+		{
+			char vr[2];
+			if (!ReadValue(file, vr))
+				return false;
+			if (IsLongVr(vr))
+			{
+				uint16_t reserved = 0;
+				if (!ReadValue(file, reserved) || !ReadValue(file, length))
+					return false;
+			}
+			else
+			{
+				uint16_t shortLength = 0;
+				if (!ReadValue(file, shortLength))
+					return false;
+				length = shortLength;
+			}
+		}
+		else if (!ReadValue(file, length))
+		{
+			return false;
+		}
+
+		if (tag == TAG_PIXEL_DATA && sequenceDepth == 0)
+		{
+			if (length == UNDEFINED_LENGTH)
+				return header.slice.encoding != DicomEncoding::Native && ReadFragments(file, header.slice);
+			header.slice.pixelOffsets = { static_cast<uint64_t>(file.tellg()) };
+			header.slice.pixelSizes = { length };
+			return header.slice.encoding == DicomEncoding::Native;
+		}
+		if (length == UNDEFINED_LENGTH)
+		{
+			sequenceDepth++;
+		}
+		else if (sequenceDepth == 0 && length <= MAX_HEADER_VALUE_SIZE && IsHeaderTag(tag))
+		{
+			std::string value(length, '\0');
+			if (!file.read(value.data(), length))
+				return false;
+			if (tag == TAG_TRANSFER_SYNTAX)
+				transferSyntax = TrimValue(value);
+			else
+				ParseHeaderValue(tag, value, header);
+		}
+		else
+		{
+			file.seekg(length, std::ios::cur);
+		}
+	}
+}
+
+static bool IsSupported(const SliceHeader& header)
+{
+	return header.samplesPerPixel == 1 && header.frameCount == 1 && header.rows > 0 && header.columns > 0 &&
+		(header.bitsAllocated == 8 || header.bitsAllocated == 16) && header.bitsStored > 0 && header.bitsStored <= header.bitsAllocated;
+}
+
+std::optional<DicomSeries> DicomLoader::Scan(const std::filesystem::path& directory)
+{
+	std::vector<std::filesystem::path> paths;
+	std::error_code error;
+	for (const std::filesystem::directory_entry& entry : std::filesystem::recursive_directory_iterator(directory, error))
+	{
+		if (entry.is_regular_file())
+			paths.push_back(entry.path());
+	}
+	if (paths.empty())
+		return std::nullopt;
+
+	std::vector<SliceHeader> headers(paths.size());
+	std::vector<uint8_t> isValid(paths.size(), 0);
+	ThreadPool::Get().ParallelFor(static_cast<uint32_t>(paths.size()), [&](uint32_t file) {
+		isValid[file] = ReadSliceHeader(paths[file], headers[file]) && IsSupported(headers[file]);
+	});
+
+	// slices of a series share its uid and their pixel layout, the biggest one is loaded
+	using SeriesKey = std::tuple<std::string, uint32_t, uint32_t, uint32_t, uint32_t, bool>;
+	std::map<SeriesKey, std::vector<uint32_t>> seriesFiles;
+	for (uint32_t file = 0; file < headers.size(); file++)
+	{
+		const SliceHeader& header = headers[file];
+		if (isValid[file])
+			seriesFiles[{ header.seriesUid, header.rows, header.columns, header.bitsAllocated, header.bitsStored, header.isSigned }].push_back(file);
+	}
+	if (seriesFiles.empty())
+		return std::nullopt;
+	const std::vector<uint32_t>& files = std::max_element(seriesFiles.begin(), seriesFiles.end(),
+		[](const auto& a, const auto& b) { return a.second.size() < b.second.size(); })->second;
+
+	const SliceHeader& first = headers[files.front()];
+	DicomSeries series{
+		.seriesUid = first.seriesUid,
+		.slices = {},
+		.dimensions = { .width = first.columns, .height = first.rows, .depth = static_cast<uint32_t>(files.size()) },
+		.spacing = { first.pixelSpacing[1], first.pixelSpacing[0], 1.0f },
+		.bitsAllocated = first.bitsAllocated,
+		.bitsStored = first.bitsStored,
+		.isSigned = first.isSigned };
+
+	if (first.hasWindow && first.windowWidth > 0.0f)
+	{
+		series.windowCenter = first.windowCenter;
+		series.windowWidth = first.windowWidth;
+	}
+	else
+	{
+		// without a window the whole range the stored values can take is mapped
+		const float minStored = first.isSigned ? -std::ldexp(1.0f, first.bitsStored - 1) : 0.0f;
+		const float maxStored = first.isSigned ? std::ldexp(1.0f, first.bitsStored - 1) - 1.0f : std::ldexp(1.0f, first.bitsStored) - 1.0f;
+		const float a = minStored * first.slice.rescaleSlope + first.slice.rescaleIntercept;
+		const float b = maxStored * first.slice.rescaleSlope + first.slice.rescaleIntercept;
+		series.windowCenter = 0.5f * (a + b);
+		series.windowWidth = std::max(std::abs(b - a), 1.0f);
+	}
+
+	// sorted by the distance along the normal of the first slice, the instance number is all there is without positions
+	const bool hasPositions = first.hasOrientation && std::all_of(files.begin(), files.end(), [&](uint32_t file) { return headers[file].hasPosition; });
+	const float* rowDirection = first.imageOrientation;
+	const float* columnDirection = first.imageOrientation + 3;
+	const float normal[3] = {
+		rowDirection[1] * columnDirection[2] - rowDirection[2] * columnDirection[1],
+		rowDirection[2] * columnDirection[0] - rowDirection[0] * columnDirection[2],
+		rowDirection[0] * columnDirection[1] - rowDirection[1] * columnDirection[0] };
+	series.slices.reserve(files.size());
+	for (uint32_t file : files)
+	{
+		DicomSlice& slice = series.slices.emplace_back(std::move(headers[file].slice));
+		const float* position = headers[file].imagePosition;
+		slice.position = hasPositions ?
+			position[0] * normal[0] + position[1] * normal[1] + position[2] * normal[2] :
+			static_cast<float>(slice.instanceNumber);
+	}
+	std::sort(series.slices.begin(), series.slices.end(), [](const DicomSlice& a, const DicomSlice& b) {
+		return a.position != b.position ? a.position < b.position : a.instanceNumber < b.instanceNumber;
+	});
+
+	if (hasPositions && series.slices.size() > 1)
+	{
+		// the median gap, a missing slice or two doesn't throw it off
+		std::vector<float> gaps(series.slices.size() - 1);
+		for (size_t slice = 0; slice < gaps.size(); slice++)
+			gaps[slice] = series.slices[slice + 1].position - series.slices[slice].position;
+		std::nth_element(gaps.begin(), gaps.begin() + gaps.size() / 2, gaps.end());
+		if (gaps[gaps.size() / 2] > 0.0f)
+			series.spacing.z = gaps[gaps.size() / 2];
+	}
+
+	return series;
+}
+
+static bool ReadSlice(const DicomSeries& series, const DicomSlice& slice, uint8_t* destination)
+{
+	// reused by every slice the thread decodes
+	thread_local std::vector<uint8_t> encoded;
+	thread_local std::vector<uint16_t> decoded;
+
+	std::ifstream file(slice.path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+	const uint64_t encodedSize = std::accumulate(slice.pixelSizes.begin(), slice.pixelSizes.end(), uint64_t(0));
+	encoded.resize(encodedSize);
+	uint64_t offset = 0;
+	for (size_t fragment = 0; fragment < slice.pixelOffsets.size(); fragment++)
+	{
+		file.seekg(static_cast<std::streamoff>(slice.pixelOffsets[fragment]));
+		if (!file.read(reinterpret_cast<char*>(encoded.data() + offset), static_cast<std::streamsize>(slice.pixelSizes[fragment])))
+			return false;
+		offset += slice.pixelSizes[fragment];
+	}
+
+	const uint32_t sampleCount = series.dimensions.width * series.dimensions.height;
+	const uint8_t* stored = encoded.data();
+	uint32_t bitsAllocated = series.bitsAllocated;
+	switch (slice.encoding)
+	{
+	case DicomEncoding::Native:
+		if (encodedSize < static_cast<uint64_t>(sampleCount) * (bitsAllocated / 8))
+			return false;
+		break;
+	case DicomEncoding::Rle:
+		decoded.resize((static_cast<size_t>(sampleCount) * (bitsAllocated / 8) + 1) / 2);
+		if (!DicomLoader::DecodeRle(encoded.data(), encoded.size(), sampleCount, bitsAllocated / 8, reinterpret_cast<uint8_t*>(decoded.data())))
+			return false;
+		stored = reinterpret_cast<const uint8_t*>(decoded.data());
+		break;
+	case DicomEncoding::JpegLossless:
+		// always decoded to 16 bits, 8 bit precision just leaves the high bytes zero
+		decoded.resize(sampleCount);
+		if (!DicomLoader::DecodeJpegLossless(encoded.data(), encoded.size(), series.dimensions.width, series.dimensions.height, decoded.data()))
+			return false;
+		stored = reinterpret_cast<const uint8_t*>(decoded.data());
+		bitsAllocated = 16;
+		break;
+	}
+
+	// modality rescale and window in one multiply add
+	const float scale = slice.rescaleSlope * 255.0f / series.windowWidth;
+	const float offset255 = (slice.rescaleIntercept - (series.windowCenter - 0.5f * series.windowWidth)) * 255.0f / series.windowWidth;
+	DicomLoader::RescaleToBytes(stored, sampleCount, bitsAllocated, series.bitsStored, series.isSigned, scale, offset255, destination);
+	return true;
+}
+
+bool DicomLoader::Read(const DicomSeries& series, uint32_t firstSlice, uint32_t sliceCount, uint8_t* destination)
+{
+	assert(firstSlice + sliceCount <= series.slices.size());
+	assert(series.windowWidth > 0.0f);
+	const size_t sliceSize = static_cast<size_t>(series.dimensions.width) * series.dimensions.height;
+
+	// slices that fail to decode are left black, the rest of the volume is still usable
+	std::atomic<bool> isComplete = true;
+	ThreadPool::Get().ParallelFor(sliceCount, [&](uint32_t slice) {
+		uint8_t* sliceDestination = destination + slice * sliceSize;
+		if (!ReadSlice(series, series.slices[firstSlice + slice], sliceDestination))
+		{
+			memset(sliceDestination, 0, sliceSize);
+			isComplete = false;
+		}
+	});
+	return isComplete;
+}
+
+void DicomLoader::RescaleToBytes(const uint8_t* stored, uint32_t count, uint32_t bitsAllocated, uint32_t bitsStored, bool isSigned,
+	float scale, float offset, uint8_t* destination)
+{
+	assert((bitsAllocated == 8 || bitsAllocated == 16) && bitsStored > 0 && bitsStored <= bitsAllocated);
+	uint32_t i = 0;
+#ifdef VOLUME_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i storedMask = _mm_set1_epi16(static_cast<short>((1u << bitsStored) - 1));
+	// moves the sign bit of the stored value to the top of the 16 bit lane and back
+	const __m128i signShift = _mm_cvtsi32_si128(16 - bitsStored);
+	const __m128 scaleVector = _mm_set1_ps(scale);
+	const __m128 offsetVector = _mm_set1_ps(offset);
+	const __m128 maxVector = _mm_set1_ps(255.0f);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i values = bitsAllocated == 16 ?
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(stored + 2 * i)) :
+			_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(stored + i)), zero);
+
+		__m128i low;
+		__m128i high;
+		if (isSigned)
+		{
+			values = _mm_sra_epi16(_mm_sll_epi16(values, signShift), signShift);
+			low = _mm_srai_epi32(_mm_unpacklo_epi16(values, values), 16);
+			high = _mm_srai_epi32(_mm_unpackhi_epi16(values, values), 16);
+		}
+		else
+		{
+			values = _mm_and_si128(values, storedMask);
+			low = _mm_unpacklo_epi16(values, zero);
+			high = _mm_unpackhi_epi16(values, zero);
+		}
+
+		// clamped before the conversion, so nothing can overflow the packs
+		const __m128 lowScaled = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(low), scaleVector), offsetVector), _mm_setzero_ps()), maxVector);
+		const __m128 highScaled = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(high), scaleVector), offsetVector), _mm_setzero_ps()), maxVector);
+		const __m128i words = _mm_packs_epi32(_mm_cvtps_epi32(lowScaled), _mm_cvtps_epi32(highScaled));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(destination + i), _mm_packus_epi16(words, zero));
+	}
+#endif
+	const uint32_t unusedBits = 32 - bitsStored;
+	for (; i < count; i++)
+	{
+		const uint32_t raw = bitsAllocated == 16 ? stored[2 * i] | (stored[2 * i + 1] << 8) : stored[i];
+		const int32_t value = isSigned ?
+			static_cast<int32_t>(raw << unusedBits) >> unusedBits :
+			static_cast<int32_t>(raw & ((1u << bitsStored) - 1));
+		// rounds to nearest even like the SIMD conversion
+		destination[i] = static_cast<uint8_t>(std::lrint(std::clamp(value * scale + offset, 0.0f, 255.0f)));
+	}
+}
+
+bool DicomLoader::DecodeRle(const uint8_t* data, size_t size, uint32_t sampleCount, uint32_t bytesPerSample, uint8_t* samples)
+{
+	uint32_t header[16];
+	if (size < sizeof(header))
+		return false;
+	memcpy(header, data, sizeof(header));
+	if (header[0] != bytesPerSample)
+		return false;
+
+	// a segment holds one byte of every sample, the most significant one first
+	for (uint32_t segment = 0; segment < bytesPerSample; segment++)
+	{
+		const size_t end = segment + 1 < bytesPerSample ? header[segment + 2] : size;
+		size_t position = header[segment + 1];
+		if (position > end || end > size)
+			return false;
+
+		uint8_t* output = samples + (bytesPerSample - 1 - segment);
+		uint32_t written = 0;
+		while (written < sampleCount && position < end)
+		{
+			const int8_t control = static_cast<int8_t>(data[position++]);
+			if (control >= 0)
+			{
+				const uint32_t literalCount = control + 1;
+				if (position + literalCount > end || written + literalCount > sampleCount)
+					return false;
+				for (uint32_t literal = 0; literal < literalCount; literal++)
+					output[static_cast<size_t>(written++) * bytesPerSample] = data[position++];
+			}
+			else if (control != -128)
+			{
+				const uint32_t runLength = 1 - control;
+				if (position >= end || written + runLength > sampleCount)
+					return false;
+				const uint8_t value = data[position++];
+				for (uint32_t run = 0; run < runLength; run++)
+					output[static_cast<size_t>(written++) * bytesPerSample] = value;
+			}
+		}
+		if (written < sampleCount)
+			return false;
+	}
+	return true;
+}
+
+// codes of up to LOOKUP_BITS bits are found with one lookup, longer ones bit by bit
+static constexpr uint32_t LOOKUP_BITS = 9;
+
+struct HuffmanTable {
+	// (code length << 8) | symbol for every LOOKUP_BITS prefix, 0 where the code is longer
+	uint16_t lookup[1 << LOOKUP_BITS] = {};
+	int32_t maxCode[17] = {}; // largest code of every length, -1 if there is none
+	int32_t valueOffset[17] = {};
+	uint8_t values[256] = {};
+};
+
+static bool BuildHuffmanTable(const uint8_t counts[16], const uint8_t* values, uint32_t valueCount, HuffmanTable& table)
+{
+	memcpy(table.values, values, valueCount);
+	memset(table.lookup, 0, sizeof(table.lookup));
+	uint32_t code = 0;
+	uint32_t value = 0;
+	for (uint32_t length = 1; length <= 16; length++)
+	{
+		table.valueOffset[length] = static_cast<int32_t>(value) - static_cast<int32_t>(code);
+		for (uint32_t i = 0; i < counts[length - 1]; i++, code++, value++)
+		{
+			if (length > LOOKUP_BITS)
+				continue;
+			const uint32_t firstPrefix = code << (LOOKUP_BITS - length);
+			for (uint32_t prefix = 0; prefix < (1u << (LOOKUP_BITS - length)); prefix++)
+				table.lookup[firstPrefix + prefix] = static_cast<uint16_t>((length << 8) | values[value]);
+		}
+		table.maxCode[length] = counts[length - 1] > 0 ? static_cast<int32_t>(code) - 1 : -1;
+		if (code > (1u << length))
+			return false;
+		code <<= 1;
+	}
+	return true;
+}
+
+// entropy coded bits, without the stuffed zero bytes and reading zeros once a marker is reached
+struct BitReader {
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+	size_t position = 0;
+	uint64_t bits = 0;
+	uint32_t bitCount = 0;
+	bool isAtMarker = false;
+
+	void Fill()
+	{
+		while (bitCount <= 56)
+		{
+			uint32_t byte = 0;
+			if (!isAtMarker && position < size)
+			{
+				byte = data[position];
+				if (byte != 0xFF)
+				{
+					position++;
+				}
+				else if (position + 1 < size && data[position + 1] == 0x00)
+				{
+					position += 2;
+				}
+				else
+				{
+					isAtMarker = true;
+					byte = 0;
+				}
+			}
+			bits |= static_cast<uint64_t>(byte) << (56 - bitCount);
+			bitCount += 8;
+		}
+	}
+
+	uint32_t Peek(uint32_t count) const { return static_cast<uint32_t>(bits >> (64 - count)); }
+
+	void Skip(uint32_t count)
+	{
+		bits <<= count;
+		bitCount -= count;
+	}
+
+	// drops the padding bits before a restart marker and the marker itself
+	void Restart()
+	{
+		bits = 0;
+		bitCount = 0;
+		if (isAtMarker && position + 1 < size && data[position + 1] >= 0xD0 && data[position + 1] <= 0xD7)
+			position += 2;
+		isAtMarker = false;
+	}
+};
+
+static int32_t DecodeDifference(BitReader& reader, const HuffmanTable& table)
+{
+	reader.Fill();
+	uint32_t category = 0;
+	const uint16_t entry = table.lookup[reader.Peek(LOOKUP_BITS)];
+	if (entry != 0)
+	{
+		reader.Skip(entry >> 8);
+		category = entry & 0xFF;
+	}
+	else
+	{
+		uint32_t length = LOOKUP_BITS + 1;
+		for (; length <= 16; length++)
+		{
+			const int32_t code = static_cast<int32_t>(reader.Peek(length));
+			if (code <= table.maxCode[length])
+			{
+				reader.Skip(length);
+				category = table.values[table.valueOffset[length] + code];
+				break;
+			}
+		}
+		if (length > 16)
+			return INT32_MIN;
+	}
+
+	// the category is the bit count of the difference, 16 is 32768 without any bits following
+	if (category == 0)
+		return 0;
+	if (category == 16)
+		return 32768;
+	if (category > 16)
+		return INT32_MIN;
+	const int32_t difference = static_cast<int32_t>(reader.Peek(category));
+	reader.Skip(category);
+	return difference < (1 << (category - 1)) ? difference - (1 << category) + 1 : difference;
+}
+
+static bool DecodeLosslessScan(BitReader& reader, const HuffmanTable& table, uint32_t width, uint32_t height, uint32_t precision,
+	uint32_t predictor, uint32_t pointTransform, uint32_t restartInterval, uint16_t* samples)
+{
+	if (predictor < 1 || predictor > 7 || pointTransform >= precision)
+		return false;
+
+	// an interval starts from the middle of the range and predicts from the left for the rest of its first row
+	const int32_t initialPrediction = 1 << (precision - pointTransform - 1);
+	uint32_t restartCountdown = restartInterval;
+	uint32_t intervalRow = 0;
+	bool isIntervalStart = true;
+	for (uint32_t y = 0; y < height; y++)
+	{
+		uint16_t* row = samples + static_cast<size_t>(y) * width;
+		const uint16_t* above = row - width;
+		for (uint32_t x = 0; x < width; x++)
+		{
+			if (restartInterval > 0 && restartCountdown == 0)
+			{
+				reader.Restart();
+				restartCountdown = restartInterval;
+				intervalRow = y;
+				isIntervalStart = true;
+			}
+
+			int32_t prediction = 0;
+			if (isIntervalStart)
+				prediction = initialPrediction;
+			else if (y == intervalRow)
+				prediction = row[x - 1];
+			else if (x == 0)
+				prediction = above[x];
+			else
+			{
+				const int32_t a = row[x - 1];
+				const int32_t b = above[x];
+				const int32_t c = above[x - 1];
+				switch (predictor)
+				{
+				case 1: prediction = a; break;
+				case 2: prediction = b; break;
+				case 3: prediction = c; break;
+				case 4: prediction = a + b - c; break;
+				case 5: prediction = a + ((b - c) >> 1); break;
+				case 6: prediction = b + ((a - c) >> 1); break;
+				case 7: prediction = (a + b) >> 1; break;
+				}
+			}
+			isIntervalStart = false;
+
+			const int32_t difference = DecodeDifference(reader, table);
+			if (difference == INT32_MIN)
+				return false;
+			// the reconstruction wraps around modulo 2^16
+			row[x] = static_cast<uint16_t>(prediction + difference);
+			restartCountdown--;
+		}
+	}
+
+	if (pointTransform > 0)
+	{
+		for (size_t sample = 0; sample < static_cast<size_t>(width) * height; sample++)
+			samples[sample] = static_cast<uint16_t>(samples[sample] << pointTransform);
+	}
+	return true;
+}
+
+static uint32_t ReadBigEndian16(const uint8_t* data)
+{
+	return (data[0] << 8) | data[1];
+}
+
+bool DicomLoader::DecodeJpegLossless(const uint8_t* data, size_t size, uint32_t width, uint32_t height, uint16_t* samples)
+{
+	if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+		return false;
+
+	HuffmanTable tables[4];
+	bool isTableDefined[4] = {};
+	uint32_t precision = 0;
+	uint32_t restartInterval = 0;
+	size_t position = 2;
+	while (position + 4 <= size)
+	{
+		if (data[position] != 0xFF)
+			return false;
+		const uint8_t marker = data[position + 1];
+		if (marker == 0xFF)
+		{
+			// fill byte before a marker
+			position++;
+			continue;
+		}
+		position += 2;
+		if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+			continue;
+		if (marker == 0xD9)
+			return false;
+
+		const uint32_t length = ReadBigEndian16(data + position);
+		if (length < 2 || position + length > size)
+			return false;
+		const uint8_t* segment = data + position + 2;
+		const uint32_t segmentSize = length - 2;
+		switch (marker)
+		{
+		case 0xC3:
+		{
+			// lossless with huffman coding, a single component of the slice's size
+			if (segmentSize < 9)
+				return false;
+			precision = segment[0];
+			const uint32_t lines = ReadBigEndian16(segment + 1);
+			if (precision < 2 || precision > 16 || segment[5] != 1 || ReadBigEndian16(segment + 3) != width || (lines != height && lines != 0))
+				return false;
+			break;
+		}
+		case 0xC4:
+		{
+			uint32_t offset = 0;
+			while (offset + 17 <= segmentSize)
+			{
+				const uint32_t tableIndex = segment[offset] & 0x0F;
+				const uint8_t* counts = segment + offset + 1;
+				const uint32_t valueCount = std::accumulate(counts, counts + 16, 0u);
+				if (tableIndex > 3 || valueCount > 256 || offset + 17 + valueCount > segmentSize)
+					return false;
+				if (!BuildHuffmanTable(counts, counts + 16, valueCount, tables[tableIndex]))
+					return false;
+				isTableDefined[tableIndex] = true;
+				offset += 17 + valueCount;
+			}
+			break;
+		}
+		case 0xDD:
+			if (segmentSize < 2)
+				return false;
+			restartInterval = ReadBigEndian16(segment);
+			break;
+		case 0xDA:
+		{
+			if (precision == 0 || segmentSize < 6 || segment[0] != 1)
+				return false;
+			const uint32_t tableIndex = segment[2] >> 4;
+			if (tableIndex > 3 || !isTableDefined[tableIndex])
+				return false;
+			BitReader reader{ .data = data, .size = size, .position = position + length };
+			return DecodeLosslessScan(reader, tables[tableIndex], width, height, precision, segment[3], segment[5] & 0x0F, restartInterval, samples);
+		}
+		default:
+			// every other frame type is lossy or arithmetic coded
+			if ((marker >= 0xC0 && marker <= 0xCF) && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+				return false;
+			break;
+		}
+		position += length;
+	}
+	return false;
+}
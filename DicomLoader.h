@@ -0,0 +1,61 @@
+#pragma once
+
+#include "VolumeTypes.h"
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+enum class DicomEncoding : uint8_t {
+	Native,
+	Rle,
+	JpegLossless,
+};
+
+// one file of a series, what the scan took from its header
+struct DicomSlice {
+	std::filesystem::path path;
+	DicomEncoding encoding = DicomEncoding::Native;
+	// native pixel data, or the fragments of the single encapsulated frame
+	std::vector<uint64_t> pixelOffsets;
+	std::vector<uint64_t> pixelSizes;
+	float position = 0.0f; // along the slice normal
+	int32_t instanceNumber = 0;
+	float rescaleSlope = 1.0f;
+	float rescaleIntercept = 0.0f;
+};
+
+struct DicomSeries {
+	std::string seriesUid;
+	std::vector<DicomSlice> slices; // sorted along the slice normal
+	VolumeDimensions dimensions{};
+	Float3 spacing = { 1.0f, 1.0f, 1.0f }; // mm
+	uint32_t bitsAllocated = 16;
+	uint32_t bitsStored = 16;
+	bool isSigned = false;
+	// rescaled values mapped to 0..255, from the first slice or the range of the stored values
+	float windowCenter = 0.0f;
+	float windowWidth = 0.0f;
+};
+
+// Reads single frame grayscale DICOM series with native, RLE or lossless JPEG (process 14) pixel data.
+// Both the header scan and the decoding run on the thread pool, every slice decodes straight into its
+// place in the volume. Only depends on the standard library.
+class DicomLoader {
+public:
+	// the series with the most slices among the files of directory
+	static std::optional<DicomSeries> Scan(const std::filesystem::path& directory);
+
+	// sliceCount slices from firstSlice into destination, one byte per voxel through the series' window
+	static bool Read(const DicomSeries& series, uint32_t firstSlice, uint32_t sliceCount, uint8_t* destination);
+
+	// clamp(value * scale + offset) for every stored value, the reference the SIMD path follows
+	static void RescaleToBytes(const uint8_t* stored, uint32_t count, uint32_t bitsAllocated, uint32_t bitsStored, bool isSigned,
+		float scale, float offset, uint8_t* destination);
+
+	// lossless JPEG frame into 16 bit samples, false if it isn't a single component width x height image
+	static bool DecodeJpegLossless(const uint8_t* data, size_t size, uint32_t width, uint32_t height, uint16_t* samples);
+	// RLE frame into bytesPerSample little endian bytes per sample
+	static bool DecodeRle(const uint8_t* data, size_t size, uint32_t sampleCount, uint32_t bytesPerSample, uint8_t* samples);
+};
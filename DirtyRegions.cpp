@@ -0,0 +1,103 @@
+#include "DirtyRegions.h"
+
+#include <algorithm>
+
+void DirtyRegions::Initialize(const VolumeDimensions& volumeDimensions, uint32_t brickSize)
+{
+	mDimensions = volumeDimensions;
+	mBrickSize = brickSize;
+	mBrickDimensions = {
+		.width = (volumeDimensions.width + brickSize - 1) / brickSize,
+		.height = (volumeDimensions.height + brickSize - 1) / brickSize,
+		.depth = (volumeDimensions.depth + brickSize - 1) / brickSize };
+	mIsBrickDirty.assign(mBrickDimensions.GetVoxelCount(), 0);
+	mIsDirty = false;
+}
+
+void DirtyRegions::MarkDirty(const VolumeBox& box)
+{
+	const VolumeBox clipped = {
+		.minX = box.minX,
+		.minY = box.minY,
+		.minZ = box.minZ,
+		.maxX = std::min(box.maxX, mDimensions.width),
+		.maxY = std::min(box.maxY, mDimensions.height),
+		.maxZ = std::min(box.maxZ, mDimensions.depth) };
+	if (clipped.IsEmpty())
+		return;
+
+	for (uint32_t z = clipped.minZ / mBrickSize; z <= (clipped.maxZ - 1) / mBrickSize; z++)
+		for (uint32_t y = clipped.minY / mBrickSize; y <= (clipped.maxY - 1) / mBrickSize; y++)
+			for (uint32_t x = clipped.minX / mBrickSize; x <= (clipped.maxX - 1) / mBrickSize; x++)
+				mIsBrickDirty[mBrickDimensions.GetIndex(x, y, z)] = 1;
+
+	mIsDirty = true;
+	mStats.markedVoxels += clipped.GetVoxelCount();
+}
+
+std::vector<VolumeBox> DirtyRegions::Flush()
+{
+	std::vector<VolumeBox> boxes;
+	if (!mIsDirty)
+		return boxes;
+
+	auto isDirty = [&](uint32_t x, uint32_t y, uint32_t z) { return mIsBrickDirty[mBrickDimensions.GetIndex(x, y, z)] != 0; };
+
+	// grow each box along x, then y, then z for as long as every brick it would take in is dirty
+	for (uint32_t z = 0; z < mBrickDimensions.depth; z++)
+	{
+		for (uint32_t y = 0; y < mBrickDimensions.height; y++)
+		{
+			for (uint32_t x = 0; x < mBrickDimensions.width; x++)
+			{
+				if (!isDirty(x, y, z))
+					continue;
+
+				uint32_t endX = x + 1;
+				while (endX < mBrickDimensions.width && isDirty(endX, y, z))
+					endX++;
+
+				auto isRowDirty = [&](uint32_t rowY, uint32_t rowZ) {
+					for (uint32_t rowX = x; rowX < endX; rowX++)
+					{
+						if (!isDirty(rowX, rowY, rowZ))
+							return false;
+					}
+					return true;
+				};
+
+				uint32_t endY = y + 1;
+				while (endY < mBrickDimensions.height && isRowDirty(endY, z))
+					endY++;
+
+				uint32_t endZ = z + 1;
+				for (; endZ < mBrickDimensions.depth; endZ++)
+				{
+					bool isLayerDirty = true;
+					for (uint32_t layerY = y; layerY < endY && isLayerDirty; layerY++)
+						isLayerDirty = isRowDirty(layerY, endZ);
+					if (!isLayerDirty)
+						break;
+				}
+
+				for (uint32_t clearZ = z; clearZ < endZ; clearZ++)
+					for (uint32_t clearY = y; clearY < endY; clearY++)
+						std::fill_n(&mIsBrickDirty[mBrickDimensions.GetIndex(x, clearY, clearZ)], endX - x, 0);
+
+				const VolumeBox box = {
+					.minX = x * mBrickSize,
+					.minY = y * mBrickSize,
+					.minZ = z * mBrickSize,
+					.maxX = std::min(endX * mBrickSize, mDimensions.width),
+					.maxY = std::min(endY * mBrickSize, mDimensions.height),
+					.maxZ = std::min(endZ * mBrickSize, mDimensions.depth) };
+				boxes.push_back(box);
+				mStats.flushedVoxels += box.GetVoxelCount();
+			}
+		}
+	}
+
+	mStats.flushedBoxes += boxes.size();
+	mIsDirty = false;
+	return boxes;
+}
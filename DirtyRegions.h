@@ -0,0 +1,38 @@
+#pragma once
+
+#include "VolumeTypes.h"
+
+#include <vector>
+
+// Tracks which bricks of a volume were edited since the last flush. Flushing merges the dirty
+// bricks into as few brick aligned boxes as a greedy sweep finds, so an edit only re-uploads the
+// bricks it touched instead of the whole texture.
+class DirtyRegions {
+public:
+	struct Stats {
+		uint64_t markedVoxels = 0; // what the edits asked for
+		uint64_t flushedVoxels = 0; // what the brick aligned boxes cover, i.e. what gets uploaded
+		uint64_t flushedBoxes = 0;
+	};
+
+	void Initialize(const VolumeDimensions& volumeDimensions, uint32_t brickSize = BRICK_SIZE);
+
+	// clipped to the volume
+	void MarkDirty(const VolumeBox& box);
+	bool IsDirty() const { return mIsDirty; }
+
+	// boxes are clipped to the volume and don't overlap, the tracker is clean afterwards
+	std::vector<VolumeBox> Flush();
+
+	const Stats& GetStats() const { return mStats; }
+	void ResetStats() { mStats = {}; }
+
+private:
+	VolumeDimensions mDimensions{};
+	VolumeDimensions mBrickDimensions{};
+	uint32_t mBrickSize = BRICK_SIZE;
+	std::vector<uint8_t> mIsBrickDirty;
+	bool mIsDirty = false;
+
+	Stats mStats{};
+};
@@ -0,0 +1,173 @@
+#include "FrameCapture.h"
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+
+ImageEncoder::ImageEncoder(size_t maxPendingImages)
+	: mMaxPendingImages(maxPendingImages)
+{
+	mThread = std::thread(&ImageEncoder::EncodeLoop, this);
+}
+
+ImageEncoder::~ImageEncoder()
+{
+	{
+		std::lock_guard lock(mMutex);
+		mShutdown = true;
+	}
+	mWakeCondition.notify_one();
+	mThread.join();
+}
+
+bool ImageEncoder::Encode(CapturedImage&& image, std::filesystem::path filePath)
+{
+	{
+		std::lock_guard lock(mMutex);
+		if (mJobs.size() >= mMaxPendingImages)
+			return false;
+		mJobs.push_back({ .image = std::move(image), .filePath = std::move(filePath) });
+	}
+	mWakeCondition.notify_one();
+	return true;
+}
+
+void ImageEncoder::Flush()
+{
+	std::unique_lock lock(mMutex);
+	mIdleCondition.wait(lock, [this] { return mJobs.empty() && !mIsEncoding; });
+}
+
+uint64_t ImageEncoder::GetWrittenCount() const
+{
+	std::lock_guard lock(mMutex);
+	return mWrittenCount;
+}
+
+uint64_t ImageEncoder::GetFailedCount() const
+{
+	std::lock_guard lock(mMutex);
+	return mFailedCount;
+}
+
+void ImageEncoder::EncodeLoop()
+{
+	std::unique_lock lock(mMutex);
+	while (true)
+	{
+		mWakeCondition.wait(lock, [this] { return mShutdown || !mJobs.empty(); });
+		if (mJobs.empty())
+			return;
+
+		Job job = std::move(mJobs.front());
+		mJobs.pop_front();
+		mIsEncoding = true;
+
+		lock.unlock();
+		const bool isWritten = WriteBmp(job.image, job.filePath);
+		lock.lock();
+
+		mIsEncoding = false;
+		(isWritten ? mWrittenCount : mFailedCount)++;
+		if (mJobs.empty())
+			mIdleCondition.notify_all();
+	}
+}
+
+static void WriteU16(uint8_t* destination, uint16_t value)
+{
+	memcpy(destination, &value, sizeof(value));
+}
+
+static void WriteU32(uint8_t* destination, uint32_t value)
+{
+	memcpy(destination, &value, sizeof(value));
+}
+
+bool ImageEncoder::WriteBmp(const CapturedImage& image, const std::filesystem::path& filePath)
+{
+	assert(image.rowPitch >= image.width * 4 && image.pixels.size() >= static_cast<size_t>(image.rowPitch) * image.height);
+
+	static constexpr uint32_t HEADER_SIZE = 14 + 40;
+	const uint32_t bmpRowSize = (image.width * 3 + 3) & ~3u;
+	const uint32_t fileSize = HEADER_SIZE + bmpRowSize * image.height;
+
+	std::vector<uint8_t> bmp(fileSize, 0);
+	bmp[0] = 'B';
+	bmp[1] = 'M';
+	WriteU32(&bmp[2], fileSize);
+	WriteU32(&bmp[10], HEADER_SIZE);
+	WriteU32(&bmp[14], 40);
+	WriteU32(&bmp[18], image.width);
+	WriteU32(&bmp[22], image.height); // positive height, rows go bottom up
+	WriteU16(&bmp[26], 1);
+	WriteU16(&bmp[28], 24);
+	WriteU32(&bmp[34], bmpRowSize * image.height);
+
+	for (uint32_t y = 0; y < image.height; y++)
+	{
+		const uint8_t* source = &image.pixels[static_cast<size_t>(y) * image.rowPitch];
+		uint8_t* destination = &bmp[HEADER_SIZE + static_cast<size_t>(image.height - 1 - y) * bmpRowSize];
+		for (uint32_t x = 0; x < image.width; x++)
+		{
+			destination[x * 3 + 0] = source[x * 4 + 2];
+			destination[x * 3 + 1] = source[x * 4 + 1];
+			destination[x * 3 + 2] = source[x * 4 + 0];
+		}
+	}
+
+	std::ofstream file(filePath, std::ios::binary);
+	file.write(reinterpret_cast<const char*>(bmp.data()), bmp.size());
+	return file.good();
+}
+
+FrameCapture::FrameCapture(uint32_t slotCount, size_t maxPendingImages)
+	: mSlots(slotCount)
+	, mEncoder(maxPendingImages)
+{
+	assert(slotCount > 0);
+}
+
+std::optional<uint32_t> FrameCapture::Request(std::filesystem::path filePath, uint32_t width, uint32_t height, uint32_t rowPitch, uint64_t fenceValue)
+{
+	if (mPendingCount == mSlots.size())
+	{
+		mDroppedCount++;
+		return std::nullopt;
+	}
+
+	// fences complete in order, so the slots are reused in order as well
+	const uint32_t slotIndex = (mOldestSlot + mPendingCount) % GetSlotCount();
+	mSlots[slotIndex] = {
+		.fenceValue = fenceValue,
+		.filePath = std::move(filePath),
+		.width = width,
+		.height = height,
+		.rowPitch = rowPitch };
+	mPendingCount++;
+	return slotIndex;
+}
+
+size_t FrameCapture::Poll(uint64_t completedFenceValue, const std::function<const uint8_t*(uint32_t slot)>& getSlotData)
+{
+	size_t freedCount = 0;
+	while (mPendingCount > 0 && mSlots[mOldestSlot].fenceValue <= completedFenceValue)
+	{
+		Slot& slot = mSlots[mOldestSlot];
+		const uint8_t* data = getSlotData(mOldestSlot);
+
+		// the slot is reused as soon as this returns, the encoder gets its own copy
+		CapturedImage image{
+			.width = slot.width,
+			.height = slot.height,
+			.rowPitch = slot.rowPitch,
+			.pixels = std::vector<uint8_t>(data, data + static_cast<size_t>(slot.rowPitch) * slot.height) };
+		if (!mEncoder.Encode(std::move(image), std::move(slot.filePath)))
+			mDroppedCount++;
+
+		mOldestSlot = (mOldestSlot + 1) % GetSlotCount();
+		mPendingCount--;
+		freedCount++;
+	}
+	return freedCount;
+}
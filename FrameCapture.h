@@ -0,0 +1,95 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// RGBA8 image with rows rowPitch bytes apart, the layout a texture copy leaves in a readback buffer
+struct CapturedImage {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t rowPitch = 0;
+	std::vector<uint8_t> pixels;
+};
+
+// Writes captured images to disk on its own thread, so the render thread only pays for handing them over.
+class ImageEncoder {
+public:
+	explicit ImageEncoder(size_t maxPendingImages);
+	// writes whatever is still queued before returning
+	~ImageEncoder();
+
+	// false when maxPendingImages are already waiting, the image is dropped then
+	bool Encode(CapturedImage&& image, std::filesystem::path filePath);
+	// blocks until everything queued so far is written
+	void Flush();
+
+	uint64_t GetWrittenCount() const;
+	uint64_t GetFailedCount() const;
+
+	// 24 bit uncompressed BMP, alpha is dropped
+	static bool WriteBmp(const CapturedImage& image, const std::filesystem::path& filePath);
+
+private:
+	struct Job {
+		CapturedImage image;
+		std::filesystem::path filePath;
+	};
+
+	void EncodeLoop();
+
+private:
+	size_t mMaxPendingImages = 0;
+	std::thread mThread;
+	mutable std::mutex mMutex;
+	std::condition_variable mWakeCondition;
+	std::condition_variable mIdleCondition;
+	std::deque<Job> mJobs;
+	bool mIsEncoding = false;
+	bool mShutdown = false;
+	uint64_t mWrittenCount = 0;
+	uint64_t mFailedCount = 0;
+};
+
+// Ring of readback slots for asynchronous captures. A capture takes the next slot, tagged with the
+// fence value of the frame whose copy fills it, and is handed to the encoder once that fence has
+// completed, usually one or two frames later. When every slot is still in flight the capture is
+// dropped instead of waiting on the GPU. Nothing in here talks to the GPU, the caller does the copies.
+class FrameCapture {
+public:
+	FrameCapture(uint32_t slotCount, size_t maxPendingImages);
+
+	// the slot the caller has to copy the image into, nullopt when the capture is dropped
+	std::optional<uint32_t> Request(std::filesystem::path filePath, uint32_t width, uint32_t height, uint32_t rowPitch, uint64_t fenceValue);
+
+	// Hands every slot whose fence completed to the encoder, getSlotData(slot) returns the slot's
+	// mapped memory. Returns how many slots were freed.
+	size_t Poll(uint64_t completedFenceValue, const std::function<const uint8_t*(uint32_t slot)>& getSlotData);
+
+	uint32_t GetSlotCount() const { return static_cast<uint32_t>(mSlots.size()); }
+	uint32_t GetPendingCount() const { return mPendingCount; }
+	uint64_t GetDroppedCount() const { return mDroppedCount; }
+	ImageEncoder& GetEncoder() { return mEncoder; }
+
+private:
+	struct Slot {
+		uint64_t fenceValue = 0;
+		std::filesystem::path filePath;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t rowPitch = 0;
+	};
+
+private:
+	std::vector<Slot> mSlots;
+	uint32_t mOldestSlot = 0;
+	uint32_t mPendingCount = 0;
+	uint64_t mDroppedCount = 0;
+	ImageEncoder mEncoder;
+};
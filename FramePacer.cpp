@@ -0,0 +1,80 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// weight of the newest frame in the running estimates
+static constexpr double ESTIMATE_SMOOTHING = 1.0 / 16.0;
+// frames measured before the start is pushed back, until then frames start right away
+static constexpr uint32_t WARM_UP_FRAME_COUNT = 8;
+// the CPU estimate is padded by this many deviations so a slower frame than usual still isn't late
+static constexpr double CPU_DEVIATION_WEIGHT = 2.0;
+// covers the caller waking up late from its sleep
+static constexpr double WAKE_UP_MARGIN = 0.0005;
+
+void FramePacer::Estimate::Add(double sample)
+{
+	if (mSampleCount == 0)
+	{
+		mMean = sample;
+		mDeviation = 0.0;
+	}
+	else
+	{
+		mDeviation += (std::abs(sample - mMean) - mDeviation) * ESTIMATE_SMOOTHING;
+		mMean += (sample - mMean) * ESTIMATE_SMOOTHING;
+	}
+	mSampleCount = std::min(mSampleCount + 1, WARM_UP_FRAME_COUNT);
+}
+
+bool FramePacer::Estimate::IsWarmedUp() const
+{
+	return mSampleCount >= WARM_UP_FRAME_COUNT;
+}
+
+FramePacer::FramePacer(uint32_t maxFrameLatency)
+	: mMaxFrameLatency(maxFrameLatency)
+{
+	assert(maxFrameLatency > 0);
+}
+
+double FramePacer::GetNextFrameStart(double now) const
+{
+	double start = now;
+	if (mCpuTime.IsWarmedUp() && mGpuTime.IsWarmedUp())
+	{
+		// each pending frame starts on the GPU when it was submitted or when the one before it finished,
+		// whichever is later, the mean is used so a faster frame than usual doesn't leave the GPU idle
+		double gpuIdleTime = mLastCompletion;
+		for (double submit : mPendingSubmits)
+			gpuIdleTime = std::max(gpuIdleTime, submit) + mGpuTime.GetMean();
+
+		const double cpuSeconds = mCpuTime.GetMean() + CPU_DEVIATION_WEIGHT * mCpuTime.GetDeviation();
+		start = gpuIdleTime - cpuSeconds - WAKE_UP_MARGIN;
+	}
+	if (mMinFrameInterval > 0.0 && mIsFrameStarted)
+		start = std::max(start, mFrameStart + mMinFrameInterval);
+	return std::max(start, now);
+}
+
+void FramePacer::OnFrameStarted(double time)
+{
+	mFrameStart = time;
+	mIsFrameStarted = true;
+}
+
+void FramePacer::OnFrameSubmitted(double time)
+{
+	if (mIsFrameStarted)
+		mCpuTime.Add(time - mFrameStart);
+	mPendingSubmits.push_back(time);
+}
+
+void FramePacer::OnFrameCompleted(double time, double gpuSeconds)
+{
+	if (!mPendingSubmits.empty())
+		mPendingSubmits.pop_front();
+	mLastCompletion = time;
+	mGpuTime.Add(gpuSeconds);
+}
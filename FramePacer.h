@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+// Decides when the CPU starts its next frame. Starting as soon as the swap chain allows lets the CPU
+// run a whole frame ahead and the input it samples waits in the queue behind the GPU's backlog.
+// Instead the start is pushed back so the frame is submitted just as the GPU runs out of work,
+// predicted from the CPU and GPU frame times measured so far. Nothing in here talks to the GPU or
+// sleeps, the caller passes in times (seconds on any one clock) and waits itself.
+class FramePacer {
+public:
+	explicit FramePacer(uint32_t maxFrameLatency);
+
+	// frames submitted and not yet finished by the GPU are capped at this by the swap chain
+	uint32_t GetMaxFrameLatency() const { return mMaxFrameLatency; }
+	// lower bound on the time between frame starts, 0 leaves the frame rate uncapped
+	void SetMinFrameInterval(double seconds) { mMinFrameInterval = seconds; }
+
+	// when the next frame should start, never before now
+	double GetNextFrameStart(double now) const;
+
+	void OnFrameStarted(double time);
+	void OnFrameSubmitted(double time);
+	// the oldest submitted frame finished on the GPU at time, after gpuSeconds of work
+	void OnFrameCompleted(double time, double gpuSeconds);
+
+private:
+	// running mean and mean absolute deviation, recent frames weigh the most
+	class Estimate {
+	public:
+		void Add(double sample);
+		bool IsWarmedUp() const;
+		double GetMean() const { return mMean; }
+		double GetDeviation() const { return mDeviation; }
+
+	private:
+		double mMean = 0.0;
+		double mDeviation = 0.0;
+		uint32_t mSampleCount = 0;
+	};
+
+	uint32_t mMaxFrameLatency = 1;
+	double mMinFrameInterval = 0.0;
+	Estimate mCpuTime;
+	Estimate mGpuTime;
+	double mFrameStart = 0.0;
+	bool mIsFrameStarted = false;
+	// submit times of the frames the GPU hasn't finished, oldest first
+	std::deque<double> mPendingSubmits;
+	double mLastCompletion = 0.0;
+};
@@ -0,0 +1,299 @@
+#include "IlluminationVolume.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	float SampleSource(const uint8_t* data, const VolumeDimensions& dimensions, float x, float y, float z)
+	{
+		x = std::clamp(x, 0.0f, static_cast<float>(dimensions.width - 1));
+		y = std::clamp(y, 0.0f, static_cast<float>(dimensions.height - 1));
+		z = std::clamp(z, 0.0f, static_cast<float>(dimensions.depth - 1));
+		const uint32_t x0 = static_cast<uint32_t>(x);
+		const uint32_t y0 = static_cast<uint32_t>(y);
+		const uint32_t z0 = static_cast<uint32_t>(z);
+		const uint32_t x1 = std::min(x0 + 1, dimensions.width - 1);
+		const uint32_t y1 = std::min(y0 + 1, dimensions.height - 1);
+		const uint32_t z1 = std::min(z0 + 1, dimensions.depth - 1);
+		const float fx = x - x0;
+		const float fy = y - y0;
+		const float fz = z - z0;
+
+		auto lerp = [](float a, float b, float t) { return a + (b - a) * t; };
+		const float c00 = lerp(data[dimensions.GetIndex(x0, y0, z0)], data[dimensions.GetIndex(x1, y0, z0)], fx);
+		const float c10 = lerp(data[dimensions.GetIndex(x0, y1, z0)], data[dimensions.GetIndex(x1, y1, z0)], fx);
+		const float c01 = lerp(data[dimensions.GetIndex(x0, y0, z1)], data[dimensions.GetIndex(x1, y0, z1)], fx);
+		const float c11 = lerp(data[dimensions.GetIndex(x0, y1, z1)], data[dimensions.GetIndex(x1, y1, z1)], fx);
+		return lerp(lerp(c00, c10, fy), lerp(c01, c11, fy), fz);
+	}
+
+	uint8_t QuantizeLight(float light)
+	{
+		return static_cast<uint8_t>(std::clamp(light, 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+}
+
+void IlluminationVolume::Initialize(const VolumeDimensions& volumeDimensions, uint32_t resolution)
+{
+	const uint32_t longestAxis = std::max({ volumeDimensions.width, volumeDimensions.height, volumeDimensions.depth });
+	auto scale = [&](uint32_t size) { return std::max(1u, static_cast<uint32_t>((static_cast<uint64_t>(size) * resolution + longestAxis - 1) / longestAxis)); };
+
+	mSourceDimensions = volumeDimensions;
+	mDimensions = {
+		.width = scale(volumeDimensions.width),
+		.height = scale(volumeDimensions.height),
+		.depth = scale(volumeDimensions.depth) };
+	mOpacity.assign(mDimensions.GetVoxelCount(), 0.0f);
+	mLight.assign(mDimensions.GetVoxelCount(), UINT8_MAX);
+	mIsOpacityDirty = true;
+	mIsLightDirty = true;
+}
+
+void IlluminationVolume::SetOpacityTable(const OpacityTable& opacityTable)
+{
+	if (opacityTable == mOpacityTable)
+		return;
+
+	mOpacityTable = opacityTable;
+	mIsOpacityDirty = true;
+}
+
+bool IlluminationVolume::Update(const uint8_t* data, const IlluminationSettings& settings)
+{
+	if (mIsOpacityDirty)
+	{
+		BuildOpacity(data);
+		mIsOpacityDirty = false;
+		mIsLightDirty = true;
+	}
+
+	if (settings != mSettings)
+	{
+		mSettings = settings;
+		mIsLightDirty = true;
+	}
+
+	if (!mIsLightDirty)
+		return false;
+
+	if (mSettings.mode == IlluminationMode::Directional)
+		SweepLight(mSettings.lightDirection);
+	else
+		ComputeAmbientOcclusion(mSettings.ambientOcclusionRadius, mSettings.ambientOcclusionStrength);
+
+	mIsLightDirty = false;
+	return true;
+}
+
+void IlluminationVolume::BuildOpacity(const uint8_t* data)
+{
+	// sampling at the illumination voxel center averages the source voxels it covers when downsampling by two
+	const float scaleX = static_cast<float>(mSourceDimensions.width) / mDimensions.width;
+	const float scaleY = static_cast<float>(mSourceDimensions.height) / mDimensions.height;
+	const float scaleZ = static_cast<float>(mSourceDimensions.depth) / mDimensions.depth;
+
+	ThreadPool::Get().ParallelFor(mDimensions.depth, [&](uint32_t z) {
+		for (uint32_t y = 0; y < mDimensions.height; y++)
+		{
+			for (uint32_t x = 0; x < mDimensions.width; x++)
+			{
+				const float density = SampleSource(data, mSourceDimensions, (x + 0.5f) * scaleX - 0.5f, (y + 0.5f) * scaleY - 0.5f, (z + 0.5f) * scaleZ - 0.5f);
+				mOpacity[mDimensions.GetIndex(x, y, z)] = mOpacityTable[static_cast<uint8_t>(density + 0.5f)];
+			}
+		}
+	});
+}
+
+void IlluminationVolume::SweepLight(const Float3& lightDirection)
+{
+	const float direction[3] = { lightDirection.x, lightDirection.y, lightDirection.z };
+	const uint32_t size[3] = { mDimensions.width, mDimensions.height, mDimensions.depth };
+
+	uint32_t a = 0;
+	for (uint32_t axis = 1; axis < 3; axis++)
+	{
+		if (std::abs(direction[axis]) > std::abs(direction[a]))
+			a = axis;
+	}
+	if (direction[a] == 0.0f)
+	{
+		std::fill(mLight.begin(), mLight.end(), UINT8_MAX);
+		return;
+	}
+
+	// slices are perpendicular to axis a, u and v span them
+	const uint32_t u = (a + 1) % 3;
+	const uint32_t v = (a + 2) % 3;
+	const uint32_t sizeU = size[u];
+	const uint32_t sizeV = size[v];
+
+	// light reaching (i, j) in a slice left the previous slice at (i, j) + shift, and since the shift is the
+	// same for every voxel so are the bilinear weights. a is the longest axis of the direction, so the shift
+	// is in [-1, 1], and a shift of exactly 1 (a diagonal) takes offset 0 with a fraction of 1 so the offsets
+	// stay -1 or 0.
+	const float shiftU = -direction[u] / std::abs(direction[a]);
+	const float shiftV = -direction[v] / std::abs(direction[a]);
+	const int32_t offsetU = std::clamp(static_cast<int32_t>(std::floor(shiftU)), -1, 0);
+	const int32_t offsetV = std::clamp(static_cast<int32_t>(std::floor(shiftV)), -1, 0);
+	const float fractionU = shiftU - offsetU;
+	const float fractionV = shiftV - offsetV;
+	const float w00 = (1.0f - fractionU) * (1.0f - fractionV);
+	const float w10 = fractionU * (1.0f - fractionV);
+	const float w01 = (1.0f - fractionU) * fractionV;
+	const float w11 = fractionU * fractionV;
+
+	// transmitted light of the previous slice with a border of unoccluded light around it
+	const uint32_t paddedWidth = sizeU + 2;
+	std::vector<float> transmitted(static_cast<size_t>(paddedWidth) * (sizeV + 2), 1.0f);
+	std::vector<float> incoming(static_cast<size_t>(sizeU) * sizeV, 1.0f);
+
+	auto getIndex = [&](uint32_t i, uint32_t j, uint32_t k) {
+		uint32_t coordinates[3];
+		coordinates[u] = i;
+		coordinates[v] = j;
+		coordinates[a] = k;
+		return mDimensions.GetIndex(coordinates[0], coordinates[1], coordinates[2]);
+	};
+
+	for (uint32_t step = 0; step < size[a]; step++)
+	{
+		const uint32_t k = direction[a] > 0.0f ? step : size[a] - 1 - step;
+
+		ThreadPool::Get().ParallelFor(sizeV, [&](uint32_t j) {
+			const float* incomingRow = &incoming[static_cast<size_t>(sizeU) * j];
+			float* transmittedRow = &transmitted[static_cast<size_t>(paddedWidth) * (j + 1) + 1];
+			for (uint32_t i = 0; i < sizeU; i++)
+			{
+				const size_t index = getIndex(i, j, k);
+				mLight[index] = QuantizeLight(incomingRow[i]);
+				transmittedRow[i] = incomingRow[i] * (1.0f - mOpacity[index]);
+			}
+		});
+
+		if (step + 1 == size[a])
+			break;
+
+		ThreadPool::Get().ParallelFor(sizeV, [&](uint32_t j) {
+			// with offsets of -1 or 0 every read is within the border
+			const float* row0 = &transmitted[static_cast<size_t>(paddedWidth) * (j + 1 + offsetV) + 1 + offsetU];
+			const float* row1 = row0 + paddedWidth;
+			float* incomingRow = &incoming[static_cast<size_t>(sizeU) * j];
+
+			uint32_t i = 0;
+#ifdef VOLUME_SSE2
+			const __m128 weight00 = _mm_set1_ps(w00);
+			const __m128 weight10 = _mm_set1_ps(w10);
+			const __m128 weight01 = _mm_set1_ps(w01);
+			const __m128 weight11 = _mm_set1_ps(w11);
+			for (; i + 4 <= sizeU; i += 4)
+			{
+				__m128 light = _mm_mul_ps(weight00, _mm_loadu_ps(row0 + i));
+				light = _mm_add_ps(light, _mm_mul_ps(weight10, _mm_loadu_ps(row0 + i + 1)));
+				light = _mm_add_ps(light, _mm_mul_ps(weight01, _mm_loadu_ps(row1 + i)));
+				light = _mm_add_ps(light, _mm_mul_ps(weight11, _mm_loadu_ps(row1 + i + 1)));
+				_mm_storeu_ps(incomingRow + i, light);
+			}
+#endif
+			for (; i < sizeU; i++)
+				incomingRow[i] = w00 * row0[i] + w10 * row0[i + 1] + w01 * row1[i] + w11 * row1[i + 1];
+		});
+	}
+}
+
+void IlluminationVolume::ComputeAmbientOcclusion(uint32_t radius, float strength)
+{
+	// box sum of the opacity around every voxel, as three separable running sums (outside counts as empty)
+	std::vector<float> sums = mOpacity;
+	const uint32_t size[3] = { mDimensions.width, mDimensions.height, mDimensions.depth };
+	const size_t stride[3] = { 1, mDimensions.width, static_cast<size_t>(mDimensions.width) * mDimensions.height };
+
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		const uint32_t u = (axis + 1) % 3;
+		const uint32_t v = (axis + 2) % 3;
+		ThreadPool::Get().ParallelFor(size[u] * size[v], [&](uint32_t line) {
+			const size_t start = (line % size[u]) * stride[u] + (line / size[u]) * stride[v];
+			std::vector<float> values(size[axis]);
+			for (uint32_t i = 0; i < size[axis]; i++)
+				values[i] = sums[start + i * stride[axis]];
+
+			float sum = 0.0f;
+			for (uint32_t i = 0; i < std::min(radius, size[axis]); i++)
+				sum += values[i];
+			for (uint32_t i = 0; i < size[axis]; i++)
+			{
+				if (i + radius < size[axis])
+					sum += values[i + radius];
+				if (i > radius)
+					sum -= values[i - radius - 1];
+				sums[start + i * stride[axis]] = sum;
+			}
+		});
+	}
+
+	const float boxSize = static_cast<float>(2 * radius + 1);
+	const float scale = strength / (boxSize * boxSize * boxSize);
+	ThreadPool::Get().ParallelFor(mDimensions.depth, [&](uint32_t z) {
+		const size_t begin = z * stride[2];
+		for (size_t index = begin; index < begin + stride[2]; index++)
+			mLight[index] = QuantizeLight(1.0f - sums[index] * scale);
+	});
+}
+
+std::vector<float> IlluminationVolume::ComputeReference(const Float3& lightDirection, uint32_t substeps) const
+{
+	std::vector<float> light(mDimensions.GetVoxelCount(), 1.0f);
+	const float longest = std::max({ std::abs(lightDirection.x), std::abs(lightDirection.y), std::abs(lightDirection.z) });
+	if (longest == 0.0f || substeps == 0)
+		return light;
+
+	// one sweep slice per substeps samples, marching back towards the light
+	const Float3 step = {
+		-lightDirection.x / longest / substeps,
+		-lightDirection.y / longest / substeps,
+		-lightDirection.z / longest / substeps };
+	const float exponent = 1.0f / substeps;
+
+	auto sampleOpacity = [&](float x, float y, float z) {
+		x = std::clamp(x, 0.0f, static_cast<float>(mDimensions.width - 1));
+		y = std::clamp(y, 0.0f, static_cast<float>(mDimensions.height - 1));
+		z = std::clamp(z, 0.0f, static_cast<float>(mDimensions.depth - 1));
+		const uint32_t x0 = static_cast<uint32_t>(x);
+		const uint32_t y0 = static_cast<uint32_t>(y);
+		const uint32_t z0 = static_cast<uint32_t>(z);
+		const uint32_t x1 = std::min(x0 + 1, mDimensions.width - 1);
+		const uint32_t y1 = std::min(y0 + 1, mDimensions.height - 1);
+		const uint32_t z1 = std::min(z0 + 1, mDimensions.depth - 1);
+		const float fx = x - x0;
+		const float fy = y - y0;
+		const float fz = z - z0;
+
+		auto lerp = [](float a, float b, float t) { return a + (b - a) * t; };
+		const float c00 = lerp(mOpacity[mDimensions.GetIndex(x0, y0, z0)], mOpacity[mDimensions.GetIndex(x1, y0, z0)], fx);
+		const float c10 = lerp(mOpacity[mDimensions.GetIndex(x0, y1, z0)], mOpacity[mDimensions.GetIndex(x1, y1, z0)], fx);
+		const float c01 = lerp(mOpacity[mDimensions.GetIndex(x0, y0, z1)], mOpacity[mDimensions.GetIndex(x1, y0, z1)], fx);
+		const float c11 = lerp(mOpacity[mDimensions.GetIndex(x0, y1, z1)], mOpacity[mDimensions.GetIndex(x1, y1, z1)], fx);
+		return lerp(lerp(c00, c10, fy), lerp(c01, c11, fy), fz);
+	};
+
+	ThreadPool::Get().ParallelFor(mDimensions.depth, [&](uint32_t z) {
+		for (uint32_t y = 0; y < mDimensions.height; y++)
+		{
+			for (uint32_t x = 0; x < mDimensions.width; x++)
+			{
+				float transmittance = 1.0f;
+				Float3 position = { x + step.x, y + step.y, z + step.z };
+				while (position.x > -0.5f && position.x < mDimensions.width - 0.5f &&
+					position.y > -0.5f && position.y < mDimensions.height - 0.5f &&
+					position.z > -0.5f && position.z < mDimensions.depth - 0.5f)
+				{
+					transmittance *= std::pow(1.0f - sampleOpacity(position.x, position.y, position.z), exponent);
+					position = { position.x + step.x, position.y + step.y, position.z + step.z };
+				}
+				light[mDimensions.GetIndex(x, y, z)] = transmittance;
+			}
+		}
+	});
+	return light;
+}
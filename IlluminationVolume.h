@@ -0,0 +1,65 @@
+#pragma once
+
+#include "VolumeTypes.h"
+
+#include <array>
+#include <vector>
+
+enum class IlluminationMode : uint8_t {
+	Directional,
+	AmbientOcclusion
+};
+
+struct IlluminationSettings {
+	Float3 lightDirection = { 0.0f, -1.0f, 0.0f }; // direction the light travels in, volume axes
+	IlluminationMode mode = IlluminationMode::Directional;
+	uint32_t ambientOcclusionRadius = 2;
+	float ambientOcclusionStrength = 4.0f;
+
+	bool operator==(const IlluminationSettings&) const = default;
+};
+
+// Low resolution light volume the ray marcher multiplies its samples with, so shadows and ambient
+// occlusion cost one extra texture fetch instead of secondary rays. Directional light is
+// propagated slice by slice along the axis closest to the light direction, each slice filtering
+// the transmitted light of the previous one. Opacity and light are cached separately, so a light
+// change only repeats the sweep while an opacity (transfer function) change rebuilds both.
+class IlluminationVolume {
+public:
+	// opacity per density value for light travelling the width of one illumination voxel
+	using OpacityTable = std::array<float, 256>;
+
+	// resolution is the voxel count along the longest axis of the volume, the others keep its aspect
+	void Initialize(const VolumeDimensions& volumeDimensions, uint32_t resolution);
+
+	void SetOpacityTable(const OpacityTable& opacityTable);
+	// the source voxels changed
+	void InvalidateOpacity() { mIsOpacityDirty = true; }
+
+	// recomputes whatever the changes since the last call need, true if the light volume changed
+	bool Update(const uint8_t* data, const IlluminationSettings& settings);
+
+	const VolumeDimensions& GetDimensions() const { return mDimensions; }
+	const std::vector<uint8_t>& GetLight() const { return mLight; }
+	const std::vector<float>& GetOpacity() const { return mOpacity; }
+
+	// Brute force directional light: every voxel marches towards the light through the cached
+	// opacity, substeps samples per slice. The sweep converges to this as substeps grows.
+	std::vector<float> ComputeReference(const Float3& lightDirection, uint32_t substeps) const;
+
+private:
+	void BuildOpacity(const uint8_t* data);
+	void SweepLight(const Float3& lightDirection);
+	void ComputeAmbientOcclusion(uint32_t radius, float strength);
+
+private:
+	VolumeDimensions mSourceDimensions{};
+	VolumeDimensions mDimensions{};
+	OpacityTable mOpacityTable{};
+	std::vector<float> mOpacity;
+	std::vector<uint8_t> mLight;
+
+	IlluminationSettings mSettings{};
+	bool mIsOpacityDirty = true;
+	bool mIsLightDirty = true;
+};
@@ -0,0 +1,429 @@
+#include "Inflate.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+// codes up to this long are decoded with one lookup, longer ones bit by bit
+static constexpr uint32_t FAST_BITS = 10;
+static constexpr uint32_t MAX_CODE_LENGTH = 15;
+
+static constexpr uint16_t LENGTH_BASE[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static constexpr uint8_t LENGTH_EXTRA_BITS[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static constexpr uint16_t DISTANCE_BASE[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static constexpr uint8_t DISTANCE_EXTRA_BITS[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static constexpr uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// deflate packs its bits starting with the least significant one, reads zeros past the end
+struct BitReader {
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+	size_t position = 0;
+	uint64_t bits = 0;
+	uint32_t count = 0;
+
+	void Refill()
+	{
+		while (count <= 56)
+		{
+			bits |= static_cast<uint64_t>(position < size ? data[position] : 0) << count;
+			position++;
+			count += 8;
+		}
+	}
+
+	uint32_t Get(uint32_t bitCount)
+	{
+		Refill();
+		const uint32_t value = static_cast<uint32_t>(bits & ((uint64_t(1) << bitCount) - 1));
+		bits >>= bitCount;
+		count -= bitCount;
+		return value;
+	}
+
+	size_t GetConsumed() const { return position - count / 8; }
+	bool IsOverrun() const { return GetConsumed() > size; }
+};
+
+struct HuffmanCode {
+	// (symbol << 4) | length for every FAST_BITS bits starting with a code that short, 0 where it's longer
+	uint16_t fast[1 << FAST_BITS];
+	uint16_t counts[MAX_CODE_LENGTH + 1];
+	uint16_t symbols[288];
+};
+
+// incomplete codes are allowed, a stream using one of the missing codes fails while decoding
+static bool BuildCode(const uint8_t* lengths, uint32_t symbolCount, HuffmanCode& code)
+{
+	memset(code.counts, 0, sizeof(code.counts));
+	for (uint32_t symbol = 0; symbol < symbolCount; symbol++)
+		code.counts[lengths[symbol]]++;
+	code.counts[0] = 0;
+
+	int32_t unusedCodes = 1;
+	for (uint32_t length = 1; length <= MAX_CODE_LENGTH; length++)
+	{
+		unusedCodes = (unusedCodes << 1) - code.counts[length];
+		if (unusedCodes < 0)
+			return false;
+	}
+
+	uint16_t offsets[MAX_CODE_LENGTH + 2] = {};
+	for (uint32_t length = 1; length <= MAX_CODE_LENGTH; length++)
+		offsets[length + 1] = offsets[length] + code.counts[length];
+	for (uint32_t symbol = 0; symbol < symbolCount; symbol++)
+	{
+		if (lengths[symbol] != 0)
+			code.symbols[offsets[lengths[symbol]]++] = static_cast<uint16_t>(symbol);
+	}
+
+	// canonical codes are assigned most significant bit first, so the lookup index is bit reversed
+	memset(code.fast, 0, sizeof(code.fast));
+	uint32_t nextCode = 0;
+	uint32_t index = 0;
+	for (uint32_t length = 1; length <= FAST_BITS; length++)
+	{
+		for (uint32_t i = 0; i < code.counts[length]; i++, nextCode++, index++)
+		{
+			uint32_t reversed = 0;
+			for (uint32_t bit = 0; bit < length; bit++)
+				reversed |= ((nextCode >> bit) & 1) << (length - 1 - bit);
+			for (uint32_t fill = reversed; fill < (1u << FAST_BITS); fill += 1u << length)
+				code.fast[fill] = static_cast<uint16_t>((code.symbols[index] << 4) | length);
+		}
+		nextCode <<= 1;
+	}
+	return true;
+}
+
+static int32_t DecodeSymbol(BitReader& reader, const HuffmanCode& code)
+{
+	reader.Refill();
+	const uint16_t entry = code.fast[reader.bits & ((1u << FAST_BITS) - 1)];
+	if (entry != 0)
+	{
+		reader.bits >>= entry & 15;
+		reader.count -= entry & 15;
+		return entry >> 4;
+	}
+
+	// longer codes one bit at a time, the first code of every length follows from the counts
+	int32_t value = 0;
+	int32_t first = 0;
+	int32_t index = 0;
+	for (uint32_t length = 1; length <= MAX_CODE_LENGTH; length++)
+	{
+		value |= static_cast<int32_t>(reader.Get(1));
+		const int32_t count = code.counts[length];
+		if (value - count < first)
+			return code.symbols[index + (value - first)];
+		index += count;
+		first = (first + count) << 1;
+		value <<= 1;
+	}
+	return -1;
+}
+
+static bool InflateBlock(BitReader& reader, const HuffmanCode& lengthCode, const HuffmanCode& distanceCode,
+	uint8_t* destination, size_t destinationSize, size_t& produced)
+{
+	while (true)
+	{
+		int32_t symbol = DecodeSymbol(reader, lengthCode);
+		if (symbol < 0)
+			return false;
+		if (symbol < 256)
+		{
+			if (produced >= destinationSize)
+				return false;
+			destination[produced++] = static_cast<uint8_t>(symbol);
+			continue;
+		}
+		if (symbol == 256)
+			return true;
+
+		symbol -= 257;
+		if (symbol >= 29)
+			return false;
+		const uint32_t length = LENGTH_BASE[symbol] + reader.Get(LENGTH_EXTRA_BITS[symbol]);
+		const int32_t distanceSymbol = DecodeSymbol(reader, distanceCode);
+		if (distanceSymbol < 0 || distanceSymbol >= 30)
+			return false;
+		const uint32_t distance = DISTANCE_BASE[distanceSymbol] + reader.Get(DISTANCE_EXTRA_BITS[distanceSymbol]);
+		if (distance > produced)
+			return false;
+
+		// a match running past the end still fills the destination up
+		const bool isCutOff = length > destinationSize - produced;
+		const uint32_t copyLength = isCutOff ? static_cast<uint32_t>(destinationSize - produced) : length;
+		uint8_t* target = destination + produced;
+		const uint8_t* source = target - distance;
+		if (distance >= copyLength)
+		{
+			memcpy(target, source, copyLength);
+		}
+		else
+		{
+			// the copy overlaps what it writes, runs repeat the last distance bytes
+			for (uint32_t i = 0; i < copyLength; i++)
+				target[i] = source[i];
+		}
+		produced += copyLength;
+		if (isCutOff)
+			return false;
+	}
+}
+
+static const HuffmanCode* GetFixedCodes()
+{
+	static const HuffmanCode* codes = [] {
+		static HuffmanCode fixedCodes[2];
+		uint8_t lengths[288];
+		memset(lengths, 8, 144);
+		memset(lengths + 144, 9, 112);
+		memset(lengths + 256, 7, 24);
+		memset(lengths + 280, 8, 8);
+		BuildCode(lengths, 288, fixedCodes[0]);
+		memset(lengths, 5, 30);
+		BuildCode(lengths, 30, fixedCodes[1]);
+		return fixedCodes;
+	}();
+	return codes;
+}
+
+static bool ReadDynamicCodes(BitReader& reader, HuffmanCode& lengthCode, HuffmanCode& distanceCode)
+{
+	const uint32_t lengthCount = reader.Get(5) + 257;
+	const uint32_t distanceCount = reader.Get(5) + 1;
+	const uint32_t codeLengthCount = reader.Get(4) + 4;
+	if (lengthCount > 286 || distanceCount > 30)
+		return false;
+
+	uint8_t codeLengthLengths[19] = {};
+	for (uint32_t i = 0; i < codeLengthCount; i++)
+		codeLengthLengths[CODE_LENGTH_ORDER[i]] = static_cast<uint8_t>(reader.Get(3));
+	HuffmanCode codeLengthCode;
+	if (!BuildCode(codeLengthLengths, 19, codeLengthCode))
+		return false;
+
+	// the literal/length and distance code lengths are one sequence, repeats may cross between them
+	uint8_t lengths[286 + 30] = {};
+	uint32_t index = 0;
+	while (index < lengthCount + distanceCount)
+	{
+		const int32_t symbol = DecodeSymbol(reader, codeLengthCode);
+		if (symbol < 0)
+			return false;
+		if (symbol < 16)
+		{
+			lengths[index++] = static_cast<uint8_t>(symbol);
+			continue;
+		}
+
+		uint8_t value = 0;
+		uint32_t repeat = 0;
+		if (symbol == 16)
+		{
+			if (index == 0)
+				return false;
+			value = lengths[index - 1];
+			repeat = 3 + reader.Get(2);
+		}
+		else
+		{
+			repeat = symbol == 17 ? 3 + reader.Get(3) : 11 + reader.Get(7);
+		}
+		if (index + repeat > lengthCount + distanceCount)
+			return false;
+		memset(lengths + index, value, repeat);
+		index += repeat;
+	}
+
+	return lengths[256] != 0 &&
+		BuildCode(lengths, lengthCount, lengthCode) &&
+		BuildCode(lengths + lengthCount, distanceCount, distanceCode);
+}
+
+bool Inflate::InflateRaw(const uint8_t* data, size_t size, uint8_t* destination, size_t destinationSize, size_t& consumed, size_t& produced)
+{
+	BitReader reader{ .data = data, .size = size };
+	produced = 0;
+	bool isLastBlock = false;
+	while (!isLastBlock)
+	{
+		isLastBlock = reader.Get(1) != 0;
+		const uint32_t blockType = reader.Get(2);
+		if (blockType == 0)
+		{
+			// stored blocks start at the next byte boundary
+			reader.Get(reader.count % 8);
+			const uint32_t length = reader.Get(16);
+			const uint32_t inverseLength = reader.Get(16);
+			const size_t position = reader.GetConsumed();
+			if (length != (~inverseLength & 0xFFFF) || position + length > size)
+				return false;
+			const size_t copyLength = std::min<size_t>(length, destinationSize - produced);
+			memcpy(destination + produced, data + position, copyLength);
+			produced += copyLength;
+			if (copyLength < length)
+				return false;
+			reader = BitReader{ .data = data, .size = size, .position = position + length };
+		}
+		else if (blockType == 1)
+		{
+			const HuffmanCode* fixedCodes = GetFixedCodes();
+			if (!InflateBlock(reader, fixedCodes[0], fixedCodes[1], destination, destinationSize, produced))
+				return false;
+		}
+		else if (blockType == 2)
+		{
+			HuffmanCode lengthCode;
+			HuffmanCode distanceCode;
+			if (!ReadDynamicCodes(reader, lengthCode, distanceCode) ||
+				!InflateBlock(reader, lengthCode, distanceCode, destination, destinationSize, produced))
+				return false;
+		}
+		else
+		{
+			return false;
+		}
+		if (reader.IsOverrun())
+			return false;
+	}
+	consumed = reader.GetConsumed();
+	return true;
+}
+
+// size of the member header, and of the whole member if the header says (BGZF), 0 otherwise
+static bool ReadGzipHeader(const uint8_t* data, size_t size, size_t& headerSize, size_t& memberSize)
+{
+	memberSize = 0;
+	if (size < 18 || data[0] != 0x1F || data[1] != 0x8B || data[2] != 8)
+		return false;
+
+	const uint8_t flags = data[3];
+	size_t position = 10;
+	if (flags & 0x04)
+	{
+		const size_t extraSize = data[position] | (data[position + 1] << 8);
+		const size_t extraEnd = position + 2 + extraSize;
+		if (extraEnd > size)
+			return false;
+		// BGZF keeps the member size - 1 in the BC subfield
+		for (position += 2; position + 4 <= extraEnd; position += 4 + (data[position + 2] | (data[position + 3] << 8)))
+		{
+			if (data[position] == 'B' && data[position + 1] == 'C' && position + 6 <= extraEnd)
+				memberSize = (data[position + 4] | (data[position + 5] << 8)) + 1;
+		}
+		position = extraEnd;
+	}
+	// file name and comment, zero terminated
+	for (uint8_t flag : { 0x08, 0x10 })
+	{
+		if (flags & flag)
+		{
+			while (position < size && data[position] != 0)
+				position++;
+			position++;
+		}
+	}
+	if (flags & 0x02)
+		position += 2;
+	headerSize = position;
+	return position + 8 <= size;
+}
+
+// With isPrefix the stream may go on past the destination, which is then filled up and the rest left out
+static bool InflateGzipMembers(const uint8_t* data, size_t size, uint8_t* destination, size_t destinationSize, size_t& produced, bool isPrefix)
+{
+	// when every member says how big it is, each one's output size is in its trailer and they can inflate side by side
+	struct Member {
+		size_t offset = 0;
+		size_t size = 0;
+		size_t outputOffset = 0;
+		size_t outputSize = 0;
+	};
+	std::vector<Member> members;
+	size_t position = 0;
+	size_t outputSize = 0;
+	while (position < size && !(isPrefix && outputSize >= destinationSize))
+	{
+		size_t headerSize = 0;
+		size_t memberSize = 0;
+		if (!ReadGzipHeader(data + position, size - position, headerSize, memberSize) || memberSize < headerSize + 8 || position + memberSize > size)
+		{
+			members.clear();
+			break;
+		}
+		const uint8_t* trailer = data + position + memberSize - 4;
+		const size_t memberOutputSize = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | (static_cast<size_t>(trailer[3]) << 24);
+		members.push_back({ .offset = position + headerSize, .size = memberSize - headerSize - 8, .outputOffset = outputSize, .outputSize = memberOutputSize });
+		outputSize += memberOutputSize;
+		position += memberSize;
+	}
+
+	if (!members.empty())
+	{
+		if (outputSize > destinationSize && !isPrefix)
+			return false;
+		std::atomic<bool> isValid = true;
+		ThreadPool::Get().ParallelFor(static_cast<uint32_t>(members.size()), [&](uint32_t index) {
+			// only the last member of a prefix can be cut off
+			const Member& member = members[index];
+			const size_t available = std::min(member.outputSize, destinationSize - member.outputOffset);
+			size_t consumed = 0;
+			size_t memberProduced = 0;
+			const bool isComplete = Inflate::InflateRaw(data + member.offset, member.size, destination + member.outputOffset, available, consumed, memberProduced);
+			if (isComplete ? memberProduced != member.outputSize : (memberProduced != available || available == member.outputSize))
+				isValid = false;
+		});
+		produced = std::min(outputSize, destinationSize);
+		return isValid;
+	}
+
+	produced = 0;
+	position = 0;
+	while (position < size && !(isPrefix && produced == destinationSize))
+	{
+		size_t headerSize = 0;
+		size_t memberSize = 0;
+		if (!ReadGzipHeader(data + position, size - position, headerSize, memberSize))
+		{
+			// some writers pad the file after the last member
+			return produced > 0;
+		}
+		size_t consumed = 0;
+		size_t memberProduced = 0;
+		const bool isComplete = Inflate::InflateRaw(data + position + headerSize, size - position - headerSize, destination + produced, destinationSize - produced, consumed, memberProduced);
+		produced += memberProduced;
+		if (!isComplete)
+			return isPrefix && produced == destinationSize;
+		position += headerSize + consumed + 8;
+	}
+	return true;
+}
+
+bool Inflate::InflateGzip(const uint8_t* data, size_t size, uint8_t* destination, size_t destinationSize, size_t& produced)
+{
+	return InflateGzipMembers(data, size, destination, destinationSize, produced, false);
+}
+
+bool Inflate::InflateGzipPrefix(const uint8_t* data, size_t size, uint8_t* destination, size_t destinationSize, size_t& produced)
+{
+	return InflateGzipMembers(data, size, destination, destinationSize, produced, true);
+}
+
+bool Inflate::InflateZlib(const uint8_t* data, size_t size, uint8_t* destination, size_t destinationSize, size_t& produced)
+{
+	// deflate without a preset dictionary, the adler32 trailer isn't checked
+	if (size < 6 || (data[0] & 0x0F) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20) != 0)
+		return false;
+	size_t consumed = 0;
+	return InflateRaw(data + 2, size - 2, destination, destinationSize, consumed, produced);
+}
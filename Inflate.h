@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// DEFLATE decompression (RFC 1951) for compressed volume payloads, with the gzip and zlib wrappers
+// around it. Output goes straight into a buffer of the size the volume header promises. Checksums
+// aren't verified, a corrupt stream is caught by its structure and the expected size.
+class Inflate {
+public:
+	// Raw deflate stream, consumed and produced are the bytes read and written. A stream that doesn't fit
+	// fills the destination up before it fails.
+	static bool InflateRaw(const uint8_t* data, size_t size, uint8_t* destination, size_t destinationSize, size_t& consumed, size_t& produced);
+
+	// Every member of a gzip file one after the other. Members that carry their compressed size
+	// (BGZF, the blocked gzip of bgzip and pigz --independent) are inflated in parallel, a single
+	// member stream can only be inflated from front to back.
+	static bool InflateGzip(const uint8_t* data, size_t size, uint8_t* destination, size_t destinationSize, size_t& produced);
+	// The first destinationSize bytes of a gzip file that may go on after them, or less if it ends before.
+	// For a header inside the stream, whose size the trailers can't tell (they only hold their member's
+	// size modulo 4 GiB).
+	static bool InflateGzipPrefix(const uint8_t* data, size_t size, uint8_t* destination, size_t destinationSize, size_t& produced);
+
+	// zlib stream, as MetaImage writes its compressed data
+	static bool InflateZlib(const uint8_t* data, size_t size, uint8_t* destination, size_t destinationSize, size_t& produced);
+
+	static bool IsGzip(const uint8_t* data, size_t size) { return size >= 2 && data[0] == 0x1F && data[1] == 0x8B; }
+};
@@ -0,0 +1,98 @@
+#include "Input.h"
+
+#include <cassert>
+#include <fstream>
+
+static constexpr uint32_t RECORDING_MAGIC = 0x4E495256; // "VRIN"
+static constexpr uint32_t RECORDING_VERSION = 1;
+
+struct RecordingHeader {
+	uint32_t magic = RECORDING_MAGIC;
+	uint32_t version = RECORDING_VERSION;
+	uint32_t frameCount = 0;
+};
+
+static_assert(sizeof(InputFrame) == 16, "Recorded frames are written as is");
+
+void InputRecorder::Record(const Input& input, float deltaTime)
+{
+	InputFrame frame{
+		.deltaTime = deltaTime,
+		.cursorX = input.cursorX,
+		.cursorY = input.cursorY };
+	for (uint32_t key = 0; key < input.keys.size(); key++)
+		frame.buttons |= input.keys[key] ? 1u << key : 0;
+	frame.buttons |= input.isRightButtonPressed ? InputFrame::RIGHT_BUTTON_BIT : 0;
+	mFrames.push_back(frame);
+}
+
+bool InputRecorder::Save(const std::filesystem::path& filePath) const
+{
+	std::ofstream file(filePath, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	const RecordingHeader header{ .frameCount = static_cast<uint32_t>(mFrames.size()) };
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(mFrames.data()), static_cast<std::streamsize>(mFrames.size() * sizeof(InputFrame)));
+	return file.good();
+}
+
+std::optional<std::vector<InputFrame>> InputReplay::Load(const std::filesystem::path& filePath)
+{
+	std::ifstream file(filePath, std::ios::binary);
+	if (!file.is_open())
+		return std::nullopt;
+
+	RecordingHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || header.magic != RECORDING_MAGIC || header.version != RECORDING_VERSION)
+		return std::nullopt;
+
+	std::vector<InputFrame> frames(header.frameCount);
+	file.read(reinterpret_cast<char*>(frames.data()), static_cast<std::streamsize>(frames.size() * sizeof(InputFrame)));
+	if (static_cast<size_t>(file.gcount()) != frames.size() * sizeof(InputFrame))
+		return std::nullopt;
+	return frames;
+}
+
+InputReplay::InputReplay(std::vector<InputFrame> frames, float fixedTimestep)
+	: mFrames(std::move(frames))
+	, mFixedTimestep(fixedTimestep)
+{
+	assert(fixedTimestep >= 0.0f);
+	if (!mFrames.empty())
+		mNextFrameTime = mFrames[0].deltaTime;
+}
+
+float InputReplay::Next(Input& input)
+{
+	assert(!IsFinished());
+
+	// without a fixed timestep the step ends exactly on the next recorded frame, both times are the same sums
+	const float deltaTime = mFixedTimestep > 0.0f ? mFixedTimestep : mFrames[mNextFrame].deltaTime;
+	const double stepEnd = mTime + deltaTime;
+
+	uint32_t buttons = mHeldFrame.buttons;
+	bool isFirstFrameInStep = true;
+	while (mNextFrame < mFrames.size() && mNextFrameTime <= stepEnd)
+	{
+		// a press shorter than a step still shows up in it, toggles in the application can't be missed
+		mHeldFrame = mFrames[mNextFrame];
+		buttons = isFirstFrameInStep ? mHeldFrame.buttons : buttons | mHeldFrame.buttons;
+		isFirstFrameInStep = false;
+
+		mNextFrame++;
+		if (mNextFrame < mFrames.size())
+			mNextFrameTime += mFrames[mNextFrame].deltaTime;
+	}
+	mTime = stepEnd;
+	mStepCount++;
+
+	for (uint32_t key = 0; key < input.keys.size(); key++)
+		input.keys[key] = (buttons >> key) & 1;
+	input.isRightButtonPressed = buttons & InputFrame::RIGHT_BUTTON_BIT;
+	input.cursorX = mHeldFrame.cursorX;
+	input.cursorY = mHeldFrame.cursorY;
+	return deltaTime;
+}
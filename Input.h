@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+// Input state the application and camera are driven by, filled from the window messages when live
+// or from a recording when replaying.
+struct Input {
+	std::array<bool, 26> keys{};
+	// cursor in screen pixels, only read while the right button drags the camera
+	float cursorX = 0.0f;
+	float cursorY = 0.0f;
+	bool isRightButtonPressed = false;
+};
+
+// one recorded Update, deltaTime is the time since the previous one
+struct InputFrame {
+	float deltaTime = 0.0f;
+	uint32_t buttons = 0; // bit per key, RIGHT_BUTTON_BIT for the right mouse button
+	float cursorX = 0.0f;
+	float cursorY = 0.0f;
+
+	static constexpr uint32_t RIGHT_BUTTON_BIT = 1u << 31;
+};
+
+// Collects the input of every frame, saved as a small header followed by the raw 16 byte frames.
+class InputRecorder {
+public:
+	void Record(const Input& input, float deltaTime);
+	bool Save(const std::filesystem::path& filePath) const;
+
+	const std::vector<InputFrame>& GetFrames() const { return mFrames; }
+
+private:
+	std::vector<InputFrame> mFrames;
+};
+
+// Plays a recording back frame by frame. With a fixed timestep the recording is resampled, each step
+// sees the last cursor and every button held during any recorded frame inside it, so a run takes the
+// same number of equally long frames no matter how fast it was recorded or is replayed.
+class InputReplay {
+public:
+	static std::optional<std::vector<InputFrame>> Load(const std::filesystem::path& filePath);
+
+	// a fixedTimestep of 0 replays the recorded frame times
+	InputReplay(std::vector<InputFrame> frames, float fixedTimestep);
+
+	// overwrites input with the next frame, returns its delta time
+	float Next(Input& input);
+	bool IsFinished() const { return mNextFrame >= mFrames.size(); }
+
+	uint32_t GetStepCount() const { return mStepCount; }
+
+private:
+	std::vector<InputFrame> mFrames;
+	float mFixedTimestep = 0.0f;
+
+	size_t mNextFrame = 0;
+	double mNextFrameTime = 0.0; // when the next recorded frame happened
+	double mTime = 0.0;
+	InputFrame mHeldFrame{}; // the last one replayed, holds until the next recorded frame
+	uint32_t mStepCount = 0;
+};
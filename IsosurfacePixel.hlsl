@@ -0,0 +1,15 @@
+struct PixelInput {
+	float4 position : SV_POSITION;
+	float3 worldPosition : WORLD_POSITION;
+};
+
+float4 PSMain(PixelInput input) : SV_TARGET
+{
+	// flat normal from the screen space derivatives, saves storing normals per vertex
+	float3 normal = normalize(cross(ddy(input.worldPosition), ddx(input.worldPosition)));
+	float3 lightDirection = normalize(float3(0.3f, 0.8f, -0.5f));
+
+	float diffuse = abs(dot(normal, lightDirection));
+	float3 color = float3(0.9f, 0.87f, 0.8f) * (0.15f + 0.85f * diffuse);
+	return float4(color, 1.0f);
+}
\ No newline at end of file
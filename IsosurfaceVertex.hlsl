@@ -0,0 +1,55 @@
+struct VertexOutput {
+	float4 position : SV_POSITION;
+	float3 worldPosition : WORLD_POSITION;
+};
+
+struct CameraConstants {
+	matrix projMatrix;
+	matrix cameraMatrix;
+};
+
+struct PerFrameConstants {
+	matrix modelMatrix;
+	float2 cameraDimensions;
+	uint frontBufferIndex;
+	uint backBufferIndex;
+	uint cubeBufferIndex;
+	uint volumeDataBufferIndex;
+	uint isosurfaceVertexBufferIndex;
+	uint isosurfaceIndexBufferIndex;
+	uint3 volumeDimensions;
+	uint pageTableIndex;
+	uint3 brickGridDimensions;
+	uint brickAtlasIndex;
+	uint3 atlasSlotDimensions;
+	uint brickFeedbackIndex;
+	uint sliceIndex;
+	uint illuminationIndex;
+	uint labelIndex;
+	uint labelBitsPerVoxel;
+	uint3 labelDimensions;
+	uint labelCount;
+	uint4 labelVisibility[2];
+	uint4 labelColors[64];
+	uint3 stepGridDimensions;
+	uint stepGridIndex;
+};
+
+
+ConstantBuffer<CameraConstants> CameraConstantBuffer : register(b0, space0);
+ConstantBuffer<PerFrameConstants> PerFrameConstantBuffer : register(b0, space1);
+
+VertexOutput VSMain(uint vertexId : SV_VERTEXID)
+{
+	ByteAddressBuffer indexBuffer = ResourceDescriptorHeap[PerFrameConstantBuffer.isosurfaceIndexBufferIndex];
+	ByteAddressBuffer vertexBuffer = ResourceDescriptorHeap[PerFrameConstantBuffer.isosurfaceVertexBufferIndex];
+	uint index = indexBuffer.Load(vertexId * sizeof(uint));
+	float3 pos = vertexBuffer.Load<float3>(index * sizeof(float3));
+
+	VertexOutput output;
+	output.position = mul(float4(pos, 1.0f), PerFrameConstantBuffer.modelMatrix);
+	output.worldPosition = output.position.xyz;
+	output.position = mul(output.position, CameraConstantBuffer.cameraMatrix);
+	output.position = mul(output.position, CameraConstantBuffer.projMatrix);
+	return output;
+}
\ No newline at end of file
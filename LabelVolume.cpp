@@ -0,0 +1,276 @@
+#include "LabelVolume.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+// labels packed per job, a multiple of every SIMD step so only the last job has a scalar tail
+static constexpr size_t PACK_JOB_SIZE = 64 * 1024;
+
+uint32_t LabelVolume::GetBitsPerLabel(uint32_t labelCount)
+{
+	assert(labelCount <= MAX_LABEL_COUNT);
+	if (labelCount <= 2)
+		return 1;
+	if (labelCount <= 4)
+		return 2;
+	if (labelCount <= 16)
+		return 4;
+	return 8;
+}
+
+size_t LabelVolume::GetPackedSize(size_t count, uint32_t bitsPerLabel)
+{
+	return (count * bitsPerLabel + 31) / 32 * 4;
+}
+
+void LabelVolume::PackScalar(const uint8_t* labels, size_t count, uint32_t bitsPerLabel, uint8_t* packed)
+{
+	const uint32_t labelsPerByte = 8 / bitsPerLabel;
+	for (size_t byte = 0; byte * labelsPerByte < count; byte++)
+	{
+		const size_t first = byte * labelsPerByte;
+		const uint32_t labelCount = static_cast<uint32_t>(std::min<size_t>(labelsPerByte, count - first));
+		uint32_t value = 0;
+		for (uint32_t i = 0; i < labelCount; i++)
+			value |= static_cast<uint32_t>(labels[first + i]) << (i * bitsPerLabel);
+		packed[byte] = static_cast<uint8_t>(value);
+	}
+}
+
+void LabelVolume::UnpackScalar(const uint8_t* packed, size_t count, uint32_t bitsPerLabel, uint8_t* labels)
+{
+	const uint32_t mask = (1u << bitsPerLabel) - 1;
+	for (size_t i = 0; i < count; i++)
+	{
+		const size_t bit = i * bitsPerLabel;
+		labels[i] = static_cast<uint8_t>((packed[bit / 8] >> (bit % 8)) & mask);
+	}
+}
+
+void LabelVolume::Pack(const uint8_t* labels, size_t count, uint32_t bitsPerLabel, uint8_t* packed)
+{
+	if (bitsPerLabel == 8)
+	{
+		memcpy(packed, labels, count);
+		return;
+	}
+
+	size_t i = 0;
+#ifdef VOLUME_SSE2
+	const __m128i lowByte = _mm_set1_epi16(0x00FF);
+	if (bitsPerLabel == 4)
+	{
+		// pairs of bytes become one byte inside every 16 bit lane, then the lanes are narrowed
+		for (; i + 32 <= count; i += 32)
+		{
+			__m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(labels + i));
+			__m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(labels + i + 16));
+			first = _mm_and_si128(_mm_or_si128(first, _mm_srli_epi16(first, 4)), lowByte);
+			second = _mm_and_si128(_mm_or_si128(second, _mm_srli_epi16(second, 4)), lowByte);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(packed + i / 2), _mm_packus_epi16(first, second));
+		}
+	}
+	else if (bitsPerLabel == 2)
+	{
+		// same again one level up, four labels end up in the low byte of every 32 bit lane
+		const __m128i lowByte32 = _mm_set1_epi32(0x000000FF);
+		for (; i + 64 <= count; i += 64)
+		{
+			__m128i values[4];
+			for (uint32_t v = 0; v < 4; v++)
+			{
+				__m128i labelVector = _mm_loadu_si128(reinterpret_cast<const __m128i*>(labels + i + v * 16));
+				labelVector = _mm_and_si128(_mm_or_si128(labelVector, _mm_srli_epi16(labelVector, 6)), lowByte);
+				values[v] = _mm_and_si128(_mm_or_si128(labelVector, _mm_srli_epi32(labelVector, 12)), lowByte32);
+			}
+			const __m128i low = _mm_packs_epi32(values[0], values[1]);
+			const __m128i high = _mm_packs_epi32(values[2], values[3]);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(packed + i / 4), _mm_packus_epi16(low, high));
+		}
+	}
+	else
+	{
+		// the label bit moved into the sign bit of every byte is exactly what movemask gathers
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m128i labelVector = _mm_loadu_si128(reinterpret_cast<const __m128i*>(labels + i));
+			const uint16_t bits = static_cast<uint16_t>(_mm_movemask_epi8(_mm_slli_epi16(labelVector, 7)));
+			memcpy(packed + i / 8, &bits, sizeof(bits));
+		}
+	}
+#endif
+	PackScalar(labels + i, count - i, bitsPerLabel, packed + i * bitsPerLabel / 8);
+}
+
+void LabelVolume::Unpack(const uint8_t* packed, size_t count, uint32_t bitsPerLabel, uint8_t* labels)
+{
+	if (bitsPerLabel == 8)
+	{
+		memcpy(labels, packed, count);
+		return;
+	}
+
+	size_t i = 0;
+#ifdef VOLUME_SSE2
+	if (bitsPerLabel == 4)
+	{
+		const __m128i nibble = _mm_set1_epi8(0x0F);
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(packed + i / 2));
+			const __m128i low = _mm_and_si128(bytes, nibble);
+			const __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(labels + i), _mm_unpacklo_epi8(low, high));
+		}
+	}
+	else if (bitsPerLabel == 2)
+	{
+		const __m128i crumb = _mm_set1_epi8(0x03);
+		for (; i + 16 <= count; i += 16)
+		{
+			int32_t word;
+			memcpy(&word, packed + i / 4, sizeof(word));
+			const __m128i bytes = _mm_cvtsi32_si128(word);
+			const __m128i first = _mm_and_si128(bytes, crumb);
+			const __m128i second = _mm_and_si128(_mm_srli_epi16(bytes, 2), crumb);
+			const __m128i third = _mm_and_si128(_mm_srli_epi16(bytes, 4), crumb);
+			const __m128i fourth = _mm_and_si128(_mm_srli_epi16(bytes, 6), crumb);
+			const __m128i firstHalf = _mm_unpacklo_epi8(first, second);
+			const __m128i secondHalf = _mm_unpacklo_epi8(third, fourth);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(labels + i), _mm_unpacklo_epi16(firstHalf, secondHalf));
+		}
+	}
+	else
+	{
+		// both bytes are broadcast over 8 lanes each and every lane tests its own bit
+		const __m128i bitMasks = _mm_set_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+		const __m128i one = _mm_set1_epi8(1);
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m128i bytes = _mm_unpacklo_epi64(
+				_mm_set1_epi8(static_cast<char>(packed[i / 8])),
+				_mm_set1_epi8(static_cast<char>(packed[i / 8 + 1])));
+			const __m128i isSet = _mm_cmpeq_epi8(_mm_and_si128(bytes, bitMasks), bitMasks);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(labels + i), _mm_and_si128(isSet, one));
+		}
+	}
+#endif
+	UnpackScalar(packed + i * bitsPerLabel / 8, count - i, bitsPerLabel, labels + i);
+}
+
+void LabelVolume::Build(const uint8_t* labels, const VolumeDimensions& volumeDimensions, uint32_t labelCount)
+{
+	const size_t voxelCount = volumeDimensions.GetVoxelCount();
+	if (labelCount == 0)
+		labelCount = static_cast<uint32_t>(*std::max_element(labels, labels + voxelCount)) + 1;
+
+	mDimensions = volumeDimensions;
+	mLabelCount = labelCount;
+	mBitsPerLabel = GetBitsPerLabel(labelCount);
+
+	// the padding of the last word is cleared, everything else gets written by the pack jobs
+	mPacked.resize(GetPackedSize(voxelCount, mBitsPerLabel));
+	memset(mPacked.data() + mPacked.size() - 4, 0, 4);
+
+	const uint32_t jobCount = static_cast<uint32_t>((voxelCount + PACK_JOB_SIZE - 1) / PACK_JOB_SIZE);
+	ThreadPool::Get().ParallelFor(jobCount, [&](uint32_t job) {
+		const size_t first = job * PACK_JOB_SIZE;
+		Pack(labels + first, std::min(PACK_JOB_SIZE, voxelCount - first), mBitsPerLabel, mPacked.data() + first * mBitsPerLabel / 8);
+	});
+
+	mBrickDimensions = {
+		.width = (volumeDimensions.width + BRICK_SIZE - 1) / BRICK_SIZE,
+		.height = (volumeDimensions.height + BRICK_SIZE - 1) / BRICK_SIZE,
+		.depth = (volumeDimensions.depth + BRICK_SIZE - 1) / BRICK_SIZE };
+	mBrickMasks.assign(mBrickDimensions.GetVoxelCount(), {});
+
+	ThreadPool::Get().ParallelFor(static_cast<uint32_t>(mBrickMasks.size()), [&](uint32_t brick) {
+		BuildBrickMask(labels,
+			brick % mBrickDimensions.width,
+			(brick / mBrickDimensions.width) % mBrickDimensions.height,
+			brick / (mBrickDimensions.width * mBrickDimensions.height));
+	});
+}
+
+void LabelVolume::BuildBrickMask(const uint8_t* labels, uint32_t x, uint32_t y, uint32_t z)
+{
+	const uint32_t beginX = x * BRICK_SIZE > 0 ? x * BRICK_SIZE - 1 : 0;
+	const uint32_t beginY = y * BRICK_SIZE > 0 ? y * BRICK_SIZE - 1 : 0;
+	const uint32_t beginZ = z * BRICK_SIZE > 0 ? z * BRICK_SIZE - 1 : 0;
+	const uint32_t endX = std::min((x + 1) * BRICK_SIZE + 1, mDimensions.width);
+	const uint32_t endY = std::min((y + 1) * BRICK_SIZE + 1, mDimensions.height);
+	const uint32_t endZ = std::min((z + 1) * BRICK_SIZE + 1, mDimensions.depth);
+	const uint32_t rowLength = endX - beginX;
+
+	// a byte per label instead of bits keeps the inner loop free of read-modify-write chains
+	alignas(16) std::array<uint8_t, MAX_LABEL_COUNT> isPresent{};
+	for (uint32_t voxelZ = beginZ; voxelZ < endZ; voxelZ++)
+	{
+		for (uint32_t voxelY = beginY; voxelY < endY; voxelY++)
+		{
+			const uint8_t* row = labels + mDimensions.GetIndex(beginX, voxelY, voxelZ);
+			uint32_t i = 0;
+#ifdef VOLUME_SSE2
+			// segmentations are mostly long runs of one label, those cost one compare per 16 voxels
+			for (; i + 16 <= rowLength; i += 16)
+			{
+				const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+				if (_mm_movemask_epi8(_mm_cmpeq_epi8(values, _mm_set1_epi8(static_cast<char>(row[i])))) == 0xFFFF)
+				{
+					isPresent[row[i]] = 1;
+					continue;
+				}
+				for (uint32_t j = 0; j < 16; j++)
+					isPresent[row[i + j]] = 1;
+			}
+#endif
+			for (; i < rowLength; i++)
+				isPresent[row[i]] = 1;
+		}
+	}
+
+	LabelMask& mask = mBrickMasks[mBrickDimensions.GetIndex(x, y, z)];
+	for (uint32_t label = 0; label < MAX_LABEL_COUNT; label += 16)
+	{
+		uint32_t bits = 0;
+#ifdef VOLUME_SSE2
+		const __m128i present = _mm_load_si128(reinterpret_cast<const __m128i*>(isPresent.data() + label));
+		bits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(present, _mm_setzero_si128())));
+#else
+		for (uint32_t i = 0; i < 16; i++)
+			bits |= static_cast<uint32_t>(isPresent[label + i]) << i;
+#endif
+		mask[label / 32] |= bits << (label % 32);
+	}
+}
+
+uint8_t LabelVolume::GetLabel(uint32_t x, uint32_t y, uint32_t z) const
+{
+	const size_t bit = mDimensions.GetIndex(x, y, z) * mBitsPerLabel;
+	return static_cast<uint8_t>((mPacked[bit / 8] >> (bit % 8)) & ((1u << mBitsPerLabel) - 1));
+}
+
+LabelVolume::LabelMask LabelVolume::GetVisibleLabels() const
+{
+	LabelMask mask{};
+	for (uint32_t label = 0; label < MAX_LABEL_COUNT; label++)
+	{
+		if (mStyles[label].isVisible && mStyles[label].opacity > 0.0f)
+			mask[label / 32] |= 1u << (label % 32);
+	}
+	return mask;
+}
+
+std::vector<uint8_t> LabelVolume::GetVisibleBricks() const
+{
+	const LabelMask visibleLabels = GetVisibleLabels();
+	std::vector<uint8_t> isVisible(mBrickMasks.size(), 0);
+	for (size_t brick = 0; brick < mBrickMasks.size(); brick++)
+	{
+		for (size_t word = 0; word < visibleLabels.size(); word++)
+			isVisible[brick] |= (mBrickMasks[brick][word] & visibleLabels[word]) != 0;
+	}
+	return isVisible;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "VolumeTypes.h"
+#include "Arena.h"
+
+#include <array>
+#include <vector>
+
+struct LabelStyle {
+	float red = 1.0f;
+	float green = 1.0f;
+	float blue = 1.0f;
+	float opacity = 1.0f;
+	bool isVisible = true;
+};
+
+// Segmentation volume with one label per voxel, stored with the fewest bits (1, 2, 4 or 8) its
+// label count needs. Voxels are packed in linear order starting at the low bits of each byte, so
+// read as little endian 32 bit words no label ever straddles a word. Every BRICK_SIZE^3 brick (with
+// the same one voxel apron as the MinMaxGrid) keeps a mask of the labels in it, which lets the
+// renderer drop bricks that only hold hidden labels.
+class LabelVolume {
+public:
+	static constexpr uint32_t MAX_LABEL_COUNT = 256;
+	using LabelMask = std::array<uint32_t, MAX_LABEL_COUNT / 32>; // bit per label
+
+	static uint32_t GetBitsPerLabel(uint32_t labelCount);
+	// bytes for count labels, rounded up to whole 32 bit words
+	static size_t GetPackedSize(size_t count, uint32_t bitsPerLabel);
+
+	// labels have to fit into bitsPerLabel
+	static void Pack(const uint8_t* labels, size_t count, uint32_t bitsPerLabel, uint8_t* packed);
+	static void Unpack(const uint8_t* packed, size_t count, uint32_t bitsPerLabel, uint8_t* labels);
+	// one label at a time without SIMD, the reference the vectorized paths are checked against
+	static void PackScalar(const uint8_t* labels, size_t count, uint32_t bitsPerLabel, uint8_t* packed);
+	static void UnpackScalar(const uint8_t* packed, size_t count, uint32_t bitsPerLabel, uint8_t* labels);
+
+	// labelCount of 0 takes the highest label + 1
+	void Build(const uint8_t* labels, const VolumeDimensions& volumeDimensions, uint32_t labelCount = 0);
+
+	const VolumeDimensions& GetDimensions() const { return mDimensions; }
+	uint32_t GetLabelCount() const { return mLabelCount; }
+	uint32_t GetBitsPerLabel() const { return mBitsPerLabel; }
+	const VoxelBuffer& GetPacked() const { return mPacked; }
+	uint8_t GetLabel(uint32_t x, uint32_t y, uint32_t z) const;
+
+	const VolumeDimensions& GetBrickDimensions() const { return mBrickDimensions; }
+	const LabelMask& GetBrickMask(size_t brick) const { return mBrickMasks[brick]; }
+
+	void SetStyle(uint8_t label, const LabelStyle& style) { mStyles[label] = style; }
+	const LabelStyle& GetStyle(uint8_t label) const { return mStyles[label]; }
+	LabelMask GetVisibleLabels() const;
+
+	// 1 for every brick holding at least one visible label, laid out like the MinMaxGrid
+	std::vector<uint8_t> GetVisibleBricks() const;
+
+private:
+	void BuildBrickMask(const uint8_t* labels, uint32_t x, uint32_t y, uint32_t z);
+
+private:
+	VolumeDimensions mDimensions{};
+	uint32_t mLabelCount = 0;
+	uint32_t mBitsPerLabel = 8;
+	VoxelBuffer mPacked;
+
+	VolumeDimensions mBrickDimensions{};
+	std::vector<LabelMask> mBrickMasks;
+	std::array<LabelStyle, MAX_LABEL_COUNT> mStyles{};
+};
@@ -0,0 +1,248 @@
+#include "LodSelector.h"
+#include "MinMaxGrid.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// the serial part of the traversal walks down until a level has this many nodes, their subtrees are
+// then split over the pool
+static constexpr uint32_t MIN_TASK_COUNT = 256;
+// a node is never kept closer than this many of its sizes, enough for touching nodes to stay within
+// one level of each other (the depth of two touching nodes differs by at most a diagonal, sqrt(3) sizes)
+static constexpr float MIN_SPLIT_DEPTH_IN_NODE_SIZES = 2.0f;
+
+void LodSelector::Build(const MinMaxGrid& grid, const VolumeDimensions& volumeDimensions)
+{
+	mVolumeDimensions = volumeDimensions;
+	mLevels.clear();
+	mLevels.push_back({ .dimensions = grid.GetDimensions(), .max = grid.GetMaxValues() });
+
+	while (mLevels.back().dimensions.width > 1 || mLevels.back().dimensions.height > 1 || mLevels.back().dimensions.depth > 1)
+	{
+		const Level& fine = mLevels.back();
+		Level coarse;
+		coarse.dimensions = {
+			.width = (fine.dimensions.width + 1) / 2,
+			.height = (fine.dimensions.height + 1) / 2,
+			.depth = (fine.dimensions.depth + 1) / 2 };
+		coarse.max.assign(coarse.dimensions.GetVoxelCount(), 0);
+
+		for (uint32_t z = 0; z < fine.dimensions.depth; z++)
+		{
+			for (uint32_t y = 0; y < fine.dimensions.height; y++)
+			{
+				for (uint32_t x = 0; x < fine.dimensions.width; x++)
+				{
+					uint8_t& max = coarse.max[coarse.dimensions.GetIndex(x / 2, y / 2, z / 2)];
+					max = std::max(max, fine.max[fine.dimensions.GetIndex(x, y, z)]);
+				}
+			}
+		}
+		mLevels.push_back(std::move(coarse));
+	}
+	assert(mLevels[0].dimensions.width <= UINT16_MAX && mLevels[0].dimensions.height <= UINT16_MAX && mLevels[0].dimensions.depth <= UINT16_MAX);
+}
+
+void LodSelector::SetView(const LodView& view)
+{
+	// the planes of the clip space box in world space, for row vectors the clip coordinates are dot
+	// products with the columns of the matrix
+	const float (&m)[4][4] = view.viewProjection;
+	auto column = [&](uint32_t j) { return Plane{ m[0][j], m[1][j], m[2][j], m[3][j] }; };
+	auto add = [](const Plane& a, const Plane& b, float sign) { return Plane{ a.x + sign * b.x, a.y + sign * b.y, a.z + sign * b.z, a.w + sign * b.w }; };
+	const Plane x = column(0);
+	const Plane y = column(1);
+	const Plane z = column(2);
+	const Plane w = column(3);
+	mFrustumPlanes = { add(w, x, 1.0f), add(w, x, -1.0f), add(w, y, 1.0f), add(w, y, -1.0f), z, add(w, z, -1.0f) };
+	mDepthPlane = w;
+
+	mVoxelSize = {
+		(view.volumeMax.x - view.volumeMin.x) / mVolumeDimensions.width,
+		(view.volumeMax.y - view.volumeMin.y) / mVolumeDimensions.height,
+		(view.volumeMax.z - view.volumeMin.z) / mVolumeDimensions.depth };
+	mVoxelOrigin = {
+		view.volumeMin.x + 0.5f * mVoxelSize.x,
+		view.volumeMin.y + 0.5f * mVoxelSize.y,
+		view.volumeMin.z + 0.5f * mVoxelSize.z };
+	mVoxelEnd = {
+		mVoxelOrigin.x + (mVolumeDimensions.width - 1) * mVoxelSize.x,
+		mVoxelOrigin.y + (mVolumeDimensions.height - 1) * mVoxelSize.y,
+		mVoxelOrigin.z + (mVolumeDimensions.depth - 1) * mVoxelSize.z };
+
+	// a level l sample is 2^l voxels, its on-screen size is that times pixelsPerUnit over the depth
+	const float voxelSize = std::max({ mVoxelSize.x, mVoxelSize.y, mVoxelSize.z });
+	const float depthPerSampleSize = std::max(view.pixelsPerUnit / view.pixelError, MIN_SPLIT_DEPTH_IN_NODE_SIZES * BRICK_SIZE);
+	mSplitDepths.resize(mLevels.size());
+	mNodeSizes.resize(mLevels.size());
+	for (uint32_t level = 0; level < mLevels.size(); level++)
+	{
+		const float levelScale = static_cast<float>(1u << level);
+		mSplitDepths[level] = levelScale * voxelSize * depthPerSampleSize;
+		mNodeSizes[level] = { levelScale * BRICK_SIZE * mVoxelSize.x, levelScale * BRICK_SIZE * mVoxelSize.y, levelScale * BRICK_SIZE * mVoxelSize.z };
+	}
+}
+
+void LodSelector::GetNodeBox(uint32_t level, uint32_t x, uint32_t y, uint32_t z, Float3& boxMin, Float3& boxMax) const
+{
+	// from the first voxel of the node to the first of the next, the last node stops at the last voxel
+	const Float3& nodeSize = mNodeSizes[level];
+	boxMin = {
+		mVoxelOrigin.x + x * nodeSize.x,
+		mVoxelOrigin.y + y * nodeSize.y,
+		mVoxelOrigin.z + z * nodeSize.z };
+	boxMax = {
+		std::min(boxMin.x + nodeSize.x, mVoxelEnd.x),
+		std::min(boxMin.y + nodeSize.y, mVoxelEnd.y),
+		std::min(boxMin.z + nodeSize.z, mVoxelEnd.z) };
+}
+
+LodSelector::Decision LodSelector::Decide(uint32_t level, Node& node) const
+{
+	const Level& nodeLevel = mLevels[level];
+	if (nodeLevel.max[nodeLevel.dimensions.GetIndex(node.x, node.y, node.z)] <= mThreshold)
+		return Decision::Cull;
+
+	Float3 boxMin;
+	Float3 boxMax;
+	GetNodeBox(level, node.x, node.y, node.z, boxMin, boxMax);
+	const Float3 center = { 0.5f * (boxMin.x + boxMax.x), 0.5f * (boxMin.y + boxMax.y), 0.5f * (boxMin.z + boxMax.z) };
+	const Float3 extent = { 0.5f * (boxMax.x - boxMin.x), 0.5f * (boxMax.y - boxMin.y), 0.5f * (boxMax.z - boxMin.z) };
+
+	// signed distance of the center to a plane and how far the box reaches along the plane's normal
+	auto distance = [&](const Plane& plane) { return plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w; };
+	auto radius = [&](const Plane& plane) { return std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z; };
+
+	for (uint32_t i = 0; i < mFrustumPlanes.size(); i++)
+	{
+		if ((node.planeMask & (1u << i)) == 0)
+			continue;
+
+		const float planeDistance = distance(mFrustumPlanes[i]);
+		const float planeRadius = radius(mFrustumPlanes[i]);
+		if (planeDistance + planeRadius < 0.0f)
+			return Decision::Cull;
+		if (planeDistance - planeRadius >= 0.0f)
+			node.planeMask &= ~(1u << i);
+	}
+
+	if (level == 0)
+		return Decision::Select;
+
+	// a box reaching behind the eye has a negative nearest depth and is always split
+	const float depth = distance(mDepthPlane);
+	const float depthRadius = radius(mDepthPlane);
+	if (depth - depthRadius >= mSplitDepths[level])
+		return Decision::Select;
+
+	// nothing under the node is further away than its farthest corner, so if that is still closer
+	// than the first level's split depth every level down to the bricks is split
+	return node.planeMask == 0 && depth + depthRadius < mSplitDepths[1] ? Decision::SelectBricks : Decision::Split;
+}
+
+void LodSelector::SelectBricks(uint32_t level, const Node& node, std::vector<LodBrick>& selection) const
+{
+	const Level& bricks = mLevels[0];
+	const uint32_t nodeSize = 1u << level;
+	const uint32_t endX = std::min((node.x + 1u) * nodeSize, bricks.dimensions.width);
+	const uint32_t endY = std::min((node.y + 1u) * nodeSize, bricks.dimensions.height);
+	const uint32_t endZ = std::min((node.z + 1u) * nodeSize, bricks.dimensions.depth);
+	for (uint32_t z = node.z * nodeSize; z < endZ; z++)
+	{
+		for (uint32_t y = node.y * nodeSize; y < endY; y++)
+		{
+			const uint8_t* max = &bricks.max[bricks.dimensions.GetIndex(0, y, z)];
+			for (uint32_t x = node.x * nodeSize; x < endX; x++)
+			{
+				if (max[x] > mThreshold)
+					selection.push_back({ .x = static_cast<uint16_t>(x), .y = static_cast<uint16_t>(y), .z = static_cast<uint16_t>(z) });
+			}
+		}
+	}
+}
+
+void LodSelector::Visit(uint32_t level, Node node, std::vector<LodBrick>& selection) const
+{
+	const Decision decision = Decide(level, node);
+	if (decision == Decision::Cull)
+		return;
+	if (decision == Decision::Select)
+	{
+		selection.push_back({ .x = node.x, .y = node.y, .z = node.z, .level = static_cast<uint8_t>(level) });
+		return;
+	}
+	if (decision == Decision::SelectBricks)
+	{
+		SelectBricks(level, node, selection);
+		return;
+	}
+
+	const VolumeDimensions& children = mLevels[level - 1].dimensions;
+	for (uint32_t z = node.z * 2u; z < std::min(node.z * 2u + 2, children.depth); z++)
+	{
+		for (uint32_t y = node.y * 2u; y < std::min(node.y * 2u + 2, children.height); y++)
+		{
+			for (uint32_t x = node.x * 2u; x < std::min(node.x * 2u + 2, children.width); x++)
+			{
+				Visit(level - 1, { static_cast<uint16_t>(x), static_cast<uint16_t>(y), static_cast<uint16_t>(z), node.planeMask }, selection);
+			}
+		}
+	}
+}
+
+const std::vector<LodBrick>& LodSelector::Select(const LodView& view, uint8_t threshold)
+{
+	mSelection.clear();
+	if (mLevels.empty())
+		return mSelection;
+
+	SetView(view);
+	mThreshold = threshold;
+
+	// the coarsest level with enough nodes to keep every thread busy, or the bricks themselves
+	uint32_t taskLevel = static_cast<uint32_t>(mLevels.size()) - 1;
+	while (taskLevel > 0 && mLevels[taskLevel].dimensions.GetVoxelCount() < MIN_TASK_COUNT)
+		taskLevel--;
+
+	// the few nodes above it are decided here, the ones still split become the tasks
+	mNodes.assign(1, Node{});
+	for (uint32_t level = static_cast<uint32_t>(mLevels.size()) - 1; level > taskLevel; level--)
+	{
+		mChildNodes.clear();
+		const VolumeDimensions& children = mLevels[level - 1].dimensions;
+		for (Node node : mNodes)
+		{
+			const Decision decision = Decide(level, node);
+			if (decision == Decision::Select)
+				mSelection.push_back({ .x = node.x, .y = node.y, .z = node.z, .level = static_cast<uint8_t>(level) });
+			if (decision == Decision::SelectBricks)
+				SelectBricks(level, node, mSelection);
+			if (decision != Decision::Split)
+				continue;
+
+			for (uint32_t z = node.z * 2u; z < std::min(node.z * 2u + 2, children.depth); z++)
+			{
+				for (uint32_t y = node.y * 2u; y < std::min(node.y * 2u + 2, children.height); y++)
+				{
+					for (uint32_t x = node.x * 2u; x < std::min(node.x * 2u + 2, children.width); x++)
+						mChildNodes.push_back({ static_cast<uint16_t>(x), static_cast<uint16_t>(y), static_cast<uint16_t>(z), node.planeMask });
+				}
+			}
+		}
+		std::swap(mNodes, mChildNodes);
+	}
+
+	mTaskSelections.resize(std::max(mTaskSelections.size(), mNodes.size()));
+	ThreadPool::Get().ParallelFor(static_cast<uint32_t>(mNodes.size()), [&](uint32_t task) {
+		mTaskSelections[task].clear();
+		Visit(taskLevel, mNodes[task], mTaskSelections[task]);
+	});
+
+	for (uint32_t task = 0; task < mNodes.size(); task++)
+	{
+		mSelection.insert(mSelection.end(), mTaskSelections[task].begin(), mTaskSelections[task].end());
+	}
+	return mSelection;
+}
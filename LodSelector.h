@@ -0,0 +1,106 @@
+#pragma once
+
+#include "VolumeTypes.h"
+
+#include <array>
+#include <vector>
+
+class MinMaxGrid;
+
+// A node of the brick octree picked for rendering, x, y and z count nodes of its level and a level l
+// node covers 2^l bricks along every axis, to be sampled with 2^l voxels per sample.
+struct LodBrick {
+	uint16_t x = 0;
+	uint16_t y = 0;
+	uint16_t z = 0;
+	uint8_t level = 0;
+};
+
+struct LodView {
+	// world to clip space for row vectors, laid out like DirectX::XMFLOAT4X4
+	float viewProjection[4][4]{};
+	// pixels a unit length covers at a view depth of 1, the projection's y scale times half the viewport height
+	float pixelsPerUnit = 1.0f;
+	// largest on-screen size of a sample before a finer level is picked
+	float pixelError = 1.0f;
+	// world space box the volume's voxels span
+	Float3 volumeMin{};
+	Float3 volumeMax{};
+};
+
+// Picks a level of detail for every brick of the volume each frame. The bricks of a MinMaxGrid are
+// the leaves of an implicit octree, traversal drops nodes outside the view frustum or without
+// voxels above the threshold and stops at the first node whose samples stay under the pixel error.
+// The split distance of a level never drops below twice the node size, which keeps any two
+// touching nodes of the selection within one level of each other so the transitions don't crack.
+class LodSelector {
+public:
+	// per-node maxima of every level, rebuilt when the grid changes
+	void Build(const MinMaxGrid& grid, const VolumeDimensions& volumeDimensions);
+
+	uint32_t GetLevelCount() const { return static_cast<uint32_t>(mLevels.size()); }
+	const VolumeDimensions& GetLevelDimensions(uint32_t level) const { return mLevels[level].dimensions; }
+
+	// the selected nodes, the coarse ones picked near the root first and the rest grouped by subtree
+	const std::vector<LodBrick>& Select(const LodView& view, uint8_t threshold);
+	const std::vector<LodBrick>& GetSelection() const { return mSelection; }
+
+private:
+	struct Level {
+		VolumeDimensions dimensions{};
+		std::vector<uint8_t> max;
+	};
+
+	struct Plane {
+		float x = 0.0f;
+		float y = 0.0f;
+		float z = 0.0f;
+		float w = 0.0f;
+	};
+
+	static constexpr uint8_t ALL_PLANES = 0x3f;
+
+	struct Node {
+		uint16_t x = 0;
+		uint16_t y = 0;
+		uint16_t z = 0;
+		// a bit for every frustum plane the node straddles, planes the node is inside of needn't be
+		// tested for its children and 0 is a node that is in the frustum as a whole
+		uint8_t planeMask = ALL_PLANES;
+	};
+
+	enum class Decision {
+		Cull,
+		Select,
+		Split,
+		// the node is in the frustum and all of it is close enough for the bricks themselves
+		SelectBricks,
+	};
+
+	void SetView(const LodView& view);
+	void GetNodeBox(uint32_t level, uint32_t x, uint32_t y, uint32_t z, Float3& boxMin, Float3& boxMax) const;
+	Decision Decide(uint32_t level, Node& node) const;
+	void SelectBricks(uint32_t level, const Node& node, std::vector<LodBrick>& selection) const;
+	void Visit(uint32_t level, Node node, std::vector<LodBrick>& selection) const;
+
+private:
+	VolumeDimensions mVolumeDimensions{};
+	// finest level first
+	std::vector<Level> mLevels;
+
+	std::array<Plane, 6> mFrustumPlanes{};
+	Plane mDepthPlane{};
+	std::vector<float> mSplitDepths;
+	// world space size of a node of every level
+	std::vector<Float3> mNodeSizes;
+	// centers of the first and last voxel
+	Float3 mVoxelOrigin{};
+	Float3 mVoxelEnd{};
+	Float3 mVoxelSize{};
+	uint8_t mThreshold = 0;
+
+	std::vector<LodBrick> mSelection;
+	std::vector<Node> mNodes;
+	std::vector<Node> mChildNodes;
+	std::vector<std::vector<LodBrick>> mTaskSelections;
+};
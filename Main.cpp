@@ -1,17 +1,74 @@
 #include "Application.h"
 #include "Window.h"
 
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <string>
 
-int main()
+// --record <file> saves the session's input on exit, --replay <file> plays one back and exits when it
+// ends, --timestep <seconds> replays with a fixed frame time instead of the recorded ones,
+// --capture <directory> writes every frame there, --null-backend 1 records frames without the GPU
+// and prints what they contain, --dicom <directory> loads the DICOM series there instead of the bundled volume,
+// --volume <file> loads a NRRD, NIfTI or MetaImage file instead
+int main(int argc, char** argv)
 {
+	std::filesystem::path recordPath;
+	std::filesystem::path replayPath;
+	std::filesystem::path captureDirectory;
+	float fixedTimestep = 0.0f;
+	bool isNullBackend = false;
+	std::filesystem::path dicomDirectory;
+	std::filesystem::path volumePath;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--record") == 0)
+			recordPath = argv[i + 1];
+		else if (strcmp(argv[i], "--replay") == 0)
+			replayPath = argv[i + 1];
+		else if (strcmp(argv[i], "--timestep") == 0)
+			fixedTimestep = std::stof(argv[i + 1]);
+		else if (strcmp(argv[i], "--capture") == 0)
+			captureDirectory = argv[i + 1];
+		else if (strcmp(argv[i], "--null-backend") == 0)
+			isNullBackend = strcmp(argv[i + 1], "0") != 0;
+		else if (strcmp(argv[i], "--dicom") == 0)
+			dicomDirectory = argv[i + 1];
+		else if (strcmp(argv[i], "--volume") == 0)
+			volumePath = argv[i + 1];
+	}
+
 	Application app{};
 	Window window{1920, 1080, &app};
 
+	if (!dicomDirectory.empty())
+		app.UseDicomSeries(dicomDirectory);
+	if (!volumePath.empty())
+		app.UseVolumeFile(volumePath);
 	app.Initialize();
 
+	if (!replayPath.empty())
+	{
+		std::optional<std::vector<InputFrame>> frames = InputReplay::Load(replayPath);
+		if (!frames)
+		{
+			std::cerr << "Couldn't read the input recording " << replayPath << std::endl;
+			return 1;
+		}
+		app.ReplayInput(std::move(*frames), fixedTimestep);
+	}
+	if (!recordPath.empty())
+		app.RecordInput();
+	if (!captureDirectory.empty())
+		app.StartContinuousCapture(captureDirectory);
+	if (isNullBackend)
+		app.UseNullBackend();
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint32_t frameCount = 0;
+
     bool shouldExit = false;
-    while (!shouldExit)
+    while (!shouldExit && !app.IsReplayFinished())
     {
         MSG msg{ 0 };
         if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
@@ -27,5 +84,24 @@ int main()
 
         app.Update();
         app.Render();
+        frameCount++;
+    }
+
+    if (!replayPath.empty())
+    {
+        const float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Replayed " << frameCount << " frames in " << seconds << " s, "
+            << seconds * 1000.0f / frameCount << " ms per frame" << std::endl;
+    }
+    if (const NullCommandList* nullCommandList = app.GetNullCommandList())
+    {
+        // counts of the last frame, the errors are collected over the whole run
+        const CommandCounts& counts = nullCommandList->GetCounts();
+        std::cout << counts.barriers << " barriers, " << counts.copies << " copies (" << counts.copiedBytes << " bytes), "
+            << counts.clears << " clears, " << counts.stateChanges << " state changes, " << counts.draws << " draws" << std::endl;
+        for (const std::string& error : nullCommandList->GetErrors())
+            std::cerr << error << std::endl;
     }
+    if (!recordPath.empty() && !app.SaveInputRecording(recordPath))
+        std::cerr << "Couldn't write the input recording " << recordPath << std::endl;
 }
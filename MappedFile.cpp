@@ -0,0 +1,102 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::filesystem::path& filePath)
+{
+	Close();
+	HANDLE file = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	mFile = file;
+
+	LARGE_INTEGER size{};
+	if (!GetFileSizeEx(file, &size))
+	{
+		Close();
+		return false;
+	}
+	mSize = static_cast<uint64_t>(size.QuadPart);
+	if (mSize == 0)
+		return true;
+
+	mMapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mMapping)
+		mData = static_cast<const uint8_t*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	if (!mData)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData)
+		UnmapViewOfFile(mData);
+	if (mMapping)
+		CloseHandle(mMapping);
+	if (mFile)
+		CloseHandle(mFile);
+	mData = nullptr;
+	mSize = 0;
+	mMapping = nullptr;
+	mFile = nullptr;
+}
+
+#else
+
+bool MappedFile::Open(const std::filesystem::path& filePath)
+{
+	Close();
+	mFile = open(filePath.c_str(), O_RDONLY);
+	if (mFile < 0)
+		return false;
+
+	struct stat status {};
+	if (fstat(mFile, &status) != 0)
+	{
+		Close();
+		return false;
+	}
+	mSize = static_cast<uint64_t>(status.st_size);
+	if (mSize == 0)
+		return true;
+
+	void* data = mmap(nullptr, mSize, PROT_READ, MAP_SHARED, mFile, 0);
+	if (data == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	mData = static_cast<const uint8_t*>(data);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData)
+		munmap(const_cast<uint8_t*>(mData), mSize);
+	if (mFile >= 0)
+		close(mFile);
+	mData = nullptr;
+	mSize = 0;
+	mFile = -1;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// Read only view of a whole file through the page cache, nothing is read until it's touched.
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// false if the file couldn't be opened or mapped, an empty file maps to no data
+	bool Open(const std::filesystem::path& filePath);
+	void Close();
+
+	const uint8_t* GetData() const { return mData; }
+	uint64_t GetSize() const { return mSize; }
+
+private:
+	const uint8_t* mData = nullptr;
+	uint64_t mSize = 0;
+#ifdef _WIN32
+	void* mFile = nullptr;
+	void* mMapping = nullptr;
+#else
+	int mFile = -1;
+#endif
+};
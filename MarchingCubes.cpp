@@ -0,0 +1,449 @@
+#include "MarchingCubes.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <unordered_map>
+
+// corner index is x | y << 1 | z << 2, edges are grouped by axis (x edges, then y, then z)
+static constexpr uint8_t EDGE_CORNERS[12][2] = {
+	{0, 1}, {2, 3}, {4, 5}, {6, 7},
+	{0, 2}, {1, 3}, {4, 6}, {5, 7},
+	{0, 4}, {1, 5}, {2, 6}, {3, 7} };
+
+static constexpr uint32_t EXTERNAL_INDEX_BIT = 0x80000000u;
+
+static uint8_t GetEdgeBetween(uint8_t a, uint8_t b)
+{
+	for (uint8_t edge = 0; edge < 12; edge++)
+	{
+		if ((EDGE_CORNERS[edge][0] == a && EDGE_CORNERS[edge][1] == b) ||
+			(EDGE_CORNERS[edge][0] == b && EDGE_CORNERS[edge][1] == a))
+			return edge;
+	}
+	assert(false && "Corners don't share an edge");
+	return 0;
+}
+
+MarchingCubes::MarchingCubes()
+{
+	BuildCaseTable();
+}
+
+// Rather than carrying the classic 256 entry triangle table around, the table is derived from the
+// cube faces. Each face contributes iso-line segments running from an "exit" crossing back to the
+// previous "entry" crossing (walking the face counterclockwise from the outside), which keeps inside
+// corners separated on ambiguous faces. Neighbouring cells see the same face with the same rule, so
+// the resulting surface is watertight. The segments form closed loops which are fan triangulated.
+void MarchingCubes::BuildCaseTable()
+{
+	std::array<std::array<uint8_t, 4>, 6> faces{};
+	std::array<uint8_t, 12> edgeFaces{};
+	for (uint8_t axis = 0; axis < 3; axis++)
+	{
+		uint8_t u = (axis + 1) % 3;
+		uint8_t v = (axis + 2) % 3;
+		for (uint8_t side = 0; side < 2; side++)
+		{
+			uint8_t base = side << axis;
+			std::array<uint8_t, 4> face = {
+				static_cast<uint8_t>(base),
+				static_cast<uint8_t>(base | (1 << u)),
+				static_cast<uint8_t>(base | (1 << u) | (1 << v)),
+				static_cast<uint8_t>(base | (1 << v)) };
+			if (side == 0)
+				std::reverse(face.begin(), face.end());
+			faces[axis * 2 + side] = face;
+
+			for (uint32_t i = 0; i < 4; i++)
+				edgeFaces[GetEdgeBetween(face[i], face[(i + 1) % 4])] |= 1 << (axis * 2 + side);
+		}
+	}
+
+	for (uint32_t cubeCase = 0; cubeCase < 256; cubeCase++)
+	{
+		auto isInside = [cubeCase](uint8_t corner) { return ((cubeCase >> corner) & 1) != 0; };
+
+		std::array<int8_t, 12> nextEdge;
+		nextEdge.fill(-1);
+
+		for (const std::array<uint8_t, 4>& face : faces)
+		{
+			struct Crossing {
+				uint8_t edge;
+				bool isEntry;
+			};
+			std::array<Crossing, 4> crossings{};
+			uint32_t crossingCount = 0;
+
+			for (uint32_t i = 0; i < 4; i++)
+			{
+				uint8_t current = face[i];
+				uint8_t next = face[(i + 1) % 4];
+				if (isInside(current) != isInside(next))
+					crossings[crossingCount++] = { GetEdgeBetween(current, next), isInside(next) };
+			}
+
+			for (uint32_t i = 0; i < crossingCount; i++)
+			{
+				if (crossings[i].isEntry)
+					continue;
+
+				uint32_t previous = (i + crossingCount - 1) % crossingCount;
+				assert(crossings[previous].isEntry);
+				assert(nextEdge[crossings[i].edge] == -1);
+				nextEdge[crossings[i].edge] = crossings[previous].edge;
+			}
+		}
+
+		CaseEntry& entry = mCaseTable[cubeCase];
+		std::array<bool, 12> visited{};
+		for (uint8_t start = 0; start < 12; start++)
+		{
+			if (nextEdge[start] == -1 || visited[start])
+				continue;
+
+			std::array<uint8_t, 12> loop{};
+			uint32_t loopSize = 0;
+			for (int8_t edge = start; !visited[edge]; edge = nextEdge[edge])
+			{
+				visited[edge] = true;
+				loop[loopSize++] = static_cast<uint8_t>(edge);
+			}
+
+			// fan from a vertex whose diagonals don't lie in a cube face, otherwise the diagonal could
+			// coincide with an edge of the neighbouring cell and the surface would stop being manifold
+			uint32_t origin = 0;
+			for (uint32_t candidate = 0; candidate < loopSize; candidate++)
+			{
+				bool isValid = true;
+				for (uint32_t i = 2; i + 1 < loopSize; i++)
+				{
+					if (edgeFaces[loop[candidate]] & edgeFaces[loop[(candidate + i) % loopSize]])
+						isValid = false;
+				}
+				if (isValid)
+				{
+					origin = candidate;
+					break;
+				}
+			}
+			std::rotate(loop.begin(), loop.begin() + origin, loop.begin() + loopSize);
+
+			for (uint32_t i = 1; i + 1 < loopSize; i++)
+			{
+				assert(entry.triangleCount < MAX_CASE_TRIANGLES);
+				uint8_t* triangle = &entry.edges[entry.triangleCount++ * 3];
+				triangle[0] = loop[0];
+				triangle[1] = loop[i];
+				triangle[2] = loop[i + 1];
+			}
+		}
+	}
+}
+
+static uint64_t GetInsideMask(const uint8_t* row, uint32_t count, uint8_t isoValue)
+{
+	uint64_t mask = 0;
+	uint32_t i = 0;
+#ifdef VOLUME_SSE2
+	const __m128i iso = _mm_set1_epi8(static_cast<char>(isoValue));
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+		__m128i isAboveIso = _mm_cmpeq_epi8(_mm_max_epu8(values, iso), values);
+		mask |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(isAboveIso))) << i;
+	}
+#endif
+	for (; i < count; i++)
+	{
+		mask |= static_cast<uint64_t>(row[i] >= isoValue) << i;
+	}
+	return mask;
+}
+
+static uint64_t GetLowBits(uint32_t count)
+{
+	return count >= 64 ? ~0ull : ((1ull << count) - 1);
+}
+
+// the vertex where the edge from voxel (x, y, z) along axis crosses the iso value, in object space
+static Float3 GetEdgeVertex(const uint8_t* data, const VolumeDimensions& dimensions, uint32_t x, uint32_t y, uint32_t z, uint32_t axis, float interpolationIso)
+{
+	const size_t voxelIndex = dimensions.GetIndex(x, y, z);
+	const size_t neighbourIndex = voxelIndex + (axis == 0 ? 1 : axis == 1 ? dimensions.width : static_cast<size_t>(dimensions.width) * dimensions.height);
+	const float value = data[voxelIndex];
+	const float t = (interpolationIso - value) / (static_cast<float>(data[neighbourIndex]) - value);
+
+	Float3 position = {
+		x + (axis == 0 ? t : 0.0f),
+		y + (axis == 1 ? t : 0.0f),
+		z + (axis == 2 ? t : 0.0f) };
+	position.x = (position.x + 0.5f) / dimensions.width * 2.0f - 1.0f;
+	position.y = (position.y + 0.5f) / dimensions.height * 2.0f - 1.0f;
+	position.z = (position.z + 0.5f) / dimensions.depth * 2.0f - 1.0f;
+	return position;
+}
+
+namespace {
+	struct BrickOutput {
+		std::vector<uint64_t> edgeIds; // sorted, one per vertex this brick owns
+		std::vector<Float3> vertices;
+		std::vector<uint32_t> indices; // local vertex index, or EXTERNAL_INDEX_BIT | index into externalEdges
+		std::vector<uint64_t> externalEdges;
+	};
+
+	struct BrickRange {
+		uint32_t begin;
+		uint32_t cellEnd; // last voxel touched by the brick's cells
+		uint32_t ownedEnd; // vertices on edges starting at [begin, ownedEnd) belong to this brick
+	};
+
+	BrickRange GetBrickRange(uint32_t brick, uint32_t brickCount, uint32_t voxelCount)
+	{
+		uint32_t begin = brick * BRICK_SIZE;
+		uint32_t cellEnd = std::min(begin + BRICK_SIZE, voxelCount - 1);
+		return { begin, cellEnd, brick == brickCount - 1 ? voxelCount : cellEnd };
+	}
+}
+
+IsosurfaceMesh MarchingCubes::Extract(const uint8_t* data, const VolumeDimensions& dimensions, uint8_t isoValue) const
+{
+	IsosurfaceMesh mesh;
+	if (dimensions.width < 2 || dimensions.height < 2 || dimensions.depth < 2 || isoValue == 0)
+		return mesh;
+
+	const uint32_t bricksX = GetBrickCount(dimensions.width);
+	const uint32_t bricksY = GetBrickCount(dimensions.height);
+	const uint32_t bricksZ = GetBrickCount(dimensions.depth);
+	const uint32_t brickCount = bricksX * bricksY * bricksZ;
+
+	// interpolating against iso - 0.5 keeps vertices strictly between voxels for integer data
+	const float interpolationIso = isoValue - 0.5f;
+
+	std::vector<BrickOutput> bricks(brickCount);
+
+	ThreadPool::Get().ParallelFor(brickCount, [&](uint32_t brickIndex) {
+		const uint32_t bx = brickIndex % bricksX;
+		const uint32_t by = (brickIndex / bricksX) % bricksY;
+		const uint32_t bz = brickIndex / (bricksX * bricksY);
+		const BrickRange rangeX = GetBrickRange(bx, bricksX, dimensions.width);
+		const BrickRange rangeY = GetBrickRange(by, bricksY, dimensions.height);
+		const BrickRange rangeZ = GetBrickRange(bz, bricksZ, dimensions.depth);
+
+		const uint32_t rowsY = rangeY.cellEnd - rangeY.begin + 1;
+		const uint32_t rowsZ = rangeZ.cellEnd - rangeZ.begin + 1;
+		const uint32_t bitsX = rangeX.cellEnd - rangeX.begin + 1;
+
+		// one bit per voxel (1 = inside) for every row the brick touches
+		thread_local std::vector<uint64_t> masks;
+		masks.resize(static_cast<size_t>(rowsY) * rowsZ);
+		uint64_t combinedAnd = ~0ull;
+		uint64_t combinedOr = 0;
+		for (uint32_t z = 0; z < rowsZ; z++)
+		{
+			for (uint32_t y = 0; y < rowsY; y++)
+			{
+				const uint8_t* row = data + dimensions.GetIndex(rangeX.begin, rangeY.begin + y, rangeZ.begin + z);
+				uint64_t mask = GetInsideMask(row, bitsX, isoValue);
+				masks[y + z * rowsY] = mask;
+				combinedAnd &= mask;
+				combinedOr |= mask;
+			}
+		}
+
+		const uint64_t allBits = GetLowBits(bitsX);
+		if (combinedOr == 0 || combinedAnd == allBits)
+			return;
+
+		auto getMask = [&](uint32_t y, uint32_t z) { return masks[y + z * rowsY]; };
+
+		BrickOutput& output = bricks[brickIndex];
+
+		const uint32_t ownedX = rangeX.ownedEnd - rangeX.begin;
+		const uint32_t ownedY = rangeY.ownedEnd - rangeY.begin;
+		const uint32_t ownedZ = rangeZ.ownedEnd - rangeZ.begin;
+
+		thread_local std::vector<uint32_t> localVertexIndices;
+		localVertexIndices.resize(static_cast<size_t>(ownedX) * ownedY * ownedZ * 3);
+
+		// vertices on the crossed edges this brick owns, emitted in edge id order
+		const uint64_t ownedBits = GetLowBits(ownedX);
+		const uint64_t xEdgeBits = GetLowBits(std::min(ownedX, dimensions.width - 1 - rangeX.begin));
+		for (uint32_t z = 0; z < ownedZ; z++)
+		{
+			const uint32_t voxelZ = rangeZ.begin + z;
+			for (uint32_t y = 0; y < ownedY; y++)
+			{
+				const uint32_t voxelY = rangeY.begin + y;
+				const uint64_t mask = getMask(y, z);
+
+				std::array<uint64_t, 3> crossings = {
+					(mask ^ (mask >> 1)) & xEdgeBits,
+					voxelY + 1 < dimensions.height ? (mask ^ getMask(y + 1, z)) & ownedBits : 0,
+					voxelZ + 1 < dimensions.depth ? (mask ^ getMask(y, z + 1)) & ownedBits : 0 };
+
+				for (uint64_t bits = crossings[0] | crossings[1] | crossings[2]; bits != 0; bits &= bits - 1)
+				{
+					const uint32_t x = std::countr_zero(bits);
+					const uint32_t voxelX = rangeX.begin + x;
+					const size_t voxelIndex = dimensions.GetIndex(voxelX, voxelY, voxelZ);
+
+					for (uint32_t axis = 0; axis < 3; axis++)
+					{
+						if (((crossings[axis] >> x) & 1) == 0)
+							continue;
+
+						localVertexIndices[((static_cast<size_t>(z) * ownedY + y) * ownedX + x) * 3 + axis] = static_cast<uint32_t>(output.vertices.size());
+						output.edgeIds.push_back(voxelIndex * 3 + axis);
+						output.vertices.push_back(GetEdgeVertex(data, dimensions, voxelX, voxelY, voxelZ, axis, interpolationIso));
+					}
+				}
+			}
+		}
+
+		// triangles for every cell, edges owned by a neighbouring brick are resolved after compaction
+		const uint32_t cellsX = rangeX.cellEnd - rangeX.begin;
+		for (uint32_t z = 0; z + 1 < rowsZ; z++)
+		{
+			for (uint32_t y = 0; y + 1 < rowsY; y++)
+			{
+				const uint64_t m00 = getMask(y, z);
+				const uint64_t m10 = getMask(y + 1, z);
+				const uint64_t m01 = getMask(y, z + 1);
+				const uint64_t m11 = getMask(y + 1, z + 1);
+
+				const uint64_t rowAnd = m00 & m10 & m01 & m11;
+				const uint64_t rowOr = m00 | m10 | m01 | m11;
+				if (rowOr == 0 || rowAnd == allBits)
+					continue;
+
+				for (uint32_t x = 0; x < cellsX; x++)
+				{
+					const uint32_t cubeCase =
+						((m00 >> x) & 3) |
+						(((m10 >> x) & 3) << 2) |
+						(((m01 >> x) & 3) << 4) |
+						(((m11 >> x) & 3) << 6);
+
+					const CaseEntry& entry = mCaseTable[cubeCase];
+					for (uint32_t i = 0; i < entry.triangleCount * 3u; i++)
+					{
+						const uint8_t edge = entry.edges[i];
+						const uint8_t corner = EDGE_CORNERS[edge][0];
+						const uint32_t axis = edge / 4;
+						const uint32_t edgeX = x + (corner & 1);
+						const uint32_t edgeY = y + ((corner >> 1) & 1);
+						const uint32_t edgeZ = z + ((corner >> 2) & 1);
+
+						if (edgeX < ownedX && edgeY < ownedY && edgeZ < ownedZ)
+						{
+							output.indices.push_back(localVertexIndices[((static_cast<size_t>(edgeZ) * ownedY + edgeY) * ownedX + edgeX) * 3 + axis]);
+						}
+						else
+						{
+							const size_t voxelIndex = dimensions.GetIndex(rangeX.begin + edgeX, rangeY.begin + edgeY, rangeZ.begin + edgeZ);
+							output.indices.push_back(EXTERNAL_INDEX_BIT | static_cast<uint32_t>(output.externalEdges.size()));
+							output.externalEdges.push_back(voxelIndex * 3 + axis);
+						}
+					}
+				}
+			}
+		}
+	});
+
+	// compaction offsets, every brick then writes its own range without any synchronization
+	std::vector<uint32_t> vertexOffsets(brickCount);
+	std::vector<uint32_t> indexOffsets(brickCount);
+	uint64_t vertexCount = 0;
+	uint64_t indexCount = 0;
+	for (uint32_t i = 0; i < brickCount; i++)
+	{
+		vertexOffsets[i] = static_cast<uint32_t>(vertexCount);
+		indexOffsets[i] = static_cast<uint32_t>(indexCount);
+		vertexCount += bricks[i].vertices.size();
+		indexCount += bricks[i].indices.size();
+	}
+	assert(vertexCount < EXTERNAL_INDEX_BIT && "Isosurface has too many vertices");
+
+	mesh.vertices.resize(vertexCount);
+	mesh.indices.resize(indexCount);
+
+	ThreadPool::Get().ParallelFor(brickCount, [&](uint32_t brickIndex) {
+		const BrickOutput& brick = bricks[brickIndex];
+		if (brick.indices.empty() && brick.vertices.empty())
+			return;
+
+		std::copy(brick.vertices.begin(), brick.vertices.end(), mesh.vertices.begin() + vertexOffsets[brickIndex]);
+
+		uint32_t* indices = mesh.indices.data() + indexOffsets[brickIndex];
+		for (uint32_t index : brick.indices)
+		{
+			if ((index & EXTERNAL_INDEX_BIT) == 0)
+			{
+				*indices++ = vertexOffsets[brickIndex] + index;
+				continue;
+			}
+
+			const uint64_t edgeId = brick.externalEdges[index & ~EXTERNAL_INDEX_BIT];
+			const uint64_t voxelIndex = edgeId / 3;
+			const uint32_t x = static_cast<uint32_t>(voxelIndex % dimensions.width);
+			const uint32_t y = static_cast<uint32_t>((voxelIndex / dimensions.width) % dimensions.height);
+			const uint32_t z = static_cast<uint32_t>(voxelIndex / (static_cast<uint64_t>(dimensions.width) * dimensions.height));
+			const uint32_t owner =
+				std::min(x / BRICK_SIZE, bricksX - 1) +
+				bricksX * (std::min(y / BRICK_SIZE, bricksY - 1) + bricksY * std::min(z / BRICK_SIZE, bricksZ - 1));
+
+			const std::vector<uint64_t>& ownerEdges = bricks[owner].edgeIds;
+			auto it = std::lower_bound(ownerEdges.begin(), ownerEdges.end(), edgeId);
+			assert(it != ownerEdges.end() && *it == edgeId && "Neighbouring brick is missing a shared vertex");
+			*indices++ = vertexOffsets[owner] + static_cast<uint32_t>(it - ownerEdges.begin());
+		}
+	});
+
+	return mesh;
+}
+
+IsosurfaceMesh MarchingCubes::ExtractScalar(const uint8_t* data, const VolumeDimensions& dimensions, uint8_t isoValue) const
+{
+	IsosurfaceMesh mesh;
+	if (dimensions.width < 2 || dimensions.height < 2 || dimensions.depth < 2 || isoValue == 0)
+		return mesh;
+
+	const float interpolationIso = isoValue - 0.5f;
+	std::unordered_map<uint64_t, uint32_t> edgeVertices;
+	for (uint32_t z = 0; z + 1 < dimensions.depth; z++)
+	{
+		for (uint32_t y = 0; y + 1 < dimensions.height; y++)
+		{
+			for (uint32_t x = 0; x + 1 < dimensions.width; x++)
+			{
+				uint32_t cubeCase = 0;
+				for (uint32_t corner = 0; corner < 8; corner++)
+				{
+					const uint8_t value = data[dimensions.GetIndex(x + (corner & 1), y + ((corner >> 1) & 1), z + (corner >> 2))];
+					cubeCase |= static_cast<uint32_t>(value >= isoValue) << corner;
+				}
+
+				const CaseEntry& entry = mCaseTable[cubeCase];
+				for (uint32_t i = 0; i < entry.triangleCount * 3u; i++)
+				{
+					const uint8_t edge = entry.edges[i];
+					const uint8_t corner = EDGE_CORNERS[edge][0];
+					const uint32_t axis = edge / 4;
+					const uint32_t edgeX = x + (corner & 1);
+					const uint32_t edgeY = y + ((corner >> 1) & 1);
+					const uint32_t edgeZ = z + ((corner >> 2) & 1);
+
+					const uint64_t edgeId = dimensions.GetIndex(edgeX, edgeY, edgeZ) * 3 + axis;
+					auto [it, isNew] = edgeVertices.try_emplace(edgeId, static_cast<uint32_t>(mesh.vertices.size()));
+					if (isNew)
+						mesh.vertices.push_back(GetEdgeVertex(data, dimensions, edgeX, edgeY, edgeZ, axis, interpolationIso));
+					mesh.indices.push_back(it->second);
+				}
+			}
+		}
+	}
+	return mesh;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "VolumeTypes.h"
+
+#include <array>
+#include <vector>
+
+// Vertices are in the same [-1, 1] object space as the volume proxy cube, so the mesh can be
+// drawn with the volume's model matrix. Triangles use the same winding as the proxy cube.
+struct IsosurfaceMesh {
+	std::vector<Float3> vertices;
+	std::vector<uint32_t> indices;
+};
+
+class MarchingCubes {
+public:
+	MarchingCubes();
+
+	// Voxels >= isoValue are considered inside. Extraction runs in parallel over bricks and welds
+	// vertices shared between cells (and bricks), so every crossed voxel edge produces one vertex.
+	IsosurfaceMesh Extract(const uint8_t* data, const VolumeDimensions& dimensions, uint8_t isoValue) const;
+
+	// one cell at a time without SIMD or bricks, the reference the parallel path is checked against.
+	// It gives the same triangles, only the vertices are numbered in a different order.
+	IsosurfaceMesh ExtractScalar(const uint8_t* data, const VolumeDimensions& dimensions, uint8_t isoValue) const;
+
+private:
+	static constexpr uint32_t MAX_CASE_TRIANGLES = 12;
+
+	struct CaseEntry {
+		uint8_t triangleCount = 0;
+		std::array<uint8_t, MAX_CASE_TRIANGLES * 3> edges{};
+	};
+
+	void BuildCaseTable();
+
+private:
+	std::array<CaseEntry, 256> mCaseTable{};
+};
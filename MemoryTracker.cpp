@@ -0,0 +1,132 @@
+#include "MemoryTracker.h"
+
+#include <cassert>
+#include <sstream>
+#include <type_traits>
+
+// nothing to destroy, so statics that release memory in their destructors at exit can still report it
+static_assert(std::is_trivially_destructible_v<MemoryTracker>);
+
+MemoryTracker& MemoryTracker::Get()
+{
+	static MemoryTracker tracker;
+	return tracker;
+}
+
+const char* MemoryTracker::GetCategoryName(MemoryCategory category)
+{
+	switch (category)
+	{
+	case MemoryCategory::VolumeTexture: return "volume_texture";
+	case MemoryCategory::BrickCache: return "brick_cache";
+	case MemoryCategory::Acceleration: return "acceleration";
+	case MemoryCategory::Lighting: return "lighting";
+	case MemoryCategory::Labels: return "labels";
+	case MemoryCategory::RenderTarget: return "render_target";
+	case MemoryCategory::Geometry: return "geometry";
+	case MemoryCategory::Constants: return "constants";
+	case MemoryCategory::Upload: return "upload";
+	case MemoryCategory::Readback: return "readback";
+	case MemoryCategory::Descriptors: return "descriptors";
+	case MemoryCategory::CpuVolume: return "cpu_volume";
+	case MemoryCategory::Other: return "other";
+	case MemoryCategory::Count: break;
+	}
+	return "unknown";
+}
+
+void MemoryTracker::Add(MemoryCategory category, uint64_t bytes)
+{
+	Counters& counters = mCounters[static_cast<size_t>(category)];
+	const uint64_t liveBytes = counters.liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	counters.liveAllocations.fetch_add(1, std::memory_order_relaxed);
+	counters.totalAllocations.fetch_add(1, std::memory_order_relaxed);
+
+	uint64_t peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+	while (liveBytes > peakBytes && !counters.peakBytes.compare_exchange_weak(peakBytes, liveBytes, std::memory_order_relaxed))
+	{
+	}
+}
+
+void MemoryTracker::Remove(MemoryCategory category, uint64_t bytes)
+{
+	Counters& counters = mCounters[static_cast<size_t>(category)];
+	assert(counters.liveBytes.load(std::memory_order_relaxed) >= bytes && "More memory removed than added");
+	counters.liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+	counters.liveAllocations.fetch_sub(1, std::memory_order_relaxed);
+}
+
+MemoryCounters MemoryTracker::GetCounters(MemoryCategory category) const
+{
+	const Counters& counters = mCounters[static_cast<size_t>(category)];
+	return {
+		.liveBytes = counters.liveBytes.load(std::memory_order_relaxed),
+		.peakBytes = counters.peakBytes.load(std::memory_order_relaxed),
+		.liveAllocations = counters.liveAllocations.load(std::memory_order_relaxed),
+		.totalAllocations = counters.totalAllocations.load(std::memory_order_relaxed) };
+}
+
+uint64_t MemoryTracker::GetLiveBytes() const
+{
+	uint64_t liveBytes = 0;
+	for (const Counters& counters : mCounters)
+		liveBytes += counters.liveBytes.load(std::memory_order_relaxed);
+	return liveBytes;
+}
+
+std::string MemoryTracker::ToJson(const GpuMemoryStatistics* gpuStatistics) const
+{
+	std::ostringstream json;
+	json << "{\n\t\"live_bytes\": " << GetLiveBytes() << ",\n\t\"categories\": {";
+	for (size_t i = 0; i < mCounters.size(); i++)
+	{
+		const MemoryCategory category = static_cast<MemoryCategory>(i);
+		const MemoryCounters counters = GetCounters(category);
+		json << (i == 0 ? "\n" : ",\n") << "\t\t\"" << GetCategoryName(category) << "\": { \"live_bytes\": " << counters.liveBytes
+			<< ", \"peak_bytes\": " << counters.peakBytes << ", \"live_allocations\": " << counters.liveAllocations
+			<< ", \"total_allocations\": " << counters.totalAllocations << " }";
+	}
+	json << "\n\t}";
+	if (gpuStatistics)
+	{
+		json << ",\n\t\"gpu\": { \"budget_bytes\": " << gpuStatistics->budgetBytes << ", \"usage_bytes\": " << gpuStatistics->usageBytes
+			<< ", \"block_bytes\": " << gpuStatistics->blockBytes << ", \"allocation_bytes\": " << gpuStatistics->allocationBytes
+			<< ", \"block_count\": " << gpuStatistics->blockCount << ", \"allocation_count\": " << gpuStatistics->allocationCount << " }";
+	}
+	json << "\n}\n";
+	return json.str();
+}
+
+TrackedMemory::TrackedMemory(MemoryCategory category, uint64_t bytes)
+	: mCategory(category)
+	, mBytes(bytes)
+{
+	if (mBytes > 0)
+		MemoryTracker::Get().Add(mCategory, mBytes);
+}
+
+TrackedMemory::~TrackedMemory()
+{
+	if (mBytes > 0)
+		MemoryTracker::Get().Remove(mCategory, mBytes);
+}
+
+TrackedMemory::TrackedMemory(TrackedMemory&& other) noexcept
+	: mCategory(other.mCategory)
+	, mBytes(other.mBytes)
+{
+	other.mBytes = 0;
+}
+
+TrackedMemory& TrackedMemory::operator=(TrackedMemory&& other) noexcept
+{
+	if (this != &other)
+	{
+		if (mBytes > 0)
+			MemoryTracker::Get().Remove(mCategory, mBytes);
+		mCategory = other.mCategory;
+		mBytes = other.mBytes;
+		other.mBytes = 0;
+	}
+	return *this;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// what an allocation is for, every GPU resource and CPU volume block is counted under one
+enum class MemoryCategory : uint8_t {
+	VolumeTexture,
+	BrickCache,
+	Acceleration,
+	Lighting,
+	Labels,
+	RenderTarget,
+	Geometry,
+	Constants,
+	Upload,
+	Readback,
+	Descriptors,
+	CpuVolume,
+	Other,
+	Count,
+};
+
+struct MemoryCounters {
+	uint64_t liveBytes = 0;
+	uint64_t peakBytes = 0;
+	uint64_t liveAllocations = 0;
+	uint64_t totalAllocations = 0;
+};
+
+// the allocator's view of local video memory, filled in by the device
+struct GpuMemoryStatistics {
+	uint64_t budgetBytes = 0;
+	uint64_t usageBytes = 0;
+	uint64_t blockBytes = 0;
+	uint64_t allocationBytes = 0;
+	uint32_t blockCount = 0;
+	uint32_t allocationCount = 0;
+};
+
+// Live and peak bytes per category. Counting is a few relaxed atomic adds on the category's own
+// cache line, so it's cheap enough for every allocation and safe from the loader threads.
+class MemoryTracker {
+public:
+	// the tracker every allocation reports to
+	static MemoryTracker& Get();
+	static const char* GetCategoryName(MemoryCategory category);
+
+	void Add(MemoryCategory category, uint64_t bytes);
+	void Remove(MemoryCategory category, uint64_t bytes);
+
+	MemoryCounters GetCounters(MemoryCategory category) const;
+	uint64_t GetLiveBytes() const;
+
+	// every category's counters, and the GPU statistics if there are any, as a JSON object
+	std::string ToJson(const GpuMemoryStatistics* gpuStatistics = nullptr) const;
+
+private:
+	struct alignas(64) Counters {
+		std::atomic<uint64_t> liveBytes = 0;
+		std::atomic<uint64_t> peakBytes = 0;
+		std::atomic<uint64_t> liveAllocations = 0;
+		std::atomic<uint64_t> totalAllocations = 0;
+	};
+
+	std::array<Counters, static_cast<size_t>(MemoryCategory::Count)> mCounters;
+};
+
+// Bytes counted for as long as the object owning them lives, moved along with it.
+class TrackedMemory {
+public:
+	TrackedMemory() = default;
+	TrackedMemory(MemoryCategory category, uint64_t bytes);
+	~TrackedMemory();
+
+	TrackedMemory(TrackedMemory&& other) noexcept;
+	TrackedMemory& operator=(TrackedMemory&& other) noexcept;
+	TrackedMemory(const TrackedMemory&) = delete;
+	TrackedMemory& operator=(const TrackedMemory&) = delete;
+
+	MemoryCategory GetCategory() const { return mCategory; }
+	uint64_t GetBytes() const { return mBytes; }
+
+private:
+	MemoryCategory mCategory = MemoryCategory::Other;
+	uint64_t mBytes = 0;
+};
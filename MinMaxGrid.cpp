@@ -0,0 +1,101 @@
+#include "MinMaxGrid.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+void MinMaxGrid::Build(const uint8_t* data, const VolumeDimensions& volumeDimensions)
+{
+	mDimensions = {
+		.width = (volumeDimensions.width + BRICK_SIZE - 1) / BRICK_SIZE,
+		.height = (volumeDimensions.height + BRICK_SIZE - 1) / BRICK_SIZE,
+		.depth = (volumeDimensions.depth + BRICK_SIZE - 1) / BRICK_SIZE };
+
+	mMin.assign(mDimensions.GetVoxelCount(), 0);
+	mMax.assign(mDimensions.GetVoxelCount(), 0);
+
+	ThreadPool::Get().ParallelFor(static_cast<uint32_t>(mDimensions.GetVoxelCount()), [&](uint32_t brick) {
+		BuildBrick(data, volumeDimensions,
+			brick % mDimensions.width,
+			(brick / mDimensions.width) % mDimensions.height,
+			brick / (mDimensions.width * mDimensions.height));
+	});
+}
+
+void MinMaxGrid::Update(const uint8_t* data, const VolumeDimensions& volumeDimensions, const VolumeBox& changedVoxels)
+{
+	if (changedVoxels.IsEmpty())
+		return;
+
+	// a brick reads one voxel past both of its sides
+	auto firstBrick = [](uint32_t voxel) { return voxel > BRICK_SIZE ? (voxel - BRICK_SIZE) / BRICK_SIZE : 0; };
+	auto lastBrick = [](uint32_t voxel, uint32_t brickCount) { return std::min(voxel / BRICK_SIZE, brickCount - 1); };
+	const uint32_t beginX = firstBrick(changedVoxels.minX);
+	const uint32_t beginY = firstBrick(changedVoxels.minY);
+	const uint32_t beginZ = firstBrick(changedVoxels.minZ);
+	const uint32_t countX = lastBrick(changedVoxels.maxX, mDimensions.width) - beginX + 1;
+	const uint32_t countY = lastBrick(changedVoxels.maxY, mDimensions.height) - beginY + 1;
+	const uint32_t countZ = lastBrick(changedVoxels.maxZ, mDimensions.depth) - beginZ + 1;
+
+	ThreadPool::Get().ParallelFor(countX * countY * countZ, [&](uint32_t brick) {
+		BuildBrick(data, volumeDimensions,
+			beginX + brick % countX,
+			beginY + (brick / countX) % countY,
+			beginZ + brick / (countX * countY));
+	});
+}
+
+void MinMaxGrid::BuildBrick(const uint8_t* data, const VolumeDimensions& volumeDimensions, uint32_t x, uint32_t y, uint32_t z)
+{
+	const uint32_t beginX = x * BRICK_SIZE > 0 ? x * BRICK_SIZE - 1 : 0;
+	const uint32_t beginY = y * BRICK_SIZE > 0 ? y * BRICK_SIZE - 1 : 0;
+	const uint32_t beginZ = z * BRICK_SIZE > 0 ? z * BRICK_SIZE - 1 : 0;
+	const uint32_t endX = std::min((x + 1) * BRICK_SIZE + 1, volumeDimensions.width);
+	const uint32_t endY = std::min((y + 1) * BRICK_SIZE + 1, volumeDimensions.height);
+	const uint32_t endZ = std::min((z + 1) * BRICK_SIZE + 1, volumeDimensions.depth);
+	const uint32_t rowLength = endX - beginX;
+
+	uint8_t minValue = UINT8_MAX;
+	uint8_t maxValue = 0;
+#ifdef VOLUME_SSE2
+	__m128i minVector = _mm_set1_epi8(static_cast<char>(UINT8_MAX));
+	__m128i maxVector = _mm_setzero_si128();
+#endif
+
+	for (uint32_t voxelZ = beginZ; voxelZ < endZ; voxelZ++)
+	{
+		for (uint32_t voxelY = beginY; voxelY < endY; voxelY++)
+		{
+			const uint8_t* row = data + volumeDimensions.GetIndex(beginX, voxelY, voxelZ);
+			uint32_t i = 0;
+#ifdef VOLUME_SSE2
+			for (; i + 16 <= rowLength; i += 16)
+			{
+				__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+				minVector = _mm_min_epu8(minVector, values);
+				maxVector = _mm_max_epu8(maxVector, values);
+			}
+#endif
+			for (; i < rowLength; i++)
+			{
+				minValue = std::min(minValue, row[i]);
+				maxValue = std::max(maxValue, row[i]);
+			}
+		}
+	}
+
+#ifdef VOLUME_SSE2
+	alignas(16) uint8_t minLanes[16];
+	alignas(16) uint8_t maxLanes[16];
+	_mm_store_si128(reinterpret_cast<__m128i*>(minLanes), minVector);
+	_mm_store_si128(reinterpret_cast<__m128i*>(maxLanes), maxVector);
+	for (uint32_t lane = 0; lane < 16; lane++)
+	{
+		minValue = std::min(minValue, minLanes[lane]);
+		maxValue = std::max(maxValue, maxLanes[lane]);
+	}
+#endif
+
+	const size_t index = mDimensions.GetIndex(x, y, z);
+	mMin[index] = minValue;
+	mMax[index] = maxValue;
+}
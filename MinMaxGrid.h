@@ -0,0 +1,33 @@
+#pragma once
+
+#include "VolumeTypes.h"
+
+#include <vector>
+
+// Minimum and maximum voxel value of every BRICK_SIZE^3 brick of a volume. Each brick also looks
+// one voxel into its neighbours so the range covers everything trilinear filtering can reach.
+class MinMaxGrid {
+public:
+	void Build(const uint8_t* data, const VolumeDimensions& volumeDimensions);
+
+	// recomputes only the bricks whose range (apron included) overlaps the changed voxels
+	void Update(const uint8_t* data, const VolumeDimensions& volumeDimensions, const VolumeBox& changedVoxels);
+
+	const VolumeDimensions& GetDimensions() const { return mDimensions; }
+	uint32_t GetBrickCount() const { return static_cast<uint32_t>(mMin.size()); }
+
+	uint8_t GetMin(uint32_t x, uint32_t y, uint32_t z) const { return mMin[mDimensions.GetIndex(x, y, z)]; }
+	uint8_t GetMax(uint32_t x, uint32_t y, uint32_t z) const { return mMax[mDimensions.GetIndex(x, y, z)]; }
+	bool IsOccupied(uint32_t x, uint32_t y, uint32_t z, uint8_t threshold) const { return GetMax(x, y, z) > threshold; }
+
+	const std::vector<uint8_t>& GetMinValues() const { return mMin; }
+	const std::vector<uint8_t>& GetMaxValues() const { return mMax; }
+
+private:
+	void BuildBrick(const uint8_t* data, const VolumeDimensions& volumeDimensions, uint32_t x, uint32_t y, uint32_t z);
+
+private:
+	VolumeDimensions mDimensions{};
+	std::vector<uint8_t> mMin;
+	std::vector<uint8_t> mMax;
+};
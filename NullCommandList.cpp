@@ -0,0 +1,189 @@
+#include "NullCommandList.h"
+
+// keeps a runaway frame from growing the error list without bound
+static constexpr size_t MAX_ERROR_COUNT = 256;
+
+void NullCommandList::BeginFrame()
+{
+	mCounts = {};
+	mStates.clear();
+	mHasDescriptorHeaps = false;
+	mHasRootSignature = false;
+	mHasPipelineState = false;
+	mHasViewport = false;
+	mHasScissorRect = false;
+	mHasRenderTarget = false;
+	mRenderTargets.clear();
+	mDepthStencil = nullptr;
+}
+
+void NullCommandList::AddError(const char* command, const char* message)
+{
+	if (mErrors.size() < MAX_ERROR_COUNT)
+		mErrors.push_back(std::string(command) + ": " + message);
+}
+
+void NullCommandList::ExpectState(const void* resource, uint32_t state, const char* command)
+{
+	auto found = mStates.find(resource);
+	if (found == mStates.end())
+		return;
+	// read states combine, a buffer in GENERIC_READ is also a copy source
+	const bool isInState = state == RESOURCE_STATE_COMMON ? found->second == state : (found->second & state) == state;
+	if (!isInState)
+		AddError(command, "resource is in the wrong state");
+}
+
+void NullCommandList::ResourceBarrier(uint32_t count, const TransitionBarrier* barriers)
+{
+	if (count == 0)
+		AddError("ResourceBarrier", "no barriers");
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const TransitionBarrier& barrier = barriers[i];
+		if (!barrier.resource)
+		{
+			AddError("ResourceBarrier", "no resource");
+			continue;
+		}
+		if (barrier.stateBefore == barrier.stateAfter)
+			AddError("ResourceBarrier", "transition doesn't change the state");
+
+		auto [state, isNew] = mStates.try_emplace(barrier.resource, barrier.stateBefore);
+		if (!isNew && state->second != barrier.stateBefore)
+			AddError("ResourceBarrier", "state before doesn't match the last transition");
+		state->second = barrier.stateAfter;
+	}
+	mCounts.barriers += count;
+}
+
+void NullCommandList::CopyBufferRegion(Resource* destination, uint64_t, Resource* source, uint64_t, uint64_t size)
+{
+	if (!destination || !source || size == 0)
+		AddError("CopyBufferRegion", "empty copy");
+	ExpectState(destination, RESOURCE_STATE_COPY_DEST, "CopyBufferRegion");
+	ExpectState(source, RESOURCE_STATE_COPY_SOURCE, "CopyBufferRegion");
+	mCounts.copies++;
+	mCounts.copiedBytes += size;
+}
+
+void NullCommandList::CopyBufferToTexture(Resource* destination, uint32_t, uint32_t, uint32_t,
+	Resource* source, const BufferFootprint& footprint, const CopyBox* sourceBox)
+{
+	if (!destination || !source || footprint.width == 0 || footprint.height == 0 || footprint.depth == 0)
+		AddError("CopyBufferToTexture", "empty copy");
+	// D3D12_TEXTURE_DATA_PITCH_ALIGNMENT and D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT
+	if (footprint.rowPitch % 256 != 0 || footprint.offset % 512 != 0)
+		AddError("CopyBufferToTexture", "footprint isn't aligned");
+	if (sourceBox && (sourceBox->right > footprint.width || sourceBox->bottom > footprint.height || sourceBox->back > footprint.depth))
+		AddError("CopyBufferToTexture", "source box is outside the footprint");
+	ExpectState(destination, RESOURCE_STATE_COPY_DEST, "CopyBufferToTexture");
+	ExpectState(source, RESOURCE_STATE_COPY_SOURCE, "CopyBufferToTexture");
+	mCounts.copies++;
+	mCounts.copiedBytes += static_cast<uint64_t>(footprint.rowPitch) * footprint.height * footprint.depth;
+}
+
+void NullCommandList::CopyTextureToBuffer(Resource* destination, const BufferFootprint& footprint, Resource* source)
+{
+	if (!destination || !source || footprint.width == 0 || footprint.height == 0)
+		AddError("CopyTextureToBuffer", "empty copy");
+	if (footprint.rowPitch % 256 != 0 || footprint.offset % 512 != 0)
+		AddError("CopyTextureToBuffer", "footprint isn't aligned");
+	ExpectState(destination, RESOURCE_STATE_COPY_DEST, "CopyTextureToBuffer");
+	ExpectState(source, RESOURCE_STATE_COPY_SOURCE, "CopyTextureToBuffer");
+	mCounts.copies++;
+	mCounts.copiedBytes += static_cast<uint64_t>(footprint.rowPitch) * footprint.height * footprint.depth;
+}
+
+void NullCommandList::ClearRenderTarget(TextureResource* renderTarget, const float*)
+{
+	ExpectState(renderTarget, RESOURCE_STATE_RENDER_TARGET, "ClearRenderTarget");
+	mCounts.clears++;
+}
+
+void NullCommandList::ClearDepth(TextureResource* depthStencil, float depth)
+{
+	if (depth < 0.0f || depth > 1.0f)
+		AddError("ClearDepth", "depth is outside [0, 1]");
+	ExpectState(depthStencil, RESOURCE_STATE_DEPTH_WRITE, "ClearDepth");
+	mCounts.clears++;
+}
+
+void NullCommandList::SetRenderTargets(uint32_t count, TextureResource* const* renderTargets, TextureResource* depthStencil)
+{
+	// D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT
+	if (count > 8)
+		AddError("SetRenderTargets", "too many render targets");
+	mRenderTargets.assign(renderTargets, renderTargets + count);
+	mDepthStencil = depthStencil;
+	mHasRenderTarget = count > 0 || depthStencil;
+	mCounts.stateChanges++;
+}
+
+void NullCommandList::SetDescriptorHeaps()
+{
+	mHasDescriptorHeaps = true;
+	mCounts.stateChanges++;
+}
+
+void NullCommandList::SetRootSignature(ID3D12RootSignature* rootSignature)
+{
+	if (!rootSignature)
+		AddError("SetRootSignature", "no root signature");
+	mHasRootSignature = rootSignature;
+	mCounts.stateChanges++;
+}
+
+void NullCommandList::SetPipelineState(ID3D12PipelineState* pipelineState)
+{
+	if (!pipelineState)
+		AddError("SetPipelineState", "no pipeline state");
+	mHasPipelineState = pipelineState;
+	mCounts.stateChanges++;
+}
+
+void NullCommandList::SetRootConstantBuffer(uint32_t, Resource* buffer)
+{
+	if (!mHasRootSignature)
+		AddError("SetRootConstantBuffer", "set before the root signature");
+	if (!buffer)
+		AddError("SetRootConstantBuffer", "no buffer");
+	mCounts.stateChanges++;
+}
+
+void NullCommandList::SetViewport(const Viewport& viewport)
+{
+	if (viewport.width <= 0.0f || viewport.height <= 0.0f || viewport.minDepth > viewport.maxDepth)
+		AddError("SetViewport", "empty viewport");
+	mHasViewport = true;
+	mCounts.stateChanges++;
+}
+
+void NullCommandList::SetScissorRect(const ScissorRect& scissorRect)
+{
+	if (scissorRect.right <= scissorRect.left || scissorRect.bottom <= scissorRect.top)
+		AddError("SetScissorRect", "empty scissor rect");
+	mHasScissorRect = true;
+	mCounts.stateChanges++;
+}
+
+void NullCommandList::SetPrimitiveTopology(PrimitiveTopology)
+{
+	mCounts.stateChanges++;
+}
+
+void NullCommandList::Draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t, uint32_t)
+{
+	if (!mHasDescriptorHeaps || !mHasRootSignature || !mHasPipelineState)
+		AddError("Draw", "pipeline isn't fully bound");
+	if (!mHasViewport || !mHasScissorRect || !mHasRenderTarget)
+		AddError("Draw", "no viewport, scissor rect or render target");
+	if (vertexCount == 0 || instanceCount == 0)
+		AddError("Draw", "nothing to draw");
+	for (const void* renderTarget : mRenderTargets)
+		ExpectState(renderTarget, RESOURCE_STATE_RENDER_TARGET, "Draw");
+	if (mDepthStencil)
+		ExpectState(mDepthStencil, RESOURCE_STATE_DEPTH_WRITE, "Draw");
+	mCounts.draws++;
+}
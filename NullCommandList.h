@@ -0,0 +1,69 @@
+#pragma once
+
+#include "RenderInterface.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct CommandCounts {
+	uint32_t barriers = 0;
+	uint32_t copies = 0;
+	uint64_t copiedBytes = 0;
+	uint32_t clears = 0;
+	uint32_t stateChanges = 0;
+	uint32_t draws = 0;
+};
+
+// Backend that records nothing, it only checks the commands against the D3D12 rules that are easy
+// to get wrong and counts them, so the CPU cost of building a frame can be measured without a GPU.
+// Resource states are only tracked within a frame since resources are known by address alone and
+// an address can be reused once a resource is released.
+class NullCommandList : public RenderCommandList {
+public:
+	// clears the counts and the tracked state for the next frame, the errors are kept
+	void BeginFrame();
+
+	const CommandCounts& GetCounts() const { return mCounts; }
+	const std::vector<std::string>& GetErrors() const { return mErrors; }
+
+	void ResourceBarrier(uint32_t count, const TransitionBarrier* barriers) override;
+
+	void CopyBufferRegion(Resource* destination, uint64_t destinationOffset, Resource* source, uint64_t sourceOffset, uint64_t size) override;
+	void CopyBufferToTexture(Resource* destination, uint32_t x, uint32_t y, uint32_t z,
+		Resource* source, const BufferFootprint& footprint, const CopyBox* sourceBox = nullptr) override;
+	void CopyTextureToBuffer(Resource* destination, const BufferFootprint& footprint, Resource* source) override;
+
+	void ClearRenderTarget(TextureResource* renderTarget, const float color[4]) override;
+	void ClearDepth(TextureResource* depthStencil, float depth) override;
+	void SetRenderTargets(uint32_t count, TextureResource* const* renderTargets, TextureResource* depthStencil) override;
+
+	void SetDescriptorHeaps() override;
+	void SetRootSignature(ID3D12RootSignature* rootSignature) override;
+	void SetPipelineState(ID3D12PipelineState* pipelineState) override;
+	void SetRootConstantBuffer(uint32_t rootIndex, Resource* buffer) override;
+	void SetViewport(const Viewport& viewport) override;
+	void SetScissorRect(const ScissorRect& scissorRect) override;
+	void SetPrimitiveTopology(PrimitiveTopology topology) override;
+
+	void Draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) override;
+
+private:
+	// resources that haven't been through a barrier this frame are assumed to be in the right state
+	void ExpectState(const void* resource, uint32_t state, const char* command);
+	void AddError(const char* command, const char* message);
+
+private:
+	CommandCounts mCounts{};
+	std::vector<std::string> mErrors;
+	std::unordered_map<const void*, uint32_t> mStates;
+
+	bool mHasDescriptorHeaps = false;
+	bool mHasRootSignature = false;
+	bool mHasPipelineState = false;
+	bool mHasViewport = false;
+	bool mHasScissorRect = false;
+	bool mHasRenderTarget = false;
+	std::vector<const void*> mRenderTargets;
+	const void* mDepthStencil = nullptr;
+};
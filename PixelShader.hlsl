@@ -1,4 +1,34 @@
 #define anisoClampSampler  0
+#define BRICK_SIZE 16
+#define BRICK_APRON 1
+#define BRICK_NOT_RESIDENT 0xFFFFFFFF
+#define EARLY_TERMINATION_OPACITY 0.99f
+#define BASE_STEP_LENGTH 0.05f
+#define STEP_SCALE_ONE 16.0f // StepGrid::STEP_SCALE_ONE
+#define MIN_STEP_SCALE 0.25f // StepGridSettings::minScale
+#define FUSION_COLOR float3(1.0f, 0.35f, 0.0f)
+#define FUSION_OPACITY 0.5f
+
+// Built once per combination of these features (PIXEL_SHADER_FEATURES in CMakeLists.txt), the
+// application binds the variant that matches its resources so the ray loop never branches on them.
+#ifndef PAGED
+#define PAGED 0
+#endif
+#ifndef LIT
+#define LIT 0
+#endif
+#ifndef LABELED
+#define LABELED 0
+#endif
+#ifndef EARLY_TERMINATION
+#define EARLY_TERMINATION 1
+#endif
+#ifndef ADAPTIVE_STEP
+#define ADAPTIVE_STEP 0
+#endif
+#ifndef FUSED
+#define FUSED 0
+#endif
 
 struct PixelInput {
 	float4 position : SV_POSITION;
@@ -12,17 +42,100 @@ struct PerFrameConstants {
 	uint backBufferIndex;
 	uint cubeBufferIndex;
 	uint volumeDataBufferIndex;
+	uint isosurfaceVertexBufferIndex;
+	uint isosurfaceIndexBufferIndex;
+	uint3 volumeDimensions;
+	uint pageTableIndex;
+	uint3 brickGridDimensions;
+	uint brickAtlasIndex;
+	uint3 atlasSlotDimensions;
+	uint brickFeedbackIndex;
+	uint sliceIndex;
+	uint illuminationIndex;
+	uint labelIndex;
+	uint labelBitsPerVoxel;
+	uint3 labelDimensions;
+	uint labelCount;
+	uint4 labelVisibility[2];
+	uint4 labelColors[64];
+	uint3 stepGridDimensions;
+	uint stepGridIndex;
 };
 
 ConstantBuffer<PerFrameConstants> PerFrameConstantBuffer : register(b0, space1);
 
+// Paged volumes go through the page table into the brick atlas. Every brick a ray enters is
+// flagged in the feedback buffer, so the CPU can refresh resident bricks and load missing ones.
+float SampleBrickAtlas(float3 pos, SamplerState volumeSampler, inout uint previousBrick)
+{
+	Texture3D<uint> pageTable = ResourceDescriptorHeap[PerFrameConstantBuffer.pageTableIndex];
+	Texture3D<float> brickAtlas = ResourceDescriptorHeap[PerFrameConstantBuffer.brickAtlasIndex];
+	RWByteAddressBuffer feedback = ResourceDescriptorHeap[PerFrameConstantBuffer.brickFeedbackIndex];
+
+	uint3 brickGrid = PerFrameConstantBuffer.brickGridDimensions;
+	float3 texel = saturate(pos) * PerFrameConstantBuffer.volumeDimensions;
+	uint3 brick = min(uint3(texel) / BRICK_SIZE, brickGrid - 1);
+	uint brickIndex = brick.x + brickGrid.x * (brick.y + brickGrid.y * brick.z);
+
+	if (brickIndex != previousBrick)
+	{
+		feedback.Store(brickIndex * 4, 1);
+		previousBrick = brickIndex;
+	}
+
+	uint slot = pageTable.Load(int4(brick, 0));
+	if (slot == BRICK_NOT_RESIDENT)
+		return 0.0f;
+
+	uint3 slotGrid = PerFrameConstantBuffer.atlasSlotDimensions;
+	uint3 slotCoords = uint3(slot % slotGrid.x, (slot / slotGrid.x) % slotGrid.y, slot / (slotGrid.x * slotGrid.y));
+	float3 atlasTexel = slotCoords * (BRICK_SIZE + 2 * BRICK_APRON) + BRICK_APRON + (texel - brick * BRICK_SIZE);
+	return brickAtlas.SampleLevel(volumeSampler, atlasTexel / (slotGrid * (BRICK_SIZE + 2 * BRICK_APRON)), 0);
+}
+
+// Label maps are bit packed in linear voxel order and looked up at the nearest voxel, labels don't
+// interpolate. A label never straddles a 32 bit word since the bit count always divides 32.
+uint LoadLabel(float3 pos)
+{
+	ByteAddressBuffer labels = ResourceDescriptorHeap[PerFrameConstantBuffer.labelIndex];
+	uint3 dimensions = PerFrameConstantBuffer.labelDimensions;
+	uint3 voxel = min(uint3(saturate(pos) * dimensions), dimensions - 1);
+	uint bit = (voxel.x + dimensions.x * (voxel.y + dimensions.y * voxel.z)) * PerFrameConstantBuffer.labelBitsPerVoxel;
+	uint word = labels.Load((bit >> 5) * 4);
+	return (word >> (bit & 31)) & ((1u << PerFrameConstantBuffer.labelBitsPerVoxel) - 1);
+}
+
+bool IsLabelVisible(uint label)
+{
+	return (PerFrameConstantBuffer.labelVisibility[label >> 7][(label >> 5) & 3] >> (label & 31)) & 1;
+}
+
+float4 GetLabelColor(uint label)
+{
+	uint color = PerFrameConstantBuffer.labelColors[label >> 2][label & 3];
+	return float4(color & 0xFF, (color >> 8) & 0xFF, (color >> 16) & 0xFF, color >> 24) / 255.0f;
+}
+
+// step length of the brick pos is in as a multiple of the base step, see StepGrid
+float LoadStepScale(Texture3D<uint> stepGrid, float3 pos)
+{
+	uint3 dimensions = PerFrameConstantBuffer.stepGridDimensions;
+	uint3 brick = min(uint3(saturate(pos) * PerFrameConstantBuffer.volumeDimensions) / BRICK_SIZE, dimensions - 1);
+	return stepGrid.Load(int4(brick, 0)) / STEP_SCALE_ONE;
+}
+
 float4 PSMain(PixelInput input) : SV_TARGET
 {
 	float2 coords = input.position.xy / PerFrameConstantBuffer.cameraDimensions;
 
 	Texture2D<float4> frontTexture = ResourceDescriptorHeap[PerFrameConstantBuffer.frontBufferIndex];
 	Texture2D<float4> backTexture = ResourceDescriptorHeap[PerFrameConstantBuffer.backBufferIndex];
+#if FUSED
+	// the volume in red, the secondary volume resampled onto its grid in green
+	Texture3D<float2> volumeData = ResourceDescriptorHeap[PerFrameConstantBuffer.volumeDataBufferIndex];
+#else
 	Texture3D<float> volumeData = ResourceDescriptorHeap[PerFrameConstantBuffer.volumeDataBufferIndex];
+#endif
 	SamplerState anisoSampler = SamplerDescriptorHeap[anisoClampSampler];
 
 	float3 front = frontTexture.Sample(anisoSampler, coords);
@@ -31,24 +144,74 @@ float4 PSMain(PixelInput input) : SV_TARGET
 	float3 direction = normalize(back - front);
 	float dist = distance(back, front);
 
-	float3 step = direction * 0.05f;
-	float stepDistance = length(step);
-
-	uint iterations = ceil(dist / stepDistance);
+#if ADAPTIVE_STEP
+	Texture3D<uint> stepGrid = ResourceDescriptorHeap[PerFrameConstantBuffer.stepGridIndex];
+	// bounded by the shortest step the grid can ask for
+	uint iterations = ceil(dist / (BASE_STEP_LENGTH * MIN_STEP_SCALE));
+#else
+	uint iterations = ceil(dist / BASE_STEP_LENGTH);
+#endif
+	float travelled = 0.0f;
 
 	float3 pos = float4(front, 0);
-	float2 result = float2(0, 0);
+	float4 result = float4(0, 0, 0, 0);
+#if PAGED
+	uint previousBrick = BRICK_NOT_RESIDENT;
+#endif
+#if LIT
+	// precomputed light reaching each point, shadows or ambient occlusion without secondary rays
+	Texture3D<float> illumination = ResourceDescriptorHeap[PerFrameConstantBuffer.illuminationIndex];
+#endif
 
-	for (uint i = 0; i < iterations; i++)
+	for (uint i = 0; i < iterations && travelled < dist; i++)
 	{
-       float2 src = volumeData.Sample(anisoSampler, pos).rr;
+#if ADAPTIVE_STEP
+		float stepScale = LoadStepScale(stepGrid, pos);
+#else
+		float stepScale = 1.0f;
+#endif
+#if PAGED
+		float density = SampleBrickAtlas(pos, anisoSampler, previousBrick);
+#elif FUSED
+		float2 densities = volumeData.Sample(anisoSampler, pos);
+		float density = densities.x;
+		float secondary = densities.y;
+#else
+		float density = volumeData.Sample(anisoSampler, pos);
+#endif
+		float4 src = density.rrrr;
+#if FUSED && !PAGED
+		// the secondary volume shows as a colored overlay with its own opacity
+		src.rgb = lerp(src.rgb, FUSION_COLOR, secondary * FUSION_OPACITY);
+		src.a = max(src.a, secondary * FUSION_OPACITY);
+#endif
+#if LIT
+		src.rgb *= illumination.SampleLevel(anisoSampler, pos, 0);
+#endif
+#if LABELED
+		// label maps tint the density with a color/opacity per label, hidden labels contribute nothing
+		uint label = LoadLabel(pos);
+		src *= IsLabelVisible(label) ? GetLabelColor(label) : 0.0f;
+#endif
 
-	   result += (1 - result.y)*src.y * src;
+		float4 contribution = src.a * src;
+#if ADAPTIVE_STEP
+		// the opacity is per base step, a longer or shorter step covers correspondingly more or less
+		if (contribution.a > 0.0f)
+			contribution *= (1.0f - pow(1.0f - contribution.a, stepScale)) / contribution.a;
+#endif
+		result += (1 - result.a) * contribution;
+#if EARLY_TERMINATION
+		// nothing further along the ray can show through anymore
+		if (result.a >= EARLY_TERMINATION_OPACITY)
+			break;
+#endif
 
-	   pos += step;
+		pos += direction * (BASE_STEP_LENGTH * stepScale);
+		travelled += BASE_STEP_LENGTH * stepScale;
 	}
 
-	return float4(result.rrr, result.y);
+	return result;
 	//float3 color = (input.vertPos + 1.0f) * 0.5f;
 	//return float4(color, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "ProgressiveLoader.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+static uint32_t DivideRoundUp(uint32_t value, uint32_t divisor)
+{
+	return (value + divisor - 1) / divisor;
+}
+
+ProgressiveLoader::ReadFunction ProgressiveLoader::ReadFromFile(const std::filesystem::path& filePath, uint64_t offset)
+{
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	if (!file->Open(filePath))
+		assert(false && "File couldn't be opened");
+
+	return [file, offset](uint64_t readOffset, uint8_t* destination, uint64_t size) {
+		if (offset + readOffset + size > file->GetSize())
+			return false;
+		memcpy(destination, file->GetData() + offset + readOffset, size);
+		return true;
+	};
+}
+
+ProgressiveLoader::ProgressiveLoader(ReadFunction read, const VolumeDimensions& dimensions, uint64_t previewReadBudget)
+	: mRead(std::move(read))
+	, mDimensions(dimensions)
+{
+	// strided reads still fetch whole rows, so the preview costs width * rows * slices bytes
+	const uint32_t maxExtent = std::max({ dimensions.width, dimensions.height, dimensions.depth });
+	while (mPreviewStride < maxExtent &&
+		static_cast<uint64_t>(dimensions.width) * DivideRoundUp(dimensions.height, mPreviewStride) * DivideRoundUp(dimensions.depth, mPreviewStride) > previewReadBudget)
+	{
+		mPreviewStride *= 2;
+	}
+}
+
+ProgressiveLoader::~ProgressiveLoader()
+{
+	mIsCancelled = true;
+	if (mThread.joinable())
+		mThread.join();
+}
+
+void ProgressiveLoader::Start()
+{
+	assert(!mThread.joinable());
+	mThread = std::thread(&ProgressiveLoader::LoadLevels, this);
+}
+
+std::optional<VolumeLevel> ProgressiveLoader::TakeLevel()
+{
+	std::lock_guard lock(mMutex);
+	std::optional<VolumeLevel> level = std::move(mFinishedLevel);
+	mFinishedLevel.reset();
+	return level;
+}
+
+VolumeLevel ProgressiveLoader::WaitForLevel()
+{
+	std::unique_lock lock(mMutex);
+	mLevelCondition.wait(lock, [this]() { return mFinishedLevel.has_value() || mIsLoadingDone; });
+	assert(mFinishedLevel && "Volume couldn't be read");
+
+	VolumeLevel level = std::move(*mFinishedLevel);
+	mFinishedLevel.reset();
+	return level;
+}
+
+bool ProgressiveLoader::IsFinished() const
+{
+	std::lock_guard lock(mMutex);
+	return mIsLoadingDone && !mFinishedLevel;
+}
+
+void ProgressiveLoader::LoadLevels()
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (uint32_t stride = mPreviewStride; stride >= 1 && !mIsCancelled; stride /= 2)
+	{
+		VolumeLevel level;
+		if (!ReadLevel(stride, level))
+			break;
+		level.loadMilliseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000.0f;
+		if (mOnLevel)
+			mOnLevel(level);
+
+		{
+			std::lock_guard lock(mMutex);
+			mFinishedLevel = std::move(level);
+		}
+		mLevelCondition.notify_all();
+	}
+
+	{
+		std::lock_guard lock(mMutex);
+		mIsLoadingDone = true;
+	}
+	mLevelCondition.notify_all();
+}
+
+bool ProgressiveLoader::ReadLevel(uint32_t stride, VolumeLevel& level)
+{
+	level.stride = stride;
+	level.dimensions = {
+		.width = DivideRoundUp(mDimensions.width, stride),
+		.height = DivideRoundUp(mDimensions.height, stride),
+		.depth = DivideRoundUp(mDimensions.depth, stride) };
+	level.data.resize(level.dimensions.GetVoxelCount());
+
+	const uint64_t sliceSize = static_cast<uint64_t>(mDimensions.width) * mDimensions.height;
+
+	// full resolution goes slice by slice straight into the level, checking for cancellation in between
+	if (stride == 1)
+	{
+		Arena::FirstTouch(level.data.data(), level.data.size(), sliceSize * BRICK_SIZE);
+		for (uint32_t z = 0; z < mDimensions.depth; z++)
+		{
+			if (mIsCancelled || !mRead(z * sliceSize, level.data.data() + z * sliceSize, sliceSize))
+				return false;
+
+			// the slab is handed over while it's still in cache
+			if (mOnFullResolutionSlab && ((z + 1) % BRICK_SIZE == 0 || z + 1 == mDimensions.depth))
+			{
+				const uint32_t firstSlice = z - z % BRICK_SIZE;
+				mOnFullResolutionSlab(level.data.data() + firstSlice * sliceSize, firstSlice, z + 1 - firstSlice);
+			}
+		}
+		return true;
+	}
+
+	std::vector<uint8_t> row(mDimensions.width);
+	uint8_t* destination = level.data.data();
+	for (uint32_t z = 0; z < mDimensions.depth; z += stride)
+	{
+		if (mIsCancelled)
+			return false;
+
+		for (uint32_t y = 0; y < mDimensions.height; y += stride)
+		{
+			if (!mRead(z * sliceSize + static_cast<uint64_t>(y) * mDimensions.width, row.data(), row.size()))
+				return false;
+
+			for (uint32_t x = 0; x < mDimensions.width; x += stride)
+				*destination++ = row[x];
+		}
+	}
+	return true;
+}
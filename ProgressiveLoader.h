@@ -0,0 +1,76 @@
+#pragma once
+
+#include "VolumeTypes.h"
+#include "Arena.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// one resolution level of a progressively loaded volume, every stride-th voxel of the source
+struct VolumeLevel {
+	VolumeDimensions dimensions{};
+	uint32_t stride = 1; // 1 is the full resolution volume
+	VoxelBuffer data;
+	float loadMilliseconds = 0.0f; // since Start
+};
+
+// Reads a raw 8 bit volume coarse to fine on a background thread. The preview level only reads
+// every stride-th row of every stride-th slice, with the stride picked so the preview reads at most
+// previewReadBudget bytes, then each following level halves the stride until the full volume is in.
+class ProgressiveLoader {
+public:
+	// reads size bytes at offset into destination, false if that failed
+	using ReadFunction = std::function<bool(uint64_t offset, uint8_t* destination, uint64_t size)>;
+
+	// sliceCount full resolution slices starting at firstSlice, right after they were read
+	using SlabFunction = std::function<void(const uint8_t* slices, uint32_t firstSlice, uint32_t sliceCount)>;
+
+	// a level that was just read, it can be changed before it's handed over
+	using LevelFunction = std::function<void(VolumeLevel& level)>;
+
+	// the volume's bytes start at offset in the file, which is mapped so strided reads are copies out of the page cache
+	static ReadFunction ReadFromFile(const std::filesystem::path& filePath, uint64_t offset = 0);
+
+	ProgressiveLoader(ReadFunction read, const VolumeDimensions& dimensions, uint64_t previewReadBudget);
+	~ProgressiveLoader();
+
+	// runs on the loader thread for every BRICK_SIZE slices of the full resolution level, set before Start
+	void SetFullResolutionSlabFunction(SlabFunction onSlab) { mOnFullResolutionSlab = std::move(onSlab); }
+	// runs on the loader thread for every level before TakeLevel or WaitForLevel gets it, set before Start
+	void SetLevelFunction(LevelFunction onLevel) { mOnLevel = std::move(onLevel); }
+
+	void Start();
+
+	// the finest level finished since the last call, coarser ones nobody took are dropped
+	std::optional<VolumeLevel> TakeLevel();
+	// blocks until a level is available
+	VolumeLevel WaitForLevel();
+
+	// the full resolution level has been taken (or reading failed)
+	bool IsFinished() const;
+	uint32_t GetPreviewStride() const { return mPreviewStride; }
+
+private:
+	void LoadLevels();
+	bool ReadLevel(uint32_t stride, VolumeLevel& level);
+
+private:
+	ReadFunction mRead;
+	SlabFunction mOnFullResolutionSlab;
+	LevelFunction mOnLevel;
+	VolumeDimensions mDimensions{};
+	uint32_t mPreviewStride = 1;
+
+	std::thread mThread;
+	mutable std::mutex mMutex;
+	std::condition_variable mLevelCondition;
+	std::optional<VolumeLevel> mFinishedLevel;
+	bool mIsLoadingDone = false;
+	std::atomic<bool> mIsCancelled = false;
+};
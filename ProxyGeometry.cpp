@@ -0,0 +1,201 @@
+#include "ProxyGeometry.h"
+#include "MinMaxGrid.h"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+	struct OccupancyGrid {
+		std::array<uint32_t, 3> size{};
+		std::array<uint32_t, 3> voxelSize{};
+		std::vector<uint8_t> isOccupied;
+
+		OccupancyGrid(const MinMaxGrid& grid, const VolumeDimensions& volumeDimensions, uint8_t threshold, const std::vector<uint8_t>* brickMask)
+		{
+			const VolumeDimensions& dimensions = grid.GetDimensions();
+			size = { dimensions.width, dimensions.height, dimensions.depth };
+			voxelSize = { volumeDimensions.width, volumeDimensions.height, volumeDimensions.depth };
+
+			isOccupied.resize(grid.GetBrickCount());
+			const std::vector<uint8_t>& maxValues = grid.GetMaxValues();
+			for (size_t i = 0; i < maxValues.size(); i++)
+				isOccupied[i] = maxValues[i] > threshold && (!brickMask || (*brickMask)[i]);
+		}
+
+		bool Get(const std::array<uint32_t, 3>& brick) const
+		{
+			return isOccupied[brick[0] + size[0] * (brick[1] + static_cast<size_t>(size[1]) * brick[2])] != 0;
+		}
+
+		// brick boundary plane in object space, the last brick along an axis may be partial
+		float GetPlane(uint32_t axis, uint32_t brickBoundary) const
+		{
+			return static_cast<float>(std::min(brickBoundary * BRICK_SIZE, voxelSize[axis])) / voxelSize[axis] * 2.0f - 1.0f;
+		}
+	};
+}
+
+ProxyMesh ProxyGeometry::Generate(const MinMaxGrid& grid, const VolumeDimensions& volumeDimensions, uint8_t threshold,
+	const std::vector<uint8_t>* brickMask)
+{
+	OccupancyGrid occupancy(grid, volumeDimensions, threshold, brickMask);
+	ProxyMesh mesh;
+
+	std::array<uint32_t, 3> boundsMin = occupancy.size;
+	std::array<uint32_t, 3> boundsMax = { 0, 0, 0 };
+
+	std::vector<uint8_t> mask;
+	for (uint32_t d = 0; d < 3; d++)
+	{
+		const uint32_t u = (d + 1) % 3;
+		const uint32_t v = (d + 2) % 3;
+		mask.resize(static_cast<size_t>(occupancy.size[u]) * occupancy.size[v]);
+
+		for (uint32_t side = 0; side < 2; side++)
+		{
+			for (uint32_t k = 0; k < occupancy.size[d]; k++)
+			{
+				// faces of occupied bricks that look at an empty brick (or out of the volume) in this direction
+				std::fill(mask.begin(), mask.end(), 0);
+				bool hasFaces = false;
+				for (uint32_t j = 0; j < occupancy.size[v]; j++)
+				{
+					for (uint32_t i = 0; i < occupancy.size[u]; i++)
+					{
+						std::array<uint32_t, 3> brick{};
+						brick[d] = k;
+						brick[u] = i;
+						brick[v] = j;
+						if (!occupancy.Get(brick))
+							continue;
+
+						for (uint32_t axis = 0; axis < 3; axis++)
+						{
+							boundsMin[axis] = std::min(boundsMin[axis], brick[axis]);
+							boundsMax[axis] = std::max(boundsMax[axis], brick[axis] + 1);
+						}
+
+						bool isBoundary = side == 0 ? k == 0 : k + 1 == occupancy.size[d];
+						if (!isBoundary)
+						{
+							std::array<uint32_t, 3> neighbour = brick;
+							neighbour[d] = side == 0 ? k - 1 : k + 1;
+							isBoundary = !occupancy.Get(neighbour);
+						}
+
+						if (isBoundary)
+						{
+							mask[i + static_cast<size_t>(occupancy.size[u]) * j] = 1;
+							hasFaces = true;
+						}
+					}
+				}
+
+				if (!hasFaces)
+					continue;
+
+				const float plane = occupancy.GetPlane(d, side == 0 ? k : k + 1);
+				for (uint32_t j = 0; j < occupancy.size[v]; j++)
+				{
+					for (uint32_t i = 0; i < occupancy.size[u];)
+					{
+						uint8_t* row = &mask[static_cast<size_t>(occupancy.size[u]) * j];
+						if (!row[i])
+						{
+							i++;
+							continue;
+						}
+
+						uint32_t width = 1;
+						while (i + width < occupancy.size[u] && row[i + width])
+							width++;
+
+						uint32_t height = 1;
+						for (; j + height < occupancy.size[v]; height++)
+						{
+							const uint8_t* nextRow = &mask[static_cast<size_t>(occupancy.size[u]) * (j + height)];
+							if (!std::all_of(nextRow + i, nextRow + i + width, [](uint8_t value) { return value != 0; }))
+								break;
+						}
+
+						for (uint32_t clearRow = j; clearRow < j + height; clearRow++)
+							std::fill_n(&mask[static_cast<size_t>(occupancy.size[u]) * clearRow + i], width, 0);
+
+						auto corner = [&](uint32_t cornerU, uint32_t cornerV) {
+							std::array<float, 3> position{};
+							position[d] = plane;
+							position[u] = occupancy.GetPlane(u, cornerU);
+							position[v] = occupancy.GetPlane(v, cornerV);
+							return Float3{ position[0], position[1], position[2] };
+						};
+						const Float3 p00 = corner(i, j);
+						const Float3 p10 = corner(i + width, j);
+						const Float3 p11 = corner(i + width, j + height);
+						const Float3 p01 = corner(i, j + height);
+
+						// same winding as the unit cube had, front faces are counterclockwise seen from outside
+						if (side == 1)
+							mesh.vertices.insert(mesh.vertices.end(), { p00, p11, p10, p00, p01, p11 });
+						else
+							mesh.vertices.insert(mesh.vertices.end(), { p00, p10, p11, p00, p11, p01 });
+
+						i += width;
+					}
+				}
+			}
+		}
+	}
+
+	if (!mesh.vertices.empty())
+	{
+		mesh.boundsMin = { occupancy.GetPlane(0, boundsMin[0]), occupancy.GetPlane(1, boundsMin[1]), occupancy.GetPlane(2, boundsMin[2]) };
+		mesh.boundsMax = { occupancy.GetPlane(0, boundsMax[0]), occupancy.GetPlane(1, boundsMax[1]), occupancy.GetPlane(2, boundsMax[2]) };
+	}
+
+	return mesh;
+}
+
+RayLengthEstimate ProxyGeometry::EstimateRayLength(const MinMaxGrid& grid, const VolumeDimensions& volumeDimensions, uint8_t threshold,
+	const std::vector<uint8_t>* brickMask)
+{
+	OccupancyGrid occupancy(grid, volumeDimensions, threshold, brickMask);
+	RayLengthEstimate estimate;
+
+	for (uint32_t d = 0; d < 3; d++)
+	{
+		const uint32_t u = (d + 1) % 3;
+		const uint32_t v = (d + 2) % 3;
+
+		for (uint32_t j = 0; j < occupancy.size[v]; j++)
+		{
+			for (uint32_t i = 0; i < occupancy.size[u]; i++)
+			{
+				const double area =
+					(occupancy.GetPlane(u, i + 1) - occupancy.GetPlane(u, i)) *
+					(occupancy.GetPlane(v, j + 1) - occupancy.GetPlane(v, j));
+				estimate.cubeLength += 2.0 * area;
+
+				std::array<uint32_t, 3> brick{};
+				brick[u] = i;
+				brick[v] = j;
+
+				uint32_t first = UINT32_MAX;
+				uint32_t last = 0;
+				for (uint32_t k = 0; k < occupancy.size[d]; k++)
+				{
+					brick[d] = k;
+					if (occupancy.Get(brick))
+					{
+						first = std::min(first, k);
+						last = k;
+					}
+				}
+
+				if (first != UINT32_MAX)
+					estimate.proxyLength += (occupancy.GetPlane(d, last + 1) - occupancy.GetPlane(d, first)) * area;
+			}
+		}
+	}
+
+	return estimate;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "VolumeTypes.h"
+
+#include <vector>
+
+class MinMaxGrid;
+
+// Non-indexed triangle list in the [-1, 1] object space of the volume, wound like the old unit cube.
+struct ProxyMesh {
+	std::vector<Float3> vertices;
+	Float3 boundsMin{};
+	Float3 boundsMax{};
+};
+
+struct RayLengthEstimate {
+	double cubeLength = 0.0;
+	double proxyLength = 0.0;
+};
+
+// Builds the ray start/end geometry from the bricks that can contribute anything under the given
+// opacity threshold. The surface is the closed boundary of the occupied bricks, with coplanar brick
+// faces greedily merged into larger rectangles to keep the triangle count down. An optional brick
+// mask (laid out like the grid) drops further bricks, e.g. ones that only hold hidden labels.
+class ProxyGeometry {
+public:
+	static ProxyMesh Generate(const MinMaxGrid& grid, const VolumeDimensions& volumeDimensions, uint8_t threshold,
+		const std::vector<uint8_t>* brickMask = nullptr);
+
+	// Total length of axis aligned rays through every brick column, marching from the first to the
+	// last occupied brick (what the proxy gives us) compared to crossing the whole box.
+	static RayLengthEstimate EstimateRayLength(const MinMaxGrid& grid, const VolumeDimensions& volumeDimensions, uint8_t threshold,
+		const std::vector<uint8_t>* brickMask = nullptr);
+};
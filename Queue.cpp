@@ -24,6 +24,12 @@ uint64_t Queue::Signal()
 	return mCurrentFenceValue++;
 }
 
+uint64_t Queue::GetCompletedFenceValue()
+{
+	mCompletedFenceValue = mFence->GetCompletedValue();
+	return mCompletedFenceValue;
+}
+
 void Queue::WaitForQueueCpuBlocking(uint64_t fenceValue)
 {
 	while (mFence->GetCompletedValue() < fenceValue)
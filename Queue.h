@@ -9,6 +9,9 @@ public:
 	ID3D12CommandQueue* GetQueue() { return mCommandQueue.Get(); }
 
 	uint64_t Signal();
+	// the value the next Signal will use, i.e. the one covering everything submitted until then
+	uint64_t GetNextFenceValue() const { return mCurrentFenceValue; }
+	uint64_t GetCompletedFenceValue();
 	void Submit(ID3D12CommandList* commandList);
 	void WaitForQueueCpuBlocking(uint64_t fenceValue);
 private:
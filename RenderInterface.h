@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+
+// Backend agnostic command recording. Everything a frame records goes through RenderCommandList, so
+// the frame building code can run against the D3D12 backend or against the null backend, which only
+// validates and counts. Resources and pipeline objects are only passed through as pointers here,
+// this header doesn't need the platform headers.
+
+struct Resource;
+struct TextureResource;
+struct ID3D12RootSignature;
+struct ID3D12PipelineState;
+
+// the D3D12_RESOURCE_STATES values the null backend looks at, the D3D12 backend checks they match
+constexpr uint32_t RESOURCE_STATE_COMMON = 0;
+constexpr uint32_t RESOURCE_STATE_RENDER_TARGET = 0x4;
+constexpr uint32_t RESOURCE_STATE_DEPTH_WRITE = 0x10;
+constexpr uint32_t RESOURCE_STATE_COPY_DEST = 0x400;
+constexpr uint32_t RESOURCE_STATE_COPY_SOURCE = 0x800;
+
+struct TransitionBarrier {
+	Resource* resource = nullptr;
+	uint32_t stateBefore = RESOURCE_STATE_COMMON;
+	uint32_t stateAfter = RESOURCE_STATE_COMMON;
+};
+
+// rows of texels laid out in a buffer, what D3D12 calls a placed footprint
+struct BufferFootprint {
+	uint64_t offset = 0;
+	uint32_t format = 0; // DXGI_FORMAT
+	uint32_t width = 0;
+	uint32_t height = 1;
+	uint32_t depth = 1;
+	uint32_t rowPitch = 0;
+};
+
+// texel range of a copy source, the end is exclusive
+struct CopyBox {
+	uint32_t left = 0;
+	uint32_t top = 0;
+	uint32_t front = 0;
+	uint32_t right = 0;
+	uint32_t bottom = 0;
+	uint32_t back = 0;
+};
+
+struct Viewport {
+	float x = 0.0f;
+	float y = 0.0f;
+	float width = 0.0f;
+	float height = 0.0f;
+	float minDepth = 0.0f;
+	float maxDepth = 1.0f;
+};
+
+struct ScissorRect {
+	int32_t left = 0;
+	int32_t top = 0;
+	int32_t right = 0;
+	int32_t bottom = 0;
+};
+
+enum class PrimitiveTopology : uint8_t {
+	TriangleList,
+	TriangleStrip
+};
+
+class RenderCommandList {
+public:
+	virtual ~RenderCommandList() = default;
+
+	virtual void ResourceBarrier(uint32_t count, const TransitionBarrier* barriers) = 0;
+
+	virtual void CopyBufferRegion(Resource* destination, uint64_t destinationOffset, Resource* source, uint64_t sourceOffset, uint64_t size) = 0;
+	// copies the footprint (or sourceBox of it) into the first subresource of destination at x, y, z
+	virtual void CopyBufferToTexture(Resource* destination, uint32_t x, uint32_t y, uint32_t z,
+		Resource* source, const BufferFootprint& footprint, const CopyBox* sourceBox = nullptr) = 0;
+	virtual void CopyTextureToBuffer(Resource* destination, const BufferFootprint& footprint, Resource* source) = 0;
+
+	virtual void ClearRenderTarget(TextureResource* renderTarget, const float color[4]) = 0;
+	virtual void ClearDepth(TextureResource* depthStencil, float depth) = 0;
+	virtual void SetRenderTargets(uint32_t count, TextureResource* const* renderTargets, TextureResource* depthStencil) = 0;
+
+	// the shader visible resource and sampler heaps everything is indexed from
+	virtual void SetDescriptorHeaps() = 0;
+	virtual void SetRootSignature(ID3D12RootSignature* rootSignature) = 0;
+	virtual void SetPipelineState(ID3D12PipelineState* pipelineState) = 0;
+	virtual void SetRootConstantBuffer(uint32_t rootIndex, Resource* buffer) = 0;
+	virtual void SetViewport(const Viewport& viewport) = 0;
+	virtual void SetScissorRect(const ScissorRect& scissorRect) = 0;
+	virtual void SetPrimitiveTopology(PrimitiveTopology topology) = 0;
+
+	virtual void Draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) = 0;
+};
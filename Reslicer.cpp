@@ -0,0 +1,251 @@
+#include "Reslicer.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	// the vector path does the exact same operations in the same order, so both agree up to rounding of the final value
+	float SampleTrilinear(const uint8_t* data, const VolumeDimensions& volumeDimensions, float x, float y, float z)
+	{
+		const float maxX = static_cast<float>(volumeDimensions.width - 1);
+		const float maxY = static_cast<float>(volumeDimensions.height - 1);
+		const float maxZ = static_cast<float>(volumeDimensions.depth - 1);
+		if (!(x >= 0.0f && x <= maxX && y >= 0.0f && y <= maxY && z >= 0.0f && z <= maxZ))
+			return 0.0f;
+
+		const uint32_t x0 = static_cast<uint32_t>(x);
+		const uint32_t y0 = static_cast<uint32_t>(y);
+		const uint32_t z0 = static_cast<uint32_t>(z);
+		const float fx = x - static_cast<float>(x0);
+		const float fy = y - static_cast<float>(y0);
+		const float fz = z - static_cast<float>(z0);
+
+		const size_t base = volumeDimensions.GetIndex(x0, y0, z0);
+		const size_t stepX = x0 + 1 < volumeDimensions.width ? 1 : 0;
+		const size_t stepY = y0 + 1 < volumeDimensions.height ? volumeDimensions.width : 0;
+		const size_t stepZ = z0 + 1 < volumeDimensions.depth ? static_cast<size_t>(volumeDimensions.width) * volumeDimensions.height : 0;
+
+		auto lerp = [](float a, float b, float t) { return a + (b - a) * t; };
+		const float c00 = lerp(data[base], data[base + stepX], fx);
+		const float c10 = lerp(data[base + stepY], data[base + stepY + stepX], fx);
+		const float c01 = lerp(data[base + stepZ], data[base + stepZ + stepX], fx);
+		const float c11 = lerp(data[base + stepZ + stepY], data[base + stepZ + stepY + stepX], fx);
+		return lerp(lerp(c00, c10, fy), lerp(c01, c11, fy), fz);
+	}
+
+	uint8_t ReslicePixel(const uint8_t* data, const VolumeDimensions& volumeDimensions, const SlicePlane& plane, uint32_t i, uint32_t j)
+	{
+		const float inverseSampleCount = 1.0f / static_cast<float>(plane.slabSampleCount);
+		float result = 0.0f;
+		for (uint32_t sample = 0; sample < plane.slabSampleCount; sample++)
+		{
+			const float rowX = plane.origin.x + static_cast<float>(j) * plane.axisV.x + static_cast<float>(sample) * plane.slabStep.x;
+			const float rowY = plane.origin.y + static_cast<float>(j) * plane.axisV.y + static_cast<float>(sample) * plane.slabStep.y;
+			const float rowZ = plane.origin.z + static_cast<float>(j) * plane.axisV.z + static_cast<float>(sample) * plane.slabStep.z;
+			const float value = SampleTrilinear(data, volumeDimensions,
+				rowX + static_cast<float>(i) * plane.axisU.x,
+				rowY + static_cast<float>(i) * plane.axisU.y,
+				rowZ + static_cast<float>(i) * plane.axisU.z);
+
+			if (plane.slabMode == SlabMode::MaximumIntensity)
+				result = std::max(result, value);
+			else if (plane.slabMode == SlabMode::Average)
+				result += value;
+			else
+				result = value;
+		}
+
+		if (plane.slabMode == SlabMode::Average)
+			result *= inverseSampleCount;
+		return static_cast<uint8_t>(std::min(std::nearbyint(result), 255.0f));
+	}
+}
+
+SlicePlane Reslicer::MakePlane(const VolumeDimensions& volumeDimensions, const Float3& center, const Float3& right, const Float3& up,
+	uint32_t width, uint32_t height)
+{
+	auto projectedExtent = [&](const Float3& axis) {
+		return std::abs(axis.x) * (volumeDimensions.width - 1) +
+			std::abs(axis.y) * (volumeDimensions.height - 1) +
+			std::abs(axis.z) * (volumeDimensions.depth - 1);
+	};
+	const float pixelSize = std::max({
+		projectedExtent(right) / std::max(width - 1, 1u),
+		projectedExtent(up) / std::max(height - 1, 1u),
+		1e-6f });
+
+	const float halfWidth = 0.5f * (width - 1) * pixelSize;
+	const float halfHeight = 0.5f * (height - 1) * pixelSize;
+
+	SlicePlane plane;
+	plane.axisU = { right.x * pixelSize, right.y * pixelSize, right.z * pixelSize };
+	plane.axisV = { up.x * pixelSize, up.y * pixelSize, up.z * pixelSize };
+	plane.origin = {
+		center.x - right.x * halfWidth - up.x * halfHeight,
+		center.y - right.y * halfWidth - up.y * halfHeight,
+		center.z - right.z * halfWidth - up.z * halfHeight };
+	return plane;
+}
+
+void Reslicer::SetSlab(SlicePlane& plane, float thickness, SlabMode mode)
+{
+	Float3 normal = {
+		plane.axisU.y * plane.axisV.z - plane.axisU.z * plane.axisV.y,
+		plane.axisU.z * plane.axisV.x - plane.axisU.x * plane.axisV.z,
+		plane.axisU.x * plane.axisV.y - plane.axisU.y * plane.axisV.x };
+	const float length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+	if (mode == SlabMode::Thin || thickness < 1.0f || length == 0.0f)
+	{
+		plane.slabStep = {};
+		plane.slabSampleCount = 1;
+		plane.slabMode = SlabMode::Thin;
+		return;
+	}
+
+	normal = { normal.x / length, normal.y / length, normal.z / length };
+	plane.slabSampleCount = static_cast<uint32_t>(thickness) + 1;
+	plane.slabStep = normal;
+	plane.slabMode = mode;
+
+	// start half the slab behind the plane
+	const float halfThickness = 0.5f * (plane.slabSampleCount - 1);
+	plane.origin = {
+		plane.origin.x - normal.x * halfThickness,
+		plane.origin.y - normal.y * halfThickness,
+		plane.origin.z - normal.z * halfThickness };
+}
+
+void Reslicer::Reslice(const uint8_t* data, const VolumeDimensions& volumeDimensions, const SlicePlane& plane,
+	uint32_t width, uint32_t height, uint8_t* out, size_t rowPitch)
+{
+	const uint32_t tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	const uint32_t tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+	ThreadPool::Get().ParallelFor(tilesX * tilesY, [&](uint32_t tile) {
+		const uint32_t beginX = (tile % tilesX) * TILE_SIZE;
+		const uint32_t beginY = (tile / tilesX) * TILE_SIZE;
+		ResliceTile(data, volumeDimensions, plane, beginX, beginY, std::min(beginX + TILE_SIZE, width), std::min(beginY + TILE_SIZE, height), out, rowPitch);
+	});
+}
+
+void Reslicer::ResliceScalar(const uint8_t* data, const VolumeDimensions& volumeDimensions, const SlicePlane& plane,
+	uint32_t width, uint32_t height, uint8_t* out, size_t rowPitch)
+{
+	for (uint32_t j = 0; j < height; j++)
+	{
+		for (uint32_t i = 0; i < width; i++)
+			out[j * rowPitch + i] = ReslicePixel(data, volumeDimensions, plane, i, j);
+	}
+}
+
+void Reslicer::ResliceTile(const uint8_t* data, const VolumeDimensions& volumeDimensions, const SlicePlane& plane,
+	uint32_t beginX, uint32_t beginY, uint32_t endX, uint32_t endY, uint8_t* out, size_t rowPitch)
+{
+	for (uint32_t j = beginY; j < endY; j++)
+	{
+		uint8_t* row = out + j * rowPitch;
+		uint32_t i = beginX;
+
+#ifdef VOLUME_SSE2
+		const __m128 maxX = _mm_set1_ps(static_cast<float>(volumeDimensions.width - 1));
+		const __m128 maxY = _mm_set1_ps(static_cast<float>(volumeDimensions.height - 1));
+		const __m128 maxZ = _mm_set1_ps(static_cast<float>(volumeDimensions.depth - 1));
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 inverseSampleCount = _mm_set1_ps(1.0f / static_cast<float>(plane.slabSampleCount));
+		const size_t sliceSize = static_cast<size_t>(volumeDimensions.width) * volumeDimensions.height;
+
+		auto lerp = [](__m128 a, __m128 b, __m128 t) { return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t)); };
+
+		for (; i + 4 <= endX; i += 4)
+		{
+			const __m128 pixel = _mm_set_ps(static_cast<float>(i + 3), static_cast<float>(i + 2), static_cast<float>(i + 1), static_cast<float>(i));
+			__m128 result = zero;
+
+			for (uint32_t sample = 0; sample < plane.slabSampleCount; sample++)
+			{
+				const float rowX = plane.origin.x + static_cast<float>(j) * plane.axisV.x + static_cast<float>(sample) * plane.slabStep.x;
+				const float rowY = plane.origin.y + static_cast<float>(j) * plane.axisV.y + static_cast<float>(sample) * plane.slabStep.y;
+				const float rowZ = plane.origin.z + static_cast<float>(j) * plane.axisV.z + static_cast<float>(sample) * plane.slabStep.z;
+				__m128 x = _mm_add_ps(_mm_set1_ps(rowX), _mm_mul_ps(pixel, _mm_set1_ps(plane.axisU.x)));
+				__m128 y = _mm_add_ps(_mm_set1_ps(rowY), _mm_mul_ps(pixel, _mm_set1_ps(plane.axisU.y)));
+				__m128 z = _mm_add_ps(_mm_set1_ps(rowZ), _mm_mul_ps(pixel, _mm_set1_ps(plane.axisU.z)));
+
+				const __m128 isInside = _mm_and_ps(
+					_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(x, zero), _mm_cmple_ps(x, maxX)), _mm_and_ps(_mm_cmpge_ps(y, zero), _mm_cmple_ps(y, maxY))),
+					_mm_and_ps(_mm_cmpge_ps(z, zero), _mm_cmple_ps(z, maxZ)));
+				const int insideMask = _mm_movemask_ps(isInside);
+				if (insideMask == 0)
+				{
+					if (plane.slabMode == SlabMode::Thin)
+						result = zero;
+					continue;
+				}
+
+				// outside lanes are clamped so their (discarded) fetches stay in bounds
+				x = _mm_min_ps(_mm_max_ps(x, zero), maxX);
+				y = _mm_min_ps(_mm_max_ps(y, zero), maxY);
+				z = _mm_min_ps(_mm_max_ps(z, zero), maxZ);
+				const __m128i x0 = _mm_cvttps_epi32(x);
+				const __m128i y0 = _mm_cvttps_epi32(y);
+				const __m128i z0 = _mm_cvttps_epi32(z);
+				const __m128 fx = _mm_sub_ps(x, _mm_cvtepi32_ps(x0));
+				const __m128 fy = _mm_sub_ps(y, _mm_cvtepi32_ps(y0));
+				const __m128 fz = _mm_sub_ps(z, _mm_cvtepi32_ps(z0));
+
+				alignas(16) uint32_t laneX[4];
+				alignas(16) uint32_t laneY[4];
+				alignas(16) uint32_t laneZ[4];
+				_mm_store_si128(reinterpret_cast<__m128i*>(laneX), x0);
+				_mm_store_si128(reinterpret_cast<__m128i*>(laneY), y0);
+				_mm_store_si128(reinterpret_cast<__m128i*>(laneZ), z0);
+
+				// SSE2 has no gather, the corners are loaded per lane
+				alignas(16) int32_t corners[8][4];
+				for (uint32_t lane = 0; lane < 4; lane++)
+				{
+					const size_t base = volumeDimensions.GetIndex(laneX[lane], laneY[lane], laneZ[lane]);
+					const size_t stepX = laneX[lane] + 1 < volumeDimensions.width ? 1 : 0;
+					const size_t stepY = laneY[lane] + 1 < volumeDimensions.height ? volumeDimensions.width : 0;
+					const size_t stepZ = laneZ[lane] + 1 < volumeDimensions.depth ? sliceSize : 0;
+					corners[0][lane] = data[base];
+					corners[1][lane] = data[base + stepX];
+					corners[2][lane] = data[base + stepY];
+					corners[3][lane] = data[base + stepY + stepX];
+					corners[4][lane] = data[base + stepZ];
+					corners[5][lane] = data[base + stepZ + stepX];
+					corners[6][lane] = data[base + stepZ + stepY];
+					corners[7][lane] = data[base + stepZ + stepY + stepX];
+				}
+
+				auto corner = [&](uint32_t index) { return _mm_cvtepi32_ps(_mm_load_si128(reinterpret_cast<const __m128i*>(corners[index]))); };
+				const __m128 c00 = lerp(corner(0), corner(1), fx);
+				const __m128 c10 = lerp(corner(2), corner(3), fx);
+				const __m128 c01 = lerp(corner(4), corner(5), fx);
+				const __m128 c11 = lerp(corner(6), corner(7), fx);
+				const __m128 value = _mm_and_ps(lerp(lerp(c00, c10, fy), lerp(c01, c11, fy), fz), isInside);
+
+				if (plane.slabMode == SlabMode::MaximumIntensity)
+					result = _mm_max_ps(result, value);
+				else if (plane.slabMode == SlabMode::Average)
+					result = _mm_add_ps(result, value);
+				else
+					result = value;
+			}
+
+			if (plane.slabMode == SlabMode::Average)
+				result = _mm_mul_ps(result, inverseSampleCount);
+
+			// round to nearest even like the scalar path, the packs saturate to [0, 255]
+			__m128i packed = _mm_cvtps_epi32(result);
+			packed = _mm_packs_epi32(packed, packed);
+			packed = _mm_packus_epi16(packed, packed);
+			const int32_t pixels = _mm_cvtsi128_si32(packed);
+			std::copy_n(reinterpret_cast<const uint8_t*>(&pixels), 4, row + i);
+		}
+#endif
+
+		for (; i < endX; i++)
+			row[i] = ReslicePixel(data, volumeDimensions, plane, i, j);
+	}
+}
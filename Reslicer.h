@@ -0,0 +1,46 @@
+#pragma once
+
+#include "VolumeTypes.h"
+
+enum class SlabMode : uint8_t {
+	Thin,
+	MaximumIntensity,
+	Average
+};
+
+// A sampled plane in voxel coordinates (voxel centers at integers). Pixel (i, j) of the output
+// samples origin + i * axisU + j * axisV, slabs add slabSampleCount samples spaced by slabStep.
+struct SlicePlane {
+	Float3 origin{};
+	Float3 axisU{};
+	Float3 axisV{};
+	Float3 slabStep{};
+	uint32_t slabSampleCount = 1;
+	SlabMode slabMode = SlabMode::Thin;
+};
+
+// CPU multi-planar reformatting of 8 bit volumes. Output rows are written with a caller given pitch
+// so the image can go straight into an upload buffer. Samples outside the volume are 0.
+class Reslicer {
+public:
+	static constexpr uint32_t TILE_SIZE = 64;
+
+	// plane through center spanned by the (unit length) right and up directions, with square pixels
+	// sized so the whole volume fits into the image whatever the orientation
+	static SlicePlane MakePlane(const VolumeDimensions& volumeDimensions, const Float3& center, const Float3& right, const Float3& up,
+		uint32_t width, uint32_t height);
+
+	// thickness in voxels, centered on the plane, one sample per voxel of thickness
+	static void SetSlab(SlicePlane& plane, float thickness, SlabMode mode);
+
+	static void Reslice(const uint8_t* data, const VolumeDimensions& volumeDimensions, const SlicePlane& plane,
+		uint32_t width, uint32_t height, uint8_t* out, size_t rowPitch);
+
+	// one pixel at a time without SIMD, the reference the vectorized path is checked against
+	static void ResliceScalar(const uint8_t* data, const VolumeDimensions& volumeDimensions, const SlicePlane& plane,
+		uint32_t width, uint32_t height, uint8_t* out, size_t rowPitch);
+
+private:
+	static void ResliceTile(const uint8_t* data, const VolumeDimensions& volumeDimensions, const SlicePlane& plane,
+		uint32_t beginX, uint32_t beginY, uint32_t endX, uint32_t endY, uint8_t* out, size_t rowPitch);
+};
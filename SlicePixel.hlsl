@@ -0,0 +1,44 @@
+#define anisoClampSampler  0
+
+struct PixelInput {
+	float4 position : SV_POSITION;
+	float2 uv : TEXCOORD;
+};
+
+struct PerFrameConstants {
+	matrix modelMatrix;
+	float2 cameraDimensions;
+	uint frontBufferIndex;
+	uint backBufferIndex;
+	uint cubeBufferIndex;
+	uint volumeDataBufferIndex;
+	uint isosurfaceVertexBufferIndex;
+	uint isosurfaceIndexBufferIndex;
+	uint3 volumeDimensions;
+	uint pageTableIndex;
+	uint3 brickGridDimensions;
+	uint brickAtlasIndex;
+	uint3 atlasSlotDimensions;
+	uint brickFeedbackIndex;
+	uint sliceIndex;
+	uint illuminationIndex;
+	uint labelIndex;
+	uint labelBitsPerVoxel;
+	uint3 labelDimensions;
+	uint labelCount;
+	uint4 labelVisibility[2];
+	uint4 labelColors[64];
+	uint3 stepGridDimensions;
+	uint stepGridIndex;
+};
+
+ConstantBuffer<PerFrameConstants> PerFrameConstantBuffer : register(b0, space1);
+
+float4 PSMain(PixelInput input) : SV_TARGET
+{
+	Texture2D<float> slice = ResourceDescriptorHeap[PerFrameConstantBuffer.sliceIndex];
+	SamplerState anisoSampler = SamplerDescriptorHeap[anisoClampSampler];
+
+	float density = slice.SampleLevel(anisoSampler, input.uv, 0);
+	return float4(density.xxx, 1.0f);
+}
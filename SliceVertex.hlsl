@@ -0,0 +1,15 @@
+struct VertexOutput {
+	float4 position : SV_POSITION;
+	float2 uv : TEXCOORD;
+};
+
+// one triangle covering the viewport, the slice is drawn into a corner viewport
+VertexOutput VSMain(uint vertexId : SV_VERTEXID)
+{
+	float2 uv = float2((vertexId << 1) & 2, vertexId & 2);
+
+	VertexOutput output;
+	output.position = float4(uv * float2(2.0f, -2.0f) + float2(-1.0f, 1.0f), 0.0f, 1.0f);
+	output.uv = uv;
+	return output;
+}
@@ -0,0 +1,150 @@
+#include "StepGrid.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// largest |a[i] - b[i]|
+static uint8_t MaxAbsDifference(const uint8_t* a, const uint8_t* b, uint32_t length)
+{
+	uint8_t maxValue = 0;
+	uint32_t i = 0;
+#ifdef VOLUME_SSE2
+	__m128i maxVector = _mm_setzero_si128();
+	for (; i + 16 <= length; i += 16)
+	{
+		__m128i valuesA = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+		__m128i valuesB = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+		// one of the saturating differences is always zero
+		__m128i difference = _mm_or_si128(_mm_subs_epu8(valuesA, valuesB), _mm_subs_epu8(valuesB, valuesA));
+		maxVector = _mm_max_epu8(maxVector, difference);
+	}
+
+	alignas(16) uint8_t maxLanes[16];
+	_mm_store_si128(reinterpret_cast<__m128i*>(maxLanes), maxVector);
+	for (uint32_t lane = 0; lane < 16; lane++)
+		maxValue = std::max(maxValue, maxLanes[lane]);
+#endif
+	for (; i < length; i++)
+		maxValue = std::max(maxValue, static_cast<uint8_t>(a[i] > b[i] ? a[i] - b[i] : b[i] - a[i]));
+	return maxValue;
+}
+
+void StepGrid::Build(const uint8_t* data, const VolumeDimensions& volumeDimensions, const StepGridSettings& settings)
+{
+	mSettings = settings;
+	mDimensions = {
+		.width = (volumeDimensions.width + BRICK_SIZE - 1) / BRICK_SIZE,
+		.height = (volumeDimensions.height + BRICK_SIZE - 1) / BRICK_SIZE,
+		.depth = (volumeDimensions.depth + BRICK_SIZE - 1) / BRICK_SIZE };
+
+	mVariation.assign(mDimensions.GetVoxelCount(), 0);
+	mScales.assign(mDimensions.GetVoxelCount(), STEP_SCALE_ONE);
+
+	ThreadPool::Get().ParallelFor(static_cast<uint32_t>(mDimensions.GetVoxelCount()), [&](uint32_t brick) {
+		MeasureBrick(data, volumeDimensions,
+			brick % mDimensions.width,
+			(brick / mDimensions.width) % mDimensions.height,
+			brick / (mDimensions.width * mDimensions.height));
+	});
+	DeriveScales();
+}
+
+void StepGrid::Update(const uint8_t* data, const VolumeDimensions& volumeDimensions, const VolumeBox& changedVoxels)
+{
+	if (changedVoxels.IsEmpty())
+		return;
+
+	// a brick owns the voxel pairs starting in it, so the brick before the change sees it too
+	auto firstBrick = [](uint32_t voxel) { return (voxel > 0 ? voxel - 1 : 0) / BRICK_SIZE; };
+	auto lastBrick = [](uint32_t voxel, uint32_t brickCount) { return std::min((voxel - 1) / BRICK_SIZE, brickCount - 1); };
+	const uint32_t beginX = firstBrick(changedVoxels.minX);
+	const uint32_t beginY = firstBrick(changedVoxels.minY);
+	const uint32_t beginZ = firstBrick(changedVoxels.minZ);
+	const uint32_t countX = lastBrick(changedVoxels.maxX, mDimensions.width) - beginX + 1;
+	const uint32_t countY = lastBrick(changedVoxels.maxY, mDimensions.height) - beginY + 1;
+	const uint32_t countZ = lastBrick(changedVoxels.maxZ, mDimensions.depth) - beginZ + 1;
+
+	ThreadPool::Get().ParallelFor(countX * countY * countZ, [&](uint32_t brick) {
+		MeasureBrick(data, volumeDimensions,
+			beginX + brick % countX,
+			beginY + (brick / countX) % countY,
+			beginZ + brick / (countX * countY));
+	});
+	// the grid is tiny next to the volume, the neighbourhoods are simply taken again everywhere
+	DeriveScales();
+}
+
+void StepGrid::MeasureBrick(const uint8_t* data, const VolumeDimensions& volumeDimensions, uint32_t x, uint32_t y, uint32_t z)
+{
+	const uint32_t beginX = x * BRICK_SIZE;
+	const uint32_t beginY = y * BRICK_SIZE;
+	const uint32_t beginZ = z * BRICK_SIZE;
+	const uint32_t endX = std::min(beginX + BRICK_SIZE, volumeDimensions.width);
+	const uint32_t endY = std::min(beginY + BRICK_SIZE, volumeDimensions.height);
+	const uint32_t endZ = std::min(beginZ + BRICK_SIZE, volumeDimensions.depth);
+	const uint32_t rowLength = endX - beginX;
+	// the last pair of a row reaches into the next brick, unless there is none
+	const uint32_t pairsPerRow = endX < volumeDimensions.width ? rowLength : rowLength - 1;
+	const size_t sliceSize = static_cast<size_t>(volumeDimensions.width) * volumeDimensions.height;
+
+	uint8_t variation = 0;
+	for (uint32_t voxelZ = beginZ; voxelZ < endZ; voxelZ++)
+	{
+		for (uint32_t voxelY = beginY; voxelY < endY; voxelY++)
+		{
+			const uint8_t* row = data + volumeDimensions.GetIndex(beginX, voxelY, voxelZ);
+			variation = std::max(variation, MaxAbsDifference(row, row + 1, pairsPerRow));
+			if (voxelY + 1 < volumeDimensions.height)
+				variation = std::max(variation, MaxAbsDifference(row, row + volumeDimensions.width, rowLength));
+			if (voxelZ + 1 < volumeDimensions.depth)
+				variation = std::max(variation, MaxAbsDifference(row, row + sliceSize, rowLength));
+		}
+	}
+	mVariation[mDimensions.GetIndex(x, y, z)] = variation;
+}
+
+void StepGrid::DeriveScales()
+{
+	// largest variation of every brick and its 26 neighbours, one axis at a time
+	std::vector<uint8_t> neighbourhood = mVariation;
+	std::vector<uint8_t> pass(neighbourhood.size());
+	const uint32_t extents[3] = { mDimensions.width, mDimensions.height, mDimensions.depth };
+	const size_t strides[3] = { 1, mDimensions.width, static_cast<size_t>(mDimensions.width) * mDimensions.height };
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		for (uint32_t z = 0; z < mDimensions.depth; z++)
+		{
+			for (uint32_t y = 0; y < mDimensions.height; y++)
+			{
+				for (uint32_t x = 0; x < mDimensions.width; x++)
+				{
+					const uint32_t coordinate = axis == 0 ? x : (axis == 1 ? y : z);
+					const size_t index = mDimensions.GetIndex(x, y, z);
+					uint8_t value = neighbourhood[index];
+					if (coordinate > 0)
+						value = std::max(value, neighbourhood[index - strides[axis]]);
+					if (coordinate + 1 < extents[axis])
+						value = std::max(value, neighbourhood[index + strides[axis]]);
+					pass[index] = value;
+				}
+			}
+		}
+		neighbourhood.swap(pass);
+	}
+
+	// the density changes by at most sqrt(3) * variation per voxel of travel in any direction
+	const float maxScale = std::max(mSettings.minScale, std::min(mSettings.maxScale, BRICK_SIZE / mSettings.baseStepVoxels));
+	for (size_t brick = 0; brick < mScales.size(); brick++)
+	{
+		float scale = maxScale;
+		if (neighbourhood[brick] > 0)
+		{
+			const float safeVoxels = mSettings.maxValueChange / (std::sqrt(3.0f) * neighbourhood[brick]);
+			scale = std::clamp(safeVoxels / mSettings.baseStepVoxels, mSettings.minScale, maxScale);
+		}
+		// rounded down, a shorter step is always safe
+		mScales[brick] = static_cast<uint8_t>(std::clamp(static_cast<uint32_t>(scale * STEP_SCALE_ONE), 1u, static_cast<uint32_t>(UINT8_MAX)));
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "VolumeTypes.h"
+
+#include <vector>
+
+struct StepGridSettings {
+	float baseStepVoxels = 1.0f; // length of the ray marcher's base step in voxels
+	float maxValueChange = 16.0f; // how much the density may change between two samples
+	float minScale = 0.25f;
+	float maxScale = 4.0f;
+};
+
+// Step length of the ray marcher for every BRICK_SIZE^3 region, as a multiple of the base step. It
+// follows from the steepest difference between neighbouring voxels around the region, so rays stride
+// through homogeneous tissue and slow down at boundaries. Steps never get longer than a brick, and
+// every region takes the steepest difference of its neighbours too, so no step can skip over an edge.
+class StepGrid {
+public:
+	// the scales are stored as fixed point, STEP_SCALE_ONE is exactly the base step
+	static constexpr uint32_t STEP_SCALE_ONE = 16;
+
+	void Build(const uint8_t* data, const VolumeDimensions& volumeDimensions, const StepGridSettings& settings);
+
+	// measures only the bricks the changed voxels (or their neighbours) are in again
+	void Update(const uint8_t* data, const VolumeDimensions& volumeDimensions, const VolumeBox& changedVoxels);
+
+	const VolumeDimensions& GetDimensions() const { return mDimensions; }
+	const std::vector<uint8_t>& GetScales() const { return mScales; }
+	float GetScale(uint32_t x, uint32_t y, uint32_t z) const { return static_cast<float>(mScales[mDimensions.GetIndex(x, y, z)]) / STEP_SCALE_ONE; }
+	uint8_t GetVariation(uint32_t x, uint32_t y, uint32_t z) const { return mVariation[mDimensions.GetIndex(x, y, z)]; }
+
+private:
+	void MeasureBrick(const uint8_t* data, const VolumeDimensions& volumeDimensions, uint32_t x, uint32_t y, uint32_t z);
+	void DeriveScales();
+
+private:
+	StepGridSettings mSettings{};
+	VolumeDimensions mDimensions{};
+	std::vector<uint8_t> mVariation; // largest difference between neighbouring voxels per brick
+	std::vector<uint8_t> mScales;
+};
@@ -0,0 +1,165 @@
+#include "Test.h"
+#include "Arena.h"
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+static bool IsAligned(const void* pointer, size_t alignment)
+{
+	return reinterpret_cast<uintptr_t>(pointer) % alignment == 0;
+}
+
+static void TestAllocations()
+{
+	Arena arena(4 * Arena::LARGE_PAGE_SIZE);
+	CHECK(arena.GetReservedBytes() == 0);
+
+	uint8_t* a = static_cast<uint8_t*>(arena.Allocate(100));
+	uint8_t* b = static_cast<uint8_t*>(arena.Allocate(1000, 4096));
+	uint8_t* c = static_cast<uint8_t*>(arena.Allocate(1));
+	CHECK(IsAligned(a, Arena::DEFAULT_ALIGNMENT) && IsAligned(b, 4096) && IsAligned(c, Arena::DEFAULT_ALIGNMENT));
+	CHECK(a + 100 <= b && b + 1000 <= c);
+	CHECK(arena.GetReservedBytes() == 4 * Arena::LARGE_PAGE_SIZE);
+	CHECK(arena.GetLargePageBytes() <= arena.GetLargePageRequestedBytes());
+
+	// the memory is writable all the way through
+	memset(a, 1, 100);
+	memset(b, 2, 1000);
+	*c = 3;
+	CHECK(a[99] == 1 && b[999] == 2 && *c == 3);
+
+	// bigger than a block gets a block of its own
+	void* large = arena.Allocate(5 * Arena::LARGE_PAGE_SIZE + 1);
+	CHECK(large != nullptr);
+	CHECK(arena.GetReservedBytes() == 4 * Arena::LARGE_PAGE_SIZE + 6 * Arena::LARGE_PAGE_SIZE);
+
+	// the first block is only rewound once all three are gone
+	arena.Deallocate(a);
+	arena.Deallocate(c);
+	CHECK(arena.Allocate(100) != a);
+	arena.Deallocate(b);
+	arena.Release();
+	CHECK(arena.GetReservedBytes() == 0);
+}
+
+static void TestReuse()
+{
+	Arena arena(4 * Arena::LARGE_PAGE_SIZE);
+	void* first = arena.Allocate(Arena::LARGE_PAGE_SIZE);
+	void* second = arena.Allocate(Arena::LARGE_PAGE_SIZE);
+	arena.Deallocate(first);
+	arena.Deallocate(second);
+	CHECK(arena.GetAllocatedBytes() == 0);
+	CHECK(arena.Allocate(2 * Arena::LARGE_PAGE_SIZE) == first);
+	CHECK(arena.GetReservedBytes() == 4 * Arena::LARGE_PAGE_SIZE);
+}
+
+// The levels of a progressive load, each eight times the previous one, replace each other as they come
+// in. Loading a second dataset of the same size has to get by with the blocks of the first.
+static void TestProgressiveLevels()
+{
+	Arena arena(4 * Arena::LARGE_PAGE_SIZE);
+	auto load = [&]() {
+		std::vector<uint8_t, ArenaAllocator<uint8_t>> current{ ArenaAllocator<uint8_t>(arena) };
+		for (size_t size = 4096; size <= 16 * 1024 * 1024; size *= 8)
+		{
+			std::vector<uint8_t, ArenaAllocator<uint8_t>> level{ ArenaAllocator<uint8_t>(arena) };
+			level.resize(size);
+			level.back() = 1;
+			current = std::move(level);
+		}
+		CHECK(current.size() == 16 * 1024 * 1024);
+		return arena.GetReservedBytes();
+	};
+
+	const size_t reservedBytes = load();
+	CHECK(arena.GetAllocatedBytes() == 0);
+	CHECK(load() == reservedBytes);
+	CHECK(load() == reservedBytes);
+}
+
+#ifndef _WIN32
+static long GetMinorFaultCount()
+{
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_minflt;
+}
+
+static size_t GetAnonHugePageBytes()
+{
+	std::ifstream smaps("/proc/self/smaps");
+	std::string line;
+	size_t kilobytes = 0;
+	while (std::getline(smaps, line))
+	{
+		if (line.rfind("AnonHugePages:", 0) == 0)
+			kilobytes += std::stoull(line.substr(14));
+	}
+	return kilobytes * 1024;
+}
+#endif
+
+// Faulting in a volume sized buffer through the arena against a zero filled std::vector, and the
+// second time round the arena hands out the blocks it already has.
+static void BenchmarkAllocation()
+{
+	constexpr size_t SIZE = 512 * 1024 * 1024;
+	Arena arena;
+
+	auto report = [](const char* name, double milliseconds, long faults) {
+		std::printf("%-28s %8.1f ms %8ld page faults\n", name, milliseconds, faults);
+	};
+
+	for (uint32_t round = 0; round < 2; round++)
+	{
+		long faults = 0;
+#ifndef _WIN32
+		faults = GetMinorFaultCount();
+#endif
+		const double arenaMilliseconds = MeasureMilliseconds(1, [&]() {
+			std::vector<uint8_t, ArenaAllocator<uint8_t>> volume{ ArenaAllocator<uint8_t>(arena) };
+			volume.resize(SIZE);
+			Arena::FirstTouch(volume.data(), volume.size(), 16 * 256 * 256);
+#ifndef _WIN32
+			if (round == 0)
+				std::printf("transparent huge pages backing the arena: %zu MB\n", GetAnonHugePageBytes() >> 20);
+#endif
+		});
+#ifndef _WIN32
+		faults = GetMinorFaultCount() - faults;
+#endif
+		report(round == 0 ? "arena" : "arena, blocks reused", arenaMilliseconds, faults);
+	}
+
+	long faults = 0;
+#ifndef _WIN32
+	faults = GetMinorFaultCount();
+#endif
+	const double vectorMilliseconds = MeasureMilliseconds(1, [&]() {
+		std::vector<uint8_t> volume(SIZE);
+		CHECK(volume[SIZE / 2] == 0);
+	});
+#ifndef _WIN32
+	faults = GetMinorFaultCount() - faults;
+#endif
+	report("std::vector", vectorMilliseconds, faults);
+	std::printf("large pages: %zu MB, requested: %zu MB of %zu MB\n",
+		arena.GetLargePageBytes() >> 20, arena.GetLargePageRequestedBytes() >> 20, arena.GetReservedBytes() >> 20);
+}
+
+int main(int argc, char** argv)
+{
+	TestAllocations();
+	TestReuse();
+	TestProgressiveLevels();
+	if (IsBenchmarkRun(argc, argv))
+		BenchmarkAllocation();
+	return GetTestResult();
+}
@@ -0,0 +1,249 @@
+#include "Test.h"
+#include "BrickCache.h"
+
+#include <list>
+#include <random>
+#include <set>
+#include <vector>
+
+// feedback the way the ray marcher writes it, one entry per brick and nonzero where a ray went through
+static std::vector<uint32_t> GetFeedback(uint32_t brickCount, const std::set<uint32_t>& bricks)
+{
+	std::vector<uint32_t> feedback(brickCount, 0);
+	for (uint32_t brick : bricks)
+		feedback[brick] = 1;
+	return feedback;
+}
+
+// one frame of the renderer: feedback from the last frame, then as many uploads as there are requests
+static std::vector<BrickUpload> RunFrame(BrickCache& cache, uint32_t brickCount, const std::set<uint32_t>& bricks)
+{
+	cache.BeginFrame();
+	const std::vector<uint32_t> feedback = GetFeedback(brickCount, bricks);
+	cache.ProcessFeedback(feedback.data(), brickCount);
+	return cache.ScheduleUploads(brickCount);
+}
+
+// Textbook LRU for the reference, most recently used first. Hits are touched and misses are loaded in
+// brick order, which is the order the feedback is read in.
+struct ReferenceLru {
+	std::list<uint32_t> bricks;
+	uint32_t capacity = 0;
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t evictions = 0;
+
+	void Access(const std::set<uint32_t>& accessed)
+	{
+		std::vector<uint32_t> missed;
+		for (uint32_t brick : accessed)
+		{
+			auto it = std::find(bricks.begin(), bricks.end(), brick);
+			if (it != bricks.end())
+			{
+				hits++;
+				bricks.splice(bricks.begin(), bricks, it);
+			}
+			else
+			{
+				misses++;
+				missed.push_back(brick);
+			}
+		}
+		for (uint32_t brick : missed)
+		{
+			if (bricks.size() == capacity)
+			{
+				evictions++;
+				bricks.pop_back();
+			}
+			bricks.push_front(brick);
+		}
+	}
+};
+
+// Random traces with a hot set and a cold tail, every frame's working set fits into the cache. The cache
+// has to keep the same bricks in the same order as the reference and count the same hits and evictions.
+static void TestTraceReplay()
+{
+	const uint32_t brickCount = 300;
+	for (uint32_t capacity : { 8u, 40u, 100u })
+	{
+		std::mt19937 random(capacity);
+		BrickCache cache(brickCount, capacity);
+		ReferenceLru reference{ .bricks = {}, .capacity = capacity };
+		bool isSameOrder = true;
+		bool isPageTableConsistent = true;
+		for (uint32_t frame = 0; frame < 500; frame++)
+		{
+			std::set<uint32_t> accessed;
+			const uint32_t accessCount = 1 + random() % capacity;
+			while (accessed.size() < accessCount)
+				accessed.insert(random() % 4 == 0 ? random() % brickCount : random() % (capacity + capacity / 2));
+
+			RunFrame(cache, brickCount, accessed);
+			reference.Access(accessed);
+
+			const std::vector<uint32_t> resident = cache.GetResidentBricks();
+			isSameOrder &= resident == std::vector<uint32_t>(reference.bricks.begin(), reference.bricks.end());
+			for (uint32_t brick : resident)
+				isPageTableConsistent &= cache.GetSlot(brick) != BrickCache::NOT_RESIDENT && cache.GetSlot(brick) < capacity;
+			isPageTableConsistent &= cache.GetResidentCount() == resident.size();
+		}
+		CHECK(isSameOrder);
+		CHECK(isPageTableConsistent);
+		CHECK(cache.GetStats().hits == reference.hits);
+		CHECK(cache.GetStats().misses == reference.misses);
+		CHECK(cache.GetStats().evictions == reference.evictions);
+		CHECK(cache.GetStats().uploads == reference.misses);
+		CHECK(cache.GetStats().hits > 0 && cache.GetStats().evictions > 0);
+	}
+}
+
+// A scan larger than the cache misses every time, repeating a working set that fits hits every time
+// after the first frame.
+static void TestHitRate()
+{
+	const uint32_t brickCount = 64;
+	BrickCache cache(brickCount, 16);
+	const std::set<uint32_t> workingSet = { 3, 5, 8, 13, 21, 34, 55 };
+	for (uint32_t frame = 0; frame < 10; frame++)
+		RunFrame(cache, brickCount, workingSet);
+	CHECK(cache.GetStats().misses == workingSet.size());
+	CHECK(cache.GetStats().hits == 9 * workingSet.size());
+
+	BrickCache scanCache(brickCount, 16);
+	for (uint32_t frame = 0; frame < 10; frame++)
+	{
+		for (uint32_t start = 0; start < brickCount; start += 8)
+			RunFrame(scanCache, brickCount, { start, start + 1, start + 2, start + 3, start + 4, start + 5, start + 6, start + 7 });
+	}
+	CHECK(scanCache.GetStats().hits == 0);
+	CHECK(scanCache.GetStats().misses == 10 * brickCount);
+}
+
+// Shrinking the budget evicts the least recently used bricks and no more, the rest keep their slots.
+// Later requests stay within the budget by evicting, raising it again fills the free slots.
+static void TestBudgetDrop()
+{
+	const uint32_t brickCount = 32;
+	BrickCache cache(brickCount, 8);
+	for (uint32_t brick = 0; brick < 8; brick++)
+		RunFrame(cache, brickCount, { brick });
+	RunFrame(cache, brickCount, { 2 });
+	RunFrame(cache, brickCount, { 6 });
+	CHECK((cache.GetResidentBricks() == std::vector<uint32_t>{ 6, 2, 7, 5, 4, 3, 1, 0 }));
+
+	std::vector<uint32_t> slots(brickCount);
+	for (uint32_t brick = 0; brick < brickCount; brick++)
+		slots[brick] = cache.GetSlot(brick);
+	cache.ClearPageTableDirty();
+	cache.ResetStats();
+
+	cache.SetSlotBudget(5);
+	CHECK(cache.GetSlotBudget() == 5);
+	CHECK(cache.GetResidentCount() == 5);
+	CHECK(cache.GetStats().evictions == 3);
+	CHECK(cache.IsPageTableDirty());
+	CHECK((cache.GetResidentBricks() == std::vector<uint32_t>{ 6, 2, 7, 5, 4 }));
+	for (uint32_t brick : { 0u, 1u, 3u })
+		CHECK(cache.GetSlot(brick) == BrickCache::NOT_RESIDENT);
+	for (uint32_t brick : { 2u, 4u, 5u, 6u, 7u })
+		CHECK(cache.GetSlot(brick) == slots[brick]);
+
+	const std::vector<BrickUpload> uploads = RunFrame(cache, brickCount, { 20, 21 });
+	CHECK(uploads.size() == 2);
+	CHECK(cache.GetResidentCount() == 5);
+	CHECK((cache.GetResidentBricks() == std::vector<uint32_t>{ 21, 20, 6, 2, 7 }));
+
+	// a budget above the capacity is clamped to it
+	cache.SetSlotBudget(100);
+	CHECK(cache.GetSlotBudget() == 8);
+	RunFrame(cache, brickCount, { 0, 1, 3 });
+	CHECK(cache.GetResidentCount() == 8);
+	CHECK((cache.GetResidentBricks() == std::vector<uint32_t>{ 3, 1, 0, 21, 20, 6, 2, 7 }));
+}
+
+// A frame that touches more bricks than fit only evicts what the frame didn't use, the requests left
+// over are uploaded next frame, oldest first.
+static void TestWorkingSetLargerThanCache()
+{
+	const uint32_t brickCount = 16;
+	BrickCache cache(brickCount, 4);
+	RunFrame(cache, brickCount, { 0, 1 });
+	const std::vector<BrickUpload> uploads = RunFrame(cache, brickCount, { 1, 2, 3, 4, 5, 6 });
+	CHECK(uploads.size() == 3);
+	CHECK(uploads[0].brick == 2 && uploads[1].brick == 3 && uploads[2].brick == 4);
+	CHECK(cache.GetSlot(0) == BrickCache::NOT_RESIDENT);
+	CHECK(cache.GetSlot(1) != BrickCache::NOT_RESIDENT);
+	CHECK(cache.GetStats().evictions == 1);
+
+	const std::vector<BrickUpload> nextUploads = RunFrame(cache, brickCount, {});
+	CHECK(nextUploads.size() == 2);
+	CHECK(nextUploads[0].brick == 5 && nextUploads[1].brick == 6);
+	CHECK((cache.GetResidentBricks() == std::vector<uint32_t>{ 6, 5, 4, 3 }));
+}
+
+// invalidated bricks go out before any request, into the slot they already have
+static void TestStaleFirst()
+{
+	const uint32_t brickCount = 16;
+	BrickCache cache(brickCount, 4);
+	RunFrame(cache, brickCount, { 0, 1 });
+	cache.BeginFrame();
+	cache.RequestBrick(9);
+	cache.InvalidateBrick(1);
+	cache.InvalidateBrick(1);
+	cache.InvalidateBrick(12);
+	std::vector<BrickUpload> uploads = cache.ScheduleUploads(1);
+	CHECK(uploads.size() == 1);
+	CHECK(uploads[0].brick == 1 && uploads[0].slot == cache.GetSlot(1) && uploads[0].isStale);
+	uploads = cache.ScheduleUploads(4);
+	CHECK(uploads.size() == 1);
+	CHECK(uploads[0].brick == 9 && !uploads[0].isStale);
+}
+
+// A cancelled upload leaves the cache as if it never happened and comes first in the next schedule.
+// A new brick gives its slot back so nothing reads it, a stale one keeps its slot and stays stale.
+static void TestCancelUpload()
+{
+	const uint32_t brickCount = 16;
+	BrickCache cache(brickCount, 4);
+	RunFrame(cache, brickCount, { 0 });
+	cache.InvalidateBrick(0);
+	cache.ClearPageTableDirty();
+	cache.ResetStats();
+
+	cache.BeginFrame();
+	cache.RequestBrick(5);
+	cache.RequestBrick(6);
+	std::vector<BrickUpload> uploads = cache.ScheduleUploads(4);
+	CHECK(uploads.size() == 3);
+	CHECK(uploads[0].brick == 0 && uploads[0].isStale);
+	for (size_t i = uploads.size(); i > 0; i--)
+		cache.CancelUpload(uploads[i - 1]);
+	CHECK(cache.GetStats().uploads == 0);
+	CHECK(cache.GetResidentCount() == 1);
+	CHECK(cache.GetSlot(0) != BrickCache::NOT_RESIDENT);
+	CHECK(cache.GetSlot(5) == BrickCache::NOT_RESIDENT && cache.GetSlot(6) == BrickCache::NOT_RESIDENT);
+	CHECK((cache.GetResidentBricks() == std::vector<uint32_t>{ 0 }));
+	CHECK(cache.IsPageTableDirty());
+
+	cache.RequestBrick(7);
+	uploads = cache.ScheduleUploads(4);
+	CHECK(uploads.size() == 4);
+	CHECK(uploads[0].brick == 0 && uploads[0].isStale);
+	CHECK(uploads[1].brick == 5 && uploads[2].brick == 6 && uploads[3].brick == 7);
+	CHECK(cache.GetResidentCount() == 4);
+}
+
+int main()
+{
+	TestTraceReplay();
+	TestHitRate();
+	TestBudgetDrop();
+	TestWorkingSetLargerThanCache();
+	TestStaleFirst();
+	TestCancelUpload();
+	return GetTestResult();
+}
@@ -0,0 +1,117 @@
+#include "Test.h"
+#include "DeferredReleaseQueue.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+// Stands in for the GPU fence: the CPU signals a value at the end of every frame and the GPU completes
+// them in order, some number of frames behind.
+class MockFence {
+public:
+	uint64_t GetNextValue() const { return mNextValue; }
+	uint64_t GetCompletedValue() const { return mCompletedValue; }
+
+	uint64_t Signal() { return mNextValue++; }
+	void Complete(uint64_t value)
+	{
+		if (value > mCompletedValue && value < mNextValue)
+			mCompletedValue = value;
+	}
+
+private:
+	uint64_t mNextValue = 1;
+	uint64_t mCompletedValue = 0;
+};
+
+struct RetiredItem {
+	uint64_t fenceValue = 0;
+	uint32_t id = 0;
+	// move only, like the resources the device retires
+	std::unique_ptr<uint32_t> resource;
+};
+
+static void TestBatches()
+{
+	MockFence fence;
+	DeferredReleaseQueue<uint32_t> queue;
+	CHECK(queue.IsEmpty());
+	CHECK(queue.Release(fence.GetCompletedValue()) == 0);
+
+	queue.Retire(1, fence.GetNextValue());
+	queue.Retire(2, fence.GetNextValue());
+	fence.Signal();
+	queue.Retire(3, fence.GetNextValue());
+	fence.Signal();
+	CHECK(queue.GetPendingCount() == 3);
+
+	// nothing goes before the GPU got there, then a frame's batch at a time and in order
+	std::vector<uint32_t> released;
+	auto onRelease = [&](uint32_t item) { released.push_back(item); };
+	CHECK(queue.Release(fence.GetCompletedValue(), onRelease) == 0);
+
+	fence.Complete(1);
+	CHECK(queue.Release(fence.GetCompletedValue(), onRelease) == 2);
+	CHECK((released == std::vector<uint32_t>{ 1, 2 }));
+	CHECK(queue.GetPendingCount() == 1);
+
+	fence.Complete(2);
+	CHECK(queue.Release(fence.GetCompletedValue(), onRelease) == 1);
+	CHECK((released == std::vector<uint32_t>{ 1, 2, 3 }));
+	CHECK(queue.IsEmpty());
+}
+
+// a render loop with frames in flight retiring a random number of items every frame, the GPU
+// completing one to three frames behind
+static void TestFramesInFlight()
+{
+	MockFence fence;
+	DeferredReleaseQueue<RetiredItem> queue;
+	std::mt19937 random(3);
+
+	uint32_t nextId = 0;
+	uint32_t releasedCount = 0;
+	uint64_t lastReleasedFence = 0;
+	auto onRelease = [&](RetiredItem& item) {
+		CHECK(item.fenceValue <= fence.GetCompletedValue());
+		CHECK(item.fenceValue >= lastReleasedFence);
+		CHECK(item.resource && *item.resource == item.id);
+		lastReleasedFence = item.fenceValue;
+		releasedCount++;
+	};
+
+	for (uint32_t frame = 0; frame < 5000; frame++)
+	{
+		// BeginFrame: the GPU has caught up to some earlier frame
+		const uint64_t lag = 1 + random() % 3;
+		if (fence.GetNextValue() > lag)
+			fence.Complete(fence.GetNextValue() - lag);
+		const size_t pendingBefore = queue.GetPendingCount();
+		const size_t released = queue.Release(fence.GetCompletedValue(), onRelease);
+		CHECK(queue.GetPendingCount() == pendingBefore - released);
+
+		const uint32_t retireCount = random() % 20;
+		for (uint32_t i = 0; i < retireCount; i++)
+		{
+			queue.Retire({ .fenceValue = fence.GetNextValue(), .id = nextId, .resource = std::make_unique<uint32_t>(nextId) }, fence.GetNextValue());
+			nextId++;
+		}
+
+		// EndFrame
+		fence.Signal();
+		CHECK(releasedCount + queue.GetPendingCount() == nextId);
+	}
+
+	// shutdown waits for the GPU to go idle and everything goes
+	fence.Complete(fence.GetNextValue() - 1);
+	queue.Release(fence.GetCompletedValue(), onRelease);
+	CHECK(queue.IsEmpty());
+	CHECK(releasedCount == nextId);
+}
+
+int main()
+{
+	TestBatches();
+	TestFramesInFlight();
+	return GetTestResult();
+}
@@ -0,0 +1,779 @@
+#include "Test.h"
+#include "DicomLoader.h"
+#include "ThreadPool.h"
+
+#include <bit>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+static const std::filesystem::path OUTPUT_DIRECTORY = std::filesystem::temp_directory_path() / "DicomLoaderTest";
+
+static constexpr const char* IMPLICIT_LITTLE_ENDIAN = "1.2.840.10008.1.2";
+static constexpr const char* EXPLICIT_LITTLE_ENDIAN = "1.2.840.10008.1.2.1";
+static constexpr const char* RLE_LOSSLESS = "1.2.840.10008.1.2.5";
+static constexpr const char* JPEG_LOSSLESS = "1.2.840.10008.1.2.4.57";
+static constexpr uint32_t UNDEFINED_LENGTH = 0xFFFFFFFF;
+
+// Code lengths of the 17 difference categories, short for small differences. Codes longer than the
+// decoder's lookup are in there too, they're what the large differences of noisy 16 bit data use.
+static constexpr uint8_t CATEGORY_CODE_LENGTHS[17] = { 2, 3, 3, 3, 3, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14 };
+
+// JPEG's bits go in from the most significant one, a 0xFF byte is followed by a stuffed zero
+struct JpegBitWriter {
+	std::vector<uint8_t>& bytes;
+	uint32_t byte = 0;
+	uint32_t bitCount = 0;
+
+	void Put(uint32_t value, uint32_t count)
+	{
+		for (uint32_t i = count; i > 0; i--)
+		{
+			byte = (byte << 1) | ((value >> (i - 1)) & 1);
+			if (++bitCount == 8)
+			{
+				bytes.push_back(static_cast<uint8_t>(byte));
+				if (byte == 0xFF)
+					bytes.push_back(0x00);
+				byte = 0;
+				bitCount = 0;
+			}
+		}
+	}
+
+	// pads with ones up to the next byte, before a marker
+	void Align()
+	{
+		while (bitCount != 0)
+			Put(1, 1);
+	}
+};
+
+static void PutBigEndian16(std::vector<uint8_t>& bytes, uint32_t value)
+{
+	bytes.push_back(static_cast<uint8_t>(value >> 8));
+	bytes.push_back(static_cast<uint8_t>(value));
+}
+
+// Lossless JPEG (process 14) of a single component image, written from the standard rather than from the
+// decoder. Restart intervals are whole rows, which is what the standard asks for in lossless mode.
+static std::vector<uint8_t> EncodeJpegLossless(const uint16_t* samples, uint32_t width, uint32_t height, uint32_t precision,
+	uint32_t predictor, uint32_t pointTransform, uint32_t restartRows)
+{
+	std::vector<uint8_t> jpeg = { 0xFF, 0xD8 };
+
+	jpeg.insert(jpeg.end(), { 0xFF, 0xC3 });
+	PutBigEndian16(jpeg, 11);
+	jpeg.push_back(static_cast<uint8_t>(precision));
+	PutBigEndian16(jpeg, height);
+	PutBigEndian16(jpeg, width);
+	jpeg.insert(jpeg.end(), { 1, 1, 0x11, 0 });
+
+	// canonical codes, the categories are already sorted by code length
+	uint32_t codes[17];
+	uint8_t counts[16] = {};
+	uint32_t code = 0;
+	uint32_t category = 0;
+	for (uint32_t length = 1; length <= 16; length++)
+	{
+		for (; category < 17 && CATEGORY_CODE_LENGTHS[category] == length; category++)
+		{
+			codes[category] = code++;
+			counts[length - 1]++;
+		}
+		code <<= 1;
+	}
+	jpeg.insert(jpeg.end(), { 0xFF, 0xC4 });
+	PutBigEndian16(jpeg, 2 + 1 + 16 + 17);
+	jpeg.push_back(0x00);
+	jpeg.insert(jpeg.end(), counts, counts + 16);
+	for (uint8_t value = 0; value < 17; value++)
+		jpeg.push_back(value);
+
+	const uint32_t restartInterval = restartRows * width;
+	if (restartInterval > 0)
+	{
+		jpeg.insert(jpeg.end(), { 0xFF, 0xDD });
+		PutBigEndian16(jpeg, 4);
+		PutBigEndian16(jpeg, restartInterval);
+	}
+
+	jpeg.insert(jpeg.end(), { 0xFF, 0xDA });
+	PutBigEndian16(jpeg, 8);
+	jpeg.insert(jpeg.end(), { 1, 1, 0x00, static_cast<uint8_t>(predictor), 0, static_cast<uint8_t>(pointTransform) });
+
+	JpegBitWriter writer{ .bytes = jpeg };
+	std::vector<int32_t> shifted(static_cast<size_t>(width) * height);
+	for (size_t sample = 0; sample < shifted.size(); sample++)
+		shifted[sample] = samples[sample] >> pointTransform;
+	uint32_t restartIndex = 0;
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			const uint32_t sample = y * width + x;
+			if (restartInterval > 0 && sample > 0 && sample % restartInterval == 0)
+			{
+				writer.Align();
+				jpeg.insert(jpeg.end(), { 0xFF, static_cast<uint8_t>(0xD0 + restartIndex++ % 8) });
+			}
+
+			// the first row of an interval predicts from the left, the first column from above
+			const uint32_t intervalRow = restartInterval > 0 ? sample / restartInterval * restartRows : 0;
+			const int32_t* row = &shifted[static_cast<size_t>(y) * width];
+			const int32_t* above = row - width;
+			int32_t prediction = 0;
+			if (y == intervalRow && x == 0)
+				prediction = 1 << (precision - pointTransform - 1);
+			else if (y == intervalRow)
+				prediction = row[x - 1];
+			else if (x == 0)
+				prediction = above[x];
+			else
+			{
+				const int32_t a = row[x - 1];
+				const int32_t b = above[x];
+				const int32_t c = above[x - 1];
+				const int32_t predictions[8] = { 0, a, b, c, a + b - c, a + ((b - c) >> 1), b + ((a - c) >> 1), (a + b) >> 1 };
+				prediction = predictions[predictor];
+			}
+
+			// modulo 2^16, in -32767..32768
+			int32_t difference = (row[x] - prediction) & 0xFFFF;
+			if (difference > 32768)
+				difference -= 65536;
+			const uint32_t differenceCategory = difference == 0 ? 0 : std::bit_width(static_cast<uint32_t>(std::abs(difference)));
+			writer.Put(codes[differenceCategory], CATEGORY_CODE_LENGTHS[differenceCategory]);
+			if (differenceCategory > 0 && differenceCategory < 16)
+				writer.Put(static_cast<uint32_t>(difference > 0 ? difference : difference + (1 << differenceCategory) - 1), differenceCategory);
+		}
+	}
+	writer.Align();
+	jpeg.insert(jpeg.end(), { 0xFF, 0xD9 });
+	return jpeg;
+}
+
+// PackBits per byte plane, most significant plane first, every segment padded to an even length
+static std::vector<uint8_t> EncodeRle(const uint8_t* samples, uint32_t sampleCount, uint32_t bytesPerSample)
+{
+	std::vector<uint8_t> rle(64, 0);
+	uint32_t header[16] = { bytesPerSample };
+	for (uint32_t segment = 0; segment < bytesPerSample; segment++)
+	{
+		header[segment + 1] = static_cast<uint32_t>(rle.size());
+		auto plane = [&](uint32_t sample) { return samples[static_cast<size_t>(sample) * bytesPerSample + bytesPerSample - 1 - segment]; };
+		uint32_t sample = 0;
+		while (sample < sampleCount)
+		{
+			uint32_t runLength = 1;
+			while (sample + runLength < sampleCount && runLength < 128 && plane(sample + runLength) == plane(sample))
+				runLength++;
+			if (runLength >= 3)
+			{
+				rle.push_back(static_cast<uint8_t>(1 - static_cast<int32_t>(runLength)));
+				rle.push_back(plane(sample));
+				sample += runLength;
+				continue;
+			}
+
+			// literals up to the next run of three
+			const uint32_t start = sample;
+			while (sample < sampleCount && sample - start < 128 &&
+				!(sample + 2 < sampleCount && plane(sample) == plane(sample + 1) && plane(sample) == plane(sample + 2)))
+				sample++;
+			rle.push_back(static_cast<uint8_t>(sample - start - 1));
+			for (uint32_t literal = start; literal < sample; literal++)
+				rle.push_back(plane(literal));
+		}
+		if (rle.size() % 2 != 0)
+			rle.push_back(0);
+	}
+	memcpy(rle.data(), header, sizeof(header));
+	return rle;
+}
+
+// the data elements of a file in explicit or implicit VR little endian
+struct DicomWriter {
+	std::vector<uint8_t> bytes;
+	bool isExplicit = true;
+
+	void Put(const void* data, size_t size)
+	{
+		bytes.insert(bytes.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+	}
+
+	// items and delimiters have no VR in either syntax
+	void PutItemTag(uint16_t element, uint32_t length)
+	{
+		const uint16_t tag[2] = { 0xFFFE, element };
+		Put(tag, sizeof(tag));
+		Put(&length, sizeof(length));
+	}
+
+	void PutHeader(uint16_t group, uint16_t element, const char* vr, uint32_t length)
+	{
+		const uint16_t tag[2] = { group, element };
+		Put(tag, sizeof(tag));
+		if (!isExplicit)
+		{
+			Put(&length, sizeof(length));
+			return;
+		}
+		Put(vr, 2);
+		if (strcmp(vr, "OB") == 0 || strcmp(vr, "OW") == 0 || strcmp(vr, "SQ") == 0 || strcmp(vr, "UN") == 0)
+		{
+			const uint16_t reserved = 0;
+			Put(&reserved, sizeof(reserved));
+			Put(&length, sizeof(length));
+		}
+		else
+		{
+			const uint16_t shortLength = static_cast<uint16_t>(length);
+			Put(&shortLength, sizeof(shortLength));
+		}
+	}
+
+	void PutString(uint16_t group, uint16_t element, const char* vr, std::string value)
+	{
+		if (value.size() % 2 != 0)
+			value.push_back(strcmp(vr, "UI") == 0 ? '\0' : ' ');
+		PutHeader(group, element, vr, static_cast<uint32_t>(value.size()));
+		Put(value.data(), value.size());
+	}
+
+	void PutUint16(uint16_t group, uint16_t element, uint16_t value)
+	{
+		PutHeader(group, element, "US", sizeof(value));
+		Put(&value, sizeof(value));
+	}
+};
+
+static std::string FormatDecimals(const float* values, uint32_t count)
+{
+	std::string text;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		char value[32];
+		std::snprintf(value, sizeof(value), "%g", values[i]);
+		if (i > 0)
+			text += '\\';
+		text += value;
+	}
+	return text;
+}
+
+// a series as the test writes it, samples are the stored values with anything above bitsStored zero
+struct TestSeries {
+	std::string uid = "1.2.826.0.1.3680043.2.1125.1";
+	const char* transferSyntax = EXPLICIT_LITTLE_ENDIAN;
+	VolumeDimensions dimensions{};
+	uint32_t bitsAllocated = 16;
+	uint32_t bitsStored = 12;
+	bool isSigned = false;
+	float rescaleSlope = 1.0f;
+	float rescaleIntercept = 0.0f;
+	float windowCenter = 0.0f;
+	float windowWidth = 0.0f; // no window in the files if 0
+	uint32_t predictor = 1;
+	uint32_t restartRows = 0;
+	bool hasGeometry = true;
+	float orientation[6] = { 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f };
+	float origin[3] = { -20.0f, 10.0f, 35.0f };
+	float sliceSpacing = 2.5f;
+	float pixelSpacing[2] = { 0.75f, 0.5f };
+	std::vector<uint16_t> samples{};
+};
+
+static Float3 GetNormal(const float orientation[6])
+{
+	return {
+		orientation[1] * orientation[5] - orientation[2] * orientation[4],
+		orientation[2] * orientation[3] - orientation[0] * orientation[5],
+		orientation[0] * orientation[4] - orientation[1] * orientation[3] };
+}
+
+// One slice as a part 10 file. A sequence ahead of the image tags holds a Rows of its own, which the scan
+// has to skip.
+static std::vector<uint8_t> GetDicomFile(const TestSeries& series, uint32_t slice, int32_t instanceNumber)
+{
+	DicomWriter writer;
+	writer.bytes.resize(128, 0);
+	writer.Put("DICM", 4);
+	writer.PutString(0x0002, 0x0010, "UI", series.transferSyntax);
+	writer.isExplicit = strcmp(series.transferSyntax, IMPLICIT_LITTLE_ENDIAN) != 0;
+
+	writer.PutHeader(0x0008, 0x1140, "SQ", UNDEFINED_LENGTH);
+	writer.PutItemTag(0xE000, UNDEFINED_LENGTH);
+	writer.PutUint16(0x0028, 0x0010, 999);
+	writer.PutItemTag(0xE00D, 0);
+	writer.PutItemTag(0xE0DD, 0);
+
+	writer.PutString(0x0020, 0x000E, "UI", series.uid);
+	writer.PutString(0x0020, 0x0013, "IS", std::to_string(instanceNumber));
+	if (series.hasGeometry)
+	{
+		const Float3 normal = GetNormal(series.orientation);
+		const float distance = slice * series.sliceSpacing;
+		const float position[3] = {
+			series.origin[0] + distance * normal.x,
+			series.origin[1] + distance * normal.y,
+			series.origin[2] + distance * normal.z };
+		writer.PutString(0x0020, 0x0032, "DS", FormatDecimals(position, 3));
+		writer.PutString(0x0020, 0x0037, "DS", FormatDecimals(series.orientation, 6));
+	}
+	writer.PutUint16(0x0028, 0x0002, 1);
+	writer.PutUint16(0x0028, 0x0010, static_cast<uint16_t>(series.dimensions.height));
+	writer.PutUint16(0x0028, 0x0011, static_cast<uint16_t>(series.dimensions.width));
+	writer.PutString(0x0028, 0x0030, "DS", FormatDecimals(series.pixelSpacing, 2));
+	writer.PutUint16(0x0028, 0x0100, static_cast<uint16_t>(series.bitsAllocated));
+	writer.PutUint16(0x0028, 0x0101, static_cast<uint16_t>(series.bitsStored));
+	writer.PutUint16(0x0028, 0x0103, series.isSigned ? 1 : 0);
+	if (series.windowWidth > 0.0f)
+	{
+		writer.PutString(0x0028, 0x1050, "DS", FormatDecimals(&series.windowCenter, 1) + "\\0");
+		writer.PutString(0x0028, 0x1051, "DS", FormatDecimals(&series.windowWidth, 1) + "\\1");
+	}
+	writer.PutString(0x0028, 0x1052, "DS", FormatDecimals(&series.rescaleIntercept, 1));
+	writer.PutString(0x0028, 0x1053, "DS", FormatDecimals(&series.rescaleSlope, 1));
+
+	const uint32_t sampleCount = series.dimensions.width * series.dimensions.height;
+	const uint16_t* samples = &series.samples[static_cast<size_t>(slice) * sampleCount];
+	const uint32_t bytesPerSample = series.bitsAllocated / 8;
+	std::vector<uint8_t> native(static_cast<size_t>(sampleCount) * bytesPerSample);
+	for (uint32_t sample = 0; sample < sampleCount; sample++)
+	{
+		for (uint32_t byte = 0; byte < bytesPerSample; byte++)
+			native[sample * bytesPerSample + byte] = static_cast<uint8_t>(samples[sample] >> (8 * byte));
+	}
+
+	if (strcmp(series.transferSyntax, EXPLICIT_LITTLE_ENDIAN) == 0 || strcmp(series.transferSyntax, IMPLICIT_LITTLE_ENDIAN) == 0)
+	{
+		writer.PutHeader(0x7FE0, 0x0010, bytesPerSample == 2 ? "OW" : "OB", static_cast<uint32_t>(native.size()));
+		writer.Put(native.data(), native.size());
+		return writer.bytes;
+	}
+
+	// encapsulated, an empty offset table and the frame in two fragments when it's long enough
+	std::vector<uint8_t> frame = strcmp(series.transferSyntax, RLE_LOSSLESS) == 0 ?
+		EncodeRle(native.data(), sampleCount, bytesPerSample) :
+		EncodeJpegLossless(samples, series.dimensions.width, series.dimensions.height, series.bitsStored, series.predictor, 0, series.restartRows);
+	if (frame.size() % 2 != 0)
+		frame.push_back(0);
+	const size_t split = frame.size() > 64 ? frame.size() / 4 * 2 : frame.size();
+	writer.PutHeader(0x7FE0, 0x0010, "OB", UNDEFINED_LENGTH);
+	writer.PutItemTag(0xE000, 0);
+	writer.PutItemTag(0xE000, static_cast<uint32_t>(split));
+	writer.Put(frame.data(), split);
+	if (split < frame.size())
+	{
+		writer.PutItemTag(0xE000, static_cast<uint32_t>(frame.size() - split));
+		writer.Put(frame.data() + split, frame.size() - split);
+	}
+	writer.PutItemTag(0xE0DD, 0);
+	return writer.bytes;
+}
+
+static bool WriteFile(const std::filesystem::path& filePath, const std::vector<uint8_t>& bytes)
+{
+	std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+	return file.good();
+}
+
+// File i holds slice order[i] with instance number instanceNumbers[i], by default both count up
+static bool WriteSeries(const std::filesystem::path& directory, const TestSeries& series, std::vector<uint32_t> order = {},
+	std::vector<int32_t> instanceNumbers = {})
+{
+	if (order.empty())
+	{
+		order.resize(series.dimensions.depth);
+		std::iota(order.begin(), order.end(), 0);
+	}
+	if (instanceNumbers.empty())
+	{
+		instanceNumbers.resize(order.size());
+		std::iota(instanceNumbers.begin(), instanceNumbers.end(), 1);
+	}
+	std::filesystem::create_directories(directory);
+	bool isWritten = true;
+	for (size_t file = 0; file < order.size(); file++)
+		isWritten &= WriteFile(directory / (series.uid + "_" + std::to_string(file) + ".dcm"), GetDicomFile(series, order[file], instanceNumbers[file]));
+	return isWritten;
+}
+
+// a bright disc over a ramp with some grain, in the range the stored bits can hold
+static std::vector<uint16_t> GetSamples(const VolumeDimensions& dimensions, uint32_t bitsStored, bool isSigned, uint32_t seed)
+{
+	std::mt19937 random(seed);
+	std::normal_distribution<float> noise(0.0f, 0.01f);
+	const int32_t minStored = isSigned ? -(1 << (bitsStored - 1)) : 0;
+	const int32_t maxStored = isSigned ? (1 << (bitsStored - 1)) - 1 : (1 << bitsStored) - 1;
+	std::vector<uint16_t> samples(dimensions.GetVoxelCount());
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+	{
+		for (uint32_t y = 0; y < dimensions.height; y++)
+		{
+			for (uint32_t x = 0; x < dimensions.width; x++)
+			{
+				const float dx = x - dimensions.width / 2.0f;
+				const float dy = y - dimensions.height / 2.0f;
+				const bool isInside = dx * dx + dy * dy < dimensions.height * dimensions.height / 9.0f;
+				const float ramp = static_cast<float>(x + 2 * y + 3 * z) / (dimensions.width + 2 * dimensions.height + 3 * dimensions.depth);
+				const float fraction = std::clamp((isInside ? 0.9f : 0.1f + 0.5f * ramp) + noise(random), 0.0f, 1.0f);
+				const int32_t value = minStored + static_cast<int32_t>(std::lround(fraction * (maxStored - minStored)));
+				samples[dimensions.GetIndex(x, y, z)] = static_cast<uint16_t>(value & ((1 << bitsStored) - 1));
+			}
+		}
+	}
+	return samples;
+}
+
+// the bytes the volume should have, with the window given or the one the stored range implies
+static std::vector<uint8_t> GetExpectedVolume(const TestSeries& series)
+{
+	const int32_t minStored = series.isSigned ? -(1 << (series.bitsStored - 1)) : 0;
+	const int32_t maxStored = series.isSigned ? (1 << (series.bitsStored - 1)) - 1 : (1 << series.bitsStored) - 1;
+	float windowCenter = series.windowCenter;
+	float windowWidth = series.windowWidth;
+	if (windowWidth <= 0.0f)
+	{
+		const float a = minStored * series.rescaleSlope + series.rescaleIntercept;
+		const float b = maxStored * series.rescaleSlope + series.rescaleIntercept;
+		windowCenter = 0.5f * (a + b);
+		windowWidth = std::abs(b - a);
+	}
+
+	std::vector<uint8_t> volume(series.samples.size());
+	for (size_t voxel = 0; voxel < volume.size(); voxel++)
+	{
+		int32_t value = series.samples[voxel];
+		if (series.isSigned && value > maxStored)
+			value -= 1 << series.bitsStored;
+		const float rescaled = value * series.rescaleSlope + series.rescaleIntercept;
+		const float windowed = (rescaled - (windowCenter - 0.5f * windowWidth)) / windowWidth * 255.0f;
+		volume[voxel] = static_cast<uint8_t>(std::lround(std::clamp(windowed, 0.0f, 255.0f)));
+	}
+	return volume;
+}
+
+// the float math differs in order from the loader's single multiply add, so results can be off by one
+static bool IsClose(const uint8_t* volume, const uint8_t* expected, size_t count)
+{
+	for (size_t voxel = 0; voxel < count; voxel++)
+	{
+		if (std::abs(volume[voxel] - expected[voxel]) > 1)
+			return false;
+	}
+	return true;
+}
+
+// Every predictor at several precisions and point transforms, with and without restart intervals. 16 bit
+// noise needs every difference category, 32768 included, and codes longer than the lookup.
+static void TestJpegLossless()
+{
+	const uint32_t width = 37;
+	const uint32_t height = 23;
+	struct Case {
+		uint32_t precision;
+		uint32_t pointTransform;
+		uint32_t restartRows;
+		bool isNoise;
+	};
+	const Case cases[] = { { 16, 0, 0, true }, { 12, 0, 0, false }, { 8, 0, 0, false }, { 12, 2, 0, false }, { 16, 0, 1, true }, { 12, 0, 3, false }, { 2, 0, 2, true } };
+	for (const Case& test : cases)
+	{
+		std::vector<uint16_t> samples = test.isNoise ?
+			std::vector<uint16_t>(width * height) :
+			GetSamples({ width, height, 1 }, test.precision, false, test.precision);
+		if (test.isNoise)
+		{
+			std::mt19937 random(test.precision + test.restartRows);
+			for (uint16_t& sample : samples)
+				sample = static_cast<uint16_t>(random() & ((1u << test.precision) - 1));
+			// a difference of exactly 32768 from the left neighbour
+			samples[width + 4] = 0;
+			samples[width + 5] = static_cast<uint16_t>(32768 & ((1u << test.precision) - 1));
+		}
+
+		for (uint32_t predictor = 1; predictor <= 7; predictor++)
+		{
+			const std::vector<uint8_t> jpeg = EncodeJpegLossless(samples.data(), width, height, test.precision, predictor, test.pointTransform, test.restartRows);
+			std::vector<uint16_t> decoded(samples.size(), 0xCDCD);
+			CHECK(DicomLoader::DecodeJpegLossless(jpeg.data(), jpeg.size(), width, height, decoded.data()));
+			bool isEqual = true;
+			for (size_t sample = 0; sample < samples.size(); sample++)
+				isEqual &= decoded[sample] == ((samples[sample] >> test.pointTransform) << test.pointTransform);
+			CHECK(isEqual);
+		}
+	}
+
+	// other sizes, a lossy frame and a cut off header are refused
+	const std::vector<uint16_t> samples = GetSamples({ width, height, 1 }, 12, false, 1);
+	std::vector<uint8_t> jpeg = EncodeJpegLossless(samples.data(), width, height, 12, 1, 0, 0);
+	std::vector<uint16_t> decoded(samples.size());
+	CHECK(!DicomLoader::DecodeJpegLossless(jpeg.data(), jpeg.size(), width + 1, height, decoded.data()));
+	CHECK(!DicomLoader::DecodeJpegLossless(jpeg.data(), 30, width, height, decoded.data()));
+	jpeg[3] = 0xC1;
+	CHECK(!DicomLoader::DecodeJpegLossless(jpeg.data(), jpeg.size(), width, height, decoded.data()));
+}
+
+// runs longer than a code can hold, literals between them and both byte orders of 16 bit samples
+static void TestRle()
+{
+	for (uint32_t bytesPerSample : { 1u, 2u })
+	{
+		const uint32_t sampleCount = 1000;
+		std::mt19937 random(bytesPerSample);
+		std::vector<uint8_t> samples(sampleCount * bytesPerSample);
+		for (uint32_t sample = 0; sample < sampleCount; sample++)
+		{
+			// long runs, short runs and noise
+			const uint32_t value = sample < 300 ? 0x1234 : sample < 500 ? (sample / 3) * 0x0101 : random();
+			for (uint32_t byte = 0; byte < bytesPerSample; byte++)
+				samples[sample * bytesPerSample + byte] = static_cast<uint8_t>(value >> (8 * byte));
+		}
+
+		const std::vector<uint8_t> rle = EncodeRle(samples.data(), sampleCount, bytesPerSample);
+		std::vector<uint8_t> decoded(samples.size(), 0xCD);
+		CHECK(DicomLoader::DecodeRle(rle.data(), rle.size(), sampleCount, bytesPerSample, decoded.data()));
+		CHECK(decoded == samples);
+
+		// too few segments for the sample size, or not enough data for every sample
+		CHECK(!DicomLoader::DecodeRle(rle.data(), rle.size(), sampleCount, bytesPerSample + 1, decoded.data()));
+		CHECK(!DicomLoader::DecodeRle(rle.data(), rle.size() - 40, sampleCount, bytesPerSample, decoded.data()));
+	}
+}
+
+// The SIMD blocks and the scalar tail against the formula, with garbage above the stored bits and counts
+// that aren't a multiple of the SIMD width.
+static void TestRescale()
+{
+	std::mt19937 random(9);
+	std::vector<uint8_t> stored(2 * 1003);
+	for (uint8_t& byte : stored)
+		byte = static_cast<uint8_t>(random());
+
+	for (uint32_t bitsAllocated : { 8u, 16u })
+	{
+		for (uint32_t bitsStored : { 1u, 7u, 8u, 12u, 16u })
+		{
+			if (bitsStored > bitsAllocated)
+				continue;
+			for (bool isSigned : { false, true })
+			{
+				const float scale = 255.0f / (1 << bitsStored) * 1.7f;
+				const float offset = isSigned ? 128.0f : -20.0f;
+				for (uint32_t count : { 1u, 7u, 8u, 29u, 1003u })
+				{
+					std::vector<uint8_t> bytes(count);
+					DicomLoader::RescaleToBytes(stored.data(), count, bitsAllocated, bitsStored, isSigned, scale, offset, bytes.data());
+					bool isEqual = true;
+					for (uint32_t i = 0; i < count; i++)
+					{
+						const uint32_t raw = bitsAllocated == 16 ? stored[2 * i] | (stored[2 * i + 1] << 8) : stored[i];
+						int32_t value = static_cast<int32_t>(raw & ((1u << bitsStored) - 1));
+						if (isSigned && value >= (1 << (bitsStored - 1)))
+							value -= 1 << bitsStored;
+						isEqual &= bytes[i] == static_cast<uint8_t>(std::lrint(std::clamp(value * scale + offset, 0.0f, 255.0f)));
+					}
+					CHECK(isEqual);
+				}
+			}
+		}
+	}
+}
+
+// Scan and read the same volume in every encoding the loader takes, straight and in part
+static void TestSeriesEncodings()
+{
+	const VolumeDimensions dimensions = { 40, 24, 9 };
+	struct Case {
+		const char* name;
+		const char* transferSyntax;
+		uint32_t bitsAllocated;
+		uint32_t bitsStored;
+		bool isSigned;
+		uint32_t predictor;
+		uint32_t restartRows;
+		bool hasWindow;
+	};
+	const Case cases[] = {
+		{ "native", EXPLICIT_LITTLE_ENDIAN, 16, 12, false, 1, 0, true },
+		{ "native signed", EXPLICIT_LITTLE_ENDIAN, 16, 16, true, 1, 0, true },
+		{ "implicit", IMPLICIT_LITTLE_ENDIAN, 16, 12, false, 1, 0, false },
+		{ "native 8 bit", EXPLICIT_LITTLE_ENDIAN, 8, 8, false, 1, 0, false },
+		{ "rle", RLE_LOSSLESS, 16, 12, false, 1, 0, true },
+		{ "rle signed", RLE_LOSSLESS, 16, 12, true, 1, 0, false },
+		{ "rle 8 bit", RLE_LOSSLESS, 8, 8, false, 1, 0, true },
+		{ "jpeg", JPEG_LOSSLESS, 16, 12, false, 1, 0, true },
+		{ "jpeg predictor 6", JPEG_LOSSLESS, 16, 16, false, 6, 2, false },
+		{ "jpeg 8 bit", JPEG_LOSSLESS, 8, 8, false, 7, 0, true },
+	};
+	for (const Case& test : cases)
+	{
+		TestSeries series{ .transferSyntax = test.transferSyntax, .dimensions = dimensions, .bitsAllocated = test.bitsAllocated, .bitsStored = test.bitsStored,
+			.isSigned = test.isSigned, .rescaleSlope = 1.5f, .rescaleIntercept = -100.0f, .predictor = test.predictor, .restartRows = test.restartRows };
+		series.samples = GetSamples(dimensions, test.bitsStored, test.isSigned, test.bitsStored);
+		if (test.hasWindow)
+		{
+			const float range = static_cast<float>(1 << test.bitsStored) * series.rescaleSlope;
+			series.windowCenter = (test.isSigned ? 0.0f : 0.5f * range) + series.rescaleIntercept;
+			series.windowWidth = 0.6f * range;
+		}
+
+		const std::filesystem::path directory = OUTPUT_DIRECTORY / test.name;
+		CHECK(WriteSeries(directory, series));
+		const std::optional<DicomSeries> scanned = DicomLoader::Scan(directory);
+		CHECK(scanned.has_value());
+		if (!scanned)
+			continue;
+
+		CHECK(scanned->seriesUid == series.uid);
+		CHECK(scanned->dimensions == dimensions);
+		CHECK(scanned->bitsAllocated == test.bitsAllocated && scanned->bitsStored == test.bitsStored && scanned->isSigned == test.isSigned);
+		CHECK(scanned->spacing.x == 0.5f && scanned->spacing.y == 0.75f && std::abs(scanned->spacing.z - 2.5f) < 1e-3f);
+
+		const std::vector<uint8_t> expected = GetExpectedVolume(series);
+		std::vector<uint8_t> volume(dimensions.GetVoxelCount(), 0xCD);
+		CHECK(DicomLoader::Read(*scanned, 0, dimensions.depth, volume.data()));
+		CHECK(IsClose(volume.data(), expected.data(), volume.size()));
+
+		// a slab out of the middle goes to the start of the destination
+		const size_t sliceSize = static_cast<size_t>(dimensions.width) * dimensions.height;
+		std::vector<uint8_t> slab(3 * sliceSize, 0xCD);
+		CHECK(DicomLoader::Read(*scanned, 4, 3, slab.data()));
+		CHECK(IsClose(slab.data(), expected.data() + 4 * sliceSize, slab.size()));
+	}
+}
+
+// Slices are put in order along the normal whatever the file names and instance numbers say, without a
+// position the instance numbers decide. A smaller series in the same directory is left out.
+static void TestSliceOrder()
+{
+	const VolumeDimensions dimensions = { 16, 12, 12 };
+	TestSeries series{ .dimensions = dimensions, .windowCenter = 2048.0f, .windowWidth = 4096.0f };
+	// rows along x, columns tilted 30 degrees from y towards -z, so the normal points down the tilted z
+	const float orientation[6] = { 1.0f, 0.0f, 0.0f, 0.0f, std::cos(0.5236f), -std::sin(0.5236f) };
+	std::copy(orientation, orientation + 6, series.orientation);
+	series.sliceSpacing = 1.25f;
+	series.samples = GetSamples(dimensions, 12, false, 3);
+	const std::vector<uint8_t> expected = GetExpectedVolume(series);
+
+	std::vector<uint32_t> order(dimensions.depth);
+	std::iota(order.begin(), order.end(), 0);
+	std::shuffle(order.begin(), order.end(), std::mt19937(5));
+	std::vector<int32_t> instanceNumbers(dimensions.depth);
+	for (size_t file = 0; file < order.size(); file++)
+		instanceNumbers[file] = 100 - static_cast<int32_t>(order[file] * 7 % dimensions.depth);
+
+	TestSeries scout = series;
+	scout.uid = "1.2.826.0.1.3680043.2.1125.2";
+	scout.dimensions.depth = 3;
+	scout.samples.resize(scout.dimensions.GetVoxelCount());
+
+	const std::filesystem::path directory = OUTPUT_DIRECTORY / "order";
+	CHECK(WriteSeries(directory, series, order, instanceNumbers));
+	CHECK(WriteSeries(directory / "scout", scout));
+	std::optional<DicomSeries> scanned = DicomLoader::Scan(directory);
+	CHECK(scanned && scanned->seriesUid == series.uid && scanned->dimensions == dimensions);
+	if (scanned)
+	{
+		CHECK(std::abs(scanned->spacing.z - 1.25f) < 1e-3f);
+		std::vector<uint8_t> volume(dimensions.GetVoxelCount());
+		CHECK(DicomLoader::Read(*scanned, 0, dimensions.depth, volume.data()));
+		CHECK(IsClose(volume.data(), expected.data(), volume.size()));
+	}
+
+	// the same files without positions come out in instance number order
+	series.hasGeometry = false;
+	const std::filesystem::path unpositioned = OUTPUT_DIRECTORY / "instance order";
+	CHECK(WriteSeries(unpositioned, series, order, instanceNumbers));
+	scanned = DicomLoader::Scan(unpositioned);
+	CHECK(scanned && scanned->dimensions == dimensions);
+	if (scanned)
+	{
+		CHECK(scanned->spacing.z == 1.0f);
+		std::vector<uint8_t> volume(dimensions.GetVoxelCount());
+		CHECK(DicomLoader::Read(*scanned, 0, dimensions.depth, volume.data()));
+		const size_t sliceSize = static_cast<size_t>(dimensions.width) * dimensions.height;
+		bool isInInstanceOrder = true;
+		for (uint32_t slice = 0; slice < dimensions.depth; slice++)
+		{
+			const int32_t instanceNumber = scanned->slices[slice].instanceNumber;
+			isInInstanceOrder &= slice == 0 || scanned->slices[slice - 1].instanceNumber < instanceNumber;
+			const size_t file = std::find(instanceNumbers.begin(), instanceNumbers.end(), instanceNumber) - instanceNumbers.begin();
+			isInInstanceOrder &= file < order.size() && IsClose(volume.data() + slice * sliceSize, expected.data() + order[file] * sliceSize, sliceSize);
+		}
+		CHECK(isInInstanceOrder);
+	}
+}
+
+// a slice cut off inside its pixel data comes out black and fails the read, the others are still there
+static void TestTruncatedSlice()
+{
+	const VolumeDimensions dimensions = { 16, 16, 4 };
+	TestSeries series{ .dimensions = dimensions, .windowCenter = 2048.0f, .windowWidth = 4096.0f };
+	series.samples = GetSamples(dimensions, 12, false, 4);
+	const std::filesystem::path directory = OUTPUT_DIRECTORY / "truncated";
+	CHECK(WriteSeries(directory, series));
+	const std::filesystem::path slicePath = directory / (series.uid + "_2.dcm");
+	std::filesystem::resize_file(slicePath, std::filesystem::file_size(slicePath) - 100);
+
+	std::optional<DicomSeries> scanned = DicomLoader::Scan(directory);
+	CHECK(scanned && scanned->dimensions == dimensions);
+	if (!scanned)
+		return;
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount(), 0xCD);
+	CHECK(!DicomLoader::Read(*scanned, 0, dimensions.depth, volume.data()));
+	const std::vector<uint8_t> expected = GetExpectedVolume(series);
+	const size_t sliceSize = static_cast<size_t>(dimensions.width) * dimensions.height;
+	CHECK(std::all_of(volume.begin() + 2 * sliceSize, volume.begin() + 3 * sliceSize, [](uint8_t value) { return value == 0; }));
+	CHECK(IsClose(volume.data(), expected.data(), 2 * sliceSize));
+	CHECK(IsClose(volume.data() + 3 * sliceSize, expected.data() + 3 * sliceSize, sliceSize));
+}
+
+// Scan and decode time of a 2000 slice series of 256x256 12 bit images in every encoding. The files were
+// just written, so they come from the page cache and this is the decoding, not the disk.
+static void BenchmarkSeries()
+{
+	const VolumeDimensions dimensions = { 256, 256, 2000 };
+	std::printf("2000 slices of 256x256, 12 bit, %u threads\n", ThreadPool::Get().GetThreadCount());
+	TestSeries series{ .dimensions = dimensions, .windowCenter = 2048.0f, .windowWidth = 4096.0f };
+	series.samples = GetSamples(dimensions, 12, false, 11);
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount());
+	for (const auto& [name, transferSyntax] : { std::pair{ "native", EXPLICIT_LITTLE_ENDIAN }, std::pair{ "rle", RLE_LOSSLESS }, std::pair{ "jpeg lossless", JPEG_LOSSLESS } })
+	{
+		series.transferSyntax = transferSyntax;
+		const std::filesystem::path directory = OUTPUT_DIRECTORY / "benchmark";
+		std::filesystem::remove_all(directory);
+		WriteSeries(directory, series);
+
+		std::optional<DicomSeries> scanned;
+		const double scanMilliseconds = MeasureMilliseconds(3, [&]() { scanned = DicomLoader::Scan(directory); });
+		if (!scanned)
+			continue;
+		const double readMilliseconds = MeasureMilliseconds(3, [&]() { DicomLoader::Read(*scanned, 0, dimensions.depth, volume.data()); });
+		const double totalMilliseconds = scanMilliseconds + readMilliseconds;
+		std::printf("%-13s scan %7.1f ms, decode %7.1f ms, total %7.1f ms, %7.0f slices/s\n", name, scanMilliseconds, readMilliseconds,
+			totalMilliseconds, dimensions.depth * 1000.0 / totalMilliseconds);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::filesystem::create_directories(OUTPUT_DIRECTORY);
+	TestJpegLossless();
+	TestRle();
+	TestRescale();
+	TestSeriesEncodings();
+	TestSliceOrder();
+	TestTruncatedSlice();
+	if (IsBenchmarkRun(argc, argv))
+		BenchmarkSeries();
+	std::filesystem::remove_all(OUTPUT_DIRECTORY);
+	return GetTestResult();
+}
@@ -0,0 +1,146 @@
+#include "Test.h"
+#include "DirtyRegions.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// which bricks the boxes cover, counting every brick as often as it's covered
+static std::vector<uint32_t> GetCoverage(const std::vector<VolumeBox>& boxes, const VolumeDimensions& brickDimensions)
+{
+	std::vector<uint32_t> coverage(brickDimensions.GetVoxelCount(), 0);
+	for (const VolumeBox& box : boxes)
+	{
+		for (uint32_t z = box.minZ / BRICK_SIZE; z < (box.maxZ + BRICK_SIZE - 1) / BRICK_SIZE; z++)
+			for (uint32_t y = box.minY / BRICK_SIZE; y < (box.maxY + BRICK_SIZE - 1) / BRICK_SIZE; y++)
+				for (uint32_t x = box.minX / BRICK_SIZE; x < (box.maxX + BRICK_SIZE - 1) / BRICK_SIZE; x++)
+					coverage[brickDimensions.GetIndex(x, y, z)]++;
+	}
+	return coverage;
+}
+
+static void TestSingleVoxel()
+{
+	DirtyRegions regions;
+	regions.Initialize({ 64, 64, 64 });
+	CHECK(!regions.IsDirty());
+	CHECK(regions.Flush().empty());
+
+	regions.MarkDirty({ .minX = 20, .minY = 5, .minZ = 40, .maxX = 21, .maxY = 6, .maxZ = 41 });
+	CHECK(regions.IsDirty());
+
+	const std::vector<VolumeBox> boxes = regions.Flush();
+	CHECK(boxes.size() == 1);
+	CHECK(boxes[0].minX == 16 && boxes[0].minY == 0 && boxes[0].minZ == 32);
+	CHECK(boxes[0].maxX == 32 && boxes[0].maxY == 16 && boxes[0].maxZ == 48);
+	CHECK(regions.GetStats().markedVoxels == 1);
+	CHECK(regions.GetStats().flushedVoxels == BRICK_SIZE * BRICK_SIZE * BRICK_SIZE);
+	CHECK(regions.GetStats().flushedBoxes == 1);
+
+	CHECK(!regions.IsDirty());
+	CHECK(regions.Flush().empty());
+}
+
+static void TestCoalescing()
+{
+	DirtyRegions regions;
+	regions.Initialize({ 128, 128, 128 });
+
+	// two edits next to each other become one 2x2x2 brick box
+	regions.MarkDirty({ .minX = 0, .minY = 0, .minZ = 0, .maxX = 32, .maxY = 32, .maxZ = 16 });
+	regions.MarkDirty({ .minX = 0, .minY = 0, .minZ = 16, .maxX = 32, .maxY = 32, .maxZ = 32 });
+	std::vector<VolumeBox> boxes = regions.Flush();
+	CHECK(boxes.size() == 1);
+	CHECK(boxes[0].maxX == 32 && boxes[0].maxY == 32 && boxes[0].maxZ == 32);
+
+	// an L in one layer of bricks is two boxes: the full first row and the rest of the column
+	regions.MarkDirty({ .minX = 0, .minY = 0, .minZ = 0, .maxX = 48, .maxY = 16, .maxZ = 16 });
+	regions.MarkDirty({ .minX = 0, .minY = 16, .minZ = 0, .maxX = 16, .maxY = 48, .maxZ = 16 });
+	boxes = regions.Flush();
+	CHECK(boxes.size() == 2);
+	CHECK(boxes[0].maxX == 48 && boxes[0].maxY == 16);
+	CHECK(boxes[1].minY == 16 && boxes[1].maxX == 16 && boxes[1].maxY == 48);
+}
+
+static void TestClipping()
+{
+	DirtyRegions regions;
+	regions.Initialize({ 40, 20, 18 });
+
+	// the edit reaches past the volume, the marked voxels and the box stop at its border
+	regions.MarkDirty({ .minX = 30, .minY = 10, .minZ = 10, .maxX = 100, .maxY = 100, .maxZ = 100 });
+	CHECK(regions.GetStats().markedVoxels == 10 * 10 * 8);
+
+	const std::vector<VolumeBox> boxes = regions.Flush();
+	CHECK(boxes.size() == 1);
+	CHECK(boxes[0].minX == 16 && boxes[0].minY == 0 && boxes[0].minZ == 0);
+	CHECK(boxes[0].maxX == 40 && boxes[0].maxY == 20 && boxes[0].maxZ == 18);
+	CHECK(regions.GetStats().flushedVoxels == boxes[0].GetVoxelCount());
+
+	// entirely outside
+	regions.MarkDirty({ .minX = 50, .minY = 0, .minZ = 0, .maxX = 60, .maxY = 10, .maxZ = 10 });
+	CHECK(!regions.IsDirty());
+}
+
+// random edits against the set of bricks they touch: every dirty brick is covered exactly once and
+// nothing else is
+static void TestRandomEdits()
+{
+	const VolumeDimensions dimensions = { 150, 97, 70 };
+	const VolumeDimensions brickDimensions = { 10, 7, 5 };
+	std::mt19937 random(7);
+
+	DirtyRegions regions;
+	regions.Initialize(dimensions);
+	for (uint32_t round = 0; round < 50; round++)
+	{
+		regions.ResetStats();
+		std::vector<uint32_t> expected(brickDimensions.GetVoxelCount(), 0);
+		const uint32_t editCount = 1 + random() % 12;
+		uint64_t markedVoxels = 0;
+		for (uint32_t edit = 0; edit < editCount; edit++)
+		{
+			const uint32_t x = random() % dimensions.width;
+			const uint32_t y = random() % dimensions.height;
+			const uint32_t z = random() % dimensions.depth;
+			const VolumeBox box = {
+				.minX = x,
+				.minY = y,
+				.minZ = z,
+				.maxX = std::min(x + 1 + static_cast<uint32_t>(random() % 40), dimensions.width),
+				.maxY = std::min(y + 1 + static_cast<uint32_t>(random() % 40), dimensions.height),
+				.maxZ = std::min(z + 1 + static_cast<uint32_t>(random() % 40), dimensions.depth) };
+			regions.MarkDirty(box);
+			markedVoxels += box.GetVoxelCount();
+
+			for (uint32_t brickZ = box.minZ / BRICK_SIZE; brickZ <= (box.maxZ - 1) / BRICK_SIZE; brickZ++)
+				for (uint32_t brickY = box.minY / BRICK_SIZE; brickY <= (box.maxY - 1) / BRICK_SIZE; brickY++)
+					for (uint32_t brickX = box.minX / BRICK_SIZE; brickX <= (box.maxX - 1) / BRICK_SIZE; brickX++)
+						expected[brickDimensions.GetIndex(brickX, brickY, brickZ)] = 1;
+		}
+
+		const std::vector<VolumeBox> boxes = regions.Flush();
+		CHECK(GetCoverage(boxes, brickDimensions) == expected);
+
+		uint64_t boxVoxels = 0;
+		for (const VolumeBox& box : boxes)
+		{
+			CHECK(!box.IsEmpty());
+			CHECK(box.maxX <= dimensions.width && box.maxY <= dimensions.height && box.maxZ <= dimensions.depth);
+			boxVoxels += box.GetVoxelCount();
+		}
+		CHECK(regions.GetStats().flushedVoxels == boxVoxels);
+		CHECK(regions.GetStats().flushedBoxes == boxes.size());
+		CHECK(regions.GetStats().markedVoxels == markedVoxels);
+		CHECK(!regions.IsDirty());
+	}
+}
+
+int main()
+{
+	TestSingleVoxel();
+	TestCoalescing();
+	TestClipping();
+	TestRandomEdits();
+	return GetTestResult();
+}
@@ -0,0 +1,131 @@
+#include "Test.h"
+#include "FrameCapture.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+static const std::filesystem::path OUTPUT_DIRECTORY = std::filesystem::temp_directory_path() / "FrameCaptureTest";
+
+// a frame's image as the GPU copy would leave it, every pixel different and the row padding garbage
+static void FillImage(uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, uint32_t frame)
+{
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < rowPitch / 4; x++)
+		{
+			uint8_t* pixel = pixels + y * rowPitch + x * 4;
+			const bool isPadding = x >= width;
+			pixel[0] = static_cast<uint8_t>(isPadding ? 0xEE : frame);
+			pixel[1] = static_cast<uint8_t>(isPadding ? 0xEE : x);
+			pixel[2] = static_cast<uint8_t>(isPadding ? 0xEE : y);
+			pixel[3] = 0xAB;
+		}
+	}
+}
+
+// true if the file is a 24 bit BMP of the image FillImage made for the frame
+static bool IsBmpOfFrame(const std::filesystem::path& filePath, uint32_t width, uint32_t height, uint32_t frame)
+{
+	std::ifstream file(filePath, std::ios::binary);
+	const std::vector<uint8_t> bmp{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+	const uint32_t rowSize = (width * 3 + 3) & ~3u;
+	if (bmp.size() != 54 + rowSize * height || bmp[0] != 'B' || bmp[1] != 'M')
+		return false;
+
+	auto readU32 = [&](size_t offset) { uint32_t value; memcpy(&value, &bmp[offset], sizeof(value)); return value; };
+	if (readU32(2) != bmp.size() || readU32(10) != 54 || readU32(18) != width || readU32(22) != height || bmp[28] != 24)
+		return false;
+
+	// rows go bottom up, pixels are BGR
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const uint8_t* row = &bmp[54 + (height - 1 - y) * rowSize];
+		for (uint32_t x = 0; x < width; x++)
+		{
+			if (row[x * 3 + 0] != y || row[x * 3 + 1] != x || row[x * 3 + 2] != static_cast<uint8_t>(frame))
+				return false;
+		}
+	}
+	return true;
+}
+
+static void TestWriteBmp()
+{
+	CapturedImage image{ .width = 5, .height = 3, .rowPitch = 32, .pixels = std::vector<uint8_t>(32 * 3) };
+	FillImage(image.pixels.data(), image.width, image.height, image.rowPitch, 42);
+
+	const std::filesystem::path filePath = OUTPUT_DIRECTORY / "image.bmp";
+	CHECK(ImageEncoder::WriteBmp(image, filePath));
+	CHECK(IsBmpOfFrame(filePath, image.width, image.height, 42));
+	CHECK(!ImageEncoder::WriteBmp(image, OUTPUT_DIRECTORY / "missing" / "image.bmp"));
+}
+
+// Captures every frame through the ring with the GPU lagging fenceLag frames behind, the copies come
+// from a fake readback memory per slot. Returns how many captures were dropped.
+static uint64_t RunCaptures(uint32_t slotCount, uint32_t frameCount, uint64_t fenceLag)
+{
+	constexpr uint32_t WIDTH = 7;
+	constexpr uint32_t HEIGHT = 4;
+	constexpr uint32_t ROW_PITCH = 256;
+	std::vector<std::vector<uint8_t>> readbacks(slotCount, std::vector<uint8_t>(ROW_PITCH * HEIGHT));
+	std::vector<bool> isCaptured(frameCount, false);
+
+	FrameCapture capture(slotCount, 1024);
+	uint64_t completedFenceValue = 0;
+	auto getSlotData = [&](uint32_t slot) { return readbacks[slot].data(); };
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		// BeginFrame: the GPU finished the frame fenceLag frames back, its slots can be written out
+		const uint64_t fenceValue = frame + 1;
+		completedFenceValue = fenceValue > fenceLag ? fenceValue - fenceLag : 0;
+		capture.Poll(completedFenceValue, getSlotData);
+
+		const std::filesystem::path filePath = OUTPUT_DIRECTORY / ("frame_" + std::to_string(frame) + ".bmp");
+		std::filesystem::remove(filePath);
+		const std::optional<uint32_t> slot = capture.Request(filePath, WIDTH, HEIGHT, ROW_PITCH, fenceValue);
+		if (slot)
+		{
+			CHECK(*slot < slotCount);
+			FillImage(readbacks[*slot].data(), WIDTH, HEIGHT, ROW_PITCH, frame);
+			isCaptured[frame] = true;
+		}
+		CHECK(capture.GetPendingCount() <= slotCount);
+	}
+
+	// shutdown waits for the GPU
+	capture.Poll(frameCount, getSlotData);
+	CHECK(capture.GetPendingCount() == 0);
+	capture.GetEncoder().Flush();
+
+	uint64_t capturedCount = 0;
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		const std::filesystem::path filePath = OUTPUT_DIRECTORY / ("frame_" + std::to_string(frame) + ".bmp");
+		CHECK(isCaptured[frame] == std::filesystem::exists(filePath));
+		if (isCaptured[frame])
+			CHECK(IsBmpOfFrame(filePath, WIDTH, HEIGHT, frame));
+		capturedCount += isCaptured[frame];
+	}
+	CHECK(capture.GetEncoder().GetWrittenCount() == capturedCount);
+	CHECK(capturedCount + capture.GetDroppedCount() == frameCount);
+	return capture.GetDroppedCount();
+}
+
+static void TestCaptureRing()
+{
+	// a GPU a frame behind never fills three slots
+	CHECK(RunCaptures(3, 40, 1) == 0);
+	// one five frames behind does, those captures are dropped instead of waited for
+	CHECK(RunCaptures(3, 40, 5) > 0);
+}
+
+int main()
+{
+	std::filesystem::create_directories(OUTPUT_DIRECTORY);
+	TestWriteBmp();
+	TestCaptureRing();
+	std::filesystem::remove_all(OUTPUT_DIRECTORY);
+	return GetTestResult();
+}
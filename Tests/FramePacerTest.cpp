@@ -0,0 +1,253 @@
+#include "Test.h"
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <random>
+#include <vector>
+
+static constexpr double MILLISECOND = 0.001;
+// WAKE_UP_MARGIN in FramePacer.cpp
+static constexpr double WAKE_UP_MARGIN = 0.0005;
+
+static bool IsNear(double a, double b)
+{
+	return std::abs(a - b) < 1e-9;
+}
+
+// frames that took cpuSeconds to record and gpuSeconds to render, the GPU running each as soon as it's submitted
+static void FeedFrames(FramePacer& pacer, uint32_t frameCount, double cpuSeconds, double gpuSeconds, double& time)
+{
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		pacer.OnFrameStarted(time);
+		time += cpuSeconds;
+		pacer.OnFrameSubmitted(time);
+		time += gpuSeconds;
+		pacer.OnFrameCompleted(time, gpuSeconds);
+	}
+}
+
+static void TestWarmUp()
+{
+	FramePacer pacer(2);
+	CHECK(pacer.GetMaxFrameLatency() == 2);
+	CHECK(pacer.GetNextFrameStart(1.5) == 1.5);
+
+	// until both estimates have seen enough frames every frame starts right away
+	double time = 0.0;
+	FeedFrames(pacer, 7, 2 * MILLISECOND, 8 * MILLISECOND, time);
+	pacer.OnFrameStarted(time);
+	pacer.OnFrameSubmitted(time + 2 * MILLISECOND);
+	CHECK(pacer.GetNextFrameStart(time + 2 * MILLISECOND) == time + 2 * MILLISECOND);
+}
+
+// Steady frame times leave no deviation, so the next frame starts its CPU time (and the wake up margin)
+// before the GPU runs out of the frames queued up, with each of them starting on the GPU when it was
+// submitted or when the one before it finished.
+static void TestPrediction()
+{
+	FramePacer pacer(2);
+	double time = 0.0;
+	FeedFrames(pacer, 20, 2 * MILLISECOND, 8 * MILLISECOND, time);
+	const double lastCompletion = time;
+
+	// nothing queued, the GPU is idle already, so the frame starts now
+	CHECK(pacer.GetNextFrameStart(time) == time);
+
+	// one frame submitted before the GPU finished the last one and one after that
+	pacer.OnFrameStarted(time - 3 * MILLISECOND);
+	pacer.OnFrameSubmitted(time - 1 * MILLISECOND);
+	pacer.OnFrameStarted(time + 10 * MILLISECOND);
+	pacer.OnFrameSubmitted(time + 12 * MILLISECOND);
+	const double gpuIdle = std::max(lastCompletion + 8 * MILLISECOND, time + 12 * MILLISECOND) + 8 * MILLISECOND;
+	CHECK(IsNear(pacer.GetNextFrameStart(time + 12 * MILLISECOND), gpuIdle - 2 * MILLISECOND - WAKE_UP_MARGIN));
+	// never before now
+	CHECK(pacer.GetNextFrameStart(time + 30 * MILLISECOND) == time + 30 * MILLISECOND);
+
+	// the oldest one finishes, the prediction follows from the actual completion
+	pacer.OnFrameCompleted(time + 9 * MILLISECOND, 8 * MILLISECOND);
+	CHECK(IsNear(pacer.GetNextFrameStart(time + 12 * MILLISECOND), time + 20 * MILLISECOND - 2 * MILLISECOND - WAKE_UP_MARGIN));
+}
+
+// a CPU time that varies pads the start by its deviation, the GPU's doesn't
+static void TestDeviation()
+{
+	FramePacer steady(2);
+	FramePacer varying(2);
+	double steadyTime = 0.0;
+	double varyingTime = 0.0;
+	for (uint32_t frame = 0; frame < 200; frame++)
+	{
+		FeedFrames(steady, 1, 2 * MILLISECOND, 8 * MILLISECOND, steadyTime);
+		FeedFrames(varying, 1, (frame % 2 == 0 ? 1 : 3) * MILLISECOND, 8 * MILLISECOND, varyingTime);
+	}
+	// a frame submitted right as the GPU went idle keeps it busy for 8 ms
+	auto getLead = [](FramePacer& pacer, double time) {
+		pacer.OnFrameStarted(time);
+		pacer.OnFrameSubmitted(time + 2 * MILLISECOND);
+		return time + 10 * MILLISECOND - pacer.GetNextFrameStart(time + 2 * MILLISECOND);
+	};
+	const double steadyLead = getLead(steady, steadyTime);
+	const double varyingLead = getLead(varying, varyingTime);
+	CHECK(IsNear(steadyLead, 2 * MILLISECOND + WAKE_UP_MARGIN));
+	// a mean of 2 ms and a deviation of 1 ms, padded by two deviations
+	CHECK(std::abs(varyingLead - (4 * MILLISECOND + WAKE_UP_MARGIN)) < 0.1 * MILLISECOND);
+}
+
+static void TestMinFrameInterval()
+{
+	FramePacer pacer(2);
+	pacer.SetMinFrameInterval(10 * MILLISECOND);
+	// nothing started yet, nothing to keep the interval to
+	CHECK(pacer.GetNextFrameStart(0.5) == 0.5);
+
+	pacer.OnFrameStarted(1.0);
+	pacer.OnFrameSubmitted(1.002);
+	CHECK(IsNear(pacer.GetNextFrameStart(1.002), 1.010));
+	CHECK(pacer.GetNextFrameStart(1.5) == 1.5);
+
+	pacer.SetMinFrameInterval(0.0);
+	CHECK(pacer.GetNextFrameStart(1.002) == 1.002);
+}
+
+struct SimulationResult {
+	double meanLatency = 0.0;
+	double p99Latency = 0.0;
+	double meanInterval = 0.0;
+};
+
+// The render loop against a GPU that renders frames in submit order. The swap chain holds a frame back
+// until fewer than the maximum frame latency are in flight. Latency is from the frame's start, when it
+// samples its input, to the GPU finishing it.
+static SimulationResult Simulate(bool isPaced, uint32_t frameCount, const std::function<double(uint32_t)>& getCpuSeconds,
+	const std::function<double(uint32_t)>& getGpuSeconds)
+{
+	struct InFlightFrame {
+		double completion = 0.0;
+		double gpuSeconds = 0.0;
+	};
+	FramePacer pacer(2);
+	std::deque<InFlightFrame> inFlight;
+	std::vector<double> latencies;
+	std::vector<double> starts;
+	double now = 0.0;
+	double gpuFree = 0.0;
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		auto completeFrames = [&]() {
+			while (!inFlight.empty() && (inFlight.size() >= pacer.GetMaxFrameLatency() || inFlight.front().completion <= now))
+			{
+				now = std::max(now, inFlight.front().completion);
+				pacer.OnFrameCompleted(inFlight.front().completion, inFlight.front().gpuSeconds);
+				inFlight.pop_front();
+			}
+		};
+		completeFrames();
+		if (isPaced)
+		{
+			now = pacer.GetNextFrameStart(now);
+			completeFrames();
+		}
+
+		const double start = now;
+		pacer.OnFrameStarted(start);
+		now += getCpuSeconds(frame);
+		pacer.OnFrameSubmitted(now);
+		const double gpuSeconds = getGpuSeconds(frame);
+		gpuFree = std::max(gpuFree, now) + gpuSeconds;
+		inFlight.push_back({ .completion = gpuFree, .gpuSeconds = gpuSeconds });
+		latencies.push_back(gpuFree - start);
+		starts.push_back(start);
+	}
+
+	// the warm up left out
+	const uint32_t first = frameCount / 10;
+	SimulationResult result;
+	std::vector<double> measured(latencies.begin() + first, latencies.end());
+	for (double latency : measured)
+		result.meanLatency += latency / measured.size();
+	std::sort(measured.begin(), measured.end());
+	result.p99Latency = measured[measured.size() * 99 / 100];
+	result.meanInterval = (starts.back() - starts[first]) / (frameCount - 1 - first);
+	return result;
+}
+
+static void TestSimulation()
+{
+	std::mt19937 random(6);
+	auto cpu = [](double milliseconds) { return [milliseconds](uint32_t) { return milliseconds * MILLISECOND; }; };
+	auto gpu = cpu;
+
+	// GPU bound: the CPU no longer runs a frame ahead, the GPU stays just as busy
+	{
+		const SimulationResult unpaced = Simulate(false, 1000, cpu(2.0), gpu(8.0));
+		const SimulationResult paced = Simulate(true, 1000, cpu(2.0), gpu(8.0));
+		CHECK(paced.meanLatency < 0.7 * unpaced.meanLatency);
+		CHECK(paced.meanLatency < (2.0 + 8.0 + 1.0) * MILLISECOND);
+		CHECK(std::abs(paced.meanInterval - unpaced.meanInterval) < 0.01 * unpaced.meanInterval);
+	}
+
+	// CPU bound: the GPU waits on the CPU anyway, pacing changes nothing
+	{
+		const SimulationResult unpaced = Simulate(false, 1000, cpu(10.0), gpu(3.0));
+		const SimulationResult paced = Simulate(true, 1000, cpu(10.0), gpu(3.0));
+		CHECK(std::abs(paced.meanLatency - unpaced.meanLatency) < 0.1 * MILLISECOND);
+		CHECK(std::abs(paced.meanInterval - unpaced.meanInterval) < 0.1 * MILLISECOND);
+	}
+
+	// GPU spikes: the frames queued behind one wait longer, still less than without pacing, and the GPU
+	// can run dry for a moment after one
+	{
+		std::vector<double> gpuMilliseconds(1000);
+		for (double& milliseconds : gpuMilliseconds)
+			milliseconds = random() % 20 == 0 ? 21.0 : 8.0;
+		auto spikes = [&](uint32_t frame) { return gpuMilliseconds[frame] * MILLISECOND; };
+		const SimulationResult unpaced = Simulate(false, 1000, cpu(2.0), spikes);
+		const SimulationResult paced = Simulate(true, 1000, cpu(2.0), spikes);
+		CHECK(paced.p99Latency < unpaced.p99Latency);
+		CHECK(paced.meanInterval < 1.05 * unpaced.meanInterval);
+	}
+}
+
+// the p99 latencies of a few frame time traces, with and without pacing
+static void BenchmarkLatency()
+{
+	std::mt19937 random(8);
+	std::vector<double> spikes(3000);
+	for (double& milliseconds : spikes)
+		milliseconds = random() % 20 == 0 ? 21.0 : 8.0;
+
+	struct Trace {
+		const char* name;
+		std::function<double(uint32_t)> cpu;
+		std::function<double(uint32_t)> gpu;
+	};
+	const Trace traces[] = {
+		{ "GPU bound 8 ms", [](uint32_t) { return 0.002; }, [](uint32_t) { return 0.008; } },
+		{ "GPU spikes, 5% at 21 ms", [](uint32_t) { return 0.002; }, [&](uint32_t frame) { return spikes[frame] * MILLISECOND; } },
+		{ "GPU step 5 -> 12 ms", [](uint32_t) { return 0.002; }, [](uint32_t frame) { return frame < 1500 ? 0.005 : 0.012; } },
+		{ "CPU bound", [](uint32_t) { return 0.010; }, [](uint32_t) { return 0.003; } },
+	};
+	for (const Trace& trace : traces)
+	{
+		const SimulationResult unpaced = Simulate(false, 3000, trace.cpu, trace.gpu);
+		const SimulationResult paced = Simulate(true, 3000, trace.cpu, trace.gpu);
+		std::printf("%-24s p99 latency %5.1f -> %5.1f ms, frame interval %5.2f -> %5.2f ms\n", trace.name,
+			unpaced.p99Latency / MILLISECOND, paced.p99Latency / MILLISECOND, unpaced.meanInterval / MILLISECOND, paced.meanInterval / MILLISECOND);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	TestWarmUp();
+	TestPrediction();
+	TestDeviation();
+	TestMinFrameInterval();
+	TestSimulation();
+	if (IsBenchmarkRun(argc, argv))
+		BenchmarkLatency();
+	return GetTestResult();
+}
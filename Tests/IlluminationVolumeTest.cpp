@@ -0,0 +1,116 @@
+#include "Test.h"
+#include "IlluminationVolume.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+static IlluminationVolume::OpacityTable GetLinearOpacityTable()
+{
+	IlluminationVolume::OpacityTable table{};
+	for (uint32_t value = 0; value < table.size(); value++)
+		table[value] = value / 255.0f;
+	return table;
+}
+
+static IlluminationSettings GetDirectionalSettings(int32_t x, int32_t y, int32_t z)
+{
+	const float length = std::sqrt(static_cast<float>(x * x + y * y + z * z));
+	return { .lightDirection = { x / length, y / length, z / length } };
+}
+
+// Diagonal directions and the ones where two or three axes tie shift the light by exactly one voxel per
+// slice, so the shadow of a single opaque voxel has to fall on exactly the voxels along the direction.
+static void TestDiagonalShadows()
+{
+	const VolumeDimensions dimensions = { 17, 17, 17 };
+	const int32_t center = 8;
+	std::vector<uint8_t> data(dimensions.GetVoxelCount(), 0);
+	data[dimensions.GetIndex(center, center, center)] = UINT8_MAX;
+
+	IlluminationVolume illumination;
+	illumination.Initialize(dimensions, dimensions.width);
+	illumination.SetOpacityTable(GetLinearOpacityTable());
+
+	uint32_t directionCount = 0;
+	for (int32_t x = -1; x <= 1; x++)
+	{
+		for (int32_t y = -1; y <= 1; y++)
+		{
+			for (int32_t z = -1; z <= 1; z++)
+			{
+				if (std::abs(x) + std::abs(y) + std::abs(z) < 2)
+					continue;
+
+				CHECK(illumination.Update(data.data(), GetDirectionalSettings(x, y, z)));
+				const std::vector<uint8_t>& light = illumination.GetLight();
+				for (int32_t step = 0; step < static_cast<int32_t>(dimensions.width); step++)
+				{
+					// the opaque voxel itself is lit, everything behind it along the direction is not
+					const int32_t shadowX = center + step * x;
+					const int32_t shadowY = center + step * y;
+					const int32_t shadowZ = center + step * z;
+					if (shadowX < 0 || shadowY < 0 || shadowZ < 0 || shadowX > 16 || shadowY > 16 || shadowZ > 16)
+						break;
+					CHECK(light[dimensions.GetIndex(shadowX, shadowY, shadowZ)] == (step == 0 ? UINT8_MAX : 0));
+				}
+
+				uint32_t shadowedCount = 0;
+				for (uint8_t value : light)
+				{
+					CHECK(value == 0 || value == UINT8_MAX);
+					shadowedCount += value == 0;
+				}
+				CHECK(shadowedCount == 8);
+				directionCount++;
+			}
+		}
+	}
+	CHECK(directionCount == 20);
+}
+
+// on a smooth volume the sweep stays close to marching every voxel towards the light, diagonals included
+static void TestAgainstReference()
+{
+	const VolumeDimensions dimensions = { 32, 24, 20 };
+	std::vector<uint8_t> data(dimensions.GetVoxelCount());
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+	{
+		for (uint32_t y = 0; y < dimensions.height; y++)
+		{
+			for (uint32_t x = 0; x < dimensions.width; x++)
+			{
+				const float distance = std::sqrt((x - 16.0f) * (x - 16.0f) + (y - 12.0f) * (y - 12.0f) + (z - 10.0f) * (z - 10.0f));
+				data[dimensions.GetIndex(x, y, z)] = static_cast<uint8_t>(std::max(0.0f, 60.0f - 7.0f * distance));
+			}
+		}
+	}
+
+	IlluminationVolume illumination;
+	illumination.Initialize(dimensions, dimensions.width);
+	illumination.SetOpacityTable(GetLinearOpacityTable());
+
+	const IlluminationSettings directions[] = {
+		GetDirectionalSettings(0, -1, 0),
+		GetDirectionalSettings(1, -1, 0),
+		GetDirectionalSettings(-1, 1, 1),
+		{ .lightDirection = { 0.3f, -0.8f, 0.52f } } };
+	for (const IlluminationSettings& settings : directions)
+	{
+		illumination.Update(data.data(), settings);
+		const std::vector<float> reference = illumination.ComputeReference(settings.lightDirection, 8);
+		const std::vector<uint8_t>& light = illumination.GetLight();
+
+		double error = 0.0;
+		for (size_t index = 0; index < light.size(); index++)
+			error += std::abs(light[index] / 255.0 - reference[index]);
+		CHECK(error / light.size() < 0.02);
+	}
+}
+
+int main()
+{
+	TestDiagonalShadows();
+	TestAgainstReference();
+	return GetTestResult();
+}
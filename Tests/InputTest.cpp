@@ -0,0 +1,162 @@
+#include "Test.h"
+#include "Input.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <random>
+
+static bool IsSameInput(const Input& a, const Input& b)
+{
+	return a.keys == b.keys && a.cursorX == b.cursorX && a.cursorY == b.cursorY && a.isRightButtonPressed == b.isRightButtonPressed;
+}
+
+// a session with frame times between 5 and 40 ms, keys held for a while and the cursor dragging around
+static std::vector<std::pair<Input, float>> GetSession(uint32_t frameCount, uint32_t seed)
+{
+	std::mt19937 random(seed);
+	std::vector<std::pair<Input, float>> session;
+	Input input;
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		if (random() % 8 == 0)
+			input.keys[random() % input.keys.size()] ^= true;
+		if (random() % 16 == 0)
+			input.isRightButtonPressed = !input.isRightButtonPressed;
+		input.cursorX += static_cast<float>(static_cast<int32_t>(random() % 21) - 10);
+		input.cursorY += static_cast<float>(static_cast<int32_t>(random() % 21) - 10);
+		session.push_back({ input, 0.005f + (random() % 36) / 1000.0f });
+	}
+	return session;
+}
+
+// what the application does with the input, something that depends on every frame's keys, cursor and time
+struct SimulatedState {
+	double position = 0.0;
+	double rotation = 0.0;
+	uint32_t toggles = 0;
+	bool wasTogglePressed = false;
+
+	void Update(const Input& input, float deltaTime)
+	{
+		for (uint32_t key = 0; key < input.keys.size(); key++)
+			position += input.keys[key] ? (key + 1) * deltaTime : 0.0;
+		if (input.isRightButtonPressed)
+			rotation += 0.001 * input.cursorX - 0.002 * input.cursorY;
+		toggles += input.keys[0] && !wasTogglePressed;
+		wasTogglePressed = input.keys[0];
+	}
+
+	bool operator==(const SimulatedState&) const = default;
+};
+
+static void TestSaveLoad()
+{
+	InputRecorder recorder;
+	for (const auto& [input, deltaTime] : GetSession(500, 1))
+		recorder.Record(input, deltaTime);
+
+	const std::filesystem::path path = std::filesystem::temp_directory_path() / "InputTest.rec";
+	CHECK(recorder.Save(path));
+	std::optional<std::vector<InputFrame>> frames = InputReplay::Load(path);
+	CHECK(frames && frames->size() == recorder.GetFrames().size());
+	if (frames && frames->size() == recorder.GetFrames().size())
+		CHECK(memcmp(frames->data(), recorder.GetFrames().data(), frames->size() * sizeof(InputFrame)) == 0);
+
+	// cut off in the middle of a frame
+	std::filesystem::resize_file(path, std::filesystem::file_size(path) - 8);
+	CHECK(!InputReplay::Load(path));
+
+	// not a recording
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file << "definitely not a recording";
+	}
+	CHECK(!InputReplay::Load(path));
+	std::filesystem::remove(path);
+	CHECK(!InputReplay::Load(path));
+}
+
+// with the recorded frame times every frame comes back as it was recorded
+static void TestRecordedTimes()
+{
+	const std::vector<std::pair<Input, float>> session = GetSession(500, 2);
+	InputRecorder recorder;
+	SimulatedState recorded;
+	for (const auto& [input, deltaTime] : session)
+	{
+		recorder.Record(input, deltaTime);
+		recorded.Update(input, deltaTime);
+	}
+
+	InputReplay replay(recorder.GetFrames(), 0.0f);
+	SimulatedState replayed;
+	for (const auto& [recordedInput, recordedDeltaTime] : session)
+	{
+		CHECK(!replay.IsFinished());
+		Input input;
+		const float deltaTime = replay.Next(input);
+		CHECK(deltaTime == recordedDeltaTime);
+		CHECK(IsSameInput(input, recordedInput));
+		replayed.Update(input, deltaTime);
+	}
+	CHECK(replay.IsFinished());
+	CHECK(replay.GetStepCount() == session.size());
+	CHECK(replayed == recorded);
+}
+
+// a fixed timestep takes as many steps as fit the recording, gives the same result every time and
+// doesn't lose a press shorter than a step
+static void TestFixedTimestep()
+{
+	InputRecorder recorder;
+	double recordedTime = 0.0;
+	for (const auto& [input, deltaTime] : GetSession(500, 3))
+	{
+		recorder.Record(input, deltaTime);
+		recordedTime += deltaTime;
+	}
+
+	constexpr float TIMESTEP = 1.0f / 60.0f;
+	auto replay = [&]() {
+		InputReplay replay(recorder.GetFrames(), TIMESTEP);
+		SimulatedState state;
+		while (!replay.IsFinished())
+		{
+			Input input;
+			const float deltaTime = replay.Next(input);
+			CHECK(deltaTime == TIMESTEP);
+			state.Update(input, deltaTime);
+		}
+		CHECK(std::abs(replay.GetStepCount() - recordedTime / TIMESTEP) <= 1.0);
+		return state;
+	};
+	CHECK(replay() == replay());
+
+	// a key tapped for 2 ms in the middle of a step, released again before the step ends
+	InputRecorder tap;
+	Input input;
+	tap.Record(input, 0.010f);
+	input.keys[3] = true;
+	tap.Record(input, 0.002f);
+	input.keys[3] = false;
+	tap.Record(input, 0.010f);
+	tap.Record(input, 0.050f);
+
+	InputReplay tapReplay(tap.GetFrames(), 0.05f);
+	uint32_t pressedSteps = 0;
+	while (!tapReplay.IsFinished())
+	{
+		tapReplay.Next(input);
+		pressedSteps += input.keys[3];
+	}
+	CHECK(pressedSteps == 1);
+}
+
+int main()
+{
+	TestSaveLoad();
+	TestRecordedTimes();
+	TestFixedTimestep();
+	return GetTestResult();
+}
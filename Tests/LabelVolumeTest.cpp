@@ -0,0 +1,150 @@
+#include "Test.h"
+#include "LabelVolume.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+static std::vector<uint8_t> GetRandomLabels(size_t count, uint32_t bitsPerLabel, std::mt19937& random)
+{
+	std::vector<uint8_t> labels(count);
+	for (uint8_t& label : labels)
+		label = static_cast<uint8_t>(random() & ((1u << bitsPerLabel) - 1));
+	return labels;
+}
+
+// the SIMD paths against the scalar references, with counts that leave every possible tail
+static void TestPackUnpack()
+{
+	std::mt19937 random(11);
+	for (uint32_t bitsPerLabel : { 1u, 2u, 4u, 8u })
+	{
+		for (size_t count : { 0, 1, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 128, 129, 1000, 100003 })
+		{
+			const std::vector<uint8_t> labels = GetRandomLabels(count, bitsPerLabel, random);
+			const size_t packedSize = LabelVolume::GetPackedSize(count, bitsPerLabel);
+			CHECK(packedSize % 4 == 0 && packedSize * 8 >= count * bitsPerLabel);
+
+			std::vector<uint8_t> packed(packedSize, 0);
+			std::vector<uint8_t> packedScalar(packedSize, 0);
+			LabelVolume::Pack(labels.data(), count, bitsPerLabel, packed.data());
+			LabelVolume::PackScalar(labels.data(), count, bitsPerLabel, packedScalar.data());
+			CHECK(packed == packedScalar);
+
+			std::vector<uint8_t> unpacked(count, 0xFF);
+			std::vector<uint8_t> unpackedScalar(count, 0xFF);
+			LabelVolume::Unpack(packed.data(), count, bitsPerLabel, unpacked.data());
+			LabelVolume::UnpackScalar(packed.data(), count, bitsPerLabel, unpackedScalar.data());
+			CHECK(unpacked == labels);
+			CHECK(unpackedScalar == labels);
+		}
+	}
+}
+
+static void TestBitsPerLabel()
+{
+	CHECK(LabelVolume::GetBitsPerLabel(1) == 1);
+	CHECK(LabelVolume::GetBitsPerLabel(2) == 1);
+	CHECK(LabelVolume::GetBitsPerLabel(3) == 2);
+	CHECK(LabelVolume::GetBitsPerLabel(4) == 2);
+	CHECK(LabelVolume::GetBitsPerLabel(5) == 4);
+	CHECK(LabelVolume::GetBitsPerLabel(16) == 4);
+	CHECK(LabelVolume::GetBitsPerLabel(17) == 8);
+	CHECK(LabelVolume::GetBitsPerLabel(256) == 8);
+}
+
+// the brick masks against every voxel of the brick and its apron, on a volume of spheres with runs of
+// one label and noisy spots
+static void TestBuild()
+{
+	const VolumeDimensions dimensions = { 53, 40, 35 };
+	std::mt19937 random(5);
+	std::vector<uint8_t> labels(dimensions.GetVoxelCount());
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+	{
+		for (uint32_t y = 0; y < dimensions.height; y++)
+		{
+			for (uint32_t x = 0; x < dimensions.width; x++)
+			{
+				const int32_t dx = static_cast<int32_t>(x) - 20;
+				const int32_t dy = static_cast<int32_t>(y) - 20;
+				const int32_t dz = static_cast<int32_t>(z) - 17;
+				const int32_t distance = dx * dx + dy * dy + dz * dz;
+				uint8_t label = distance < 100 ? 1 : distance < 200 ? 2 : 0;
+				if (x > 40 && random() % 5 == 0)
+					label = static_cast<uint8_t>(3 + random() % 6);
+				labels[dimensions.GetIndex(x, y, z)] = label;
+			}
+		}
+	}
+
+	LabelVolume volume;
+	volume.Build(labels.data(), dimensions);
+	CHECK(volume.GetLabelCount() == 9);
+	CHECK(volume.GetBitsPerLabel() == 4);
+	CHECK(volume.GetPacked().size() == LabelVolume::GetPackedSize(labels.size(), 4));
+
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+		for (uint32_t y = 0; y < dimensions.height; y++)
+			for (uint32_t x = 0; x < dimensions.width; x++)
+				CHECK(volume.GetLabel(x, y, z) == labels[dimensions.GetIndex(x, y, z)]);
+
+	const VolumeDimensions& bricks = volume.GetBrickDimensions();
+	CHECK((bricks == VolumeDimensions{ 4, 3, 3 }));
+	for (uint32_t brickZ = 0; brickZ < bricks.depth; brickZ++)
+	{
+		for (uint32_t brickY = 0; brickY < bricks.height; brickY++)
+		{
+			for (uint32_t brickX = 0; brickX < bricks.width; brickX++)
+			{
+				LabelVolume::LabelMask expected{};
+				// the brick's voxels and the apron reaching one voxel into its neighbours
+				for (uint32_t z = brickZ > 0 ? brickZ * BRICK_SIZE - 1 : 0; z < std::min((brickZ + 1) * BRICK_SIZE + 1, dimensions.depth); z++)
+					for (uint32_t y = brickY > 0 ? brickY * BRICK_SIZE - 1 : 0; y < std::min((brickY + 1) * BRICK_SIZE + 1, dimensions.height); y++)
+						for (uint32_t x = brickX > 0 ? brickX * BRICK_SIZE - 1 : 0; x < std::min((brickX + 1) * BRICK_SIZE + 1, dimensions.width); x++)
+						{
+							const uint8_t label = labels[dimensions.GetIndex(x, y, z)];
+							expected[label / 32] |= 1u << (label % 32);
+						}
+
+				CHECK(volume.GetBrickMask(bricks.GetIndex(brickX, brickY, brickZ)) == expected);
+			}
+		}
+	}
+
+	// hiding everything but the sphere's core leaves the bricks that hold some of it
+	for (uint32_t label = 0; label < LabelVolume::MAX_LABEL_COUNT; label++)
+		volume.SetStyle(static_cast<uint8_t>(label), { .isVisible = label == 1 });
+	const std::vector<uint8_t> visibleBricks = volume.GetVisibleBricks();
+	for (size_t brick = 0; brick < visibleBricks.size(); brick++)
+		CHECK(visibleBricks[brick] == ((volume.GetBrickMask(brick)[0] & 2) != 0 ? 1 : 0));
+}
+
+static void BenchmarkPackUnpack()
+{
+	constexpr size_t COUNT = 64 * 1024 * 1024;
+	std::mt19937 random(1);
+	for (uint32_t bitsPerLabel : { 1u, 2u, 4u })
+	{
+		const std::vector<uint8_t> labels = GetRandomLabels(COUNT, bitsPerLabel, random);
+		std::vector<uint8_t> packed(LabelVolume::GetPackedSize(COUNT, bitsPerLabel));
+		std::vector<uint8_t> unpacked(COUNT);
+
+		const double pack = MeasureMilliseconds(3, [&]() { LabelVolume::Pack(labels.data(), COUNT, bitsPerLabel, packed.data()); });
+		const double packScalar = MeasureMilliseconds(3, [&]() { LabelVolume::PackScalar(labels.data(), COUNT, bitsPerLabel, packed.data()); });
+		const double unpack = MeasureMilliseconds(3, [&]() { LabelVolume::Unpack(packed.data(), COUNT, bitsPerLabel, unpacked.data()); });
+		const double unpackScalar = MeasureMilliseconds(3, [&]() { LabelVolume::UnpackScalar(packed.data(), COUNT, bitsPerLabel, unpacked.data()); });
+		std::printf("%u bits, 64M labels: pack %.1f ms (scalar %.1f ms), unpack %.1f ms (scalar %.1f ms)\n",
+			bitsPerLabel, pack, packScalar, unpack, unpackScalar);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	TestPackUnpack();
+	TestBitsPerLabel();
+	TestBuild();
+	if (IsBenchmarkRun(argc, argv))
+		BenchmarkPackUnpack();
+	return GetTestResult();
+}
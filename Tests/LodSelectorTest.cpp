@@ -0,0 +1,304 @@
+#include "Test.h"
+#include "LodSelector.h"
+#include "MinMaxGrid.h"
+
+#include <cmath>
+#include <vector>
+
+static constexpr float FIELD_OF_VIEW = 3.14159265f / 4.0f;
+static constexpr float VIEWPORT_WIDTH = 1920.0f;
+static constexpr float VIEWPORT_HEIGHT = 1080.0f;
+
+struct Matrix {
+	float m[4][4]{};
+};
+
+static Matrix Multiply(const Matrix& a, const Matrix& b)
+{
+	Matrix result;
+	for (uint32_t row = 0; row < 4; row++)
+		for (uint32_t column = 0; column < 4; column++)
+			for (uint32_t i = 0; i < 4; i++)
+				result.m[row][column] += a.m[row][i] * b.m[i][column];
+	return result;
+}
+
+static Float3 Normalize(const Float3& v)
+{
+	const float length = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+	return { v.x / length, v.y / length, v.z / length };
+}
+
+static Float3 Cross(const Float3& a, const Float3& b)
+{
+	return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+static float Dot(const Float3& a, const Float3& b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// left handed and for row vectors like DirectX's XMMatrixLookToLH and XMMatrixPerspectiveFovLH
+static Matrix GetViewProjection(const Float3& eye, const Float3& direction, float aspectRatio)
+{
+	const Float3 axisZ = Normalize(direction);
+	const Float3 up = std::abs(axisZ.y) > 0.99f ? Float3{ 1.0f, 0.0f, 0.0f } : Float3{ 0.0f, 1.0f, 0.0f };
+	const Float3 axisX = Normalize(Cross(up, axisZ));
+	const Float3 axisY = Cross(axisZ, axisX);
+	Matrix view;
+	const Float3 axes[3] = { axisX, axisY, axisZ };
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		view.m[0][i] = axes[i].x;
+		view.m[1][i] = axes[i].y;
+		view.m[2][i] = axes[i].z;
+		view.m[3][i] = -Dot(axes[i], eye);
+	}
+	view.m[3][3] = 1.0f;
+
+	constexpr float NEAR_PLANE = 0.01f;
+	constexpr float FAR_PLANE = 100.0f;
+	const float scaleY = 1.0f / std::tan(FIELD_OF_VIEW / 2.0f);
+	Matrix projection;
+	projection.m[0][0] = scaleY / aspectRatio;
+	projection.m[1][1] = scaleY;
+	projection.m[2][2] = FAR_PLANE / (FAR_PLANE - NEAR_PLANE);
+	projection.m[2][3] = 1.0f;
+	projection.m[3][2] = -NEAR_PLANE * FAR_PLANE / (FAR_PLANE - NEAR_PLANE);
+	return Multiply(view, projection);
+}
+
+struct TestCamera {
+	const char* name;
+	Float3 eye;
+	Float3 direction;
+	float pixelError;
+};
+
+// outside, close up, inside the volume, at a corner, grazing along a face and with errors that mix levels
+static const TestCamera CAMERAS[] = {
+	{ "default", { 0.0f, 0.0f, -5.0f }, { 0.0f, 0.0f, 1.0f }, 1.0f },
+	{ "close", { 0.0f, 0.0f, -1.5f }, { 0.0f, 0.0f, 1.0f }, 1.0f },
+	{ "inside", { 0.1f, 0.2f, 0.05f }, { 0.3f, -0.2f, 1.0f }, 1.0f },
+	{ "corner", { 0.9f, 0.9f, -1.2f }, { -0.5f, -0.6f, 1.0f }, 1.0f },
+	{ "fine", { 0.0f, 0.0f, -1.2f }, { 0.0f, 0.0f, 1.0f }, 0.25f },
+	{ "coarse", { 0.0f, 0.0f, -3.0f }, { 0.0f, 0.0f, 1.0f }, 4.0f },
+	{ "grazing", { 0.0f, 0.0f, -1.1f }, { 0.0f, 1.0f, 0.0f }, 1.0f },
+	{ "mixed", { 0.0f, 0.0f, -1.05f }, { 0.0f, 0.0f, 1.0f }, 8.0f },
+	{ "mixed2", { 0.3f, 0.8f, -1.02f }, { 0.2f, -0.4f, 1.0f }, 16.0f },
+	{ "center", { 0.0f, 0.0f, 0.0f }, { 1.0f, 0.3f, 0.2f }, 6.0f },
+	{ "huge", { 0.0f, 0.0f, -1.02f }, { 0.1f, 0.1f, 1.0f }, 100.0f },
+};
+
+// the volume spans [-1, 1] on every axis like under the application's model matrix
+static LodView GetView(const TestCamera& camera)
+{
+	const Matrix viewProjection = GetViewProjection(camera.eye, camera.direction, VIEWPORT_WIDTH / VIEWPORT_HEIGHT);
+	LodView view{
+		.pixelsPerUnit = VIEWPORT_HEIGHT * 0.5f / std::tan(FIELD_OF_VIEW / 2.0f),
+		.pixelError = camera.pixelError,
+		.volumeMin = { -1.0f, -1.0f, -1.0f },
+		.volumeMax = { 1.0f, 1.0f, 1.0f } };
+	memcpy(view.viewProjection, viewProjection.m, sizeof(view.viewProjection));
+	return view;
+}
+
+// a body filling most of the volume, the corners around it are empty
+static std::vector<uint8_t> GetBody(const VolumeDimensions& dimensions)
+{
+	std::vector<uint8_t> data(dimensions.GetVoxelCount());
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+	{
+		for (uint32_t y = 0; y < dimensions.height; y++)
+		{
+			for (uint32_t x = 0; x < dimensions.width; x++)
+			{
+				const float dx = 2.0f * x / dimensions.width - 1.0f;
+				const float dy = 2.0f * y / dimensions.height - 1.0f;
+				const float dz = 2.0f * z / dimensions.depth - 1.0f;
+				data[dimensions.GetIndex(x, y, z)] = dx * dx + dy * dy + dz * dz < 1.1f ? 100 : 0;
+			}
+		}
+	}
+	return data;
+}
+
+// a brick counts as visible if any of a 5x5x5 lattice of voxel centers in it is inside the clip volume
+static bool IsBrickVisible(const Matrix& viewProjection, const VolumeDimensions& dimensions, uint32_t x, uint32_t y, uint32_t z)
+{
+	for (uint32_t i = 0; i < 125; i++)
+	{
+		const float voxelX = std::min(x * BRICK_SIZE + (i % 5) * BRICK_SIZE / 4.0f, dimensions.width - 1.0f);
+		const float voxelY = std::min(y * BRICK_SIZE + (i / 5 % 5) * BRICK_SIZE / 4.0f, dimensions.height - 1.0f);
+		const float voxelZ = std::min(z * BRICK_SIZE + (i / 25) * BRICK_SIZE / 4.0f, dimensions.depth - 1.0f);
+		const float position[3] = {
+			-1.0f + (voxelX + 0.5f) * 2.0f / dimensions.width,
+			-1.0f + (voxelY + 0.5f) * 2.0f / dimensions.height,
+			-1.0f + (voxelZ + 0.5f) * 2.0f / dimensions.depth };
+		float clip[4];
+		for (uint32_t column = 0; column < 4; column++)
+			clip[column] = position[0] * viewProjection.m[0][column] + position[1] * viewProjection.m[1][column] + position[2] * viewProjection.m[2][column] + viewProjection.m[3][column];
+		if (clip[3] > 0.0f && std::abs(clip[0]) <= clip[3] && std::abs(clip[1]) <= clip[3] && clip[2] >= 0.0f && clip[2] <= clip[3])
+			return true;
+	}
+	return false;
+}
+
+struct SelectionErrors {
+	// bricks covered by more than one node
+	size_t overlaps = 0;
+	// occupied bricks in view covered by none
+	size_t holes = 0;
+	// touching bricks more than one level apart
+	size_t cracks = 0;
+};
+
+static SelectionErrors CheckSelection(const std::vector<LodBrick>& selection, const MinMaxGrid& grid, const VolumeDimensions& dimensions, const Matrix& viewProjection)
+{
+	const VolumeDimensions& bricks = grid.GetDimensions();
+	std::vector<int32_t> levels(bricks.GetVoxelCount(), -1);
+	std::vector<uint32_t> coverCounts(bricks.GetVoxelCount(), 0);
+	for (const LodBrick& node : selection)
+	{
+		const uint32_t size = 1u << node.level;
+		for (uint32_t z = node.z * size; z < std::min((node.z + 1u) * size, bricks.depth); z++)
+			for (uint32_t y = node.y * size; y < std::min((node.y + 1u) * size, bricks.height); y++)
+				for (uint32_t x = node.x * size; x < std::min((node.x + 1u) * size, bricks.width); x++)
+				{
+					coverCounts[bricks.GetIndex(x, y, z)]++;
+					levels[bricks.GetIndex(x, y, z)] = node.level;
+				}
+	}
+
+	SelectionErrors errors;
+	for (uint32_t z = 0; z < bricks.depth; z++)
+	{
+		for (uint32_t y = 0; y < bricks.height; y++)
+		{
+			for (uint32_t x = 0; x < bricks.width; x++)
+			{
+				const size_t brick = bricks.GetIndex(x, y, z);
+				errors.overlaps += coverCounts[brick] > 1;
+				if (coverCounts[brick] == 0)
+				{
+					errors.holes += grid.GetMax(x, y, z) > 0 && IsBrickVisible(viewProjection, dimensions, x, y, z);
+					continue;
+				}
+				for (int32_t neighbor = 0; neighbor < 27; neighbor++)
+				{
+					const int32_t neighborX = static_cast<int32_t>(x) + neighbor % 3 - 1;
+					const int32_t neighborY = static_cast<int32_t>(y) + neighbor / 3 % 3 - 1;
+					const int32_t neighborZ = static_cast<int32_t>(z) + neighbor / 9 - 1;
+					if (neighborX < 0 || neighborY < 0 || neighborZ < 0 ||
+						neighborX >= static_cast<int32_t>(bricks.width) || neighborY >= static_cast<int32_t>(bricks.height) || neighborZ >= static_cast<int32_t>(bricks.depth))
+						continue;
+					const size_t neighborBrick = bricks.GetIndex(neighborX, neighborY, neighborZ);
+					errors.cracks += coverCounts[neighborBrick] > 0 && std::abs(levels[brick] - levels[neighborBrick]) > 1;
+				}
+			}
+		}
+	}
+	return errors;
+}
+
+// Every camera's selection covers each visible occupied brick exactly once, and touching nodes stay
+// within a level of each other.
+static void TestSelection()
+{
+	const VolumeDimensions dimensions = { 176, 176, 160 };
+	const std::vector<uint8_t> data = GetBody(dimensions);
+	MinMaxGrid grid;
+	grid.Build(data.data(), dimensions);
+	LodSelector selector;
+	selector.Build(grid, dimensions);
+	CHECK(selector.GetLevelCount() == 5);
+	CHECK((selector.GetLevelDimensions(0) == grid.GetDimensions()));
+	CHECK((selector.GetLevelDimensions(4) == VolumeDimensions{ 1, 1, 1 }));
+
+	std::vector<uint32_t> levelCounts(selector.GetLevelCount(), 0);
+	for (const TestCamera& camera : CAMERAS)
+	{
+		const LodView view = GetView(camera);
+		Matrix viewProjection;
+		memcpy(viewProjection.m, view.viewProjection, sizeof(viewProjection.m));
+		const std::vector<LodBrick>& selection = selector.Select(view, 0);
+		CHECK(&selection == &selector.GetSelection());
+		CHECK(!selection.empty());
+
+		const SelectionErrors errors = CheckSelection(selection, grid, dimensions, viewProjection);
+		if (errors.overlaps > 0 || errors.holes > 0 || errors.cracks > 0)
+			std::fprintf(stderr, "%s: %zu overlaps, %zu holes, %zu cracks\n", camera.name, errors.overlaps, errors.holes, errors.cracks);
+		CHECK(errors.overlaps == 0 && errors.holes == 0 && errors.cracks == 0);
+		for (const LodBrick& node : selection)
+			levelCounts[node.level]++;
+	}
+	// the transitions the crack check looks at
+	CHECK(levelCounts[0] > 0 && levelCounts[1] > 0 && levelCounts[2] > 0);
+}
+
+// a looser error picks coarser nodes, a threshold over every value and a camera looking away pick none
+static void TestCulling()
+{
+	const VolumeDimensions dimensions = { 128, 128, 128 };
+	const std::vector<uint8_t> data = GetBody(dimensions);
+	MinMaxGrid grid;
+	grid.Build(data.data(), dimensions);
+	LodSelector selector;
+	selector.Build(grid, dimensions);
+
+	TestCamera camera = { "", { 0.0f, 0.0f, -3.0f }, { 0.0f, 0.0f, 1.0f }, 1.0f };
+	const size_t fineCount = selector.Select(GetView(camera), 0).size();
+	camera.pixelError = 16.0f;
+	const size_t coarseCount = selector.Select(GetView(camera), 0).size();
+	CHECK(coarseCount < fineCount);
+
+	CHECK(selector.Select(GetView(camera), 100).empty());
+	camera.direction = { 0.0f, 0.0f, -1.0f };
+	CHECK(selector.Select(GetView(camera), 0).empty());
+
+	// empty corners are left out even when everything is selected at full resolution
+	LodView everything = GetView({ "", { 0.0f, 0.0f, -3.0f }, { 0.0f, 0.0f, 1.0f }, 1.0f });
+	everything.pixelsPerUnit = 1e6f;
+	const std::vector<LodBrick>& selection = selector.Select(everything, 0);
+	size_t occupiedCount = 0;
+	for (uint8_t max : grid.GetMaxValues())
+		occupiedCount += max > 0;
+	CHECK(selection.size() == occupiedCount && occupiedCount < grid.GetMaxValues().size());
+	for (const LodBrick& node : selection)
+		CHECK(node.level == 0 && grid.GetMax(node.x, node.y, node.z) > 0);
+}
+
+// the per-frame cost on a 752x752x720 CT sized volume, for every camera and with every brick at full resolution
+static void BenchmarkSelect()
+{
+	const VolumeDimensions dimensions = { 752, 752, 720 };
+	const std::vector<uint8_t> data = GetBody(dimensions);
+	MinMaxGrid grid;
+	grid.Build(data.data(), dimensions);
+	LodSelector selector;
+	selector.Build(grid, dimensions);
+	const VolumeDimensions& bricks = grid.GetDimensions();
+	std::printf("%ux%ux%u bricks, %u levels\n", bricks.width, bricks.height, bricks.depth, selector.GetLevelCount());
+
+	for (const TestCamera& camera : CAMERAS)
+	{
+		const LodView view = GetView(camera);
+		const double milliseconds = MeasureMilliseconds(100, [&]() { selector.Select(view, 0); });
+		std::printf("%-8s %6zu nodes %7.3f ms\n", camera.name, selector.GetSelection().size(), milliseconds);
+	}
+
+	LodView everything = GetView({ "", { 0.0f, 0.0f, -3.0f }, { 0.0f, 0.0f, 1.0f }, 1.0f });
+	everything.pixelsPerUnit = 1e6f;
+	const double milliseconds = MeasureMilliseconds(100, [&]() { selector.Select(everything, 0); });
+	std::printf("%-8s %6zu nodes %7.3f ms\n", "all fine", selector.GetSelection().size(), milliseconds);
+}
+
+int main(int argc, char** argv)
+{
+	TestSelection();
+	TestCulling();
+	if (IsBenchmarkRun(argc, argv))
+		BenchmarkSelect();
+	return GetTestResult();
+}
@@ -0,0 +1,193 @@
+#include "Test.h"
+#include "MarchingCubes.h"
+#include "ThreadPool.h"
+
+#include <array>
+#include <cmath>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+
+// a solid sphere of radius times the smallest dimension around the center, 200 inside falling off to 0
+static std::vector<uint8_t> GetSphere(const VolumeDimensions& dimensions, float radius)
+{
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount());
+	const float size = static_cast<float>(std::min({ dimensions.width, dimensions.height, dimensions.depth }));
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+		for (uint32_t y = 0; y < dimensions.height; y++)
+			for (uint32_t x = 0; x < dimensions.width; x++)
+			{
+				const float dx = x - (dimensions.width - 1) / 2.0f;
+				const float dy = y - (dimensions.height - 1) / 2.0f;
+				const float dz = z - (dimensions.depth - 1) / 2.0f;
+				const float distance = std::sqrt(dx * dx + dy * dy + dz * dz) - radius * size;
+				volume[dimensions.GetIndex(x, y, z)] = static_cast<uint8_t>(std::clamp(100.0f - 25.0f * distance, 0.0f, 200.0f));
+			}
+	return volume;
+}
+
+// noise with every voxel on the border left out, so the surface is closed and full of ambiguous cells
+static std::vector<uint8_t> GetNoise(const VolumeDimensions& dimensions, uint32_t seed)
+{
+	std::mt19937 random(seed);
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount());
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+		for (uint32_t y = 0; y < dimensions.height; y++)
+			for (uint32_t x = 0; x < dimensions.width; x++)
+			{
+				const bool isBorder = x == 0 || y == 0 || z == 0 || x + 1 == dimensions.width || y + 1 == dimensions.height || z + 1 == dimensions.depth;
+				volume[dimensions.GetIndex(x, y, z)] = isBorder ? 0 : static_cast<uint8_t>(random());
+			}
+	return volume;
+}
+
+// Every edge between two welded vertices is walked once in each direction, so the surface has no holes,
+// no edge is shared by more than two triangles and the winding agrees across every edge.
+static bool IsClosed(const IsosurfaceMesh& mesh)
+{
+	std::map<std::pair<uint32_t, uint32_t>, uint32_t> edges;
+	for (size_t i = 0; i < mesh.indices.size(); i += 3)
+	{
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			const uint32_t a = mesh.indices[i + corner];
+			const uint32_t b = mesh.indices[i + (corner + 1) % 3];
+			if (a == b)
+				return false;
+			edges[{ a, b }]++;
+		}
+	}
+	for (const auto& [edge, count] : edges)
+	{
+		if (count != 1 || !edges.contains({ edge.second, edge.first }))
+			return false;
+	}
+	return true;
+}
+
+// V - E + F, 2 for anything shaped like a sphere
+static int64_t GetEulerCharacteristic(const IsosurfaceMesh& mesh)
+{
+	return static_cast<int64_t>(mesh.vertices.size()) - static_cast<int64_t>(mesh.indices.size() / 2) + static_cast<int64_t>(mesh.indices.size() / 3);
+}
+
+// the triangles by the positions of their corners, starting at the smallest so the numbering doesn't matter
+static std::multiset<std::array<float, 9>> GetTriangles(const IsosurfaceMesh& mesh)
+{
+	std::multiset<std::array<float, 9>> triangles;
+	for (size_t i = 0; i < mesh.indices.size(); i += 3)
+	{
+		std::array<std::array<float, 3>, 3> corners;
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			const Float3& vertex = mesh.vertices[mesh.indices[i + corner]];
+			corners[corner] = { vertex.x, vertex.y, vertex.z };
+		}
+		std::rotate(corners.begin(), std::min_element(corners.begin(), corners.end()), corners.end());
+		triangles.insert({ corners[0][0], corners[0][1], corners[0][2], corners[1][0], corners[1][1], corners[1][2], corners[2][0], corners[2][1], corners[2][2] });
+	}
+	return triangles;
+}
+
+static bool IsWelded(const IsosurfaceMesh& mesh)
+{
+	std::set<std::array<float, 3>> positions;
+	for (const Float3& vertex : mesh.vertices)
+		positions.insert({ vertex.x, vertex.y, vertex.z });
+	return positions.size() == mesh.vertices.size();
+}
+
+// The sphere crosses brick borders on every axis, sizes that aren't a multiple of the brick size leave
+// partial bricks at the end. Extract has to give the triangles of the reference and a closed sphere.
+static void TestSphere()
+{
+	const MarchingCubes marchingCubes;
+	for (const VolumeDimensions& dimensions : { VolumeDimensions{ 40, 35, 37 }, VolumeDimensions{ 17, 17, 17 }, VolumeDimensions{ 66, 20, 33 } })
+	{
+		const std::vector<uint8_t> volume = GetSphere(dimensions, 0.35f);
+		const IsosurfaceMesh mesh = marchingCubes.Extract(volume.data(), dimensions, 100);
+		const IsosurfaceMesh reference = marchingCubes.ExtractScalar(volume.data(), dimensions, 100);
+		CHECK(!mesh.indices.empty() && mesh.indices.size() % 3 == 0);
+		CHECK(mesh.vertices.size() == reference.vertices.size());
+		CHECK(GetTriangles(mesh) == GetTriangles(reference));
+		CHECK(IsWelded(mesh));
+		CHECK(IsClosed(mesh));
+		CHECK(GetEulerCharacteristic(mesh) == 2);
+
+		// every vertex lies on the sphere, within the reach of the linear interpolation
+		const float size = static_cast<float>(std::min({ dimensions.width, dimensions.height, dimensions.depth }));
+		bool isOnSphere = true;
+		for (const Float3& vertex : mesh.vertices)
+		{
+			const float x = (vertex.x + 1.0f) / 2.0f * dimensions.width - 0.5f - (dimensions.width - 1) / 2.0f;
+			const float y = (vertex.y + 1.0f) / 2.0f * dimensions.height - 0.5f - (dimensions.height - 1) / 2.0f;
+			const float z = (vertex.z + 1.0f) / 2.0f * dimensions.depth - 0.5f - (dimensions.depth - 1) / 2.0f;
+			isOnSphere &= std::abs(std::sqrt(x * x + y * y + z * z) - 0.35f * size) < 0.1f;
+		}
+		CHECK(isOnSphere);
+	}
+}
+
+// random voxels hit every case, the ambiguous ones too, and the surface still has to close up
+static void TestNoise()
+{
+	const MarchingCubes marchingCubes;
+	const VolumeDimensions dimensions = { 35, 18, 20 };
+	const std::vector<uint8_t> volume = GetNoise(dimensions, 3);
+	for (uint8_t isoValue : { 1, 128, 255 })
+	{
+		const IsosurfaceMesh mesh = marchingCubes.Extract(volume.data(), dimensions, isoValue);
+		const IsosurfaceMesh reference = marchingCubes.ExtractScalar(volume.data(), dimensions, isoValue);
+		CHECK(!mesh.indices.empty());
+		CHECK(GetTriangles(mesh) == GetTriangles(reference));
+		CHECK(IsWelded(mesh));
+		CHECK(IsClosed(mesh));
+	}
+}
+
+// nothing to extract from volumes that are all inside, all outside or too thin to have a cell
+static void TestEmpty()
+{
+	const MarchingCubes marchingCubes;
+	const VolumeDimensions dimensions = { 20, 20, 20 };
+	const std::vector<uint8_t> inside(dimensions.GetVoxelCount(), 200);
+	CHECK(marchingCubes.Extract(inside.data(), dimensions, 100).indices.empty());
+	CHECK(marchingCubes.Extract(inside.data(), dimensions, 0).indices.empty());
+	const std::vector<uint8_t> outside(dimensions.GetVoxelCount(), 0);
+	CHECK(marchingCubes.Extract(outside.data(), dimensions, 100).indices.empty());
+	const std::vector<uint8_t> slice = GetNoise({ 20, 20, 1 }, 5);
+	CHECK(marchingCubes.Extract(slice.data(), { 20, 20, 1 }, 100).indices.empty());
+}
+
+// extraction time and triangle count of a sphere and of a noisy volume, against the reference
+static void BenchmarkExtract()
+{
+	const MarchingCubes marchingCubes;
+	const VolumeDimensions dimensions = { 256, 256, 256 };
+	std::vector<uint8_t> sphere = GetSphere(dimensions, 0.4f);
+	std::vector<uint8_t> noisy = sphere;
+	std::mt19937 random(2);
+	for (uint8_t& value : noisy)
+		value = static_cast<uint8_t>(std::clamp(static_cast<int32_t>(value) + static_cast<int32_t>(random() % 41) - 20, 0, 255));
+
+	std::printf("256x256x256, %u threads\n", ThreadPool::Get().GetThreadCount());
+	for (const auto& [name, volume] : { std::pair{ "sphere", &sphere }, std::pair{ "noisy sphere", &noisy } })
+	{
+		IsosurfaceMesh mesh;
+		const double milliseconds = MeasureMilliseconds(3, [&]() { mesh = marchingCubes.Extract(volume->data(), dimensions, 100); });
+		const double scalarMilliseconds = MeasureMilliseconds(1, [&]() { marchingCubes.ExtractScalar(volume->data(), dimensions, 100); });
+		std::printf("%-13s %9zu triangles, %s, extract %6.1f ms, scalar %7.1f ms\n", name, mesh.indices.size() / 3,
+			IsClosed(mesh) ? "closed" : "not closed", milliseconds, scalarMilliseconds);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	TestSphere();
+	TestNoise();
+	TestEmpty();
+	if (IsBenchmarkRun(argc, argv))
+		BenchmarkExtract();
+	return GetTestResult();
+}
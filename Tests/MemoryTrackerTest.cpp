@@ -0,0 +1,227 @@
+#include "Test.h"
+#include "MemoryTracker.h"
+#include "Arena.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+static bool IsSame(const MemoryCounters& a, const MemoryCounters& b)
+{
+	return a.liveBytes == b.liveBytes && a.peakBytes == b.peakBytes && a.liveAllocations == b.liveAllocations && a.totalAllocations == b.totalAllocations;
+}
+
+static void TestCounters()
+{
+	MemoryTracker tracker;
+	CHECK(tracker.GetLiveBytes() == 0);
+
+	tracker.Add(MemoryCategory::Labels, 300);
+	tracker.Add(MemoryCategory::Labels, 200);
+	tracker.Add(MemoryCategory::Upload, 64);
+	tracker.Remove(MemoryCategory::Labels, 300);
+	tracker.Add(MemoryCategory::Labels, 100);
+	CHECK(IsSame(tracker.GetCounters(MemoryCategory::Labels), { .liveBytes = 300, .peakBytes = 500, .liveAllocations = 2, .totalAllocations = 3 }));
+	CHECK(IsSame(tracker.GetCounters(MemoryCategory::Upload), { .liveBytes = 64, .peakBytes = 64, .liveAllocations = 1, .totalAllocations = 1 }));
+	CHECK(IsSame(tracker.GetCounters(MemoryCategory::Other), {}));
+	CHECK(tracker.GetLiveBytes() == 364);
+
+	// the peak stays when everything is gone
+	tracker.Remove(MemoryCategory::Labels, 200);
+	tracker.Remove(MemoryCategory::Labels, 100);
+	tracker.Remove(MemoryCategory::Upload, 64);
+	CHECK(IsSame(tracker.GetCounters(MemoryCategory::Labels), { .liveBytes = 0, .peakBytes = 500, .liveAllocations = 0, .totalAllocations = 3 }));
+	CHECK(tracker.GetLiveBytes() == 0);
+}
+
+// Every thread adds its allocations before any is removed, so the peak has to be all of them at once however
+// the adds interleave. Some threads share a category, the others have one each.
+static void TestConcurrentThreads()
+{
+	constexpr uint32_t THREAD_COUNT = 8;
+	constexpr uint32_t ALLOCATION_COUNT = 20000;
+	const MemoryCategory categories[THREAD_COUNT] = {
+		MemoryCategory::CpuVolume, MemoryCategory::CpuVolume, MemoryCategory::CpuVolume, MemoryCategory::CpuVolume,
+		MemoryCategory::Lighting, MemoryCategory::Geometry, MemoryCategory::Constants, MemoryCategory::Readback };
+	MemoryTracker tracker;
+
+	auto run = [&](auto&& func) {
+		std::vector<std::thread> threads;
+		for (uint32_t thread = 0; thread < THREAD_COUNT; thread++)
+			threads.emplace_back(func, thread);
+		for (std::thread& thread : threads)
+			thread.join();
+	};
+	run([&](uint32_t thread) {
+		for (uint32_t i = 0; i < ALLOCATION_COUNT; i++)
+			tracker.Add(categories[thread], thread + 1);
+	});
+	CHECK(IsSame(tracker.GetCounters(MemoryCategory::CpuVolume),
+		{ .liveBytes = 10 * ALLOCATION_COUNT, .peakBytes = 10 * ALLOCATION_COUNT, .liveAllocations = 4 * ALLOCATION_COUNT, .totalAllocations = 4 * ALLOCATION_COUNT }));
+	CHECK(tracker.GetCounters(MemoryCategory::Readback).peakBytes == 8 * ALLOCATION_COUNT);
+	CHECK(tracker.GetLiveBytes() == (1 + 2 + 3 + 4 + 5 + 6 + 7 + 8) * ALLOCATION_COUNT);
+
+	// adds and removes interleaved on every thread never go below zero or above the earlier peak
+	run([&](uint32_t thread) {
+		for (uint32_t i = 0; i < ALLOCATION_COUNT; i++)
+		{
+			tracker.Remove(categories[thread], thread + 1);
+			tracker.Add(categories[thread], thread + 1);
+			tracker.Remove(categories[thread], thread + 1);
+		}
+	});
+	for (MemoryCategory category : categories)
+	{
+		const MemoryCounters counters = tracker.GetCounters(category);
+		CHECK(counters.liveBytes == 0 && counters.liveAllocations == 0);
+	}
+	CHECK(tracker.GetCounters(MemoryCategory::CpuVolume).peakBytes == 10 * ALLOCATION_COUNT);
+	CHECK(tracker.GetCounters(MemoryCategory::CpuVolume).totalAllocations == 8 * ALLOCATION_COUNT);
+	CHECK(tracker.GetLiveBytes() == 0);
+}
+
+// the handle counts on the global tracker, a move hands the bytes over and counts nothing twice
+static void TestTrackedMemory()
+{
+	MemoryTracker& tracker = MemoryTracker::Get();
+	const MemoryCounters before = tracker.GetCounters(MemoryCategory::RenderTarget);
+	const MemoryCounters beforeOther = tracker.GetCounters(MemoryCategory::Descriptors);
+	auto liveBytes = [&]() { return tracker.GetCounters(MemoryCategory::RenderTarget).liveBytes - before.liveBytes; };
+	auto liveAllocations = [&]() { return tracker.GetCounters(MemoryCategory::RenderTarget).liveAllocations - before.liveAllocations; };
+	{
+		TrackedMemory empty;
+		TrackedMemory zero(MemoryCategory::RenderTarget, 0);
+		CHECK(liveAllocations() == 0);
+
+		TrackedMemory a(MemoryCategory::RenderTarget, 1000);
+		CHECK(liveBytes() == 1000 && liveAllocations() == 1);
+
+		TrackedMemory b(std::move(a));
+		CHECK(a.GetBytes() == 0 && b.GetBytes() == 1000 && b.GetCategory() == MemoryCategory::RenderTarget);
+		CHECK(liveBytes() == 1000 && liveAllocations() == 1);
+
+		// assigning over a handle gives up what it held
+		TrackedMemory c(MemoryCategory::Descriptors, 50);
+		c = std::move(b);
+		CHECK(liveBytes() == 1000 && liveAllocations() == 1);
+		CHECK(tracker.GetCounters(MemoryCategory::Descriptors).liveBytes == beforeOther.liveBytes);
+
+		TrackedMemory& self = c;
+		c = std::move(self);
+		CHECK(c.GetBytes() == 1000 && liveBytes() == 1000);
+
+		std::vector<TrackedMemory> handles;
+		for (uint32_t i = 0; i < 100; i++)
+			handles.emplace_back(MemoryCategory::RenderTarget, 10);
+		CHECK(liveBytes() == 2000 && liveAllocations() == 101);
+	}
+	CHECK(liveBytes() == 0 && liveAllocations() == 0);
+	CHECK(tracker.GetCounters(MemoryCategory::RenderTarget).totalAllocations - before.totalAllocations == 101);
+	CHECK(tracker.GetCounters(MemoryCategory::Descriptors).totalAllocations - beforeOther.totalAllocations == 1);
+}
+
+// the arena counts its blocks as they're reserved and released, not the allocations out of them
+static void TestArenaBlocks()
+{
+	MemoryTracker& tracker = MemoryTracker::Get();
+	const MemoryCounters before = tracker.GetCounters(MemoryCategory::CpuVolume);
+	auto liveBytes = [&]() { return tracker.GetCounters(MemoryCategory::CpuVolume).liveBytes - before.liveBytes; };
+	{
+		Arena arena(2 * Arena::LARGE_PAGE_SIZE);
+		void* a = arena.Allocate(100);
+		void* b = arena.Allocate(1000);
+		CHECK(liveBytes() == 2 * Arena::LARGE_PAGE_SIZE);
+		CHECK(tracker.GetCounters(MemoryCategory::CpuVolume).liveAllocations - before.liveAllocations == 1);
+
+		void* large = arena.Allocate(3 * Arena::LARGE_PAGE_SIZE);
+		CHECK(liveBytes() == arena.GetReservedBytes() && liveBytes() == 5 * Arena::LARGE_PAGE_SIZE);
+
+		// freed allocations leave their blocks reserved
+		arena.Deallocate(a);
+		arena.Deallocate(b);
+		arena.Deallocate(large);
+		CHECK(liveBytes() == 5 * Arena::LARGE_PAGE_SIZE);
+		arena.Release();
+		CHECK(liveBytes() == 0);
+
+		arena.Allocate(10);
+		CHECK(liveBytes() == 2 * Arena::LARGE_PAGE_SIZE);
+	}
+	// and the destructor releases what's left
+	CHECK(liveBytes() == 0);
+	CHECK(tracker.GetCounters(MemoryCategory::CpuVolume).peakBytes - before.liveBytes >= 5 * Arena::LARGE_PAGE_SIZE);
+}
+
+static void TestJson()
+{
+	MemoryTracker tracker;
+	tracker.Add(MemoryCategory::Labels, 300);
+	tracker.Add(MemoryCategory::Labels, 200);
+	tracker.Remove(MemoryCategory::Labels, 300);
+	tracker.Add(MemoryCategory::Readback, 7);
+
+	const std::string json = tracker.ToJson();
+	CHECK(json.find("\"live_bytes\": 207,") != std::string::npos);
+	CHECK(json.find("\"labels\": { \"live_bytes\": 200, \"peak_bytes\": 500, \"live_allocations\": 1, \"total_allocations\": 2 }") != std::string::npos);
+	CHECK(json.find("\"readback\": { \"live_bytes\": 7, \"peak_bytes\": 7, \"live_allocations\": 1, \"total_allocations\": 1 }") != std::string::npos);
+	CHECK(json.find("\"gpu\"") == std::string::npos);
+
+	// every category once, and brackets that pair up
+	for (size_t i = 0; i < static_cast<size_t>(MemoryCategory::Count); i++)
+	{
+		const std::string key = std::string("\"") + MemoryTracker::GetCategoryName(static_cast<MemoryCategory>(i)) + "\":";
+		CHECK(json.find(key) != std::string::npos && json.find(key) == json.rfind(key));
+	}
+	int32_t depth = 0;
+	for (char c : json)
+	{
+		depth += c == '{' ? 1 : c == '}' ? -1 : 0;
+		CHECK(depth >= 0);
+	}
+	CHECK(depth == 0 && json.front() == '{');
+
+	const GpuMemoryStatistics gpu = { .budgetBytes = 4096, .usageBytes = 1024, .blockBytes = 512, .allocationBytes = 256, .blockCount = 2, .allocationCount = 9 };
+	const std::string gpuJson = tracker.ToJson(&gpu);
+	CHECK(gpuJson.find("\"gpu\": { \"budget_bytes\": 4096, \"usage_bytes\": 1024, \"block_bytes\": 512, \"allocation_bytes\": 256, \"block_count\": 2, \"allocation_count\": 9 }") != std::string::npos);
+	CHECK(gpuJson.rfind("}\n") == gpuJson.size() - 2);
+}
+
+// an add and a remove, on one thread and on all of them sharing a category or each on its own
+static void BenchmarkCounting()
+{
+	constexpr uint32_t COUNT = 10000000;
+	const uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	MemoryTracker tracker;
+	auto run = [&](uint32_t threads, bool isShared) {
+		return MeasureMilliseconds(3, [&]() {
+			std::vector<std::thread> workers;
+			for (uint32_t thread = 0; thread < threads; thread++)
+			{
+				workers.emplace_back([&, thread]() {
+					const MemoryCategory category = static_cast<MemoryCategory>(isShared ? 0 : thread % static_cast<uint32_t>(MemoryCategory::Count));
+					for (uint32_t i = 0; i < COUNT / threads; i++)
+					{
+						tracker.Add(category, 64);
+						tracker.Remove(category, 64);
+					}
+				});
+			}
+			for (std::thread& worker : workers)
+				worker.join();
+		}) * 1e6 / COUNT;
+	};
+	std::printf("add and remove: %.1f ns on one thread, %.1f ns on %u threads sharing a category, %.1f ns on their own\n",
+		run(1, true), run(threadCount, true), threadCount, run(threadCount, false));
+}
+
+int main(int argc, char** argv)
+{
+	TestCounters();
+	TestConcurrentThreads();
+	TestTrackedMemory();
+	TestArenaBlocks();
+	TestJson();
+	if (IsBenchmarkRun(argc, argv))
+		BenchmarkCounting();
+	return GetTestResult();
+}
@@ -0,0 +1,319 @@
+#include "Test.h"
+#include "NullCommandList.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// the null backend only ever looks at the addresses, the objects behind them never exist
+static uint64_t gObjects[16];
+static Resource* const VOLUME = reinterpret_cast<Resource*>(&gObjects[0]);
+static Resource* const UPLOAD = reinterpret_cast<Resource*>(&gObjects[1]);
+static Resource* const CONSTANTS = reinterpret_cast<Resource*>(&gObjects[2]);
+static TextureResource* const BACK_BUFFER = reinterpret_cast<TextureResource*>(&gObjects[3]);
+static TextureResource* const DEPTH = reinterpret_cast<TextureResource*>(&gObjects[4]);
+static ID3D12RootSignature* const ROOT_SIGNATURE = reinterpret_cast<ID3D12RootSignature*>(&gObjects[5]);
+static ID3D12PipelineState* const PIPELINE_STATE = reinterpret_cast<ID3D12PipelineState*>(&gObjects[6]);
+
+static constexpr uint32_t RESOURCE_STATE_ALL_SHADER_RESOURCE = 0x40 | 0x80;
+static constexpr uint32_t RESOURCE_STATE_GENERIC_READ = 0x1 | 0x2 | 0x40 | 0x80 | 0x200 | 0x800;
+
+static Resource* AsResource(TextureResource* texture)
+{
+	return reinterpret_cast<Resource*>(texture);
+}
+
+// binds everything a draw needs to the back buffer and the depth buffer
+static void BindPipeline(NullCommandList& commandList)
+{
+	TextureResource* const renderTargets[] = { BACK_BUFFER };
+	commandList.SetDescriptorHeaps();
+	commandList.SetRenderTargets(1, renderTargets, DEPTH);
+	commandList.SetRootSignature(ROOT_SIGNATURE);
+	commandList.SetPipelineState(PIPELINE_STATE);
+	commandList.SetRootConstantBuffer(0, CONSTANTS);
+	commandList.SetViewport({ .width = 640.0f, .height = 480.0f });
+	commandList.SetScissorRect({ .right = 640, .bottom = 480 });
+	commandList.SetPrimitiveTopology(PrimitiveTopology::TriangleList);
+}
+
+// A frame the way the renderer records one: a slab upload into the volume, the back buffer into render
+// target state and back, two draws. Nothing in it is wrong and every command is counted.
+static void TestValidFrame()
+{
+	NullCommandList commandList;
+	commandList.BeginFrame();
+
+	const TransitionBarrier toCopy[] = { { VOLUME, RESOURCE_STATE_ALL_SHADER_RESOURCE, RESOURCE_STATE_COPY_DEST } };
+	commandList.ResourceBarrier(1, toCopy);
+	const BufferFootprint footprint = { .offset = 1024, .width = 200, .height = 180, .depth = 16, .rowPitch = 256 };
+	const CopyBox box = { .right = 200, .bottom = 180, .back = 16 };
+	commandList.CopyBufferToTexture(VOLUME, 0, 0, 32, UPLOAD, footprint, &box);
+	commandList.CopyBufferRegion(CONSTANTS, 0, UPLOAD, 0, 256);
+	const TransitionBarrier toRead[] = {
+		{ VOLUME, RESOURCE_STATE_COPY_DEST, RESOURCE_STATE_ALL_SHADER_RESOURCE },
+		{ AsResource(BACK_BUFFER), RESOURCE_STATE_COMMON, RESOURCE_STATE_RENDER_TARGET } };
+	commandList.ResourceBarrier(2, toRead);
+
+	const float color[4] = {};
+	commandList.ClearRenderTarget(BACK_BUFFER, color);
+	commandList.ClearDepth(DEPTH, 1.0f);
+	BindPipeline(commandList);
+	commandList.Draw(36, 1, 0, 0);
+	commandList.Draw(1200, 1, 36, 0);
+
+	const TransitionBarrier toPresent[] = { { AsResource(BACK_BUFFER), RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_COMMON } };
+	commandList.ResourceBarrier(1, toPresent);
+
+	CHECK(commandList.GetErrors().empty());
+	const CommandCounts& counts = commandList.GetCounts();
+	CHECK(counts.barriers == 4);
+	CHECK(counts.copies == 2 && counts.copiedBytes == 256ull * 180 * 16 + 256);
+	CHECK(counts.clears == 2);
+	CHECK(counts.stateChanges == 8);
+	CHECK(counts.draws == 2);
+}
+
+// Every rule on its own, each mistake gives exactly one error that names the command. A buffer in
+// GENERIC_READ is a copy source as well, so reading from it is fine.
+static void TestErrors()
+{
+	TextureResource* const renderTargets[] = { BACK_BUFFER };
+	TextureResource* const tooManyRenderTargets[9] = {};
+	const TransitionBarrier toCopyDest[] = { { VOLUME, RESOURCE_STATE_COMMON, RESOURCE_STATE_COPY_DEST } };
+	const TransitionBarrier uploadToRead[] = { { UPLOAD, RESOURCE_STATE_COMMON, RESOURCE_STATE_GENERIC_READ } };
+	const BufferFootprint footprint = { .width = 64, .height = 64, .depth = 1, .rowPitch = 256 };
+	const float color[4] = {};
+
+	const struct {
+		const char* command;
+		std::function<void(NullCommandList&)> record;
+	} cases[] = {
+		{ "ResourceBarrier", [&](NullCommandList& list) { list.ResourceBarrier(0, toCopyDest); } },
+		{ "ResourceBarrier", [&](NullCommandList& list) {
+			const TransitionBarrier barrier = { nullptr, RESOURCE_STATE_COMMON, RESOURCE_STATE_COPY_DEST };
+			list.ResourceBarrier(1, &barrier);
+		} },
+		{ "ResourceBarrier", [&](NullCommandList& list) {
+			const TransitionBarrier barrier = { VOLUME, RESOURCE_STATE_COPY_DEST, RESOURCE_STATE_COPY_DEST };
+			list.ResourceBarrier(1, &barrier);
+		} },
+		{ "ResourceBarrier", [&](NullCommandList& list) {
+			const TransitionBarrier barriers[] = {
+				{ VOLUME, RESOURCE_STATE_COMMON, RESOURCE_STATE_COPY_DEST },
+				{ VOLUME, RESOURCE_STATE_COPY_SOURCE, RESOURCE_STATE_COMMON } };
+			list.ResourceBarrier(2, barriers);
+		} },
+		{ "CopyBufferRegion", [&](NullCommandList& list) { list.CopyBufferRegion(CONSTANTS, 0, UPLOAD, 0, 0); } },
+		{ "CopyBufferRegion", [&](NullCommandList& list) {
+			list.ResourceBarrier(1, toCopyDest);
+			list.CopyBufferRegion(UPLOAD, 0, VOLUME, 0, 64);
+		} },
+		{ "CopyBufferToTexture", [&](NullCommandList& list) {
+			BufferFootprint unaligned = footprint;
+			unaligned.rowPitch = 192;
+			list.CopyBufferToTexture(VOLUME, 0, 0, 0, UPLOAD, unaligned);
+		} },
+		{ "CopyBufferToTexture", [&](NullCommandList& list) {
+			BufferFootprint unaligned = footprint;
+			unaligned.offset = 256;
+			list.CopyBufferToTexture(VOLUME, 0, 0, 0, UPLOAD, unaligned);
+		} },
+		{ "CopyBufferToTexture", [&](NullCommandList& list) {
+			const CopyBox box = { .right = 64, .bottom = 65, .back = 1 };
+			list.CopyBufferToTexture(VOLUME, 0, 0, 0, UPLOAD, footprint, &box);
+		} },
+		{ "CopyBufferToTexture", [&](NullCommandList& list) {
+			BufferFootprint empty = footprint;
+			empty.depth = 0;
+			list.CopyBufferToTexture(VOLUME, 0, 0, 0, UPLOAD, empty);
+		} },
+		{ "CopyBufferToTexture", [&](NullCommandList& list) {
+			list.ResourceBarrier(1, uploadToRead);
+			const TransitionBarrier toShader[] = { { VOLUME, RESOURCE_STATE_COMMON, RESOURCE_STATE_ALL_SHADER_RESOURCE } };
+			list.ResourceBarrier(1, toShader);
+			list.CopyBufferToTexture(VOLUME, 0, 0, 0, UPLOAD, footprint);
+		} },
+		{ "CopyTextureToBuffer", [&](NullCommandList& list) {
+			BufferFootprint unaligned = footprint;
+			unaligned.rowPitch = 100;
+			list.CopyTextureToBuffer(UPLOAD, unaligned, VOLUME);
+		} },
+		{ "ClearRenderTarget", [&](NullCommandList& list) {
+			const TransitionBarrier toRead[] = { { AsResource(BACK_BUFFER), RESOURCE_STATE_COMMON, RESOURCE_STATE_ALL_SHADER_RESOURCE } };
+			list.ResourceBarrier(1, toRead);
+			list.ClearRenderTarget(BACK_BUFFER, color);
+		} },
+		{ "ClearDepth", [&](NullCommandList& list) { list.ClearDepth(DEPTH, 1.5f); } },
+		{ "SetRenderTargets", [&](NullCommandList& list) { list.SetRenderTargets(9, tooManyRenderTargets, nullptr); } },
+		{ "SetRootSignature", [&](NullCommandList& list) { list.SetRootSignature(nullptr); } },
+		{ "SetPipelineState", [&](NullCommandList& list) { list.SetPipelineState(nullptr); } },
+		{ "SetRootConstantBuffer", [&](NullCommandList& list) { list.SetRootConstantBuffer(0, CONSTANTS); } },
+		{ "SetRootConstantBuffer", [&](NullCommandList& list) {
+			list.SetRootSignature(ROOT_SIGNATURE);
+			list.SetRootConstantBuffer(0, nullptr);
+		} },
+		{ "SetViewport", [&](NullCommandList& list) { list.SetViewport({ .width = 640.0f, .height = 0.0f }); } },
+		{ "SetViewport", [&](NullCommandList& list) { list.SetViewport({ .width = 640.0f, .height = 480.0f, .minDepth = 1.0f, .maxDepth = 0.0f }); } },
+		{ "SetScissorRect", [&](NullCommandList& list) { list.SetScissorRect({ .left = 10, .right = 10, .bottom = 480 }); } },
+		{ "Draw", [&](NullCommandList& list) {
+			BindPipeline(list);
+			list.Draw(0, 1, 0, 0);
+		} },
+		{ "Draw", [&](NullCommandList& list) {
+			BindPipeline(list);
+			list.SetPipelineState(PIPELINE_STATE);
+			list.SetRenderTargets(1, renderTargets, nullptr);
+			list.Draw(3, 0, 0, 0);
+		} },
+		{ "Draw", [&](NullCommandList& list) {
+			list.SetDescriptorHeaps();
+			list.SetRootSignature(ROOT_SIGNATURE);
+			list.SetPipelineState(PIPELINE_STATE);
+			list.SetRenderTargets(1, renderTargets, DEPTH);
+			list.SetViewport({ .width = 640.0f, .height = 480.0f });
+			list.Draw(3, 1, 0, 0);
+		} },
+		{ "Draw", [&](NullCommandList& list) {
+			list.SetRootSignature(ROOT_SIGNATURE);
+			list.SetPipelineState(PIPELINE_STATE);
+			list.SetRenderTargets(1, renderTargets, DEPTH);
+			list.SetViewport({ .width = 640.0f, .height = 480.0f });
+			list.SetScissorRect({ .right = 640, .bottom = 480 });
+			list.Draw(3, 1, 0, 0);
+		} },
+		{ "Draw", [&](NullCommandList& list) {
+			const TransitionBarrier toRead[] = { { AsResource(DEPTH), RESOURCE_STATE_COMMON, RESOURCE_STATE_ALL_SHADER_RESOURCE } };
+			list.ResourceBarrier(1, toRead);
+			BindPipeline(list);
+			list.Draw(3, 1, 0, 0);
+		} },
+	};
+	for (const auto& test : cases)
+	{
+		NullCommandList commandList;
+		commandList.BeginFrame();
+		test.record(commandList);
+		const std::vector<std::string>& errors = commandList.GetErrors();
+		CHECK(errors.size() == 1 && errors[0].rfind(std::string(test.command) + ": ", 0) == 0);
+	}
+
+	// reading from an upload buffer in GENERIC_READ, and from resources that had no barrier this frame
+	NullCommandList commandList;
+	commandList.BeginFrame();
+	commandList.ResourceBarrier(1, uploadToRead);
+	commandList.ResourceBarrier(1, toCopyDest);
+	commandList.CopyBufferToTexture(VOLUME, 0, 0, 0, UPLOAD, footprint);
+	commandList.CopyBufferRegion(CONSTANTS, 0, reinterpret_cast<Resource*>(&gObjects[7]), 0, 64);
+	CHECK(commandList.GetErrors().empty());
+}
+
+// A new frame forgets the states and bindings of the last one but keeps its errors, and a frame that
+// goes wrong everywhere stops adding errors at some point.
+static void TestBeginFrame()
+{
+	NullCommandList commandList;
+	commandList.BeginFrame();
+	const TransitionBarrier toCopyDest[] = { { VOLUME, RESOURCE_STATE_COMMON, RESOURCE_STATE_COPY_DEST } };
+	commandList.ResourceBarrier(1, toCopyDest);
+	BindPipeline(commandList);
+	commandList.Draw(3, 1, 0, 0);
+	commandList.ClearDepth(DEPTH, -1.0f);
+	CHECK(commandList.GetErrors().size() == 1);
+
+	commandList.BeginFrame();
+	CHECK(commandList.GetCounts().barriers == 0 && commandList.GetCounts().draws == 0 && commandList.GetCounts().stateChanges == 0);
+	commandList.ResourceBarrier(1, toCopyDest);
+	CHECK(commandList.GetErrors().size() == 1);
+	commandList.Draw(3, 1, 0, 0);
+	CHECK(commandList.GetErrors().size() == 3);
+
+	for (uint32_t i = 0; i < 1000; i++)
+		commandList.ClearDepth(DEPTH, 2.0f);
+	CHECK(commandList.GetErrors().size() == 256);
+	CHECK(commandList.GetCounts().clears == 1000);
+
+	// every binding a draw needs has to be made again in the next frame
+	TextureResource* const renderTargets[] = { BACK_BUFFER };
+	const std::function<void(NullCommandList&)> bindings[] = {
+		[](NullCommandList& list) { list.SetDescriptorHeaps(); },
+		[](NullCommandList& list) { list.SetRootSignature(ROOT_SIGNATURE); },
+		[](NullCommandList& list) { list.SetPipelineState(PIPELINE_STATE); },
+		[](NullCommandList& list) { list.SetViewport({ .width = 640.0f, .height = 480.0f }); },
+		[](NullCommandList& list) { list.SetScissorRect({ .right = 640, .bottom = 480 }); },
+		[&](NullCommandList& list) { list.SetRenderTargets(1, renderTargets, nullptr); },
+	};
+	for (size_t skipped = 0; skipped < std::size(bindings); skipped++)
+	{
+		NullCommandList bindingList;
+		bindingList.BeginFrame();
+		for (const auto& bind : bindings)
+			bind(bindingList);
+		bindingList.Draw(3, 1, 0, 0);
+		bindingList.BeginFrame();
+		for (size_t binding = 0; binding < std::size(bindings); binding++)
+		{
+			if (binding != skipped)
+				bindings[binding](bindingList);
+		}
+		bindingList.Draw(3, 1, 0, 0);
+		CHECK(bindingList.GetErrors().size() == 1);
+	}
+}
+
+// A frame shaped like a heavy one of the renderer: 64 bricks uploaded with a barrier pair each, the
+// per-pass bindings and draws of ten passes. What recording costs when nothing reaches a GPU.
+static void BenchmarkFrame()
+{
+	NullCommandList commandList;
+	std::vector<uint64_t> brickObjects(64);
+	std::vector<Resource*> bricks;
+	for (uint64_t& brick : brickObjects)
+		bricks.push_back(reinterpret_cast<Resource*>(&brick));
+
+	const uint32_t frameCount = 10000;
+	uint32_t commandCount = 0;
+	const double milliseconds = MeasureMilliseconds(3, [&]() {
+		for (uint32_t frame = 0; frame < frameCount; frame++)
+		{
+			commandList.BeginFrame();
+			std::vector<TransitionBarrier> barriers;
+			for (Resource* brick : bricks)
+				barriers.push_back({ brick, RESOURCE_STATE_ALL_SHADER_RESOURCE, RESOURCE_STATE_COPY_DEST });
+			commandList.ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+			for (Resource* brick : bricks)
+				commandList.CopyBufferToTexture(brick, 0, 0, 0, UPLOAD, { .width = 16, .height = 16, .depth = 16, .rowPitch = 256 });
+			for (TransitionBarrier& barrier : barriers)
+				std::swap(barrier.stateBefore, barrier.stateAfter);
+			commandList.ResourceBarrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+
+			const float color[4] = {};
+			const TransitionBarrier toRenderTarget[] = { { AsResource(BACK_BUFFER), RESOURCE_STATE_COMMON, RESOURCE_STATE_RENDER_TARGET } };
+			commandList.ResourceBarrier(1, toRenderTarget);
+			commandList.ClearRenderTarget(BACK_BUFFER, color);
+			commandList.ClearDepth(DEPTH, 1.0f);
+			for (uint32_t pass = 0; pass < 10; pass++)
+			{
+				BindPipeline(commandList);
+				commandList.Draw(36, 1, 0, 0);
+			}
+			const TransitionBarrier toPresent[] = { { AsResource(BACK_BUFFER), RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_COMMON } };
+			commandList.ResourceBarrier(1, toPresent);
+		}
+		const CommandCounts& counts = commandList.GetCounts();
+		commandCount = counts.barriers + counts.copies + counts.clears + counts.stateChanges + counts.draws;
+	});
+	CHECK(commandList.GetErrors().empty());
+	std::printf("%u commands a frame\n", commandCount);
+	std::printf("%.2f us a frame, %.1f ns a command\n", milliseconds * 1000.0 / frameCount, milliseconds * 1e6 / (static_cast<double>(frameCount) * commandCount));
+}
+
+int main(int argc, char** argv)
+{
+	TestValidFrame();
+	TestErrors();
+	TestBeginFrame();
+	if (IsBenchmarkRun(argc, argv))
+		BenchmarkFrame();
+	return GetTestResult();
+}
@@ -0,0 +1,293 @@
+#include "Test.h"
+#include "ProgressiveLoader.h"
+#include "ThreadPool.h"
+
+#include <fstream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+static const std::filesystem::path OUTPUT_DIRECTORY = std::filesystem::temp_directory_path() / "ProgressiveLoaderTest";
+
+// what the reader did so far, shared with the loader thread
+struct ReadLog {
+	std::atomic<uint64_t> bytes = 0;
+	uint64_t failAfterBytes = UINT64_MAX;
+	double bytesPerMillisecond = 0.0; // 0 reads as fast as memory allows
+};
+
+// Reads out of memory, at most as fast as a disk that delivers bytesPerMillisecond. The reader sleeps
+// until the bytes so far would have arrived, so short row reads don't each pay for a whole sleep.
+static ProgressiveLoader::ReadFunction GetReader(const std::vector<uint8_t>& source, std::shared_ptr<ReadLog> log)
+{
+	return [&source, log, start = std::optional<std::chrono::steady_clock::time_point>()](uint64_t offset, uint8_t* destination, uint64_t size) mutable {
+		if (offset + size > source.size() || log->bytes + size > log->failAfterBytes)
+			return false;
+		memcpy(destination, source.data() + offset, size);
+		log->bytes += size;
+
+		if (log->bytesPerMillisecond > 0.0)
+		{
+			if (!start)
+				start = std::chrono::steady_clock::now();
+			std::this_thread::sleep_until(*start + std::chrono::microseconds(static_cast<int64_t>(log->bytes * 1000.0 / log->bytesPerMillisecond)));
+		}
+		return true;
+	};
+}
+
+static std::vector<uint8_t> GetSource(const VolumeDimensions& dimensions)
+{
+	std::mt19937 random(dimensions.width);
+	std::vector<uint8_t> source(dimensions.GetVoxelCount());
+	for (uint8_t& voxel : source)
+		voxel = static_cast<uint8_t>(random());
+	return source;
+}
+
+// every stride-th voxel of every stride-th row of every stride-th slice
+static bool IsLevelOf(const VolumeLevel& level, const std::vector<uint8_t>& source, const VolumeDimensions& dimensions)
+{
+	if (level.dimensions.width != (dimensions.width + level.stride - 1) / level.stride ||
+		level.dimensions.height != (dimensions.height + level.stride - 1) / level.stride ||
+		level.dimensions.depth != (dimensions.depth + level.stride - 1) / level.stride ||
+		level.data.size() != level.dimensions.GetVoxelCount())
+	{
+		return false;
+	}
+
+	for (uint32_t z = 0; z < level.dimensions.depth; z++)
+		for (uint32_t y = 0; y < level.dimensions.height; y++)
+			for (uint32_t x = 0; x < level.dimensions.width; x++)
+			{
+				if (level.data[level.dimensions.GetIndex(x, y, z)] != source[dimensions.GetIndex(x * level.stride, y * level.stride, z * level.stride)])
+					return false;
+			}
+	return true;
+}
+
+// Takes levels as the renderer does, once a frame, until the full resolution one is in. A load that doesn't
+// get there within a few seconds ends in an empty level, so the checks fail instead of hanging.
+static std::vector<VolumeLevel> TakeLevelsUntilFull(ProgressiveLoader& loader)
+{
+	std::vector<VolumeLevel> levels;
+	for (uint32_t i = 0; i < 5000 && (levels.empty() || levels.back().stride != 1); i++)
+	{
+		if (std::optional<VolumeLevel> level = loader.TakeLevel())
+			levels.push_back(std::move(*level));
+		else
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	if (levels.empty() || levels.back().stride != 1)
+		levels.emplace_back();
+	return levels;
+}
+
+static bool WaitForFinished(const ProgressiveLoader& loader)
+{
+	for (uint32_t i = 0; i < 5000 && !loader.IsFinished(); i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	return loader.IsFinished();
+}
+
+// Every level on its way from the coarsest to the full resolution, each holding the voxels of its stride.
+// The preview stays within its read budget and the full resolution slabs arrive in order.
+static void TestLevels()
+{
+	const VolumeDimensions dimensions = { 70, 45, 33 };
+	const std::vector<uint8_t> source = GetSource(dimensions);
+	const struct {
+		uint64_t budget;
+		std::vector<uint32_t> strides;
+	} cases[] = {
+		{ 4000, { 8, 4, 2, 1 } },
+		{ 1, { 128, 64, 32, 16, 8, 4, 2, 1 } },
+		{ 103950, { 1 } },
+		{ 103949, { 2, 1 } },
+	};
+	for (const auto& test : cases)
+	{
+		std::shared_ptr<ReadLog> log = std::make_shared<ReadLog>();
+		ProgressiveLoader loader(GetReader(source, log), dimensions, test.budget);
+		CHECK(loader.GetPreviewStride() == test.strides.front());
+
+		std::vector<uint32_t> strides;
+		bool isEveryLevelRight = true;
+		uint64_t previewBytes = 0;
+		loader.SetLevelFunction([&](VolumeLevel& level) {
+			if (strides.empty())
+				previewBytes = log->bytes;
+			strides.push_back(level.stride);
+			isEveryLevelRight &= IsLevelOf(level, source, dimensions);
+		});
+
+		uint32_t nextSlice = 0;
+		bool areSlabsRight = true;
+		loader.SetFullResolutionSlabFunction([&](const uint8_t* slices, uint32_t firstSlice, uint32_t sliceCount) {
+			const size_t sliceSize = static_cast<size_t>(dimensions.width) * dimensions.height;
+			areSlabsRight &= firstSlice == nextSlice && (sliceCount == BRICK_SIZE || firstSlice + sliceCount == dimensions.depth);
+			areSlabsRight &= std::equal(slices, slices + sliceCount * sliceSize, source.begin() + firstSlice * sliceSize);
+			nextSlice = firstSlice + sliceCount;
+		});
+
+		loader.Start();
+		const std::vector<VolumeLevel> levels = TakeLevelsUntilFull(loader);
+		CHECK(WaitForFinished(loader));
+		CHECK(strides == test.strides);
+		CHECK(isEveryLevelRight);
+		CHECK(previewBytes <= std::max<uint64_t>(test.budget, dimensions.width));
+		CHECK(areSlabsRight && nextSlice == dimensions.depth);
+		CHECK(std::equal(levels.back().data.begin(), levels.back().data.end(), source.begin(), source.end()));
+		for (size_t i = 1; i < levels.size(); i++)
+			CHECK(levels[i].stride < levels[i - 1].stride && levels[i].loadMilliseconds >= levels[i - 1].loadMilliseconds);
+	}
+}
+
+// On a slow disk the preview is there long before the full resolution, the levels in between come in
+// coarse to fine whatever the renderer happens to take.
+static void TestCoarseFirst()
+{
+	const VolumeDimensions dimensions = { 128, 128, 64 };
+	const std::vector<uint8_t> source = GetSource(dimensions);
+	std::shared_ptr<ReadLog> log = std::make_shared<ReadLog>();
+	log->bytesPerMillisecond = 4096.0;
+	ProgressiveLoader loader(GetReader(source, log), dimensions, 16384);
+	CHECK(loader.GetPreviewStride() == 8);
+	loader.Start();
+
+	const VolumeLevel preview = loader.WaitForLevel();
+	CHECK(preview.stride == 8);
+	CHECK(IsLevelOf(preview, source, dimensions));
+	CHECK(log->bytes < source.size() / 4);
+
+	const std::vector<VolumeLevel> levels = TakeLevelsUntilFull(loader);
+	CHECK(levels.front().stride < preview.stride);
+	for (size_t i = 1; i < levels.size(); i++)
+		CHECK(levels[i].stride < levels[i - 1].stride);
+	CHECK(IsLevelOf(levels.back(), source, dimensions));
+	CHECK(preview.loadMilliseconds * 10.0f < levels.back().loadMilliseconds);
+	CHECK(WaitForFinished(loader));
+}
+
+// Dropping the loader halfway through a level stops reading within a slice, whether it's in the preview,
+// in between or in the full resolution level, and no level is handed over after that.
+static void TestShutdown()
+{
+	const VolumeDimensions dimensions = { 128, 128, 64 };
+	const std::vector<uint8_t> source = GetSource(dimensions);
+	const struct {
+		uint32_t levels;
+		uint32_t slabs;
+	} shutdowns[] = { { 0, 0 }, { 2, 0 }, { 3, 1 }, { 3, 3 } };
+	for (const auto& shutdown : shutdowns)
+	{
+		std::shared_ptr<ReadLog> log = std::make_shared<ReadLog>();
+		log->bytesPerMillisecond = 4096.0;
+		std::unique_ptr<ProgressiveLoader> loader = std::make_unique<ProgressiveLoader>(GetReader(source, log), dimensions, 16384);
+		std::atomic<uint32_t> levelCount = 0;
+		std::atomic<uint32_t> slabCount = 0;
+		loader->SetLevelFunction([&](VolumeLevel&) { levelCount++; });
+		loader->SetFullResolutionSlabFunction([&](const uint8_t*, uint32_t, uint32_t) { slabCount++; });
+		loader->Start();
+
+		// right away before the preview is read, in the 64 ms of stride 2 or in the full resolution level
+		while (levelCount < shutdown.levels || slabCount < shutdown.slabs)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		const double milliseconds = MeasureMilliseconds(1, [&]() { loader.reset(); });
+		const uint64_t bytes = log->bytes;
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+		// a full resolution slice takes 4 ms to read, the levels before it read 16384 + 65536 + 262144 bytes
+		CHECK(milliseconds < 20.0);
+		CHECK(log->bytes == bytes && bytes < 16384 + 65536 + 262144 + source.size());
+		CHECK(shutdown.levels == 0 ? levelCount <= 1 : levelCount == shutdown.levels);
+		CHECK(slabCount == shutdown.slabs || slabCount == shutdown.slabs + 1);
+	}
+
+	// a loader that never started goes down as well
+	const std::vector<uint8_t> empty;
+	ProgressiveLoader loader(GetReader(empty, std::make_shared<ReadLog>()), dimensions, 16384);
+}
+
+// a read that fails in the full resolution level leaves the coarser levels and finishes the load
+static void TestReadFailure()
+{
+	const VolumeDimensions dimensions = { 70, 45, 33 };
+	const std::vector<uint8_t> source = GetSource(dimensions);
+	std::shared_ptr<ReadLog> log = std::make_shared<ReadLog>();
+	log->failAfterBytes = 60000;
+	ProgressiveLoader loader(GetReader(source, log), dimensions, 4000);
+	uint32_t slabCount = 0;
+	loader.SetFullResolutionSlabFunction([&](const uint8_t*, uint32_t, uint32_t) { slabCount++; });
+	loader.Start();
+
+	std::optional<VolumeLevel> lastLevel;
+	for (uint32_t i = 0; i < 5000 && !loader.IsFinished(); i++)
+	{
+		if (std::optional<VolumeLevel> level = loader.TakeLevel())
+			lastLevel = std::move(level);
+		else
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	CHECK(loader.IsFinished());
+	CHECK(lastLevel && lastLevel->stride == 2 && IsLevelOf(*lastLevel, source, dimensions));
+	CHECK(!loader.TakeLevel());
+	CHECK(slabCount == 0);
+}
+
+// the volume after a header in a file, read through the mapping
+static void TestReadFromFile()
+{
+	const VolumeDimensions dimensions = { 70, 45, 33 };
+	const std::vector<uint8_t> source = GetSource(dimensions);
+	const std::filesystem::path path = OUTPUT_DIRECTORY / "volume.raw";
+	{
+		std::ofstream file(path, std::ios::binary);
+		const std::vector<uint8_t> header(100, 0xAB);
+		file.write(reinterpret_cast<const char*>(header.data()), header.size());
+		file.write(reinterpret_cast<const char*>(source.data()), source.size());
+	}
+
+	ProgressiveLoader loader(ProgressiveLoader::ReadFromFile(path, 100), dimensions, 4000);
+	loader.Start();
+	const std::vector<VolumeLevel> levels = TakeLevelsUntilFull(loader);
+	CHECK(levels.front().stride <= 8);
+	CHECK(IsLevelOf(levels.back(), source, dimensions));
+	CHECK(WaitForFinished(loader));
+}
+
+// A 512x512x256 volume from a disk that reads 500 MB/s, with the budget the viewer uses. How long until
+// there is something on the screen, and until the volume is complete.
+static void BenchmarkLoad()
+{
+	const VolumeDimensions dimensions = { 512, 512, 256 };
+	const std::vector<uint8_t> source = GetSource(dimensions);
+	std::shared_ptr<ReadLog> log = std::make_shared<ReadLog>();
+	log->bytesPerMillisecond = 500.0 * 1000.0;
+	ProgressiveLoader loader(GetReader(source, log), dimensions, 1024 * 1024);
+	std::vector<VolumeLevel> levels;
+	const double milliseconds = MeasureMilliseconds(1, [&]() {
+		loader.Start();
+		levels = TakeLevelsUntilFull(loader);
+	});
+	std::printf("512x512x256 at 500 MB/s, %u threads, preview stride %u\n", ThreadPool::Get().GetThreadCount(), loader.GetPreviewStride());
+	for (const VolumeLevel& level : levels)
+		std::printf("stride %2u after %7.2f ms\n", level.stride, level.loadMilliseconds);
+	std::printf("full resolution taken after %.2f ms, %.1f MB read in all\n", milliseconds, log->bytes / 1e6);
+}
+
+int main(int argc, char** argv)
+{
+	std::filesystem::create_directories(OUTPUT_DIRECTORY);
+	TestLevels();
+	TestCoarseFirst();
+	TestShutdown();
+	TestReadFailure();
+	TestReadFromFile();
+	if (IsBenchmarkRun(argc, argv))
+		BenchmarkLoad();
+	std::filesystem::remove_all(OUTPUT_DIRECTORY);
+	return GetTestResult();
+}
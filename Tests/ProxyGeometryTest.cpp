@@ -0,0 +1,268 @@
+#include "Test.h"
+#include "ProxyGeometry.h"
+#include "MinMaxGrid.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+static float GetAxis(const Float3& v, uint32_t axis)
+{
+	return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+// brick boundary in object space the way the proxy places it, the last brick may be partial
+static float GetPlane(const VolumeDimensions& dimensions, uint32_t axis, uint32_t brickBoundary)
+{
+	const uint32_t size = axis == 0 ? dimensions.width : (axis == 1 ? dimensions.height : dimensions.depth);
+	return static_cast<float>(std::min(brickBoundary * BRICK_SIZE, size)) / size * 2.0f - 1.0f;
+}
+
+// one merged rectangle of the proxy, always written as six vertices in one plane
+struct ProxyRectangle {
+	uint32_t axis = 0;
+	float plane = 0.0f;
+	Float3 min{};
+	Float3 max{};
+};
+
+static std::vector<ProxyRectangle> GetRectangles(const ProxyMesh& mesh)
+{
+	std::vector<ProxyRectangle> rectangles;
+	for (size_t first = 0; first + 6 <= mesh.vertices.size(); first += 6)
+	{
+		ProxyRectangle rectangle{ .min = mesh.vertices[first], .max = mesh.vertices[first] };
+		for (size_t i = first + 1; i < first + 6; i++)
+		{
+			const Float3& v = mesh.vertices[i];
+			rectangle.min = { std::min(rectangle.min.x, v.x), std::min(rectangle.min.y, v.y), std::min(rectangle.min.z, v.z) };
+			rectangle.max = { std::max(rectangle.max.x, v.x), std::max(rectangle.max.y, v.y), std::max(rectangle.max.z, v.z) };
+		}
+		while (rectangle.axis < 3 && GetAxis(rectangle.min, rectangle.axis) != GetAxis(rectangle.max, rectangle.axis))
+			rectangle.axis++;
+		rectangle.plane = rectangle.axis < 3 ? GetAxis(rectangle.min, rectangle.axis) : 0.0f;
+		rectangles.push_back(rectangle);
+	}
+	return rectangles;
+}
+
+// a point is inside a closed surface when a ray from it crosses the surface an odd number of times, on every axis
+static bool IsInside(const std::vector<ProxyRectangle>& rectangles, const Float3& point)
+{
+	bool isInside = true;
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		const uint32_t u = (axis + 1) % 3;
+		const uint32_t v = (axis + 2) % 3;
+		uint32_t crossings = 0;
+		for (const ProxyRectangle& rectangle : rectangles)
+		{
+			crossings += rectangle.axis == axis && rectangle.plane > GetAxis(point, axis) &&
+				GetAxis(rectangle.min, u) < GetAxis(point, u) && GetAxis(point, u) < GetAxis(rectangle.max, u) &&
+				GetAxis(rectangle.min, v) < GetAxis(point, v) && GetAxis(point, v) < GetAxis(rectangle.max, v);
+		}
+		isInside &= crossings % 2 == 1;
+	}
+	return isInside;
+}
+
+// signed volume of the triangles, positive or negative depending on the winding
+static double GetSignedVolume(const ProxyMesh& mesh)
+{
+	double volume = 0.0;
+	for (size_t i = 0; i + 3 <= mesh.vertices.size(); i += 3)
+	{
+		const Float3& a = mesh.vertices[i];
+		const Float3& b = mesh.vertices[i + 1];
+		const Float3& c = mesh.vertices[i + 2];
+		volume += (static_cast<double>(a.x) * (b.y * c.z - b.z * c.y) + a.y * (b.z * c.x - b.x * c.z) + a.z * (b.x * c.y - b.y * c.x)) / 6.0;
+	}
+	return volume;
+}
+
+// a bright voxel in the middle of every chosen brick, nothing else
+static std::vector<uint8_t> GetVolume(const VolumeDimensions& dimensions, const VolumeDimensions& bricks, const std::vector<uint8_t>& isChosen)
+{
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount(), 10);
+	for (uint32_t z = 0; z < bricks.depth; z++)
+		for (uint32_t y = 0; y < bricks.height; y++)
+			for (uint32_t x = 0; x < bricks.width; x++)
+			{
+				if (!isChosen[bricks.GetIndex(x, y, z)])
+					continue;
+				const uint32_t voxelX = x * BRICK_SIZE + std::min(BRICK_SIZE, dimensions.width - x * BRICK_SIZE) / 2;
+				const uint32_t voxelY = y * BRICK_SIZE + std::min(BRICK_SIZE, dimensions.height - y * BRICK_SIZE) / 2;
+				const uint32_t voxelZ = z * BRICK_SIZE + std::min(BRICK_SIZE, dimensions.depth - z * BRICK_SIZE) / 2;
+				volume[dimensions.GetIndex(voxelX, voxelY, voxelZ)] = 200;
+			}
+	return volume;
+}
+
+// Every occupied brick and every voxel above the threshold is inside the proxy, every empty brick outside
+// of it. The volume it encloses is the volume of the occupied bricks and the bounds are theirs.
+static void CheckProxy(const MinMaxGrid& grid, const VolumeDimensions& dimensions, const std::vector<uint8_t>& volume,
+	const std::vector<uint8_t>* brickMask)
+{
+	const uint8_t threshold = 100;
+	const ProxyMesh mesh = ProxyGeometry::Generate(grid, dimensions, threshold, brickMask);
+	const std::vector<ProxyRectangle> rectangles = GetRectangles(mesh);
+	CHECK(mesh.vertices.size() % 6 == 0);
+	CHECK(std::all_of(rectangles.begin(), rectangles.end(), [](const ProxyRectangle& rectangle) { return rectangle.axis < 3; }));
+
+	const VolumeDimensions& bricks = grid.GetDimensions();
+	bool isCovered = true;
+	bool isTight = true;
+	double occupiedVolume = 0.0;
+	Float3 boundsMin = { 1.0f, 1.0f, 1.0f };
+	Float3 boundsMax = { -1.0f, -1.0f, -1.0f };
+	for (uint32_t z = 0; z < bricks.depth; z++)
+		for (uint32_t y = 0; y < bricks.height; y++)
+			for (uint32_t x = 0; x < bricks.width; x++)
+			{
+				const Float3 min = { GetPlane(dimensions, 0, x), GetPlane(dimensions, 1, y), GetPlane(dimensions, 2, z) };
+				const Float3 max = { GetPlane(dimensions, 0, x + 1), GetPlane(dimensions, 1, y + 1), GetPlane(dimensions, 2, z + 1) };
+				const Float3 center = { (min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f, (min.z + max.z) * 0.5f };
+				const bool isOccupied = grid.IsOccupied(x, y, z, threshold) && (!brickMask || (*brickMask)[bricks.GetIndex(x, y, z)]);
+				if (isOccupied)
+				{
+					isCovered &= IsInside(rectangles, center);
+					occupiedVolume += static_cast<double>(max.x - min.x) * (max.y - min.y) * (max.z - min.z);
+					boundsMin = { std::min(boundsMin.x, min.x), std::min(boundsMin.y, min.y), std::min(boundsMin.z, min.z) };
+					boundsMax = { std::max(boundsMax.x, max.x), std::max(boundsMax.y, max.y), std::max(boundsMax.z, max.z) };
+				}
+				else
+				{
+					isTight &= !IsInside(rectangles, center);
+				}
+			}
+	CHECK(isCovered);
+	CHECK(isTight);
+
+	// front faces are counterclockwise seen from outside, which makes the signed volume negative
+	CHECK(std::abs(-GetSignedVolume(mesh) - occupiedVolume) < 1e-4);
+	if (occupiedVolume > 0.0)
+	{
+		CHECK(mesh.boundsMin.x == boundsMin.x && mesh.boundsMin.y == boundsMin.y && mesh.boundsMin.z == boundsMin.z);
+		CHECK(mesh.boundsMax.x == boundsMax.x && mesh.boundsMax.y == boundsMax.y && mesh.boundsMax.z == boundsMax.z);
+	}
+
+	if (brickMask)
+		return;
+	bool isEveryVoxelInside = true;
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+		for (uint32_t y = 0; y < dimensions.height; y++)
+			for (uint32_t x = 0; x < dimensions.width; x++)
+			{
+				if (volume[dimensions.GetIndex(x, y, z)] <= threshold)
+					continue;
+				const Float3 voxel = {
+					(x + 0.5f) / dimensions.width * 2.0f - 1.0f,
+					(y + 0.5f) / dimensions.height * 2.0f - 1.0f,
+					(z + 0.5f) / dimensions.depth * 2.0f - 1.0f };
+				isEveryVoxelInside &= IsInside(rectangles, voxel);
+			}
+	CHECK(isEveryVoxelInside);
+}
+
+// Random brick patterns with holes, tunnels and partial bricks at the far end of every axis, with and
+// without a mask that hides bricks.
+static void TestCoverage()
+{
+	const VolumeDimensions sizes[] = { { 70, 33, 40 }, { 64, 64, 64 }, { 16, 16, 16 }, { 100, 17, 5 } };
+	for (const VolumeDimensions& dimensions : sizes)
+	{
+		const VolumeDimensions bricks = {
+			(dimensions.width + BRICK_SIZE - 1) / BRICK_SIZE,
+			(dimensions.height + BRICK_SIZE - 1) / BRICK_SIZE,
+			(dimensions.depth + BRICK_SIZE - 1) / BRICK_SIZE };
+		for (uint32_t seed = 0; seed < 8; seed++)
+		{
+			std::mt19937 random(seed);
+			std::vector<uint8_t> isChosen(bricks.GetVoxelCount());
+			for (uint8_t& chosen : isChosen)
+				chosen = random() % 8 < 1 + seed % 7;
+			const std::vector<uint8_t> volume = GetVolume(dimensions, bricks, isChosen);
+			MinMaxGrid grid;
+			grid.Build(volume.data(), dimensions);
+			CheckProxy(grid, dimensions, volume, nullptr);
+
+			std::vector<uint8_t> mask(bricks.GetVoxelCount());
+			for (uint8_t& visible : mask)
+				visible = random() % 3 != 0;
+			CheckProxy(grid, dimensions, volume, &mask);
+		}
+	}
+}
+
+// A full grid is the unit cube in twelve triangles, an empty one has no triangles at all. Rays cross the
+// whole cube in one case and only the bricks they go through otherwise.
+static void TestExtremes()
+{
+	const VolumeDimensions dimensions = { 64, 64, 64 };
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount(), 150);
+	MinMaxGrid grid;
+	grid.Build(volume.data(), dimensions);
+	ProxyMesh mesh = ProxyGeometry::Generate(grid, dimensions, 100);
+	CHECK(mesh.vertices.size() == 36);
+	CHECK(mesh.boundsMin.x == -1.0f && mesh.boundsMin.y == -1.0f && mesh.boundsMin.z == -1.0f);
+	CHECK(mesh.boundsMax.x == 1.0f && mesh.boundsMax.y == 1.0f && mesh.boundsMax.z == 1.0f);
+	RayLengthEstimate estimate = ProxyGeometry::EstimateRayLength(grid, dimensions, 100);
+	CHECK(estimate.cubeLength == 24.0 && estimate.proxyLength == 24.0);
+
+	mesh = ProxyGeometry::Generate(grid, dimensions, 150);
+	CHECK(mesh.vertices.empty());
+	estimate = ProxyGeometry::EstimateRayLength(grid, dimensions, 150);
+	CHECK(estimate.cubeLength == 24.0 && estimate.proxyLength == 0.0);
+
+	// a single brick is a quarter of the way on every axis, the rays through it are that long
+	std::fill(volume.begin(), volume.end(), 0);
+	volume[dimensions.GetIndex(40, 20, 55)] = 200;
+	grid.Build(volume.data(), dimensions);
+	mesh = ProxyGeometry::Generate(grid, dimensions, 100);
+	CHECK(mesh.vertices.size() == 36);
+	estimate = ProxyGeometry::EstimateRayLength(grid, dimensions, 100);
+	CHECK(std::abs(estimate.proxyLength - 3 * 0.25 * 0.5) < 1e-9);
+
+	// two bricks in a row with a gap between them, the ray along the row marches over the gap
+	volume[dimensions.GetIndex(8, 20, 55)] = 200;
+	grid.Build(volume.data(), dimensions);
+	estimate = ProxyGeometry::EstimateRayLength(grid, dimensions, 100);
+	CHECK(std::abs(estimate.proxyLength - (0.25 * 1.5 + 4 * 0.25 * 0.5)) < 1e-9);
+}
+
+// A head sized blob in the air of a 512x512x256 scan. How big the proxy is against the unit cube it
+// replaces, and how long building it takes.
+static void BenchmarkProxy()
+{
+	const VolumeDimensions dimensions = { 512, 512, 256 };
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount());
+	std::mt19937 random(1);
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+		for (uint32_t y = 0; y < dimensions.height; y++)
+			for (uint32_t x = 0; x < dimensions.width; x++)
+			{
+				const float dx = (x - 256.0f) / 190.0f;
+				const float dy = (y - 270.0f) / 230.0f;
+				const float dz = (z - 110.0f) / 140.0f;
+				volume[dimensions.GetIndex(x, y, z)] = static_cast<uint8_t>(dx * dx + dy * dy + dz * dz < 1.0f ? 60 + random() % 150 : random() % 8);
+			}
+	MinMaxGrid grid;
+	grid.Build(volume.data(), dimensions);
+
+	ProxyMesh mesh;
+	const double milliseconds = MeasureMilliseconds(5, [&]() { mesh = ProxyGeometry::Generate(grid, dimensions, 10); });
+	const RayLengthEstimate estimate = ProxyGeometry::EstimateRayLength(grid, dimensions, 10);
+	std::printf("512x512x256, %u threads\n", ThreadPool::Get().GetThreadCount());
+	std::printf("proxy %zu triangles in %.2f ms, encloses %.1f%% of the unit cube, rays %.1f%% as long\n", mesh.vertices.size() / 3, milliseconds,
+		100.0 * -GetSignedVolume(mesh) / 8.0, 100.0 * estimate.proxyLength / estimate.cubeLength);
+}
+
+int main(int argc, char** argv)
+{
+	TestCoverage();
+	TestExtremes();
+	if (IsBenchmarkRun(argc, argv))
+		BenchmarkProxy();
+	return GetTestResult();
+}
@@ -0,0 +1,142 @@
+#include "Test.h"
+#include "Reslicer.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+// smooth blobs over noise, so the interpolation has gradients in every direction to get wrong
+static std::vector<uint8_t> GetVolume(const VolumeDimensions& dimensions, uint32_t seed)
+{
+	std::mt19937 random(seed);
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount());
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+		for (uint32_t y = 0; y < dimensions.height; y++)
+			for (uint32_t x = 0; x < dimensions.width; x++)
+			{
+				const float wave = std::sin(x * 0.31f) * std::cos(y * 0.17f + z * 0.23f);
+				volume[dimensions.GetIndex(x, y, z)] = static_cast<uint8_t>(std::clamp(128.0f + 100.0f * wave + static_cast<float>(random() % 31) - 15.0f, 0.0f, 255.0f));
+			}
+	return volume;
+}
+
+static Float3 Normalize(const Float3& v)
+{
+	const float length = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+	return { v.x / length, v.y / length, v.z / length };
+}
+
+// a random direction and a random one perpendicular to it
+static std::pair<Float3, Float3> GetRandomAxes(std::mt19937& random)
+{
+	std::normal_distribution<float> normal;
+	const Float3 right = Normalize({ normal(random), normal(random), normal(random) });
+	const Float3 other = { normal(random), normal(random), normal(random) };
+	const float along = other.x * right.x + other.y * right.y + other.z * right.z;
+	const Float3 up = Normalize({ other.x - along * right.x, other.y - along * right.y, other.z - along * right.z });
+	return { right, up };
+}
+
+// Random oblique planes through random points near the volume, thin and as slabs, against the scalar path.
+// Image sizes leave partial tiles and pixels past the last group of four, the padding of every row has
+// to stay untouched.
+static void TestAgainstScalar()
+{
+	const VolumeDimensions dimensions = { 45, 38, 29 };
+	const std::vector<uint8_t> volume = GetVolume(dimensions, 1);
+	std::mt19937 random(2);
+	std::uniform_real_distribution<float> position(-5.0f, 50.0f);
+	const uint32_t sizes[][2] = { { 130, 77 }, { 3, 5 }, { 64, 64 }, { 71, 1 } };
+	for (uint32_t planeIndex = 0; planeIndex < 40; planeIndex++)
+	{
+		const auto [right, up] = GetRandomAxes(random);
+		const Float3 center = { position(random), position(random), position(random) };
+		const uint32_t width = sizes[planeIndex % 4][0];
+		const uint32_t height = sizes[planeIndex % 4][1];
+		SlicePlane plane = Reslicer::MakePlane(dimensions, center, right, up, width, height);
+		const SlabMode mode = static_cast<SlabMode>(planeIndex % 3);
+		Reslicer::SetSlab(plane, mode == SlabMode::Thin ? 0.0f : 1.0f + planeIndex % 9, mode);
+
+		const size_t rowPitch = width + 13;
+		std::vector<uint8_t> image(rowPitch * height, 0xCD);
+		std::vector<uint8_t> reference(rowPitch * height, 0xCD);
+		Reslicer::Reslice(volume.data(), dimensions, plane, width, height, image.data(), rowPitch);
+		Reslicer::ResliceScalar(volume.data(), dimensions, plane, width, height, reference.data(), rowPitch);
+
+		// the same operations in the same order, only the rounding of the final value may differ
+		bool isClose = true;
+		bool isPaddingUntouched = true;
+		for (uint32_t j = 0; j < height; j++)
+		{
+			for (uint32_t i = 0; i < width; i++)
+				isClose &= std::abs(image[j * rowPitch + i] - reference[j * rowPitch + i]) <= 1;
+			for (size_t i = width; i < rowPitch; i++)
+				isPaddingUntouched &= image[j * rowPitch + i] == 0xCD;
+		}
+		CHECK(isClose);
+		CHECK(isPaddingUntouched);
+	}
+}
+
+// A plane along the voxel grid samples the voxels themselves, up to the last slice. A plane away from the
+// volume is black and a maximum over a slab is at least what the plane in its middle sees.
+static void TestAxisAligned()
+{
+	const VolumeDimensions dimensions = { 40, 30, 20 };
+	const std::vector<uint8_t> volume = GetVolume(dimensions, 3);
+	SlicePlane plane{ .origin = { 0.0f, 0.0f, 7.0f }, .axisU = { 1.0f, 0.0f, 0.0f }, .axisV = { 0.0f, 1.0f, 0.0f } };
+	std::vector<uint8_t> image(dimensions.width * dimensions.height);
+	Reslicer::Reslice(volume.data(), dimensions, plane, dimensions.width, dimensions.height, image.data(), dimensions.width);
+	CHECK(std::equal(image.begin(), image.end(), volume.begin() + dimensions.GetIndex(0, 0, 7)));
+
+	// the last slice is still inside
+	plane.origin.z = dimensions.depth - 1.0f;
+	Reslicer::Reslice(volume.data(), dimensions, plane, dimensions.width, dimensions.height, image.data(), dimensions.width);
+	CHECK(std::equal(image.begin(), image.end(), volume.begin() + dimensions.GetIndex(0, 0, dimensions.depth - 1)));
+	plane.origin.z = 7.0f;
+	Reslicer::Reslice(volume.data(), dimensions, plane, dimensions.width, dimensions.height, image.data(), dimensions.width);
+
+	const std::vector<uint8_t> thin = image;
+	Reslicer::SetSlab(plane, 4.0f, SlabMode::MaximumIntensity);
+	Reslicer::Reslice(volume.data(), dimensions, plane, dimensions.width, dimensions.height, image.data(), dimensions.width);
+	bool isAtLeastThin = true;
+	for (size_t pixel = 0; pixel < image.size(); pixel++)
+		isAtLeastThin &= image[pixel] >= thin[pixel];
+	CHECK(isAtLeastThin);
+	CHECK(image != thin);
+
+	plane = { .origin = { 0.0f, 0.0f, 25.0f }, .axisU = { 1.0f, 0.0f, 0.0f }, .axisV = { 0.0f, 1.0f, 0.0f } };
+	Reslicer::Reslice(volume.data(), dimensions, plane, dimensions.width, dimensions.height, image.data(), dimensions.width);
+	CHECK(std::all_of(image.begin(), image.end(), [](uint8_t value) { return value == 0; }));
+}
+
+// a 512x512 oblique image of a 256^3 volume, thin and with 16 voxel slabs, against the scalar path
+static void BenchmarkReslice()
+{
+	const VolumeDimensions dimensions = { 256, 256, 256 };
+	const std::vector<uint8_t> volume = GetVolume(dimensions, 4);
+	const uint32_t size = 512;
+	std::vector<uint8_t> image(size * size);
+	std::mt19937 random(5);
+	const auto [right, up] = GetRandomAxes(random);
+
+	std::printf("512x512 of 256x256x256, %u threads\n", ThreadPool::Get().GetThreadCount());
+	for (const auto& [name, mode] : { std::pair{ "thin", SlabMode::Thin }, std::pair{ "MIP 16", SlabMode::MaximumIntensity }, std::pair{ "average 16", SlabMode::Average } })
+	{
+		SlicePlane plane = Reslicer::MakePlane(dimensions, { 127.5f, 127.5f, 127.5f }, right, up, size, size);
+		Reslicer::SetSlab(plane, mode == SlabMode::Thin ? 0.0f : 16.0f, mode);
+		const double milliseconds = MeasureMilliseconds(5, [&]() { Reslicer::Reslice(volume.data(), dimensions, plane, size, size, image.data(), size); });
+		const double scalarMilliseconds = MeasureMilliseconds(3, [&]() { Reslicer::ResliceScalar(volume.data(), dimensions, plane, size, size, image.data(), size); });
+		std::printf("%-11s reslice %6.2f ms, scalar %6.2f ms, %.1fx\n", name, milliseconds, scalarMilliseconds, scalarMilliseconds / milliseconds);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	TestAgainstScalar();
+	TestAxisAligned();
+	if (IsBenchmarkRun(argc, argv))
+		BenchmarkReslice();
+	return GetTestResult();
+}
@@ -0,0 +1,161 @@
+#include "Test.h"
+#include "StepGrid.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+// flat regions with a few sharp edges and noisy patches, so bricks get very different variations
+static std::vector<uint8_t> GetVolume(const VolumeDimensions& dimensions, uint32_t seed)
+{
+	std::mt19937 random(seed);
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount());
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+		for (uint32_t y = 0; y < dimensions.height; y++)
+			for (uint32_t x = 0; x < dimensions.width; x++)
+			{
+				const uint8_t base = x * 3 < dimensions.width ? 40 : (y * 2 < dimensions.height ? 90 : 200);
+				const bool isNoisy = (x / 7 + y / 5 + z / 9) % 6 == 0;
+				volume[dimensions.GetIndex(x, y, z)] = static_cast<uint8_t>(base + (isNoisy ? random() % 40 : z % 3));
+			}
+	return volume;
+}
+
+// Every voxel against its neighbour on each axis, the brick of the first voxel takes the difference. Then
+// the largest of the 3x3x3 bricks around each brick, and the step it allows.
+static std::vector<uint8_t> GetReferenceScales(const uint8_t* data, const VolumeDimensions& dimensions, const StepGridSettings& settings)
+{
+	const VolumeDimensions bricks = {
+		(dimensions.width + BRICK_SIZE - 1) / BRICK_SIZE,
+		(dimensions.height + BRICK_SIZE - 1) / BRICK_SIZE,
+		(dimensions.depth + BRICK_SIZE - 1) / BRICK_SIZE };
+	std::vector<uint8_t> variation(bricks.GetVoxelCount(), 0);
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+		for (uint32_t y = 0; y < dimensions.height; y++)
+			for (uint32_t x = 0; x < dimensions.width; x++)
+			{
+				const int32_t value = data[dimensions.GetIndex(x, y, z)];
+				uint8_t& brick = variation[bricks.GetIndex(x / BRICK_SIZE, y / BRICK_SIZE, z / BRICK_SIZE)];
+				if (x + 1 < dimensions.width)
+					brick = std::max(brick, static_cast<uint8_t>(std::abs(value - data[dimensions.GetIndex(x + 1, y, z)])));
+				if (y + 1 < dimensions.height)
+					brick = std::max(brick, static_cast<uint8_t>(std::abs(value - data[dimensions.GetIndex(x, y + 1, z)])));
+				if (z + 1 < dimensions.depth)
+					brick = std::max(brick, static_cast<uint8_t>(std::abs(value - data[dimensions.GetIndex(x, y, z + 1)])));
+			}
+
+	const float maxScale = std::max(settings.minScale, std::min(settings.maxScale, BRICK_SIZE / settings.baseStepVoxels));
+	std::vector<uint8_t> scales(bricks.GetVoxelCount());
+	for (uint32_t z = 0; z < bricks.depth; z++)
+		for (uint32_t y = 0; y < bricks.height; y++)
+			for (uint32_t x = 0; x < bricks.width; x++)
+			{
+				uint8_t neighbourhood = 0;
+				for (uint32_t nz = z > 0 ? z - 1 : 0; nz <= std::min(z + 1, bricks.depth - 1); nz++)
+					for (uint32_t ny = y > 0 ? y - 1 : 0; ny <= std::min(y + 1, bricks.height - 1); ny++)
+						for (uint32_t nx = x > 0 ? x - 1 : 0; nx <= std::min(x + 1, bricks.width - 1); nx++)
+							neighbourhood = std::max(neighbourhood, variation[bricks.GetIndex(nx, ny, nz)]);
+
+				const float scale = neighbourhood == 0 ? maxScale :
+					std::clamp(settings.maxValueChange / (std::sqrt(3.0f) * neighbourhood) / settings.baseStepVoxels, settings.minScale, maxScale);
+				scales[bricks.GetIndex(x, y, z)] = static_cast<uint8_t>(std::clamp(static_cast<uint32_t>(scale * StepGrid::STEP_SCALE_ONE), 1u, 255u));
+			}
+	return scales;
+}
+
+// Sizes with partial bricks at the end of every axis, a single brick, a single voxel and flat volumes.
+// Edges along a brick border only show up in the variation of the brick before it.
+static void TestBuild()
+{
+	const StepGridSettings settings{ .baseStepVoxels = 0.8f };
+	const VolumeDimensions sizes[] = { { 50, 33, 17 }, { 16, 16, 16 }, { 1, 1, 1 }, { 17, 1, 40 }, { 100, 20, 3 } };
+	for (const VolumeDimensions& dimensions : sizes)
+	{
+		const std::vector<uint8_t> volume = GetVolume(dimensions, dimensions.width);
+		StepGrid grid;
+		grid.Build(volume.data(), dimensions, settings);
+		CHECK(grid.GetDimensions().width == (dimensions.width + 15) / 16 && grid.GetDimensions().depth == (dimensions.depth + 15) / 16);
+		CHECK(grid.GetScales() == GetReferenceScales(volume.data(), dimensions, settings));
+	}
+
+	// a flat volume strides at the longest step, one that is at most a brick
+	const VolumeDimensions dimensions = { 40, 40, 40 };
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount(), 120);
+	StepGrid grid;
+	grid.Build(volume.data(), dimensions, settings);
+	CHECK(std::all_of(grid.GetScales().begin(), grid.GetScales().end(), [](uint8_t scale) { return scale == 4 * StepGrid::STEP_SCALE_ONE; }));
+	grid.Build(volume.data(), dimensions, { .baseStepVoxels = 8.0f });
+	CHECK(std::all_of(grid.GetScales().begin(), grid.GetScales().end(), [](uint8_t scale) { return scale == 2 * StepGrid::STEP_SCALE_ONE; }));
+
+	// a step between x 31 and 32 belongs to brick 1, and slows down bricks 0 to 2 but not 3
+	const VolumeDimensions stepDimensions = { 64, 32, 32 };
+	std::vector<uint8_t> step(stepDimensions.GetVoxelCount());
+	for (size_t voxel = 0; voxel < step.size(); voxel++)
+		step[voxel] = voxel % stepDimensions.width < 32 ? 120 : 250;
+	grid.Build(step.data(), stepDimensions, settings);
+	CHECK(grid.GetVariation(1, 0, 0) == 130 && grid.GetVariation(0, 0, 0) == 0 && grid.GetVariation(2, 1, 1) == 0);
+	CHECK(grid.GetScales() == GetReferenceScales(step.data(), stepDimensions, settings));
+	CHECK(grid.GetScale(0, 1, 1) == 0.25f && grid.GetScale(2, 1, 1) == 0.25f && grid.GetScale(3, 1, 1) == 4.0f);
+}
+
+// edits anywhere, including at brick borders and the far end of the volume, give what a new build gives
+static void TestUpdate()
+{
+	const StepGridSettings settings{};
+	const VolumeDimensions dimensions = { 50, 33, 37 };
+	std::vector<uint8_t> volume = GetVolume(dimensions, 7);
+	StepGrid grid;
+	grid.Build(volume.data(), dimensions, settings);
+
+	std::mt19937 random(8);
+	const VolumeBox edits[] = {
+		{ .minX = 16, .minY = 0, .minZ = 0, .maxX = 17, .maxY = 1, .maxZ = 1 },
+		{ .minX = 0, .minY = 31, .minZ = 32, .maxX = 50, .maxY = 33, .maxZ = 37 },
+		{ .minX = 10, .minY = 10, .minZ = 10, .maxX = 40, .maxY = 25, .maxZ = 30 },
+		{ .minX = 49, .minY = 15, .minZ = 16, .maxX = 50, .maxY = 16, .maxZ = 17 },
+	};
+	for (const VolumeBox& edit : edits)
+	{
+		for (uint32_t z = edit.minZ; z < edit.maxZ; z++)
+			for (uint32_t y = edit.minY; y < edit.maxY; y++)
+				for (uint32_t x = edit.minX; x < edit.maxX; x++)
+					volume[dimensions.GetIndex(x, y, z)] = static_cast<uint8_t>(random() % 2 == 0 ? 0 : random());
+		grid.Update(volume.data(), dimensions, edit);
+		CHECK(grid.GetScales() == GetReferenceScales(volume.data(), dimensions, settings));
+	}
+
+	// smoothing an edit away brings the long steps back
+	std::fill(volume.begin(), volume.end(), 60);
+	grid.Update(volume.data(), dimensions, { .minX = 0, .minY = 0, .minZ = 0, .maxX = 50, .maxY = 33, .maxZ = 37 });
+	CHECK(std::all_of(grid.GetScales().begin(), grid.GetScales().end(), [](uint8_t scale) { return scale == 4 * StepGrid::STEP_SCALE_ONE; }));
+
+	// the first voxel of a brick changes the variation of the brick before it as well
+	volume[dimensions.GetIndex(16, 16, 16)] = 190;
+	grid.Update(volume.data(), dimensions, { .minX = 16, .minY = 16, .minZ = 16, .maxX = 17, .maxY = 17, .maxZ = 17 });
+	CHECK(grid.GetVariation(0, 1, 1) == 130 && grid.GetVariation(1, 0, 1) == 130 && grid.GetVariation(1, 1, 0) == 130 && grid.GetVariation(1, 1, 1) == 130);
+	CHECK(grid.GetScales() == GetReferenceScales(volume.data(), dimensions, settings));
+}
+
+// building the grid of a 256^3 volume and updating it after a 32^3 edit, against the reference
+static void BenchmarkStepGrid()
+{
+	const VolumeDimensions dimensions = { 256, 256, 256 };
+	std::vector<uint8_t> volume = GetVolume(dimensions, 9);
+	StepGrid grid;
+	const double buildMilliseconds = MeasureMilliseconds(3, [&]() { grid.Build(volume.data(), dimensions, {}); });
+	const VolumeBox edit = { .minX = 100, .minY = 100, .minZ = 100, .maxX = 132, .maxY = 132, .maxZ = 132 };
+	const double updateMilliseconds = MeasureMilliseconds(5, [&]() { grid.Update(volume.data(), dimensions, edit); });
+	const double referenceMilliseconds = MeasureMilliseconds(1, [&]() { GetReferenceScales(volume.data(), dimensions, {}); });
+	std::printf("256x256x256, %u threads\n", ThreadPool::Get().GetThreadCount());
+	std::printf("build %6.2f ms, update of 32^3 %5.2f ms, reference %7.2f ms\n", buildMilliseconds, updateMilliseconds, referenceMilliseconds);
+}
+
+int main(int argc, char** argv)
+{
+	TestBuild();
+	TestUpdate();
+	if (IsBenchmarkRun(argc, argv))
+		BenchmarkStepGrid();
+	return GetTestResult();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+// Just enough for the tests of the platform neutral modules: a failed CHECK prints where it failed and
+// makes the test return nonzero, and benchmarks only run when the test is started with --benchmark.
+
+inline uint32_t& GetFailedCheckCount()
+{
+	static uint32_t count = 0;
+	return count;
+}
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) \
+		{ \
+			std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			GetFailedCheckCount()++; \
+		} \
+	} while (false)
+
+inline int GetTestResult()
+{
+	if (GetFailedCheckCount() > 0)
+		std::fprintf(stderr, "%u checks failed\n", GetFailedCheckCount());
+	return GetFailedCheckCount() > 0 ? 1 : 0;
+}
+
+inline bool IsBenchmarkRun(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--benchmark") == 0)
+			return true;
+	}
+	return false;
+}
+
+// best of a few runs, the first one also warms the caches up
+template<typename Func>
+double MeasureMilliseconds(uint32_t runCount, Func&& func)
+{
+	double best = 0.0;
+	for (uint32_t run = 0; run < runCount; run++)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		func();
+		const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		best = run == 0 ? milliseconds : std::min(best, milliseconds);
+	}
+	return best;
+}
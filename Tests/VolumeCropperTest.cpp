@@ -0,0 +1,167 @@
+#include "Test.h"
+#include "VolumeCropper.h"
+#include "ThreadPool.h"
+
+#include <random>
+#include <vector>
+
+// the bounds voxel by voxel
+static VolumeBox FindReferenceBounds(const uint8_t* data, const VolumeDimensions& dimensions, uint8_t threshold)
+{
+	VolumeBox bounds = { .minX = UINT32_MAX, .minY = UINT32_MAX, .minZ = UINT32_MAX };
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+		for (uint32_t y = 0; y < dimensions.height; y++)
+			for (uint32_t x = 0; x < dimensions.width; x++)
+			{
+				if (data[dimensions.GetIndex(x, y, z)] <= threshold)
+					continue;
+				bounds = {
+					.minX = std::min(bounds.minX, x), .minY = std::min(bounds.minY, y), .minZ = std::min(bounds.minZ, z),
+					.maxX = std::max(bounds.maxX, x + 1), .maxY = std::max(bounds.maxY, y + 1), .maxZ = std::max(bounds.maxZ, z + 1) };
+			}
+	return bounds.IsEmpty() ? VolumeBox{} : bounds;
+}
+
+static bool operator==(const VolumeBox& a, const VolumeBox& b)
+{
+	return a.minX == b.minX && a.minY == b.minY && a.minZ == b.minZ && a.maxX == b.maxX && a.maxY == b.maxY && a.maxZ == b.maxZ;
+}
+
+// a noisy blob in a dim background, the blob's extent and brightness are up to the seed
+static std::vector<uint8_t> GetScan(const VolumeDimensions& dimensions, uint32_t seed)
+{
+	std::mt19937 random(seed);
+	const float centerX = static_cast<float>(random() % dimensions.width);
+	const float centerY = static_cast<float>(random() % dimensions.height);
+	const float centerZ = static_cast<float>(random() % dimensions.depth);
+	const float radius = 2.0f + static_cast<float>(random() % (std::max({ dimensions.width, dimensions.height, dimensions.depth }) / 2 + 1));
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount());
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+		for (uint32_t y = 0; y < dimensions.height; y++)
+			for (uint32_t x = 0; x < dimensions.width; x++)
+			{
+				const float dx = x - centerX;
+				const float dy = (y - centerY) * 1.5f;
+				const float dz = z - centerZ;
+				const bool isInside = dx * dx + dy * dy + dz * dz < radius * radius;
+				volume[dimensions.GetIndex(x, y, z)] = static_cast<uint8_t>(isInside ? 60 + random() % 196 : random() % 12);
+			}
+	return volume;
+}
+
+// Random blobs at every threshold against the reference. The widths leave rows shorter than a SIMD
+// block, rows that end in a partial block and depths with a partial slab.
+static void TestThresholds()
+{
+	const VolumeDimensions sizes[] = { { 37, 19, 40 }, { 16, 16, 16 }, { 5, 3, 2 }, { 70, 9, 17 }, { 1, 1, 1 } };
+	for (const VolumeDimensions& dimensions : sizes)
+	{
+		for (uint32_t seed = 0; seed < 6; seed++)
+		{
+			const std::vector<uint8_t> volume = GetScan(dimensions, seed);
+			for (uint8_t threshold : { 0, 5, 11, 59, 128, 254, 255 })
+				CHECK(VolumeCropper::FindBounds(volume.data(), dimensions, threshold) == FindReferenceBounds(volume.data(), dimensions, threshold));
+		}
+	}
+}
+
+// nothing above the threshold is an empty box, whatever the threshold is
+static void TestEmpty()
+{
+	const VolumeDimensions dimensions = { 50, 20, 33 };
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount(), 0);
+	CHECK(VolumeCropper::FindBounds(volume.data(), dimensions, 0).IsEmpty());
+	std::fill(volume.begin(), volume.end(), 30);
+	CHECK(VolumeCropper::FindBounds(volume.data(), dimensions, 30).IsEmpty());
+	CHECK(VolumeCropper::FindBounds(volume.data(), dimensions, 255).IsEmpty());
+	CHECK((VolumeCropper::FindBounds(volume.data(), dimensions, 29) == VolumeBox{ 0, 0, 0, 50, 20, 33 }));
+}
+
+// One voxel on each face, and each one alone. The box has to reach every face and cropping it copies the
+// whole volume, in place too.
+static void TestFaces()
+{
+	const VolumeDimensions dimensions = { 45, 21, 35 };
+	const uint32_t faceVoxels[6][3] = { { 0, 10, 17 }, { 44, 3, 30 }, { 20, 0, 5 }, { 7, 20, 12 }, { 33, 14, 0 }, { 16, 6, 34 } };
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount(), 3);
+	for (const auto& voxel : faceVoxels)
+	{
+		std::vector<uint8_t> single(dimensions.GetVoxelCount(), 3);
+		single[dimensions.GetIndex(voxel[0], voxel[1], voxel[2])] = 200;
+		CHECK((VolumeCropper::FindBounds(single.data(), dimensions, 100) == VolumeBox{ voxel[0], voxel[1], voxel[2], voxel[0] + 1, voxel[1] + 1, voxel[2] + 1 }));
+		volume[dimensions.GetIndex(voxel[0], voxel[1], voxel[2])] = 200;
+	}
+	const VolumeBox bounds = VolumeCropper::FindBounds(volume.data(), dimensions, 100);
+	CHECK((bounds == VolumeBox{ 0, 0, 0, 45, 21, 35 }));
+
+	std::vector<uint8_t> cropped(volume.size());
+	VolumeCropper::Crop(volume.data(), dimensions, bounds, cropped.data());
+	CHECK(cropped == volume);
+	std::vector<uint8_t> inPlace = volume;
+	VolumeCropper::Crop(inPlace.data(), dimensions, bounds, inPlace.data());
+	CHECK(inPlace == volume);
+
+	// a margin grows the box up to the faces and no further
+	CHECK((VolumeCropper::Expand({ 3, 0, 10, 20, 21, 30 }, 4, dimensions) == VolumeBox{ 0, 0, 6, 24, 21, 34 }));
+	CHECK((VolumeCropper::Expand(bounds, 100, dimensions) == bounds));
+}
+
+// cropping into another buffer and in place both give the voxels of the box row by row
+static void TestCrop()
+{
+	const VolumeDimensions dimensions = { 37, 19, 40 };
+	const std::vector<uint8_t> volume = GetScan(dimensions, 3);
+	for (const VolumeBox& box : { VolumeBox{ 5, 2, 7, 30, 18, 33 }, VolumeBox{ 0, 0, 39, 37, 19, 40 }, VolumeBox{ 36, 5, 0, 37, 6, 40 } })
+	{
+		std::vector<uint8_t> expected;
+		for (uint32_t z = box.minZ; z < box.maxZ; z++)
+			for (uint32_t y = box.minY; y < box.maxY; y++)
+				for (uint32_t x = box.minX; x < box.maxX; x++)
+					expected.push_back(volume[dimensions.GetIndex(x, y, z)]);
+
+		std::vector<uint8_t> cropped(box.GetVoxelCount());
+		VolumeCropper::Crop(volume.data(), dimensions, box, cropped.data());
+		CHECK(cropped == expected);
+		std::vector<uint8_t> inPlace = volume;
+		VolumeCropper::Crop(inPlace.data(), dimensions, box, inPlace.data());
+		CHECK(std::equal(expected.begin(), expected.end(), inPlace.begin()));
+	}
+}
+
+// a 512x512x256 scan with air around it, bounds against the reference and the crop, in place and not
+static void BenchmarkCropper()
+{
+	const VolumeDimensions dimensions = { 512, 512, 256 };
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount());
+	std::mt19937 random(1);
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+		for (uint32_t y = 0; y < dimensions.height; y++)
+			for (uint32_t x = 0; x < dimensions.width; x++)
+			{
+				const float dx = (x - 256.0f) / 200.0f;
+				const float dy = (y - 240.0f) / 150.0f;
+				volume[dimensions.GetIndex(x, y, z)] = static_cast<uint8_t>(dx * dx + dy * dy < 1.0f ? 80 + random() % 100 : random() % 8);
+			}
+
+	VolumeBox bounds;
+	const double milliseconds = MeasureMilliseconds(5, [&]() { bounds = VolumeCropper::FindBounds(volume.data(), dimensions, 10); });
+	VolumeBox referenceBounds;
+	const double referenceMilliseconds = MeasureMilliseconds(1, [&]() { referenceBounds = FindReferenceBounds(volume.data(), dimensions, 10); });
+	CHECK(bounds == referenceBounds);
+	std::vector<uint8_t> cropped(bounds.GetVoxelCount());
+	const double cropMilliseconds = MeasureMilliseconds(5, [&]() { VolumeCropper::Crop(volume.data(), dimensions, bounds, cropped.data()); });
+	const double inPlaceMilliseconds = MeasureMilliseconds(1, [&]() { VolumeCropper::Crop(volume.data(), dimensions, bounds, volume.data()); });
+	std::printf("512x512x256, %u threads, keeps %.0f%%\n", ThreadPool::Get().GetThreadCount(), 100.0 * bounds.GetVoxelCount() / dimensions.GetVoxelCount());
+	std::printf("bounds %6.2f ms, reference %7.2f ms, crop %6.2f ms, in place %6.2f ms\n", milliseconds, referenceMilliseconds, cropMilliseconds, inPlaceMilliseconds);
+}
+
+int main(int argc, char** argv)
+{
+	TestThresholds();
+	TestEmpty();
+	TestFaces();
+	TestCrop();
+	if (IsBenchmarkRun(argc, argv))
+		BenchmarkCropper();
+	return GetTestResult();
+}
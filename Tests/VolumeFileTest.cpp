@@ -0,0 +1,232 @@
+#include "Test.h"
+#include "VolumeFile.h"
+#include "Inflate.h"
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+
+static const std::filesystem::path OUTPUT_DIRECTORY = std::filesystem::temp_directory_path() / "VolumeFileTest";
+
+// deflate's bits go in from the least significant one up
+struct BitWriter {
+	std::vector<uint8_t> bytes;
+	uint32_t bitCount = 0;
+
+	void Put(uint32_t value, uint32_t count)
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			if (bitCount % 8 == 0)
+				bytes.push_back(0);
+			bytes.back() |= ((value >> i) & 1) << (bitCount % 8);
+			bitCount++;
+		}
+	}
+
+	// Huffman codes go in from their most significant bit
+	void PutCode(uint32_t code, uint32_t length)
+	{
+		for (uint32_t i = length; i-- > 0;)
+			Put((code >> i) & 1, 1);
+	}
+};
+
+// one fixed Huffman block, runs of a byte become matches one byte back, everything else literals
+static std::vector<uint8_t> Deflate(const uint8_t* data, size_t size)
+{
+	static constexpr uint16_t LENGTH_BASE[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static constexpr uint8_t LENGTH_EXTRA_BITS[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+	BitWriter writer;
+	auto putSymbol = [&](uint32_t symbol) {
+		if (symbol < 144)
+			writer.PutCode(0x30 + symbol, 8);
+		else if (symbol < 256)
+			writer.PutCode(0x190 + symbol - 144, 9);
+		else if (symbol < 280)
+			writer.PutCode(symbol - 256, 7);
+		else
+			writer.PutCode(0xC0 + symbol - 280, 8);
+	};
+
+	writer.Put(1, 1);
+	writer.Put(1, 2);
+	size_t position = 0;
+	while (position < size)
+	{
+		size_t run = 0;
+		while (position > 0 && position + run < size && run < 258 && data[position + run] == data[position - 1])
+			run++;
+		if (run < 3)
+		{
+			putSymbol(data[position++]);
+			continue;
+		}
+
+		uint32_t symbol = 28;
+		while (LENGTH_BASE[symbol] > run)
+			symbol--;
+		putSymbol(257 + symbol);
+		writer.Put(static_cast<uint32_t>(run - LENGTH_BASE[symbol]), LENGTH_EXTRA_BITS[symbol]);
+		writer.PutCode(0, 5);
+		position += run;
+	}
+	putSymbol(256);
+	return writer.bytes;
+}
+
+static void PutU32(std::vector<uint8_t>& bytes, uint32_t value)
+{
+	for (uint32_t i = 0; i < 4; i++)
+		bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+// A gzip file of one member per memberSize bytes. BGZF members say how big they are in their header,
+// a trailer only keeps the size modulo 4 GiB, which reportedSize stands in for. The CRC is left 0.
+static std::vector<uint8_t> Gzip(const std::vector<uint8_t>& data, size_t memberSize, bool isBgzf, uint32_t reportedSize = 0)
+{
+	std::vector<uint8_t> file;
+	for (size_t begin = 0; begin < data.size(); begin += memberSize)
+	{
+		const size_t size = std::min(memberSize, data.size() - begin);
+		const std::vector<uint8_t> deflated = Deflate(data.data() + begin, size);
+		const size_t headerSize = isBgzf ? 18 : 10;
+		file.insert(file.end(), { 0x1F, 0x8B, 8, static_cast<uint8_t>(isBgzf ? 0x04 : 0), 0, 0, 0, 0, 0, 0xFF });
+		if (isBgzf)
+		{
+			const uint32_t blockSize = static_cast<uint32_t>(headerSize + deflated.size() + 8 - 1);
+			file.insert(file.end(), { 6, 0, 'B', 'C', 2, 0, static_cast<uint8_t>(blockSize), static_cast<uint8_t>(blockSize >> 8) });
+		}
+		file.insert(file.end(), deflated.begin(), deflated.end());
+		PutU32(file, 0);
+		PutU32(file, reportedSize != 0 ? reportedSize : static_cast<uint32_t>(size));
+	}
+	return file;
+}
+
+// NIfTI-1 single file of byte voxels, volumeCount volumes of dimensions one after the other
+static std::vector<uint8_t> GetNifti(const VolumeDimensions& dimensions, uint32_t volumeCount, std::vector<uint8_t>& voxels)
+{
+	std::vector<uint8_t> file(352, 0);
+	auto putI16 = [&](size_t offset, int16_t value) { memcpy(&file[offset], &value, sizeof(value)); };
+	const int32_t headerSize = 348;
+	const float voxelOffset = 352.0f;
+	const float spacing[3] = { 0.5f, 0.5f, 2.0f };
+	memcpy(&file[0], &headerSize, sizeof(headerSize));
+	putI16(40, volumeCount > 1 ? 4 : 3);
+	putI16(42, static_cast<int16_t>(dimensions.width));
+	putI16(44, static_cast<int16_t>(dimensions.height));
+	putI16(46, static_cast<int16_t>(dimensions.depth));
+	putI16(48, static_cast<int16_t>(volumeCount));
+	putI16(70, 2);
+	memcpy(&file[80], spacing, sizeof(spacing));
+	memcpy(&file[108], &voxelOffset, sizeof(voxelOffset));
+	memcpy(&file[344], "n+1", 4);
+
+	// background with a noisy block in it, so there are runs and literals
+	std::mt19937 random(9);
+	voxels.assign(dimensions.GetVoxelCount() * volumeCount, 0);
+	for (uint32_t volume = 0; volume < volumeCount; volume++)
+		for (uint32_t z = 2; z < dimensions.depth - 2; z++)
+			for (uint32_t y = 3; y < dimensions.height - 3; y++)
+				for (uint32_t x = 4; x < dimensions.width - 4; x++)
+					voxels[volume * dimensions.GetVoxelCount() + dimensions.GetIndex(x, y, z)] = static_cast<uint8_t>(random() % 4 == 0 ? random() : 100 + volume);
+	file.insert(file.end(), voxels.begin(), voxels.end());
+	return file;
+}
+
+static bool WriteFile(const std::filesystem::path& filePath, const std::vector<uint8_t>& bytes)
+{
+	std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+	return file.good();
+}
+
+// Any prefix comes out as the start of the data, cut off inside a member, a match or right after a member.
+// The whole stream needs a destination it fits in.
+static void TestInflatePrefix()
+{
+	std::vector<uint8_t> data(5000, 7);
+	std::mt19937 random(4);
+	for (size_t i = 0; i < data.size(); i++)
+		data[i] = i % 700 < 300 ? static_cast<uint8_t>(random()) : static_cast<uint8_t>(i / 700);
+
+	for (bool isBgzf : { false, true })
+	{
+		for (size_t memberSize : { size_t(5000), size_t(1024), size_t(333) })
+		{
+			const std::vector<uint8_t> file = Gzip(data, memberSize, isBgzf);
+			for (size_t prefixSize : { size_t(1), size_t(10), size_t(333), size_t(350), size_t(1024), size_t(1025), size_t(4000), size_t(5000), size_t(6000) })
+			{
+				std::vector<uint8_t> prefix(prefixSize, 0xCD);
+				size_t produced = 0;
+				CHECK(Inflate::InflateGzipPrefix(file.data(), file.size(), prefix.data(), prefix.size(), produced));
+				CHECK(produced == std::min(prefixSize, data.size()));
+				CHECK(std::equal(prefix.begin(), prefix.begin() + produced, data.begin()));
+			}
+
+			std::vector<uint8_t> inflated(data.size());
+			size_t produced = 0;
+			CHECK(Inflate::InflateGzip(file.data(), file.size(), inflated.data(), inflated.size(), produced));
+			CHECK(produced == data.size() && inflated == data);
+			CHECK(!Inflate::InflateGzip(file.data(), file.size(), inflated.data(), inflated.size() - 1, produced));
+		}
+	}
+}
+
+// a .nii.gz whose inflated size the last trailer doesn't tell, the voxels of the first volume have to come out
+static void TestCompressedNifti()
+{
+	const VolumeDimensions dimensions = { 23, 17, 11 };
+	std::vector<uint8_t> voxels;
+	const std::vector<uint8_t> nifti = GetNifti(dimensions, 2, voxels);
+
+	struct Layout {
+		const char* name;
+		std::vector<uint8_t> file;
+	};
+	const Layout layouts[] = {
+		{ "single", Gzip(nifti, nifti.size(), false) },
+		// 4 GiB + 1000 bytes would say 1000
+		{ "large", Gzip(nifti, nifti.size(), false, 1000) },
+		// the last member alone is small
+		{ "members", Gzip(nifti, 4000, false) },
+		{ "bgzf", Gzip(nifti, 1500, true) },
+	};
+	for (const Layout& layout : layouts)
+	{
+		const std::filesystem::path filePath = OUTPUT_DIRECTORY / (std::string(layout.name) + ".nii.gz");
+		CHECK(WriteFile(filePath, layout.file));
+		std::optional<VolumeFileInfo> info = VolumeFile::ReadHeader(filePath);
+		CHECK(info.has_value());
+		if (!info)
+			continue;
+
+		CHECK(info->dimensions == dimensions);
+		CHECK(info->spacing.z == 2.0f && info->type == VoxelType::Uint8 && !VolumeFile::IsDirectlyReadable(*info));
+		// only what the first volume needs is inflated
+		CHECK(info->inflatedFile && info->inflatedFile->size() == 352 + dimensions.GetVoxelCount());
+
+		std::vector<uint8_t> volume(dimensions.GetVoxelCount());
+		CHECK(VolumeFile::Read(*info, volume.data()));
+		CHECK(std::equal(volume.begin(), volume.end(), voxels.begin()));
+	}
+
+	// cut off before the end of the first volume
+	const std::vector<uint8_t> truncated = Gzip(std::vector<uint8_t>(nifti.begin(), nifti.begin() + 3000), 3000, false);
+	CHECK(WriteFile(OUTPUT_DIRECTORY / "truncated.nii.gz", truncated));
+	CHECK(!VolumeFile::ReadHeader(OUTPUT_DIRECTORY / "truncated.nii.gz"));
+}
+
+int main()
+{
+	std::filesystem::create_directories(OUTPUT_DIRECTORY);
+	TestInflatePrefix();
+	TestCompressedNifti();
+	std::filesystem::remove_all(OUTPUT_DIRECTORY);
+	return GetTestResult();
+}
@@ -0,0 +1,136 @@
+#include "Test.h"
+#include "VolumeFilter.h"
+#include "ThreadPool.h"
+
+#include <functional>
+#include <random>
+#include <vector>
+
+// a bright sphere in a striped background with noise on top, so there are edges and grain to filter
+static std::vector<uint8_t> GetNoisyVolume(const VolumeDimensions& dimensions, uint32_t seed)
+{
+	std::mt19937 random(seed);
+	std::normal_distribution<float> noise(0.0f, 25.0f);
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount());
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+	{
+		for (uint32_t y = 0; y < dimensions.height; y++)
+		{
+			for (uint32_t x = 0; x < dimensions.width; x++)
+			{
+				const float dx = x - dimensions.width / 2.0f;
+				const float dy = y - dimensions.height / 2.0f;
+				const float dz = z - dimensions.depth / 2.0f;
+				const bool isInside = dx * dx + dy * dy + dz * dz < dimensions.width * dimensions.width / 9.0f;
+				const float value = isInside ? 180.0f : x % 17 < 8 ? 60.0f : 20.0f;
+				volume[dimensions.GetIndex(x, y, z)] = static_cast<uint8_t>(std::clamp(value + noise(random), 0.0f, 255.0f));
+			}
+		}
+	}
+	return volume;
+}
+
+// Every voxel of the block path against the scalar reference. The sizes are a few blocks with partial ones
+// at the ends, volumes smaller than the filter radius and a single voxel. The reference takes every tap
+// of the window, so the larger volumes only run the settings the application defaults to.
+static void TestAgainstReference()
+{
+	const VolumeDimensions sizes[] = { { 100, 37, 29 }, { 5, 3, 2 }, { 1, 1, 1 }, { 64, 16, 16 }, { 130, 20, 33 } };
+	for (const VolumeDimensions& dimensions : sizes)
+	{
+		const bool isLarge = dimensions.GetVoxelCount() > 20000;
+		const std::vector<uint8_t> volume = GetNoisyVolume(dimensions, dimensions.width);
+		std::vector<uint8_t> filtered(volume.size());
+		auto matches = [&](const std::function<uint8_t(uint32_t x, uint32_t y, uint32_t z)>& getReference) {
+			for (uint32_t z = 0; z < dimensions.depth; z++)
+				for (uint32_t y = 0; y < dimensions.height; y++)
+					for (uint32_t x = 0; x < dimensions.width; x++)
+					{
+						if (filtered[dimensions.GetIndex(x, y, z)] != getReference(x, y, z))
+							return false;
+					}
+			return true;
+		};
+
+		for (float sigma : isLarge ? std::vector<float>{ 0.8f } : std::vector<float>{ 0.5f, 0.8f, 1.5f })
+		{
+			std::fill(filtered.begin(), filtered.end(), 0xCD);
+			VolumeFilter::Gaussian(volume.data(), dimensions, sigma, filtered.data());
+			CHECK(matches([&](uint32_t x, uint32_t y, uint32_t z) { return VolumeFilter::GaussianAt(volume.data(), dimensions, x, y, z, sigma); }));
+		}
+		for (uint32_t radius : isLarge ? std::vector<uint32_t>{ 1 } : std::vector<uint32_t>{ 1, 2 })
+		{
+			std::fill(filtered.begin(), filtered.end(), 0xCD);
+			VolumeFilter::Median(volume.data(), dimensions, radius, filtered.data());
+			CHECK(matches([&](uint32_t x, uint32_t y, uint32_t z) { return VolumeFilter::MedianAt(volume.data(), dimensions, x, y, z, radius); }));
+		}
+		for (float spatialSigma : isLarge ? std::vector<float>{ 0.5f } : std::vector<float>{ 0.5f, 1.0f })
+		{
+			std::fill(filtered.begin(), filtered.end(), 0xCD);
+			VolumeFilter::Bilateral(volume.data(), dimensions, spatialSigma, 20.0f, filtered.data());
+			CHECK(matches([&](uint32_t x, uint32_t y, uint32_t z) {
+				return VolumeFilter::BilateralAt(volume.data(), dimensions, x, y, z, spatialSigma, 20.0f); }));
+		}
+	}
+}
+
+// a flat volume stays flat, a single bright voxel is gone after the median and a step survives the bilateral
+static void TestFiltering()
+{
+	const VolumeDimensions dimensions = { 20, 12, 9 };
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount(), 77);
+	std::vector<uint8_t> filtered(volume.size());
+	VolumeFilter::Gaussian(volume.data(), dimensions, 1.5f, filtered.data());
+	CHECK(filtered == volume);
+	VolumeFilter::Bilateral(volume.data(), dimensions, 1.0f, 20.0f, filtered.data());
+	CHECK(filtered == volume);
+
+	volume[dimensions.GetIndex(7, 5, 4)] = 255;
+	VolumeFilter::Median(volume.data(), dimensions, 1, filtered.data());
+	CHECK(std::all_of(filtered.begin(), filtered.end(), [](uint8_t value) { return value == 77; }));
+
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+		for (uint32_t y = 0; y < dimensions.height; y++)
+			for (uint32_t x = 0; x < dimensions.width; x++)
+				volume[dimensions.GetIndex(x, y, z)] = x < 10 ? 20 : 200;
+	VolumeFilter::Bilateral(volume.data(), dimensions, 1.0f, 20.0f, filtered.data());
+	CHECK(filtered == volume);
+	VolumeFilter::Gaussian(volume.data(), dimensions, 1.0f, filtered.data());
+	CHECK(filtered[dimensions.GetIndex(9, 5, 4)] > 20 && filtered[dimensions.GetIndex(10, 5, 4)] < 200);
+}
+
+// throughput of every filter on a 256^3 volume, on every thread of the pool
+static void BenchmarkFilters()
+{
+	const VolumeDimensions dimensions = { 256, 256, 256 };
+	const std::vector<uint8_t> volume = GetNoisyVolume(dimensions, 7);
+	std::vector<uint8_t> filtered(volume.size());
+
+	struct Filter {
+		const char* name;
+		std::function<void()> run;
+	};
+	const Filter filters[] = {
+		{ "Gaussian sigma 0.8", [&]() { VolumeFilter::Gaussian(volume.data(), dimensions, 0.8f, filtered.data()); } },
+		{ "Gaussian sigma 1.5", [&]() { VolumeFilter::Gaussian(volume.data(), dimensions, 1.5f, filtered.data()); } },
+		{ "median 3x3x3", [&]() { VolumeFilter::Median(volume.data(), dimensions, 1, filtered.data()); } },
+		{ "median 5x5x5", [&]() { VolumeFilter::Median(volume.data(), dimensions, 2, filtered.data()); } },
+		{ "bilateral sigma 0.5", [&]() { VolumeFilter::Bilateral(volume.data(), dimensions, 0.5f, 20.0f, filtered.data()); } },
+		{ "bilateral sigma 1.0", [&]() { VolumeFilter::Bilateral(volume.data(), dimensions, 1.0f, 20.0f, filtered.data()); } },
+	};
+	std::printf("256x256x256, %u threads\n", ThreadPool::Get().GetThreadCount());
+	for (const Filter& filter : filters)
+	{
+		const double milliseconds = MeasureMilliseconds(3, filter.run);
+		std::printf("%-20s %7.1f ms, %7.1f Mvoxels/s\n", filter.name, milliseconds, dimensions.GetVoxelCount() / milliseconds / 1000.0);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	TestAgainstReference();
+	TestFiltering();
+	if (IsBenchmarkRun(argc, argv))
+		BenchmarkFilters();
+	return GetTestResult();
+}
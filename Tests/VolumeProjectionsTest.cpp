@@ -0,0 +1,236 @@
+#include "Test.h"
+#include "VolumeProjections.h"
+#include "ThreadPool.h"
+
+#include <fstream>
+#include <random>
+#include <vector>
+
+static const std::filesystem::path OUTPUT_DIRECTORY = std::filesystem::temp_directory_path() / "VolumeProjectionsTest";
+
+// bright structures in noise, so maxima and averages differ from pixel to pixel
+static std::vector<uint8_t> GetVolume(const VolumeDimensions& dimensions, uint32_t seed)
+{
+	std::mt19937 random(seed);
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount());
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+		for (uint32_t y = 0; y < dimensions.height; y++)
+			for (uint32_t x = 0; x < dimensions.width; x++)
+			{
+				const bool isBright = (x * 3 + y * 5 + z * 7) % 23 == 0;
+				volume[dimensions.GetIndex(x, y, z)] = static_cast<uint8_t>(isBright ? 200 + random() % 56 : random() % 100);
+			}
+	return volume;
+}
+
+// every pixel walks its line of voxels, the average is rounded to the nearest value
+static ProjectionImage GetReference(const std::vector<uint8_t>& volume, const VolumeDimensions& dimensions, ProjectionAxis axis, bool isMaximum)
+{
+	const uint32_t sizes[3] = { dimensions.width, dimensions.height, dimensions.depth };
+	const uint32_t d = static_cast<uint32_t>(axis);
+	const uint32_t u = d == 0 ? 1 : 0;
+	const uint32_t v = d == 2 ? 1 : 2;
+	ProjectionImage image{ .width = sizes[u], .height = sizes[v], .pixels = std::vector<uint8_t>(static_cast<size_t>(sizes[u]) * sizes[v]) };
+	for (uint32_t j = 0; j < sizes[v]; j++)
+		for (uint32_t i = 0; i < sizes[u]; i++)
+		{
+			uint32_t maximum = 0;
+			uint32_t sum = 0;
+			for (uint32_t k = 0; k < sizes[d]; k++)
+			{
+				uint32_t voxel[3]{};
+				voxel[d] = k;
+				voxel[u] = i;
+				voxel[v] = j;
+				const uint8_t value = volume[dimensions.GetIndex(voxel[0], voxel[1], voxel[2])];
+				maximum = std::max<uint32_t>(maximum, value);
+				sum += value;
+			}
+			image.pixels[static_cast<size_t>(j) * image.width + i] = static_cast<uint8_t>(isMaximum ? maximum : (sum + sizes[d] / 2) / sizes[d]);
+		}
+	return image;
+}
+
+static bool IsSame(const ProjectionImage& a, const ProjectionImage& b)
+{
+	return a.width == b.width && a.height == b.height && a.pixels == b.pixels;
+}
+
+static bool IsSameAsReference(const VolumeProjections& projections, const std::vector<uint8_t>& volume, const VolumeDimensions& dimensions)
+{
+	bool isSame = true;
+	for (ProjectionAxis axis : { ProjectionAxis::X, ProjectionAxis::Y, ProjectionAxis::Z })
+	{
+		isSame &= IsSame(projections.GetMaximum(axis), GetReference(volume, dimensions, axis, true));
+		isSame &= IsSame(projections.GetAverage(axis), GetReference(volume, dimensions, axis, false));
+	}
+	return isSame;
+}
+
+// Sizes with rows shorter than a SIMD block, rows ending in a partial block, a partial band of rows and a
+// single voxel. Slabs of every size come in any order, the projections are only complete after the last.
+static void TestAgainstReference()
+{
+	const VolumeDimensions sizes[] = { { 37, 19, 40 }, { 16, 16, 16 }, { 5, 3, 2 }, { 70, 33, 17 }, { 1, 1, 1 }, { 130, 1, 9 } };
+	for (const VolumeDimensions& dimensions : sizes)
+	{
+		const std::vector<uint8_t> volume = GetVolume(dimensions, dimensions.width);
+		const size_t sliceSize = static_cast<size_t>(dimensions.width) * dimensions.height;
+		for (uint32_t slabSize : { 16u, 1u, 7u })
+		{
+			std::vector<uint32_t> firstSlices;
+			for (uint32_t z = 0; z < dimensions.depth; z += slabSize)
+				firstSlices.push_back(z);
+			if (slabSize == 7)
+				std::reverse(firstSlices.begin(), firstSlices.end());
+
+			VolumeProjections projections;
+			projections.Initialize(dimensions);
+			for (uint32_t firstSlice : firstSlices)
+			{
+				CHECK(!projections.IsComplete());
+				projections.AddSlab(volume.data() + firstSlice * sliceSize, firstSlice, std::min(slabSize, dimensions.depth - firstSlice));
+			}
+			CHECK(projections.IsComplete());
+			CHECK(IsSameAsReference(projections, volume, dimensions));
+		}
+	}
+}
+
+// A bright volume wide enough to fill every lane of the sums, a black one and a dim one, with Initialize
+// starting over in between.
+static void TestExtremes()
+{
+	const VolumeDimensions dimensions = { 300, 40, 35 };
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount());
+	VolumeProjections projections;
+	for (uint8_t value : { 255, 0, 1 })
+	{
+		std::fill(volume.begin(), volume.end(), value);
+		projections.Initialize(dimensions);
+		projections.AddSlab(volume.data(), 0, dimensions.depth);
+		for (ProjectionAxis axis : { ProjectionAxis::X, ProjectionAxis::Y, ProjectionAxis::Z })
+		{
+			const ProjectionImage maximum = projections.GetMaximum(axis);
+			const ProjectionImage average = projections.GetAverage(axis);
+			CHECK(std::all_of(maximum.pixels.begin(), maximum.pixels.end(), [&](uint8_t pixel) { return pixel == value; }));
+			CHECK(std::all_of(average.pixels.begin(), average.pixels.end(), [&](uint8_t pixel) { return pixel == value; }));
+		}
+	}
+}
+
+// the gray values of a 24 bit BMP written bottom up
+static ProjectionImage ReadBmp(const std::filesystem::path& filePath)
+{
+	std::ifstream file(filePath, std::ios::binary);
+	const std::vector<uint8_t> bmp((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	ProjectionImage image;
+	if (bmp.size() < 54 || bmp[0] != 'B' || bmp[1] != 'M')
+		return image;
+
+	memcpy(&image.width, &bmp[18], sizeof(uint32_t));
+	memcpy(&image.height, &bmp[22], sizeof(uint32_t));
+	const size_t rowSize = (image.width * 3 + 3) & ~3u;
+	if (bmp.size() < 54 + rowSize * image.height)
+		return {};
+	image.pixels.resize(static_cast<size_t>(image.width) * image.height);
+	for (uint32_t y = 0; y < image.height; y++)
+		for (uint32_t x = 0; x < image.width; x++)
+			image.pixels[static_cast<size_t>(y) * image.width + x] = bmp[54 + (image.height - 1 - y) * rowSize + x * 3];
+	return image;
+}
+
+// boxes of factor x factor pixels, clipped at the far edges, keeping the maximum or the rounded mean
+static ProjectionImage DownsampleReference(const ProjectionImage& image, uint32_t factor, bool isMaximum)
+{
+	ProjectionImage result{ .width = (image.width + factor - 1) / factor, .height = (image.height + factor - 1) / factor, .pixels = {} };
+	for (uint32_t y = 0; y < result.height; y++)
+		for (uint32_t x = 0; x < result.width; x++)
+		{
+			uint32_t value = 0;
+			uint32_t count = 0;
+			for (uint32_t sourceY = y * factor; sourceY < std::min((y + 1) * factor, image.height); sourceY++)
+				for (uint32_t sourceX = x * factor; sourceX < std::min((x + 1) * factor, image.width); sourceX++)
+				{
+					const uint8_t pixel = image.pixels[static_cast<size_t>(sourceY) * image.width + sourceX];
+					value = isMaximum ? std::max<uint32_t>(value, pixel) : value + pixel;
+					count++;
+				}
+			result.pixels.push_back(static_cast<uint8_t>(isMaximum ? value : (value + count / 2) / count));
+		}
+	return result;
+}
+
+// The catalogue path: a raw file read slab by slab, six images next to it scaled down by a whole factor.
+// A file shorter than the volume writes nothing.
+static void TestWriteImagesForFile()
+{
+	const VolumeDimensions dimensions = { 70, 45, 33 };
+	const std::vector<uint8_t> volume = GetVolume(dimensions, 5);
+	const std::filesystem::path datasetPath = OUTPUT_DIRECTORY / "dataset.raw";
+	{
+		std::ofstream file(datasetPath, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(volume.data()), volume.size());
+	}
+
+	// every image by the whole factor that brings its longer side to 16 or less, 70 by 5 and 45 by 3
+	CHECK(VolumeProjections::WriteImagesForFile(datasetPath, dimensions, 16));
+	const char* axisNames[3] = { "x", "y", "z" };
+	for (ProjectionAxis axis : { ProjectionAxis::X, ProjectionAxis::Y, ProjectionAxis::Z })
+	{
+		const std::string axisName = axisNames[static_cast<size_t>(axis)];
+		const ProjectionImage maximum = ReadBmp(OUTPUT_DIRECTORY / ("dataset.mip_" + axisName + ".bmp"));
+		const ProjectionImage average = ReadBmp(OUTPUT_DIRECTORY / ("dataset.avg_" + axisName + ".bmp"));
+		const uint32_t factor = axis == ProjectionAxis::X ? 3 : 5;
+		CHECK(IsSame(maximum, DownsampleReference(GetReference(volume, dimensions, axis, true), factor, true)));
+		CHECK(IsSame(average, DownsampleReference(GetReference(volume, dimensions, axis, false), factor, false)));
+	}
+
+	// images that fit stay as they are
+	CHECK(VolumeProjections::WriteImagesForFile(datasetPath, dimensions, 70));
+	CHECK(IsSame(ReadBmp(OUTPUT_DIRECTORY / "dataset.mip_z.bmp"), GetReference(volume, dimensions, ProjectionAxis::Z, true)));
+
+	const std::filesystem::path truncatedPath = OUTPUT_DIRECTORY / "truncated.raw";
+	{
+		std::ofstream file(truncatedPath, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(volume.data()), volume.size() - 1);
+	}
+	CHECK(!VolumeProjections::WriteImagesForFile(truncatedPath, dimensions, 16));
+	CHECK(!std::filesystem::exists(OUTPUT_DIRECTORY / "truncated.mip_x.bmp"));
+	CHECK(!VolumeProjections::WriteImagesForFile(OUTPUT_DIRECTORY / "missing.raw", dimensions, 16));
+}
+
+// a 256^3 volume added in slabs of 16 slices the way the loader hands them over, against the reference
+static void BenchmarkProjections()
+{
+	const VolumeDimensions dimensions = { 256, 256, 256 };
+	const std::vector<uint8_t> volume = GetVolume(dimensions, 9);
+	const size_t sliceSize = static_cast<size_t>(dimensions.width) * dimensions.height;
+	VolumeProjections projections;
+	const double milliseconds = MeasureMilliseconds(5, [&]() {
+		projections.Initialize(dimensions);
+		for (uint32_t z = 0; z < dimensions.depth; z += BRICK_SIZE)
+			projections.AddSlab(volume.data() + z * sliceSize, z, BRICK_SIZE);
+	});
+	const double referenceMilliseconds = MeasureMilliseconds(1, [&]() {
+		for (ProjectionAxis axis : { ProjectionAxis::X, ProjectionAxis::Y, ProjectionAxis::Z })
+		{
+			CHECK(IsSame(projections.GetMaximum(axis), GetReference(volume, dimensions, axis, true)));
+			CHECK(IsSame(projections.GetAverage(axis), GetReference(volume, dimensions, axis, false)));
+		}
+	});
+	std::printf("256x256x256, %u threads\n", ThreadPool::Get().GetThreadCount());
+	std::printf("all six projections %6.2f ms, reference %7.2f ms\n", milliseconds, referenceMilliseconds);
+}
+
+int main(int argc, char** argv)
+{
+	std::filesystem::create_directories(OUTPUT_DIRECTORY);
+	TestAgainstReference();
+	TestExtremes();
+	TestWriteImagesForFile();
+	if (IsBenchmarkRun(argc, argv))
+		BenchmarkProjections();
+	std::filesystem::remove_all(OUTPUT_DIRECTORY);
+	return GetTestResult();
+}
@@ -0,0 +1,195 @@
+#include "Test.h"
+#include "VolumeResampler.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static bool IsNear(const Float3& a, const Float3& b)
+{
+	return std::abs(a.x - b.x) < 1e-3f && std::abs(a.y - b.y) < 1e-3f && std::abs(a.z - b.z) < 1e-3f;
+}
+
+static AffineTransform GetRotation(float angleX, float angleZ)
+{
+	AffineTransform rotationX;
+	rotationX.m[1][1] = std::cos(angleX);
+	rotationX.m[1][2] = -std::sin(angleX);
+	rotationX.m[2][1] = std::sin(angleX);
+	rotationX.m[2][2] = std::cos(angleX);
+	AffineTransform rotationZ;
+	rotationZ.m[0][0] = std::cos(angleZ);
+	rotationZ.m[0][1] = -std::sin(angleZ);
+	rotationZ.m[1][0] = std::sin(angleZ);
+	rotationZ.m[1][1] = std::cos(angleZ);
+	return rotationZ * rotationX;
+}
+
+// A CT-like primary with thick slices and a PET-like secondary with coarse voxels, tilted and shifted
+// against each other. Returns the map from primary voxels to secondary voxels.
+static AffineTransform GetRegistration()
+{
+	AffineTransform secondaryToWorld = GetRotation(0.17f, 0.35f) * AffineTransform::FromSpacing({ 2.0f, 2.0f, 3.0f }, { -4.0f, 3.0f, -2.5f });
+	return secondaryToWorld.Inverse() * AffineTransform::FromSpacing({ 0.8f, 0.8f, 2.5f }, { 0.0f, 0.0f, 0.0f });
+}
+
+static std::vector<uint8_t> GetRandomVolume(const VolumeDimensions& dimensions, uint32_t seed)
+{
+	std::mt19937 random(seed);
+	std::vector<uint8_t> volume(dimensions.GetVoxelCount());
+	for (uint8_t& value : volume)
+		value = static_cast<uint8_t>(random());
+	return volume;
+}
+
+static void TestAffineTransform()
+{
+	const AffineTransform spacing = AffineTransform::FromSpacing({ 0.5f, 2.0f, 3.0f }, { 1.0f, -2.0f, 4.0f });
+	CHECK(IsNear(spacing.Apply({ 2.0f, 1.0f, 1.0f }), { 2.0f, 0.0f, 7.0f }));
+	CHECK(IsNear(spacing.ApplyLinear({ 2.0f, 1.0f, 1.0f }), { 1.0f, 2.0f, 3.0f }));
+
+	// the right hand side goes first
+	const AffineTransform rotation = GetRotation(0.0f, 1.5707964f);
+	CHECK(IsNear((rotation * spacing).Apply({ 2.0f, 1.0f, 1.0f }), rotation.Apply(spacing.Apply({ 2.0f, 1.0f, 1.0f }))));
+	CHECK(IsNear((rotation * spacing).Apply({ 2.0f, 1.0f, 1.0f }), { 0.0f, 2.0f, 7.0f }));
+
+	const AffineTransform registration = GetRegistration();
+	const AffineTransform inverse = registration.Inverse();
+	for (const Float3& p : { Float3{ 0.0f, 0.0f, 0.0f }, Float3{ 10.0f, -3.0f, 7.5f }, Float3{ 100.0f, 50.0f, 20.0f } })
+	{
+		CHECK(IsNear(inverse.Apply(registration.Apply(p)), p));
+		CHECK(IsNear((inverse * registration).Apply(p), p));
+	}
+}
+
+// the voxel centers of the source come back unchanged and the points between them are the average
+static void TestSample()
+{
+	const VolumeDimensions dimensions = { 3, 2, 2 };
+	const std::vector<uint8_t> volume = { 0, 10, 20, 30, 40, 50, 60, 70, 80, 90, 100, 110 };
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+		for (uint32_t y = 0; y < dimensions.height; y++)
+			for (uint32_t x = 0; x < dimensions.width; x++)
+			{
+				const Float3 position = { static_cast<float>(x), static_cast<float>(y), static_cast<float>(z) };
+				CHECK(VolumeResampler::Sample(volume.data(), dimensions, position) == volume[dimensions.GetIndex(x, y, z)]);
+			}
+
+	CHECK(std::abs(VolumeResampler::Sample(volume.data(), dimensions, { 0.5f, 0.5f, 0.5f }) - 50.0f) < 1e-4f);
+	CHECK(VolumeResampler::Sample(volume.data(), dimensions, { -0.01f, 0.0f, 0.0f }) == 0.0f);
+	CHECK(VolumeResampler::Sample(volume.data(), dimensions, { 2.0f, 1.01f, 0.0f }) == 0.0f);
+	CHECK(VolumeResampler::Sample(volume.data(), dimensions, { 0.0f, 0.0f, NAN }) == 0.0f);
+}
+
+// Every destination voxel against the rounded scalar reference at the same position. The SIMD path
+// steps along rows from the row start, so the positions can differ in the last bits and the rounding
+// go the other way, never more than that.
+static void TestResampleAgainstSample()
+{
+	const VolumeDimensions sourceDimensions = { 30, 25, 14 };
+	const VolumeDimensions destinationDimensions = { 37, 29, 23 };
+	const std::vector<uint8_t> source = GetRandomVolume(sourceDimensions, 7);
+	const AffineTransform destinationToSource = GetRegistration();
+
+	std::vector<uint8_t> destination(destinationDimensions.GetVoxelCount(), 0xCD);
+	VolumeResampler::Resample(source.data(), sourceDimensions, destinationToSource, destination.data(), destinationDimensions);
+
+	size_t insideCount = 0;
+	size_t differentCount = 0;
+	for (uint32_t z = 0; z < destinationDimensions.depth; z++)
+	{
+		for (uint32_t y = 0; y < destinationDimensions.height; y++)
+		{
+			for (uint32_t x = 0; x < destinationDimensions.width; x++)
+			{
+				const Float3 position = destinationToSource.Apply({ static_cast<float>(x), static_cast<float>(y), static_cast<float>(z) });
+				const int32_t expected = static_cast<int32_t>(VolumeResampler::Sample(source.data(), sourceDimensions, position) + 0.5f);
+				const int32_t actual = destination[destinationDimensions.GetIndex(x, y, z)];
+				CHECK(std::abs(actual - expected) <= 1);
+				insideCount += expected != 0;
+				differentCount += actual != expected;
+			}
+		}
+	}
+	// the registration has to cover part of the destination, and off by one has to stay the exception
+	CHECK(insideCount > destinationDimensions.GetVoxelCount() / 4 && insideCount < destinationDimensions.GetVoxelCount());
+	CHECK(differentCount * 100 < destinationDimensions.GetVoxelCount());
+}
+
+// the identity hands the source back, a shift by whole voxels moves it and fills in 0
+static void TestResampleExact()
+{
+	const VolumeDimensions dimensions = { 21, 18, 17 };
+	const std::vector<uint8_t> source = GetRandomVolume(dimensions, 3);
+	std::vector<uint8_t> destination(dimensions.GetVoxelCount());
+	VolumeResampler::Resample(source.data(), dimensions, AffineTransform(), destination.data(), dimensions);
+	CHECK(destination == source);
+
+	const AffineTransform shift = AffineTransform::FromSpacing({ 1.0f, 1.0f, 1.0f }, { 2.0f, -1.0f, 0.0f });
+	VolumeResampler::Resample(source.data(), dimensions, shift, destination.data(), dimensions);
+	for (uint32_t z = 0; z < dimensions.depth; z++)
+		for (uint32_t y = 0; y < dimensions.height; y++)
+			for (uint32_t x = 0; x < dimensions.width; x++)
+			{
+				const bool isInside = x + 2 < dimensions.width && y >= 1;
+				CHECK(destination[dimensions.GetIndex(x, y, z)] == (isInside ? source[dimensions.GetIndex(x + 2, y - 1, z)] : 0));
+			}
+}
+
+// the primary in the first byte of every pair, the secondary as Resample puts it in the second
+static void TestFuse()
+{
+	const VolumeDimensions primaryDimensions = { 19, 33, 9 };
+	const VolumeDimensions secondaryDimensions = { 12, 14, 6 };
+	const std::vector<uint8_t> primary = GetRandomVolume(primaryDimensions, 1);
+	const std::vector<uint8_t> secondary = GetRandomVolume(secondaryDimensions, 2);
+	const AffineTransform primaryToSecondary = GetRegistration();
+
+	std::vector<uint8_t> fused(primary.size() * 2);
+	VolumeResampler::Fuse(primary.data(), primaryDimensions, secondary.data(), secondaryDimensions, primaryToSecondary, fused.data());
+	std::vector<uint8_t> resampled(primary.size());
+	VolumeResampler::Resample(secondary.data(), secondaryDimensions, primaryToSecondary, resampled.data(), primaryDimensions);
+	for (size_t voxel = 0; voxel < primary.size(); voxel++)
+		CHECK(fused[voxel * 2] == primary[voxel] && fused[voxel * 2 + 1] == resampled[voxel]);
+}
+
+// Resample against the scalar reference run over the same slices, both on every thread of the pool
+static void BenchmarkResample()
+{
+	const VolumeDimensions sourceDimensions = { 128, 128, 96 };
+	const VolumeDimensions destinationDimensions = { 256, 256, 192 };
+	const std::vector<uint8_t> source = GetRandomVolume(sourceDimensions, 5);
+	const AffineTransform destinationToSource = GetRegistration();
+	std::vector<uint8_t> destination(destinationDimensions.GetVoxelCount());
+
+	const double simd = MeasureMilliseconds(3, [&]() {
+		VolumeResampler::Resample(source.data(), sourceDimensions, destinationToSource, destination.data(), destinationDimensions);
+	});
+	const double scalar = MeasureMilliseconds(3, [&]() {
+		ThreadPool::Get().ParallelFor(destinationDimensions.depth, [&](uint32_t z) {
+			for (uint32_t y = 0; y < destinationDimensions.height; y++)
+				for (uint32_t x = 0; x < destinationDimensions.width; x++)
+				{
+					const Float3 position = destinationToSource.Apply({ static_cast<float>(x), static_cast<float>(y), static_cast<float>(z) });
+					destination[destinationDimensions.GetIndex(x, y, z)] =
+						static_cast<uint8_t>(VolumeResampler::Sample(source.data(), sourceDimensions, position) + 0.5f);
+				}
+		});
+	});
+	std::printf("256x256x192 from 128x128x96, %u threads: resample %.1f ms, scalar %.1f ms\n",
+		ThreadPool::Get().GetThreadCount(), simd, scalar);
+}
+
+int main(int argc, char** argv)
+{
+	TestAffineTransform();
+	TestSample();
+	TestResampleAgainstSample();
+	TestResampleExact();
+	TestFuse();
+	if (IsBenchmarkRun(argc, argv))
+		BenchmarkResample();
+	return GetTestResult();
+}
@@ -0,0 +1,111 @@
+#include "ThreadPool.h"
+
+static thread_local bool isInsideJob = false;
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+	threadCount = threadCount > 1 ? threadCount - 1 : 0;
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		mWorkers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard lock(mMutex);
+		mShutdown = true;
+	}
+	mWakeCondition.notify_all();
+
+	for (std::thread& worker : mWorkers)
+		worker.join();
+}
+
+ThreadPool& ThreadPool::Get()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::RunJob(Job& job)
+{
+	bool wasInsideJob = isInsideJob;
+	isInsideJob = true;
+
+	for (;;)
+	{
+		uint32_t index = job.next.fetch_add(1, std::memory_order_relaxed);
+		if (index >= job.count)
+			break;
+
+		(*job.func)(index);
+		job.finished.fetch_add(1, std::memory_order_release);
+	}
+
+	isInsideJob = wasInsideJob;
+}
+
+void ThreadPool::WorkerLoop()
+{
+	uint64_t seenGeneration = 0;
+
+	for (;;)
+	{
+		Job* job = nullptr;
+		{
+			std::unique_lock lock(mMutex);
+			mWakeCondition.wait(lock, [&] { return mShutdown || mJobGeneration != seenGeneration; });
+			if (mShutdown)
+				return;
+
+			seenGeneration = mJobGeneration;
+			job = mCurrentJob;
+			if (job == nullptr)
+				continue;
+			mActiveWorkers++;
+		}
+
+		RunJob(*job);
+
+		{
+			std::lock_guard lock(mMutex);
+			mActiveWorkers--;
+		}
+		mDoneCondition.notify_one();
+	}
+}
+
+void ThreadPool::ParallelFor(uint32_t count, const std::function<void(uint32_t)>& func)
+{
+	if (count == 0)
+		return;
+
+	// nested calls from inside a job (or a pool without workers) just run inline
+	if (isInsideJob || mWorkers.empty() || count == 1)
+	{
+		for (uint32_t i = 0; i < count; i++)
+			func(i);
+		return;
+	}
+
+	std::lock_guard submitLock(mSubmitMutex);
+
+	Job job;
+	job.func = &func;
+	job.count = count;
+	{
+		std::lock_guard lock(mMutex);
+		mCurrentJob = &job;
+		mJobGeneration++;
+	}
+	mWakeCondition.notify_all();
+
+	RunJob(job);
+
+	std::unique_lock lock(mMutex);
+	mDoneCondition.wait(lock, [&] {
+		return mActiveWorkers == 0 && job.finished.load(std::memory_order_acquire) == count; });
+	mCurrentJob = nullptr;
+}
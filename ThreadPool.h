@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker pool for the CPU-side volume processing. Deliberately has no
+// platform dependencies so the preprocessing code can be run anywhere.
+class ThreadPool {
+public:
+	explicit ThreadPool(uint32_t threadCount = std::thread::hardware_concurrency());
+	~ThreadPool();
+
+	static ThreadPool& Get();
+
+	uint32_t GetThreadCount() const { return static_cast<uint32_t>(mWorkers.size()) + 1; }
+
+	// calls func(index) for every index in [0, count), the calling thread helps out and returns once all are done
+	void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& func);
+
+private:
+	struct Job {
+		const std::function<void(uint32_t)>* func = nullptr;
+		uint32_t count = 0;
+		std::atomic<uint32_t> next = 0;
+		std::atomic<uint32_t> finished = 0;
+	};
+
+	void WorkerLoop();
+	static void RunJob(Job& job);
+
+private:
+	std::vector<std::thread> mWorkers;
+	std::mutex mMutex;
+	std::condition_variable mWakeCondition;
+	std::condition_variable mDoneCondition;
+	std::mutex mSubmitMutex;
+	Job* mCurrentJob = nullptr;
+	uint64_t mJobGeneration = 0;
+	uint32_t mActiveWorkers = 0;
+	bool mShutdown = false;
+};
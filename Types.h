@@ -1,6 +1,7 @@
 #pragma once
 
 #include "D3D12MemAlloc.h"
+#include "MemoryTracker.h"
 
 #include <filesystem>
 #include <fstream>
@@ -17,7 +18,10 @@ struct Resource {
 	D3D12_RESOURCE_STATES mCurrentState = D3D12_RESOURCE_STATE_COMMON;
 	D3D12_RESOURCE_DESC mDesc{};
 	uint32_t mDescriptorIndex = 0;
-	uint32_t mSize = 0;
+	// bytes of data in every subresource, without row pitch padding
+	uint64_t mSize = 0;
+	// the allocation's bytes in video memory, counted under the category the resource was created with
+	TrackedMemory mTrackedMemory;
 };
 
 struct BufferResource : public Resource {
@@ -37,6 +41,11 @@ struct TextureResource : public Resource {
 	DXGI_FORMAT mTextureFormat = DXGI_FORMAT_UNKNOWN;
 };
 
+struct UploadAllocation {
+	void* mCpuAddress = nullptr;
+	uint64_t mOffset = 0;
+};
+
 enum DescriptorType : uint8_t {
 	None = 0,
 	Cbv = 1,
@@ -61,6 +70,7 @@ struct BufferDescription {
 	uint32_t stride = 0;
 	bool isShaderVisible = false;
 	bool isRaw = false;
+	MemoryCategory memoryCategory = MemoryCategory::Other;
 };
 
 struct TextureDescription {
@@ -73,6 +83,7 @@ struct TextureDescription {
 	uint32_t height = 1;
 	uint16_t depthOrArraySize = 1;
 	uint16_t mipLevels = 1;
+	MemoryCategory memoryCategory = MemoryCategory::Other;
 };
 
 struct PerFrameConstantBuffer {
@@ -82,6 +93,24 @@ struct PerFrameConstantBuffer {
 	uint32_t backDescriptorIndex = UINT_MAX;
 	uint32_t cubeDescriptorIndex = UINT_MAX;
 	uint32_t volumeDataDescriptor = UINT_MAX;
+	uint32_t isosurfaceVertexDescriptor = UINT_MAX;
+	uint32_t isosurfaceIndexDescriptor = UINT_MAX;
+	DirectX::XMUINT3 volumeDimensions{};
+	uint32_t pageTableDescriptor = UINT_MAX;
+	DirectX::XMUINT3 brickGridDimensions{};
+	uint32_t brickAtlasDescriptor = UINT_MAX;
+	DirectX::XMUINT3 atlasSlotDimensions{};
+	uint32_t brickFeedbackDescriptor = UINT_MAX;
+	uint32_t sliceDescriptor = UINT_MAX;
+	uint32_t illuminationDescriptor = UINT_MAX;
+	uint32_t labelDescriptor = UINT_MAX;
+	uint32_t labelBitsPerVoxel = 0;
+	DirectX::XMUINT3 labelDimensions{};
+	uint32_t labelCount = 0;
+	DirectX::XMUINT4 labelVisibility[2]{}; // bit per label
+	uint32_t labelColors[256]{}; // RGBA8 per label, alpha is the opacity (uint4[64] on the HLSL side)
+	DirectX::XMUINT3 stepGridDimensions{};
+	uint32_t stepGridDescriptor = UINT_MAX;
 };
 
 struct CameraConstantBuffer {
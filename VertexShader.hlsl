@@ -15,6 +15,24 @@ struct PerFrameConstants {
 	uint backBufferIndex;
 	uint cubeBufferIndex;
 	uint volumeDataBufferIndex;
+	uint isosurfaceVertexBufferIndex;
+	uint isosurfaceIndexBufferIndex;
+	uint3 volumeDimensions;
+	uint pageTableIndex;
+	uint3 brickGridDimensions;
+	uint brickAtlasIndex;
+	uint3 atlasSlotDimensions;
+	uint brickFeedbackIndex;
+	uint sliceIndex;
+	uint illuminationIndex;
+	uint labelIndex;
+	uint labelBitsPerVoxel;
+	uint3 labelDimensions;
+	uint labelCount;
+	uint4 labelVisibility[2];
+	uint4 labelColors[64];
+	uint3 stepGridDimensions;
+	uint stepGridIndex;
 };
 
 
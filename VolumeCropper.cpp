@@ -0,0 +1,149 @@
+#include "VolumeCropper.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+// bit i set for every byte of 16 above threshold
+#ifdef VOLUME_SSE2
+static uint32_t GetAboveMask(const uint8_t* values, __m128i threshold)
+{
+	// saturating subtraction leaves zero for everything at or below the threshold
+	__m128i above = _mm_subs_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values)), threshold);
+	return ~static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(above, _mm_setzero_si128()))) & 0xFFFF;
+}
+#endif
+
+// first and last voxel of the row above threshold, false if there is none
+static bool FindRowBounds(const uint8_t* row, uint32_t length, uint8_t threshold, uint32_t& first, uint32_t& last)
+{
+	uint32_t i = 0;
+	bool isFound = false;
+#ifdef VOLUME_SSE2
+	const __m128i thresholdVector = _mm_set1_epi8(static_cast<char>(threshold));
+	for (; i + 16 <= length; i += 16)
+	{
+		const uint32_t mask = GetAboveMask(row + i, thresholdVector);
+		if (mask != 0)
+		{
+			first = i + std::countr_zero(mask);
+			isFound = true;
+			break;
+		}
+	}
+#endif
+	for (; !isFound && i < length; i++)
+	{
+		if (row[i] > threshold)
+		{
+			first = i;
+			isFound = true;
+		}
+	}
+	if (!isFound)
+		return false;
+
+	// the first hit bounds the search from the back
+	uint32_t end = length;
+#ifdef VOLUME_SSE2
+	for (; end >= first + 16; end -= 16)
+	{
+		const uint32_t mask = GetAboveMask(row + end - 16, thresholdVector);
+		if (mask != 0)
+		{
+			last = end - 16 + 31 - std::countl_zero(mask);
+			return true;
+		}
+	}
+#endif
+	for (; end > first; end--)
+	{
+		if (row[end - 1] > threshold)
+		{
+			last = end - 1;
+			return true;
+		}
+	}
+	last = first;
+	return true;
+}
+
+VolumeBox VolumeCropper::FindBounds(const uint8_t* data, const VolumeDimensions& dimensions, uint8_t threshold)
+{
+	// every slab reduces to its own box, merged at the end
+	const uint32_t slabCount = (dimensions.depth + BRICK_SIZE - 1) / BRICK_SIZE;
+	std::vector<VolumeBox> slabBounds(slabCount);
+	ThreadPool::Get().ParallelFor(slabCount, [&](uint32_t slab) {
+		VolumeBox bounds = { .minX = UINT32_MAX, .minY = UINT32_MAX, .minZ = UINT32_MAX };
+		const uint32_t endZ = std::min((slab + 1) * BRICK_SIZE, dimensions.depth);
+		for (uint32_t z = slab * BRICK_SIZE; z < endZ; z++)
+		{
+			for (uint32_t y = 0; y < dimensions.height; y++)
+			{
+				uint32_t first = 0;
+				uint32_t last = 0;
+				if (!FindRowBounds(data + dimensions.GetIndex(0, y, z), dimensions.width, threshold, first, last))
+					continue;
+				bounds.minX = std::min(bounds.minX, first);
+				bounds.maxX = std::max(bounds.maxX, last + 1);
+				bounds.minY = std::min(bounds.minY, y);
+				bounds.maxY = std::max(bounds.maxY, y + 1);
+				bounds.minZ = std::min(bounds.minZ, z);
+				bounds.maxZ = z + 1;
+			}
+		}
+		slabBounds[slab] = bounds;
+	});
+
+	VolumeBox bounds = { .minX = UINT32_MAX, .minY = UINT32_MAX, .minZ = UINT32_MAX };
+	for (const VolumeBox& slab : slabBounds)
+	{
+		bounds.minX = std::min(bounds.minX, slab.minX);
+		bounds.minY = std::min(bounds.minY, slab.minY);
+		bounds.minZ = std::min(bounds.minZ, slab.minZ);
+		bounds.maxX = std::max(bounds.maxX, slab.maxX);
+		bounds.maxY = std::max(bounds.maxY, slab.maxY);
+		bounds.maxZ = std::max(bounds.maxZ, slab.maxZ);
+	}
+	return bounds.IsEmpty() ? VolumeBox{} : bounds;
+}
+
+VolumeBox VolumeCropper::Expand(const VolumeBox& box, uint32_t margin, const VolumeDimensions& dimensions)
+{
+	return {
+		.minX = box.minX - std::min(box.minX, margin),
+		.minY = box.minY - std::min(box.minY, margin),
+		.minZ = box.minZ - std::min(box.minZ, margin),
+		.maxX = std::min(box.maxX + margin, dimensions.width),
+		.maxY = std::min(box.maxY + margin, dimensions.height),
+		.maxZ = std::min(box.maxZ + margin, dimensions.depth) };
+}
+
+void VolumeCropper::Crop(const uint8_t* data, const VolumeDimensions& dimensions, const VolumeBox& box, uint8_t* destination)
+{
+	assert(box.maxX <= dimensions.width && box.maxY <= dimensions.height && box.maxZ <= dimensions.depth);
+	const uint32_t width = box.maxX - box.minX;
+	const uint32_t height = box.maxY - box.minY;
+
+	auto cropSlice = [&](uint32_t slice) {
+		for (uint32_t y = 0; y < height; y++)
+		{
+			uint8_t* destinationRow = destination + (static_cast<size_t>(slice) * height + y) * width;
+			memmove(destinationRow, data + dimensions.GetIndex(box.minX, box.minY + y, box.minZ + slice), width);
+		}
+	};
+
+	// in place every row moves towards the front, so they have to go in order
+	if (destination == data)
+	{
+		for (uint32_t slice = 0; slice < box.maxZ - box.minZ; slice++)
+			cropSlice(slice);
+	}
+	else
+	{
+		ThreadPool::Get().ParallelFor(box.maxZ - box.minZ, cropSlice);
+	}
+}
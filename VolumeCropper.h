@@ -0,0 +1,16 @@
+#pragma once
+
+#include "VolumeTypes.h"
+
+// Cuts the background (air around a scan) off a volume before it's uploaded.
+class VolumeCropper {
+public:
+	// smallest box holding every voxel above threshold, an empty box if there is none
+	static VolumeBox FindBounds(const uint8_t* data, const VolumeDimensions& dimensions, uint8_t threshold);
+
+	// box grown by margin voxels on every side, clamped to the volume
+	static VolumeBox Expand(const VolumeBox& box, uint32_t margin, const VolumeDimensions& dimensions);
+
+	// copies box out of the volume, destination may be data itself
+	static void Crop(const uint8_t* data, const VolumeDimensions& dimensions, const VolumeBox& box, uint8_t* destination);
+};
@@ -0,0 +1,680 @@
+#include "VolumeFile.h"
+#include "Inflate.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+// voxels converted per thread pool job
+static constexpr uint64_t CONVERT_CHUNK_VOXELS = 1u << 20;
+// deflate's best case, a 258 byte match in a bit or so
+static constexpr uint64_t MAX_DEFLATE_RATIO = 1032;
+
+static std::string ToLower(std::string text)
+{
+	std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return text;
+}
+
+static std::string Trim(const std::string& text)
+{
+	const size_t begin = text.find_first_not_of(" \t\r\n");
+	const size_t end = text.find_last_not_of(" \t\r\n");
+	return begin == std::string::npos ? std::string() : text.substr(begin, end - begin + 1);
+}
+
+// malformed numbers read as 0
+static int64_t ParseInteger(const std::string& text)
+{
+	return std::strtoll(text.c_str(), nullptr, 10);
+}
+
+static bool HasPositiveDimensions(const VolumeFileInfo& info)
+{
+	return info.dimensions.width > 0 && info.dimensions.height > 0 && info.dimensions.depth > 0;
+}
+
+// the first three values of a whitespace separated list of sizes
+static bool ParseDimensions(const std::string& value, VolumeDimensions& dimensions)
+{
+	std::istringstream stream(value);
+	int64_t sizes[3] = {};
+	for (int64_t& size : sizes)
+	{
+		if (!(stream >> size) || size <= 0 || size > std::numeric_limits<uint32_t>::max())
+			return false;
+	}
+	dimensions = { static_cast<uint32_t>(sizes[0]), static_cast<uint32_t>(sizes[1]), static_cast<uint32_t>(sizes[2]) };
+	return true;
+}
+
+// unknown or non-positive spacings stay 1
+static void ParseSpacing(const std::string& value, Float3& spacing)
+{
+	std::istringstream stream(value);
+	float* axes[3] = { &spacing.x, &spacing.y, &spacing.z };
+	for (float* axis : axes)
+	{
+		std::string token;
+		if (!(stream >> token))
+			return;
+		const float parsed = std::strtof(token.c_str(), nullptr);
+		if (std::isfinite(parsed) && parsed != 0.0f)
+			*axis = std::abs(parsed);
+	}
+}
+
+// ----------------------------------------------------------------------------------------------
+// NRRD
+
+static std::optional<VoxelType> ParseNrrdType(const std::string& type)
+{
+	if (type == "uchar" || type == "unsigned char" || type == "uint8" || type == "uint8_t")
+		return VoxelType::Uint8;
+	if (type == "signed char" || type == "int8" || type == "int8_t")
+		return VoxelType::Int8;
+	if (type == "ushort" || type == "unsigned short" || type == "unsigned short int" || type == "uint16" || type == "uint16_t")
+		return VoxelType::Uint16;
+	if (type == "short" || type == "short int" || type == "signed short" || type == "signed short int" || type == "int16" || type == "int16_t")
+		return VoxelType::Int16;
+	if (type == "uint" || type == "unsigned int" || type == "uint32" || type == "uint32_t")
+		return VoxelType::Uint32;
+	if (type == "int" || type == "signed int" || type == "int32" || type == "int32_t")
+		return VoxelType::Int32;
+	if (type == "float")
+		return VoxelType::Float32;
+	if (type == "double")
+		return VoxelType::Float64;
+	return std::nullopt;
+}
+
+// "(x,y,z) (x,y,z) (x,y,z)", the spacing along each axis is the length of its direction
+static void ParseNrrdSpaceDirections(const std::string& value, Float3& spacing)
+{
+	float* axes[3] = { &spacing.x, &spacing.y, &spacing.z };
+	size_t position = 0;
+	for (float* axis : axes)
+	{
+		const size_t open = value.find_first_of("(n", position);
+		if (open == std::string::npos)
+			return;
+		// "none" marks a non-spatial axis
+		if (value[open] == 'n')
+		{
+			position = open + 4;
+			continue;
+		}
+		const size_t close = value.find(')', open);
+		if (close == std::string::npos)
+			return;
+		std::string vector = value.substr(open + 1, close - open - 1);
+		std::replace(vector.begin(), vector.end(), ',', ' ');
+		std::istringstream stream(vector);
+		double x = 0.0, y = 0.0, z = 0.0;
+		if (stream >> x >> y >> z)
+		{
+			const double length = std::sqrt(x * x + y * y + z * z);
+			if (length > 0.0)
+				*axis = static_cast<float>(length);
+		}
+		position = close + 1;
+	}
+}
+
+// the offset just past the given number of lines, from the start of the file
+static std::optional<uint64_t> SkipLines(const std::filesystem::path& filePath, uint64_t offset, uint64_t lineCount)
+{
+	std::ifstream file(filePath, std::ios::binary);
+	file.seekg(static_cast<std::streamoff>(offset));
+	std::string line;
+	for (uint64_t i = 0; i < lineCount; i++)
+	{
+		if (!std::getline(file, line))
+			return std::nullopt;
+	}
+	return static_cast<uint64_t>(file.tellg());
+}
+
+static std::optional<VolumeFileInfo> ReadNrrdHeader(const std::filesystem::path& filePath)
+{
+	std::ifstream file(filePath, std::ios::binary);
+	std::string line;
+	if (!std::getline(file, line) || line.compare(0, 4, "NRRD") != 0)
+		return std::nullopt;
+
+	VolumeFileInfo info{};
+	info.dataPath = filePath;
+	bool hasDimensions = false;
+	bool isDetached = false;
+	int64_t byteSkip = 0;
+	uint64_t lineSkip = 0;
+	// the header ends at the first empty line, attached data starts right after it
+	while (std::getline(file, line))
+	{
+		line = Trim(line);
+		if (line.empty())
+			break;
+		// comments and key:=value pairs don't describe the voxels
+		const size_t separator = line.find(": ");
+		if (line[0] == '#' || separator == std::string::npos)
+			continue;
+		const std::string field = ToLower(line.substr(0, separator));
+		const std::string value = Trim(line.substr(separator + 2));
+
+		if (field == "type")
+		{
+			const std::optional<VoxelType> type = ParseNrrdType(ToLower(value));
+			if (!type)
+				return std::nullopt;
+			info.type = *type;
+		}
+		else if (field == "dimension")
+		{
+			if (ParseInteger(value) != 3)
+				return std::nullopt;
+		}
+		else if (field == "sizes")
+			hasDimensions = ParseDimensions(value, info.dimensions);
+		else if (field == "spacings")
+			ParseSpacing(value, info.spacing);
+		else if (field == "space directions")
+			ParseNrrdSpaceDirections(value, info.spacing);
+		else if (field == "endian")
+			info.isBigEndian = ToLower(value) == "big";
+		else if (field == "encoding")
+		{
+			const std::string encoding = ToLower(value);
+			if (encoding == "gzip" || encoding == "gz")
+				info.encoding = VolumeEncoding::Gzip;
+			else if (encoding != "raw")
+				return std::nullopt;
+		}
+		else if (field == "data file" || field == "datafile")
+		{
+			// lists and printf style patterns of slice files aren't supported
+			if (value.find(' ') != std::string::npos || value.find('%') != std::string::npos)
+				return std::nullopt;
+			const std::filesystem::path dataPath(value);
+			info.dataPath = dataPath.is_absolute() ? dataPath : filePath.parent_path() / dataPath;
+			isDetached = true;
+		}
+		else if (field == "byte skip" || field == "byteskip")
+			byteSkip = ParseInteger(value);
+		else if (field == "line skip" || field == "lineskip")
+			lineSkip = static_cast<uint64_t>(std::max<int64_t>(ParseInteger(value), 0));
+	}
+	if (!hasDimensions)
+		return std::nullopt;
+
+	uint64_t dataOffset = 0;
+	if (!isDetached)
+	{
+		if (!file)
+			return std::nullopt;
+		dataOffset = static_cast<uint64_t>(file.tellg());
+	}
+	if (lineSkip > 0)
+	{
+		const std::optional<uint64_t> skipped = SkipLines(info.dataPath, dataOffset, lineSkip);
+		if (!skipped)
+			return std::nullopt;
+		dataOffset = *skipped;
+	}
+	// -1 means the voxels are the last bytes of the file
+	if (byteSkip == -1)
+	{
+		if (info.encoding != VolumeEncoding::Raw)
+			return std::nullopt;
+		std::error_code error;
+		const uint64_t fileSize = std::filesystem::file_size(info.dataPath, error);
+		const uint64_t payloadSize = info.dimensions.GetVoxelCount() * VolumeFile::GetVoxelSize(info.type);
+		if (error || fileSize < payloadSize)
+			return std::nullopt;
+		dataOffset = fileSize - payloadSize;
+	}
+	else if (byteSkip > 0)
+		dataOffset += static_cast<uint64_t>(byteSkip);
+	info.dataOffset = dataOffset;
+	return info;
+}
+
+// ----------------------------------------------------------------------------------------------
+// MetaImage
+
+static std::optional<VoxelType> ParseMetaImageType(const std::string& type)
+{
+	if (type == "MET_UCHAR")
+		return VoxelType::Uint8;
+	if (type == "MET_CHAR")
+		return VoxelType::Int8;
+	if (type == "MET_USHORT")
+		return VoxelType::Uint16;
+	if (type == "MET_SHORT")
+		return VoxelType::Int16;
+	if (type == "MET_UINT" || type == "MET_ULONG")
+		return VoxelType::Uint32;
+	if (type == "MET_INT" || type == "MET_LONG")
+		return VoxelType::Int32;
+	if (type == "MET_FLOAT")
+		return VoxelType::Float32;
+	if (type == "MET_DOUBLE")
+		return VoxelType::Float64;
+	return std::nullopt;
+}
+
+static std::optional<VolumeFileInfo> ReadMetaImageHeader(const std::filesystem::path& filePath)
+{
+	std::ifstream file(filePath, std::ios::binary);
+	if (!file.is_open())
+		return std::nullopt;
+
+	VolumeFileInfo info{};
+	bool hasDimensions = false;
+	bool hasType = false;
+	bool hasDataFile = false;
+	int64_t headerSize = 0;
+	bool hasElementSpacing = false;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		const size_t separator = line.find('=');
+		if (separator == std::string::npos)
+			continue;
+		const std::string key = Trim(line.substr(0, separator));
+		const std::string value = Trim(line.substr(separator + 1));
+
+		if (key == "NDims")
+		{
+			if (ParseInteger(value) != 3)
+				return std::nullopt;
+		}
+		else if (key == "DimSize")
+			hasDimensions = ParseDimensions(value, info.dimensions);
+		else if (key == "ElementSpacing")
+		{
+			ParseSpacing(value, info.spacing);
+			hasElementSpacing = true;
+		}
+		else if (key == "ElementSize" && !hasElementSpacing)
+			ParseSpacing(value, info.spacing);
+		else if (key == "ElementType")
+		{
+			const std::optional<VoxelType> type = ParseMetaImageType(value);
+			if (!type)
+				return std::nullopt;
+			info.type = *type;
+			hasType = true;
+		}
+		else if (key == "ElementByteOrderMSB" || key == "BinaryDataByteOrderMSB")
+			info.isBigEndian = ToLower(value) == "true";
+		else if (key == "CompressedData")
+			info.encoding = ToLower(value) == "true" ? VolumeEncoding::Zlib : VolumeEncoding::Raw;
+		else if (key == "ElementNumberOfChannels")
+		{
+			if (ParseInteger(value) != 1)
+				return std::nullopt;
+		}
+		else if (key == "HeaderSize")
+			headerSize = ParseInteger(value);
+		else if (key == "ElementDataFile")
+		{
+			// always the last field, LOCAL data starts on the next line
+			if (value == "LOCAL")
+			{
+				if (!file)
+					return std::nullopt;
+				info.dataPath = filePath;
+				info.dataOffset = static_cast<uint64_t>(file.tellg());
+			}
+			else
+			{
+				// lists and patterns of slice files aren't supported
+				if (value.compare(0, 4, "LIST") == 0 || value.find('%') != std::string::npos)
+					return std::nullopt;
+				const std::filesystem::path dataPath(value);
+				info.dataPath = dataPath.is_absolute() ? dataPath : filePath.parent_path() / dataPath;
+			}
+			hasDataFile = true;
+			break;
+		}
+	}
+	if (!hasDimensions || !hasType || !hasDataFile)
+		return std::nullopt;
+
+	// -1 means the voxels are the last bytes of the file
+	if (headerSize == -1)
+	{
+		if (info.encoding != VolumeEncoding::Raw)
+			return std::nullopt;
+		std::error_code error;
+		const uint64_t fileSize = std::filesystem::file_size(info.dataPath, error);
+		const uint64_t payloadSize = info.dimensions.GetVoxelCount() * VolumeFile::GetVoxelSize(info.type);
+		if (error || fileSize < payloadSize)
+			return std::nullopt;
+		info.dataOffset = fileSize - payloadSize;
+	}
+	else if (headerSize > 0)
+		info.dataOffset += static_cast<uint64_t>(headerSize);
+	return info;
+}
+
+// ----------------------------------------------------------------------------------------------
+// NIfTI
+
+static constexpr uint32_t NIFTI1_HEADER_SIZE = 348;
+static constexpr uint32_t NIFTI2_HEADER_SIZE = 540;
+
+// reads a little or big endian value at offset
+template<typename T>
+static T ReadValue(const uint8_t* data, size_t offset, bool isBigEndian)
+{
+	uint8_t bytes[sizeof(T)];
+	memcpy(bytes, data + offset, sizeof(T));
+	if (isBigEndian != (std::endian::native == std::endian::big))
+		std::reverse(bytes, bytes + sizeof(T));
+	T value;
+	memcpy(&value, bytes, sizeof(T));
+	return value;
+}
+
+static std::optional<VoxelType> ParseNiftiType(int32_t datatype)
+{
+	switch (datatype)
+	{
+	case 2: return VoxelType::Uint8;
+	case 4: return VoxelType::Int16;
+	case 8: return VoxelType::Int32;
+	case 16: return VoxelType::Float32;
+	case 64: return VoxelType::Float64;
+	case 256: return VoxelType::Int8;
+	case 512: return VoxelType::Uint16;
+	case 768: return VoxelType::Uint32;
+	default: return std::nullopt;
+	}
+}
+
+// a 4D file shows its first volume, slope and intercept don't matter once the value range is stretched to 8 bits
+static std::optional<VolumeFileInfo> ParseNiftiHeader(const uint8_t* data, size_t size, const std::filesystem::path& filePath)
+{
+	if (size < NIFTI1_HEADER_SIZE)
+		return std::nullopt;
+
+	VolumeFileInfo info{};
+	const int32_t headerSize = ReadValue<int32_t>(data, 0, false);
+	const bool isBigEndian = headerSize != static_cast<int32_t>(NIFTI1_HEADER_SIZE) && headerSize != static_cast<int32_t>(NIFTI2_HEADER_SIZE);
+	info.isBigEndian = isBigEndian;
+	const int32_t version = ReadValue<int32_t>(data, 0, isBigEndian);
+
+	int64_t dims[4] = {};
+	double spacing[3] = {};
+	int32_t datatype = 0;
+	double voxelOffset = 0.0;
+	bool isSingleFile = false;
+	if (version == static_cast<int32_t>(NIFTI1_HEADER_SIZE))
+	{
+		if (memcmp(data + 344, "n+1", 4) != 0 && memcmp(data + 344, "ni1", 4) != 0)
+			return std::nullopt;
+		isSingleFile = data[345] == '+';
+		for (uint32_t i = 0; i < 4; i++)
+			dims[i] = ReadValue<int16_t>(data, 40 + 2 * i, isBigEndian);
+		datatype = ReadValue<int16_t>(data, 70, isBigEndian);
+		for (uint32_t i = 0; i < 3; i++)
+			spacing[i] = ReadValue<float>(data, 80 + 4 * i, isBigEndian);
+		voxelOffset = ReadValue<float>(data, 108, isBigEndian);
+	}
+	else if (version == static_cast<int32_t>(NIFTI2_HEADER_SIZE))
+	{
+		if (size < NIFTI2_HEADER_SIZE || (memcmp(data + 4, "n+2", 4) != 0 && memcmp(data + 4, "ni2", 4) != 0))
+			return std::nullopt;
+		isSingleFile = data[5] == '+';
+		datatype = ReadValue<int16_t>(data, 12, isBigEndian);
+		for (uint32_t i = 0; i < 4; i++)
+			dims[i] = ReadValue<int64_t>(data, 16 + 8 * i, isBigEndian);
+		for (uint32_t i = 0; i < 3; i++)
+			spacing[i] = ReadValue<double>(data, 112 + 8 * i, isBigEndian);
+		voxelOffset = static_cast<double>(ReadValue<int64_t>(data, 168, isBigEndian));
+	}
+	else
+		return std::nullopt;
+
+	const std::optional<VoxelType> type = ParseNiftiType(datatype);
+	if (!type || dims[0] < 3)
+		return std::nullopt;
+	for (uint32_t i = 1; i < 4; i++)
+	{
+		if (dims[i] <= 0 || dims[i] > std::numeric_limits<uint32_t>::max())
+			return std::nullopt;
+	}
+	info.type = *type;
+	info.dimensions = { static_cast<uint32_t>(dims[1]), static_cast<uint32_t>(dims[2]), static_cast<uint32_t>(dims[3]) };
+	float* axes[3] = { &info.spacing.x, &info.spacing.y, &info.spacing.z };
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		if (std::isfinite(spacing[i]) && spacing[i] != 0.0)
+			*axes[i] = static_cast<float>(std::abs(spacing[i]));
+	}
+
+	// a .hdr/.img pair keeps the voxels next to the header
+	info.dataPath = filePath;
+	if (!isSingleFile)
+		info.dataPath.replace_extension(".img");
+	info.dataOffset = static_cast<uint64_t>(std::max(voxelOffset, 0.0));
+	return info;
+}
+
+static std::optional<VolumeFileInfo> ReadNiftiHeader(const std::filesystem::path& filePath)
+{
+	uint8_t header[NIFTI2_HEADER_SIZE] = {};
+	std::ifstream file(filePath, std::ios::binary);
+	file.read(reinterpret_cast<char*>(header), sizeof(header));
+	return ParseNiftiHeader(header, static_cast<size_t>(file.gcount()), filePath);
+}
+
+// The header is inside the compressed stream, it's inflated on its own first. That says how much of the
+// stream the first volume needs, which is inflated up front and kept for Read.
+static std::optional<VolumeFileInfo> ReadCompressedNiftiHeader(const std::filesystem::path& filePath)
+{
+	MappedFile file;
+	if (!file.Open(filePath) || !Inflate::IsGzip(file.GetData(), file.GetSize()))
+		return std::nullopt;
+
+	uint8_t header[NIFTI2_HEADER_SIZE] = {};
+	size_t produced = 0;
+	if (!Inflate::InflateGzipPrefix(file.GetData(), file.GetSize(), header, sizeof(header), produced))
+		return std::nullopt;
+	std::optional<VolumeFileInfo> info = ParseNiftiHeader(header, produced, filePath);
+	if (!info || info->dataPath != filePath)
+		return std::nullopt;
+
+	// a header promising more than deflate can expand the file to is broken
+	const uint64_t payloadSize = info->dimensions.GetVoxelCount() * VolumeFile::GetVoxelSize(info->type);
+	const uint64_t inflatedSize = info->dataOffset + payloadSize;
+	if (inflatedSize / MAX_DEFLATE_RATIO > file.GetSize())
+		return std::nullopt;
+
+	std::shared_ptr<std::vector<uint8_t>> inflated = std::make_shared<std::vector<uint8_t>>(inflatedSize);
+	if (!Inflate::InflateGzipPrefix(file.GetData(), file.GetSize(), inflated->data(), inflated->size(), produced) || produced != inflated->size())
+		return std::nullopt;
+	info->inflatedFile = std::move(inflated);
+	return info;
+}
+
+// ----------------------------------------------------------------------------------------------
+// conversion to 8 bits
+
+// voxel at index, swapped to the machine's byte order
+template<typename T>
+static T LoadVoxel(const uint8_t* data, uint64_t index, bool isSwapped)
+{
+	uint8_t bytes[sizeof(T)];
+	memcpy(bytes, data + index * sizeof(T), sizeof(T));
+	if (isSwapped)
+		std::reverse(bytes, bytes + sizeof(T));
+	T value;
+	memcpy(&value, bytes, sizeof(T));
+	return value;
+}
+
+template<typename T>
+static void ConvertToBytes(const uint8_t* source, uint64_t voxelCount, bool isSwapped, uint8_t* destination)
+{
+	const uint32_t chunkCount = static_cast<uint32_t>((voxelCount + CONVERT_CHUNK_VOXELS - 1) / CONVERT_CHUNK_VOXELS);
+
+	// NaNs fail both comparisons and don't widen the range
+	std::vector<double> chunkMin(chunkCount, std::numeric_limits<double>::max());
+	std::vector<double> chunkMax(chunkCount, std::numeric_limits<double>::lowest());
+	ThreadPool::Get().ParallelFor(chunkCount, [&](uint32_t chunk) {
+		const uint64_t begin = chunk * CONVERT_CHUNK_VOXELS;
+		const uint64_t end = std::min(begin + CONVERT_CHUNK_VOXELS, voxelCount);
+		T minValue = std::numeric_limits<T>::max();
+		T maxValue = std::numeric_limits<T>::lowest();
+		for (uint64_t i = begin; i < end; i++)
+		{
+			const T value = LoadVoxel<T>(source, i, isSwapped);
+			if (value < minValue)
+				minValue = value;
+			if (value > maxValue)
+				maxValue = value;
+		}
+		chunkMin[chunk] = static_cast<double>(minValue);
+		chunkMax[chunk] = static_cast<double>(maxValue);
+	});
+	const double minValue = *std::min_element(chunkMin.begin(), chunkMin.end());
+	const double maxValue = *std::max_element(chunkMax.begin(), chunkMax.end());
+	const double scale = maxValue > minValue ? 255.0 / (maxValue - minValue) : 0.0;
+
+	ThreadPool::Get().ParallelFor(chunkCount, [&](uint32_t chunk) {
+		const uint64_t begin = chunk * CONVERT_CHUNK_VOXELS;
+		const uint64_t end = std::min(begin + CONVERT_CHUNK_VOXELS, voxelCount);
+		for (uint64_t i = begin; i < end; i++)
+		{
+			const double scaled = (static_cast<double>(LoadVoxel<T>(source, i, isSwapped)) - minValue) * scale;
+			destination[i] = scaled > 0.0 ? static_cast<uint8_t>(std::min(scaled, 255.0) + 0.5) : 0;
+		}
+	});
+}
+
+// ----------------------------------------------------------------------------------------------
+
+std::optional<VolumeFileInfo> VolumeFile::ReadHeader(const std::filesystem::path& filePath)
+{
+	const std::string extension = ToLower(filePath.extension().string());
+	std::optional<VolumeFileInfo> info;
+	if (extension == ".nrrd" || extension == ".nhdr")
+		info = ReadNrrdHeader(filePath);
+	else if (extension == ".mhd" || extension == ".mha")
+		info = ReadMetaImageHeader(filePath);
+	else if (extension == ".nii" || extension == ".hdr")
+		info = ReadNiftiHeader(filePath);
+	else if (extension == ".gz" && ToLower(filePath.stem().extension().string()) == ".nii")
+		info = ReadCompressedNiftiHeader(filePath);
+
+	if (!info || !HasPositiveDimensions(*info))
+		return std::nullopt;
+	return info;
+}
+
+uint32_t VolumeFile::GetVoxelSize(VoxelType type)
+{
+	switch (type)
+	{
+	case VoxelType::Uint8:
+	case VoxelType::Int8:
+		return 1;
+	case VoxelType::Uint16:
+	case VoxelType::Int16:
+		return 2;
+	case VoxelType::Uint32:
+	case VoxelType::Int32:
+	case VoxelType::Float32:
+		return 4;
+	case VoxelType::Float64:
+		return 8;
+	}
+	return 1;
+}
+
+bool VolumeFile::IsDirectlyReadable(const VolumeFileInfo& info)
+{
+	return info.type == VoxelType::Uint8 && info.encoding == VolumeEncoding::Raw && !info.inflatedFile;
+}
+
+bool VolumeFile::Read(const VolumeFileInfo& info, uint8_t* destination)
+{
+	const uint64_t voxelCount = info.dimensions.GetVoxelCount();
+	const uint64_t payloadSize = voxelCount * GetVoxelSize(info.type);
+
+	MappedFile file;
+	const uint8_t* data = nullptr;
+	uint64_t size = 0;
+	if (info.inflatedFile)
+	{
+		data = info.inflatedFile->data();
+		size = info.inflatedFile->size();
+	}
+	else
+	{
+		if (!file.Open(info.dataPath))
+			return false;
+		data = file.GetData();
+		size = file.GetSize();
+	}
+	if (info.dataOffset > size)
+		return false;
+	data += info.dataOffset;
+	size -= info.dataOffset;
+
+	// bytes inflate straight into the destination, wider voxels into a temporary copy that's converted from
+	std::vector<uint8_t> inflated;
+	if (info.encoding != VolumeEncoding::Raw && !info.inflatedFile)
+	{
+		uint8_t* target = destination;
+		if (GetVoxelSize(info.type) > 1)
+		{
+			inflated.resize(payloadSize);
+			target = inflated.data();
+		}
+		size_t produced = 0;
+		const bool isInflated = info.encoding == VolumeEncoding::Gzip
+			? Inflate::InflateGzip(data, size, target, payloadSize, produced)
+			: Inflate::InflateZlib(data, size, target, payloadSize, produced);
+		if (!isInflated || produced != payloadSize)
+			return false;
+		data = target;
+		size = payloadSize;
+	}
+	if (size < payloadSize)
+		return false;
+
+	const bool isSwapped = info.isBigEndian != (std::endian::native == std::endian::big);
+	switch (info.type)
+	{
+	case VoxelType::Uint8:
+		if (data != destination)
+		{
+			const uint32_t chunkCount = static_cast<uint32_t>((voxelCount + CONVERT_CHUNK_VOXELS - 1) / CONVERT_CHUNK_VOXELS);
+			ThreadPool::Get().ParallelFor(chunkCount, [&](uint32_t chunk) {
+				const uint64_t begin = chunk * CONVERT_CHUNK_VOXELS;
+				memcpy(destination + begin, data + begin, std::min(CONVERT_CHUNK_VOXELS, voxelCount - begin));
+			});
+		}
+		break;
+	case VoxelType::Int8: ConvertToBytes<int8_t>(data, voxelCount, false, destination); break;
+	case VoxelType::Uint16: ConvertToBytes<uint16_t>(data, voxelCount, isSwapped, destination); break;
+	case VoxelType::Int16: ConvertToBytes<int16_t>(data, voxelCount, isSwapped, destination); break;
+	case VoxelType::Uint32: ConvertToBytes<uint32_t>(data, voxelCount, isSwapped, destination); break;
+	case VoxelType::Int32: ConvertToBytes<int32_t>(data, voxelCount, isSwapped, destination); break;
+	case VoxelType::Float32: ConvertToBytes<float>(data, voxelCount, isSwapped, destination); break;
+	case VoxelType::Float64: ConvertToBytes<double>(data, voxelCount, isSwapped, destination); break;
+	}
+	return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "VolumeTypes.h"
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <vector>
+
+enum class VoxelType : uint8_t {
+	Uint8,
+	Int8,
+	Uint16,
+	Int16,
+	Uint32,
+	Int32,
+	Float32,
+	Float64,
+};
+
+enum class VolumeEncoding : uint8_t {
+	Raw,
+	Gzip,
+	Zlib,
+};
+
+// what a volume file's header says about its voxels and where they are
+struct VolumeFileInfo {
+	VolumeDimensions dimensions{};
+	Float3 spacing = { 1.0f, 1.0f, 1.0f };
+	VoxelType type = VoxelType::Uint8;
+	bool isBigEndian = false;
+	VolumeEncoding encoding = VolumeEncoding::Raw;
+	// the file holding the voxels, which may be the header file itself, and where they start in it
+	std::filesystem::path dataPath;
+	uint64_t dataOffset = 0;
+	// a gzipped NIfTI has its header compressed too, the file up to the end of the first volume is inflated while reading the header
+	std::shared_ptr<std::vector<uint8_t>> inflatedFile;
+};
+
+// Headers of NRRD (.nrrd/.nhdr), NIfTI-1/2 (.nii/.nii.gz/.hdr) and MetaImage (.mhd/.mha) volumes.
+// 8 bit raw payloads are read in place from the mapped file, everything else is inflated, byte
+// swapped and mapped from its value range to the renderer's 8 bits on the thread pool.
+class VolumeFile {
+public:
+	static std::optional<VolumeFileInfo> ReadHeader(const std::filesystem::path& filePath);
+
+	static uint32_t GetVoxelSize(VoxelType type);
+	// the payload can be copied out of the file as it is
+	static bool IsDirectlyReadable(const VolumeFileInfo& info);
+
+	// every voxel as a byte, the range of the stored values is stretched over 0..255 unless they already are bytes
+	static bool Read(const VolumeFileInfo& info, uint8_t* destination);
+};
@@ -0,0 +1,568 @@
+#include "VolumeFilter.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// output voxels of one task, with its input around it this stays within the L2 cache
+static constexpr uint32_t BLOCK_WIDTH = 64;
+static constexpr uint32_t BLOCK_HEIGHT = 16;
+static constexpr uint32_t BLOCK_DEPTH = 16;
+
+static constexpr uint32_t MAX_MEDIAN_RADIUS = 2;
+static constexpr uint32_t MAX_MEDIAN_WINDOW = (2 * MAX_MEDIAN_RADIUS + 1) * (2 * MAX_MEDIAN_RADIUS + 1) * (2 * MAX_MEDIAN_RADIUS + 1);
+
+namespace {
+
+using BlockResult = std::array<uint8_t, BLOCK_WIDTH * BLOCK_HEIGHT * BLOCK_DEPTH>;
+
+// A block and radius voxels of its neighbours on every side, rows are padded to a multiple of 16
+// bytes so the SIMD loads of the last voxels stay inside.
+struct PaddedBlock {
+	uint32_t radius = 0;
+	uint32_t width = 0;
+	uint32_t rowSize = 0;
+	uint32_t sliceSize = 0;
+	const uint8_t* voxels = nullptr;
+
+	// the input voxel under output voxel (x, y, z) of the block
+	const uint8_t* GetCenter(uint32_t x, uint32_t y, uint32_t z) const
+	{
+		return voxels + (x + radius) + (y + radius) * static_cast<size_t>(rowSize) + (z + radius) * static_cast<size_t>(sliceSize);
+	}
+};
+
+struct Comparator {
+	uint8_t low = 0;
+	uint8_t high = 0;
+};
+
+// Compare-exchanges leaving the median of inputCount values on the median wire. The wires past the
+// inputs are padding, half of them 0 and half 255, which moves the median by the number of zeros.
+struct MedianNetwork {
+	uint32_t inputCount = 0;
+	uint32_t wireCount = 0;
+	uint32_t zeroCount = 0;
+	uint32_t median = 0;
+	std::vector<Comparator> comparators;
+};
+
+} // namespace
+
+static uint8_t GetClamped(const uint8_t* data, const VolumeDimensions& dimensions, int32_t x, int32_t y, int32_t z)
+{
+	return data[dimensions.GetIndex(
+		std::clamp(x, 0, static_cast<int32_t>(dimensions.width) - 1),
+		std::clamp(y, 0, static_cast<int32_t>(dimensions.height) - 1),
+		std::clamp(z, 0, static_cast<int32_t>(dimensions.depth) - 1))];
+}
+
+// normalized weights of the 2 * radius + 1 taps, shared by the reference and the block path so both sum the same floats
+static std::vector<float> GetGaussianWeights(float sigma)
+{
+	assert(sigma > 0.0f);
+	const int32_t radius = static_cast<int32_t>(std::ceil(3.0f * sigma));
+	std::vector<float> weights(2 * radius + 1);
+	float sum = 0.0f;
+	for (int32_t i = -radius; i <= radius; i++)
+	{
+		weights[i + radius] = std::exp(-static_cast<float>(i * i) / (2.0f * sigma * sigma));
+		sum += weights[i + radius];
+	}
+	for (float& weight : weights)
+		weight /= sum;
+	return weights;
+}
+
+static uint32_t GetBilateralRadius(float spatialSigma)
+{
+	assert(spatialSigma > 0.0f);
+	return static_cast<uint32_t>(std::ceil(2.0f * spatialSigma));
+}
+
+// weight of every tap of the window, z, then y, then x
+static std::vector<float> GetSpatialWeights(float spatialSigma)
+{
+	const int32_t radius = static_cast<int32_t>(GetBilateralRadius(spatialSigma));
+	std::vector<float> weights;
+	for (int32_t dz = -radius; dz <= radius; dz++)
+	{
+		for (int32_t dy = -radius; dy <= radius; dy++)
+		{
+			for (int32_t dx = -radius; dx <= radius; dx++)
+				weights.push_back(std::exp(-static_cast<float>(dx * dx + dy * dy + dz * dz) / (2.0f * spatialSigma * spatialSigma)));
+		}
+	}
+	return weights;
+}
+
+// weight of every absolute value difference to the center
+static std::array<float, 256> GetRangeWeights(float rangeSigma)
+{
+	assert(rangeSigma > 0.0f);
+	std::array<float, 256> weights;
+	for (uint32_t difference = 0; difference < weights.size(); difference++)
+		weights[difference] = std::exp(-static_cast<float>(difference * difference) / (2.0f * rangeSigma * rangeSigma));
+	return weights;
+}
+
+// Batcher's odd-even merge sort over the next power of two wires, with everything that can't reach
+// the median or only compares against padding left out
+static MedianNetwork BuildMedianNetwork(uint32_t inputCount)
+{
+	MedianNetwork network;
+	network.inputCount = inputCount;
+	network.wireCount = std::bit_ceil(inputCount);
+	network.zeroCount = (network.wireCount - inputCount) / 2;
+	network.median = (inputCount - 1) / 2 + network.zeroCount;
+
+	std::vector<Comparator> sort;
+	const uint32_t n = network.wireCount;
+	for (uint32_t p = 1; p < n; p *= 2)
+	{
+		for (uint32_t k = p; k >= 1; k /= 2)
+		{
+			for (uint32_t j = k % p; j + k < n; j += 2 * k)
+			{
+				for (uint32_t i = 0; i < std::min(k, n - j - k); i++)
+				{
+					if ((i + j) / (2 * p) == (i + j + k) / (2 * p))
+						sort.push_back({ static_cast<uint8_t>(i + j), static_cast<uint8_t>(i + j + k) });
+				}
+			}
+		}
+	}
+
+	// comparators that can't change anything because a wire already holds 0 or 255 are dropped
+	enum class Wire : uint8_t { Input, Zero, Full };
+	std::vector<Wire> wires(n, Wire::Input);
+	std::fill(wires.begin() + inputCount, wires.begin() + inputCount + network.zeroCount, Wire::Zero);
+	std::fill(wires.begin() + inputCount + network.zeroCount, wires.end(), Wire::Full);
+	std::vector<bool> isKept(sort.size(), false);
+	for (size_t i = 0; i < sort.size(); i++)
+	{
+		Wire& low = wires[sort[i].low];
+		Wire& high = wires[sort[i].high];
+		if (low == Wire::Zero || high == Wire::Full || (low == high && low != Wire::Input))
+			continue;
+		isKept[i] = true;
+		if (low == Wire::Full || high == Wire::Zero)
+			std::swap(low, high);
+	}
+
+	// then walking backwards from the median, only comparators touching a wire it still depends on are needed
+	std::vector<bool> isNeeded(n, false);
+	isNeeded[network.median] = true;
+	for (size_t i = sort.size(); i-- > 0;)
+	{
+		if (!isKept[i] || (!isNeeded[sort[i].low] && !isNeeded[sort[i].high]))
+		{
+			isKept[i] = false;
+			continue;
+		}
+		isNeeded[sort[i].low] = true;
+		isNeeded[sort[i].high] = true;
+	}
+
+	for (size_t i = 0; i < sort.size(); i++)
+	{
+		if (isKept[i])
+			network.comparators.push_back(sort[i]);
+	}
+	return network;
+}
+
+static const MedianNetwork& GetMedianNetwork(uint32_t radius)
+{
+	assert(radius >= 1 && radius <= MAX_MEDIAN_RADIUS && "Median radius has to be 1 or 2");
+	static const std::array<MedianNetwork, MAX_MEDIAN_RADIUS> networks = { BuildMedianNetwork(3 * 3 * 3), BuildMedianNetwork(5 * 5 * 5) };
+	return networks[radius - 1];
+}
+
+// copies the block at (x, y, z) out of the volume along with radius voxels around it
+static PaddedBlock CopyBlock(const uint8_t* data, const VolumeDimensions& dimensions, uint32_t x, uint32_t y, uint32_t z, uint32_t radius,
+	std::vector<uint8_t>& voxels)
+{
+	PaddedBlock block{ .radius = radius, .width = BLOCK_WIDTH + 2 * radius };
+	block.rowSize = (block.width + 15) & ~15u;
+	block.sliceSize = block.rowSize * (BLOCK_HEIGHT + 2 * radius);
+	voxels.resize(static_cast<size_t>(block.sliceSize) * (BLOCK_DEPTH + 2 * radius));
+	block.voxels = voxels.data();
+
+	// the part of the row inside the volume is copied, the rest repeats the first or last voxel
+	const uint32_t left = radius > x ? radius - x : 0;
+	const uint32_t begin = x + left - radius;
+	const uint32_t end = std::min(x + BLOCK_WIDTH + radius, dimensions.width);
+	const uint32_t right = block.width - left - (end - begin);
+	for (uint32_t slice = 0; slice < BLOCK_DEPTH + 2 * radius; slice++)
+	{
+		const int32_t sourceZ = std::clamp(static_cast<int32_t>(z + slice) - static_cast<int32_t>(radius), 0, static_cast<int32_t>(dimensions.depth) - 1);
+		for (uint32_t row = 0; row < BLOCK_HEIGHT + 2 * radius; row++)
+		{
+			const int32_t sourceY = std::clamp(static_cast<int32_t>(y + row) - static_cast<int32_t>(radius), 0, static_cast<int32_t>(dimensions.height) - 1);
+			const uint8_t* source = data + dimensions.GetIndex(0, sourceY, sourceZ);
+			uint8_t* destination = voxels.data() + slice * static_cast<size_t>(block.sliceSize) + row * block.rowSize;
+			memset(destination, source[0], left);
+			memcpy(destination + left, source + begin, end - begin);
+			memset(destination + left + (end - begin), source[dimensions.width - 1], right);
+		}
+	}
+	return block;
+}
+
+// runs filterBlock(block, result) for every block of the volume over the pool and writes the part of each result inside the volume
+template<typename FilterBlock>
+static void FilterBlocks(const uint8_t* data, const VolumeDimensions& dimensions, uint32_t radius, uint8_t* destination, const FilterBlock& filterBlock)
+{
+	assert(data != destination && "Filters can't run in place");
+	const uint32_t blocksX = (dimensions.width + BLOCK_WIDTH - 1) / BLOCK_WIDTH;
+	const uint32_t blocksY = (dimensions.height + BLOCK_HEIGHT - 1) / BLOCK_HEIGHT;
+	const uint32_t blocksZ = (dimensions.depth + BLOCK_DEPTH - 1) / BLOCK_DEPTH;
+	ThreadPool::Get().ParallelFor(blocksX * blocksY * blocksZ, [&](uint32_t blockIndex) {
+		const uint32_t x = (blockIndex % blocksX) * BLOCK_WIDTH;
+		const uint32_t y = (blockIndex / blocksX % blocksY) * BLOCK_HEIGHT;
+		const uint32_t z = (blockIndex / (blocksX * blocksY)) * BLOCK_DEPTH;
+
+		thread_local std::vector<uint8_t> voxels;
+		const PaddedBlock block = CopyBlock(data, dimensions, x, y, z, radius, voxels);
+		BlockResult result;
+		filterBlock(block, result);
+
+		const uint32_t width = std::min(BLOCK_WIDTH, dimensions.width - x);
+		for (uint32_t slice = 0; slice < std::min(BLOCK_DEPTH, dimensions.depth - z); slice++)
+		{
+			for (uint32_t row = 0; row < std::min(BLOCK_HEIGHT, dimensions.height - y); row++)
+				memcpy(destination + dimensions.GetIndex(x, y + row, z + slice), &result[(slice * BLOCK_HEIGHT + row) * BLOCK_WIDTH], width);
+		}
+	});
+}
+
+#ifdef VOLUME_SSE2
+// the lowest four lanes as float, rounded to the nearest byte
+static void StoreRounded(__m128 value, uint8_t* destination)
+{
+	const __m128i rounded = _mm_cvttps_epi32(_mm_add_ps(value, _mm_set1_ps(0.5f)));
+	const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(rounded, rounded), _mm_setzero_si128());
+	const int32_t bytes = _mm_cvtsi128_si32(packed);
+	memcpy(destination, &bytes, sizeof(bytes));
+}
+#endif
+
+uint8_t VolumeFilter::GaussianAt(const uint8_t* data, const VolumeDimensions& dimensions, uint32_t x, uint32_t y, uint32_t z, float sigma)
+{
+	const std::vector<float> weights = GetGaussianWeights(sigma);
+	const int32_t radius = static_cast<int32_t>(weights.size() / 2);
+
+	// summed the way the passes do it, along x first, those along y, then along z
+	float sum = 0.0f;
+	for (int32_t dz = -radius; dz <= radius; dz++)
+	{
+		float plane = 0.0f;
+		for (int32_t dy = -radius; dy <= radius; dy++)
+		{
+			float row = 0.0f;
+			for (int32_t dx = -radius; dx <= radius; dx++)
+				row += weights[dx + radius] * GetClamped(data, dimensions, static_cast<int32_t>(x) + dx, static_cast<int32_t>(y) + dy, static_cast<int32_t>(z) + dz);
+			plane += weights[dy + radius] * row;
+		}
+		sum += weights[dz + radius] * plane;
+	}
+	return static_cast<uint8_t>(sum + 0.5f);
+}
+
+void VolumeFilter::Gaussian(const uint8_t* data, const VolumeDimensions& dimensions, float sigma, uint8_t* destination)
+{
+	const std::vector<float> weights = GetGaussianWeights(sigma);
+	const uint32_t radius = static_cast<uint32_t>(weights.size() / 2);
+	const uint32_t tapCount = static_cast<uint32_t>(weights.size());
+	const uint32_t rowCount = BLOCK_HEIGHT + 2 * radius;
+	const uint32_t sliceCount = BLOCK_DEPTH + 2 * radius;
+
+	FilterBlocks(data, dimensions, radius, destination, [&](const PaddedBlock& block, BlockResult& result) {
+		// x pass over every padded row, y pass over the block's rows of every padded slice, z pass into the result
+		thread_local std::vector<float> row;
+		thread_local std::vector<float> alongX;
+		thread_local std::vector<float> alongY;
+		row.resize(block.width);
+		alongX.resize(static_cast<size_t>(sliceCount) * rowCount * BLOCK_WIDTH);
+		alongY.resize(static_cast<size_t>(sliceCount) * BLOCK_HEIGHT * BLOCK_WIDTH);
+
+		for (uint32_t slice = 0; slice < sliceCount; slice++)
+		{
+			for (uint32_t y = 0; y < rowCount; y++)
+			{
+				const uint8_t* voxels = block.voxels + slice * static_cast<size_t>(block.sliceSize) + y * block.rowSize;
+				for (uint32_t x = 0; x < block.width; x++)
+					row[x] = voxels[x];
+
+				float* output = &alongX[(static_cast<size_t>(slice) * rowCount + y) * BLOCK_WIDTH];
+				uint32_t x = 0;
+#ifdef VOLUME_SSE2
+				for (; x + 4 <= BLOCK_WIDTH; x += 4)
+				{
+					__m128 sum = _mm_setzero_ps();
+					for (uint32_t tap = 0; tap < tapCount; tap++)
+						sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[tap]), _mm_loadu_ps(&row[x + tap])));
+					_mm_storeu_ps(output + x, sum);
+				}
+#endif
+				for (; x < BLOCK_WIDTH; x++)
+				{
+					float sum = 0.0f;
+					for (uint32_t tap = 0; tap < tapCount; tap++)
+						sum += weights[tap] * row[x + tap];
+					output[x] = sum;
+				}
+			}
+		}
+
+		for (uint32_t slice = 0; slice < sliceCount; slice++)
+		{
+			for (uint32_t y = 0; y < BLOCK_HEIGHT; y++)
+			{
+				const float* input = &alongX[(static_cast<size_t>(slice) * rowCount + y) * BLOCK_WIDTH];
+				float* output = &alongY[(static_cast<size_t>(slice) * BLOCK_HEIGHT + y) * BLOCK_WIDTH];
+				uint32_t x = 0;
+#ifdef VOLUME_SSE2
+				for (; x + 4 <= BLOCK_WIDTH; x += 4)
+				{
+					__m128 sum = _mm_setzero_ps();
+					for (uint32_t tap = 0; tap < tapCount; tap++)
+						sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[tap]), _mm_loadu_ps(input + tap * BLOCK_WIDTH + x)));
+					_mm_storeu_ps(output + x, sum);
+				}
+#endif
+				for (; x < BLOCK_WIDTH; x++)
+				{
+					float sum = 0.0f;
+					for (uint32_t tap = 0; tap < tapCount; tap++)
+						sum += weights[tap] * input[tap * BLOCK_WIDTH + x];
+					output[x] = sum;
+				}
+			}
+		}
+
+		for (uint32_t z = 0; z < BLOCK_DEPTH; z++)
+		{
+			for (uint32_t y = 0; y < BLOCK_HEIGHT; y++)
+			{
+				const float* input = &alongY[(static_cast<size_t>(z) * BLOCK_HEIGHT + y) * BLOCK_WIDTH];
+				uint8_t* output = &result[(z * BLOCK_HEIGHT + y) * BLOCK_WIDTH];
+				const size_t sliceStride = BLOCK_HEIGHT * BLOCK_WIDTH;
+				uint32_t x = 0;
+#ifdef VOLUME_SSE2
+				for (; x + 4 <= BLOCK_WIDTH; x += 4)
+				{
+					__m128 sum = _mm_setzero_ps();
+					for (uint32_t tap = 0; tap < tapCount; tap++)
+						sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[tap]), _mm_loadu_ps(input + tap * sliceStride + x)));
+					StoreRounded(sum, output + x);
+				}
+#endif
+				for (; x < BLOCK_WIDTH; x++)
+				{
+					float sum = 0.0f;
+					for (uint32_t tap = 0; tap < tapCount; tap++)
+						sum += weights[tap] * input[tap * sliceStride + x];
+					output[x] = static_cast<uint8_t>(sum + 0.5f);
+				}
+			}
+		}
+	});
+}
+
+uint8_t VolumeFilter::MedianAt(const uint8_t* data, const VolumeDimensions& dimensions, uint32_t x, uint32_t y, uint32_t z, uint32_t radius)
+{
+	assert(radius >= 1 && radius <= MAX_MEDIAN_RADIUS && "Median radius has to be 1 or 2");
+	const int32_t r = static_cast<int32_t>(radius);
+	std::vector<uint8_t> window;
+	for (int32_t dz = -r; dz <= r; dz++)
+	{
+		for (int32_t dy = -r; dy <= r; dy++)
+		{
+			for (int32_t dx = -r; dx <= r; dx++)
+				window.push_back(GetClamped(data, dimensions, static_cast<int32_t>(x) + dx, static_cast<int32_t>(y) + dy, static_cast<int32_t>(z) + dz));
+		}
+	}
+	std::nth_element(window.begin(), window.begin() + window.size() / 2, window.end());
+	return window[window.size() / 2];
+}
+
+void VolumeFilter::Median(const uint8_t* data, const VolumeDimensions& dimensions, uint32_t radius, uint8_t* destination)
+{
+	const MedianNetwork& network = GetMedianNetwork(radius);
+
+	FilterBlocks(data, dimensions, radius, destination, [&](const PaddedBlock& block, BlockResult& result) {
+		// where the window's voxels are from its center
+		std::array<int32_t, MAX_MEDIAN_WINDOW> offsets;
+		uint32_t input = 0;
+		const int32_t r = static_cast<int32_t>(radius);
+		for (int32_t dz = -r; dz <= r; dz++)
+		{
+			for (int32_t dy = -r; dy <= r; dy++)
+			{
+				for (int32_t dx = -r; dx <= r; dx++)
+					offsets[input++] = dz * static_cast<int32_t>(block.sliceSize) + dy * static_cast<int32_t>(block.rowSize) + dx;
+			}
+		}
+
+		for (uint32_t z = 0; z < BLOCK_DEPTH; z++)
+		{
+			for (uint32_t y = 0; y < BLOCK_HEIGHT; y++)
+			{
+				uint8_t* output = &result[(z * BLOCK_HEIGHT + y) * BLOCK_WIDTH];
+				uint32_t x = 0;
+#ifdef VOLUME_SSE2
+				// sixteen windows side by side, one per byte lane, min and max of unsigned bytes is all the network needs
+				__m128i wires[MAX_MEDIAN_WINDOW + 3];
+				for (; x + 16 <= BLOCK_WIDTH; x += 16)
+				{
+					const uint8_t* center = block.GetCenter(x, y, z);
+					for (uint32_t i = 0; i < network.inputCount; i++)
+						wires[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center + offsets[i]));
+					for (uint32_t i = network.inputCount; i < network.wireCount; i++)
+						wires[i] = i < network.inputCount + network.zeroCount ? _mm_setzero_si128() : _mm_set1_epi8(-1);
+
+					for (const Comparator& comparator : network.comparators)
+					{
+						const __m128i low = wires[comparator.low];
+						wires[comparator.low] = _mm_min_epu8(low, wires[comparator.high]);
+						wires[comparator.high] = _mm_max_epu8(low, wires[comparator.high]);
+					}
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(output + x), wires[network.median]);
+				}
+#endif
+				for (; x < BLOCK_WIDTH; x++)
+				{
+					uint8_t values[MAX_MEDIAN_WINDOW + 3];
+					const uint8_t* center = block.GetCenter(x, y, z);
+					for (uint32_t i = 0; i < network.inputCount; i++)
+						values[i] = center[offsets[i]];
+					for (uint32_t i = network.inputCount; i < network.wireCount; i++)
+						values[i] = i < network.inputCount + network.zeroCount ? 0 : 255;
+
+					for (const Comparator& comparator : network.comparators)
+					{
+						const uint8_t low = values[comparator.low];
+						values[comparator.low] = std::min(low, values[comparator.high]);
+						values[comparator.high] = std::max(low, values[comparator.high]);
+					}
+					output[x] = values[network.median];
+				}
+			}
+		}
+	});
+}
+
+uint8_t VolumeFilter::BilateralAt(const uint8_t* data, const VolumeDimensions& dimensions, uint32_t x, uint32_t y, uint32_t z,
+	float spatialSigma, float rangeSigma)
+{
+	const std::vector<float> spatialWeights = GetSpatialWeights(spatialSigma);
+	const std::array<float, 256> rangeWeights = GetRangeWeights(rangeSigma);
+	const int32_t radius = static_cast<int32_t>(GetBilateralRadius(spatialSigma));
+	const uint8_t center = data[dimensions.GetIndex(x, y, z)];
+
+	float sum = 0.0f;
+	float weightSum = 0.0f;
+	uint32_t tap = 0;
+	for (int32_t dz = -radius; dz <= radius; dz++)
+	{
+		for (int32_t dy = -radius; dy <= radius; dy++)
+		{
+			for (int32_t dx = -radius; dx <= radius; dx++)
+			{
+				const uint8_t value = GetClamped(data, dimensions, static_cast<int32_t>(x) + dx, static_cast<int32_t>(y) + dy, static_cast<int32_t>(z) + dz);
+				const float weight = spatialWeights[tap++] * rangeWeights[value > center ? value - center : center - value];
+				sum += weight * value;
+				weightSum += weight;
+			}
+		}
+	}
+	return static_cast<uint8_t>(sum / weightSum + 0.5f);
+}
+
+void VolumeFilter::Bilateral(const uint8_t* data, const VolumeDimensions& dimensions, float spatialSigma, float rangeSigma, uint8_t* destination)
+{
+	const std::vector<float> spatialWeights = GetSpatialWeights(spatialSigma);
+	const std::array<float, 256> rangeWeights = GetRangeWeights(rangeSigma);
+	const uint32_t radius = GetBilateralRadius(spatialSigma);
+	const uint32_t tapCount = static_cast<uint32_t>(spatialWeights.size());
+
+	FilterBlocks(data, dimensions, radius, destination, [&](const PaddedBlock& block, BlockResult& result) {
+		thread_local std::vector<int32_t> offsets;
+		offsets.clear();
+		const int32_t r = static_cast<int32_t>(radius);
+		for (int32_t dz = -r; dz <= r; dz++)
+		{
+			for (int32_t dy = -r; dy <= r; dy++)
+			{
+				for (int32_t dx = -r; dx <= r; dx++)
+					offsets.push_back(dz * static_cast<int32_t>(block.sliceSize) + dy * static_cast<int32_t>(block.rowSize) + dx);
+			}
+		}
+
+		for (uint32_t z = 0; z < BLOCK_DEPTH; z++)
+		{
+			for (uint32_t y = 0; y < BLOCK_HEIGHT; y++)
+			{
+				uint8_t* output = &result[(z * BLOCK_HEIGHT + y) * BLOCK_WIDTH];
+				uint32_t x = 0;
+#ifdef VOLUME_SSE2
+				// sixteen voxels a tap, the differences come from byte math but SSE2 has no gather for the range weights
+				const __m128i zero = _mm_setzero_si128();
+				for (; x + 16 <= BLOCK_WIDTH; x += 16)
+				{
+					const uint8_t* centerVoxels = block.GetCenter(x, y, z);
+					const __m128i center = _mm_loadu_si128(reinterpret_cast<const __m128i*>(centerVoxels));
+					__m128 sums[4] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+					__m128 weightSums[4] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+					for (uint32_t tap = 0; tap < tapCount; tap++)
+					{
+						const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(centerVoxels + offsets[tap]));
+						alignas(16) uint8_t differences[16];
+						_mm_store_si128(reinterpret_cast<__m128i*>(differences), _mm_or_si128(_mm_subs_epu8(values, center), _mm_subs_epu8(center, values)));
+
+						const __m128i low = _mm_unpacklo_epi8(values, zero);
+						const __m128i high = _mm_unpackhi_epi8(values, zero);
+						const __m128 floats[4] = {
+							_mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero)),
+							_mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero)),
+							_mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero)),
+							_mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero)) };
+						const __m128 spatial = _mm_set1_ps(spatialWeights[tap]);
+						for (uint32_t quarter = 0; quarter < 4; quarter++)
+						{
+							const uint8_t* difference = &differences[quarter * 4];
+							const __m128 range = _mm_set_ps(rangeWeights[difference[3]], rangeWeights[difference[2]], rangeWeights[difference[1]], rangeWeights[difference[0]]);
+							const __m128 weight = _mm_mul_ps(spatial, range);
+							sums[quarter] = _mm_add_ps(sums[quarter], _mm_mul_ps(weight, floats[quarter]));
+							weightSums[quarter] = _mm_add_ps(weightSums[quarter], weight);
+						}
+					}
+					for (uint32_t quarter = 0; quarter < 4; quarter++)
+						StoreRounded(_mm_div_ps(sums[quarter], weightSums[quarter]), output + x + quarter * 4);
+				}
+#endif
+				for (; x < BLOCK_WIDTH; x++)
+				{
+					const uint8_t* centerVoxel = block.GetCenter(x, y, z);
+					float sum = 0.0f;
+					float weightSum = 0.0f;
+					for (uint32_t tap = 0; tap < tapCount; tap++)
+					{
+						const uint8_t value = centerVoxel[offsets[tap]];
+						const float weight = spatialWeights[tap] * rangeWeights[value > *centerVoxel ? value - *centerVoxel : *centerVoxel - value];
+						sum += weight * value;
+						weightSum += weight;
+					}
+					output[x] = static_cast<uint8_t>(sum / weightSum + 0.5f);
+				}
+			}
+		}
+	});
+}
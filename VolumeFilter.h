@@ -0,0 +1,24 @@
+#pragma once
+
+#include "VolumeTypes.h"
+
+// Denoising filters run on a loaded volume before it's uploaded, so the ray marcher doesn't have to
+// smooth low-dose CT itself. Voxels outside the volume read as the nearest edge voxel. Every filter
+// works through cache sized blocks (with the filter radius of their neighbours copied in around them)
+// in parallel, and has a scalar reference for a single voxel that the block paths match exactly.
+class VolumeFilter {
+public:
+	// separable Gaussian over ceil(3 * sigma) voxels on each side
+	static uint8_t GaussianAt(const uint8_t* data, const VolumeDimensions& dimensions, uint32_t x, uint32_t y, uint32_t z, float sigma);
+	static void Gaussian(const uint8_t* data, const VolumeDimensions& dimensions, float sigma, uint8_t* destination);
+
+	// median of the (2 * radius + 1)^3 window, radius 1 or 2
+	static uint8_t MedianAt(const uint8_t* data, const VolumeDimensions& dimensions, uint32_t x, uint32_t y, uint32_t z, uint32_t radius);
+	static void Median(const uint8_t* data, const VolumeDimensions& dimensions, uint32_t radius, uint8_t* destination);
+
+	// Gaussian in space over ceil(2 * spatialSigma) voxels on each side, weighted by a Gaussian of the
+	// value difference to the center so edges aren't blurred, rangeSigma is in voxel values
+	static uint8_t BilateralAt(const uint8_t* data, const VolumeDimensions& dimensions, uint32_t x, uint32_t y, uint32_t z,
+		float spatialSigma, float rangeSigma);
+	static void Bilateral(const uint8_t* data, const VolumeDimensions& dimensions, float spatialSigma, float rangeSigma, uint8_t* destination);
+};
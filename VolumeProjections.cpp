@@ -0,0 +1,293 @@
+#include "VolumeProjections.h"
+#include "ThreadPool.h"
+#include "FrameCapture.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+
+static uint32_t DivideRoundUp(uint32_t value, uint32_t divisor)
+{
+	return (value + divisor - 1) / divisor;
+}
+
+static size_t GetAxisIndex(ProjectionAxis axis)
+{
+	return static_cast<size_t>(axis);
+}
+
+// maximum[i] = max(maximum[i], row[i])
+static void MaxRow(uint8_t* maximum, const uint8_t* row, uint32_t length)
+{
+	uint32_t i = 0;
+#ifdef VOLUME_SSE2
+	for (; i + 16 <= length; i += 16)
+	{
+		__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+		__m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(maximum + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(maximum + i), _mm_max_epu8(current, values));
+	}
+#endif
+	for (; i < length; i++)
+		maximum[i] = std::max(maximum[i], row[i]);
+}
+
+// sum[i] += row[i]
+static void AddRow(uint32_t* sum, const uint8_t* row, uint32_t length)
+{
+	uint32_t i = 0;
+#ifdef VOLUME_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= length; i += 16)
+	{
+		__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+		__m128i low = _mm_unpacklo_epi8(values, zero);
+		__m128i high = _mm_unpackhi_epi8(values, zero);
+		__m128i* destination = reinterpret_cast<__m128i*>(sum + i);
+		_mm_storeu_si128(destination + 0, _mm_add_epi32(_mm_loadu_si128(destination + 0), _mm_unpacklo_epi16(low, zero)));
+		_mm_storeu_si128(destination + 1, _mm_add_epi32(_mm_loadu_si128(destination + 1), _mm_unpackhi_epi16(low, zero)));
+		_mm_storeu_si128(destination + 2, _mm_add_epi32(_mm_loadu_si128(destination + 2), _mm_unpacklo_epi16(high, zero)));
+		_mm_storeu_si128(destination + 3, _mm_add_epi32(_mm_loadu_si128(destination + 3), _mm_unpackhi_epi16(high, zero)));
+	}
+#endif
+	for (; i < length; i++)
+		sum[i] += row[i];
+}
+
+static void ReduceRow(const uint8_t* row, uint32_t length, uint8_t& maximum, uint32_t& sum)
+{
+	uint8_t maxValue = 0;
+	uint64_t total = 0;
+	uint32_t i = 0;
+#ifdef VOLUME_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	__m128i maxVector = zero;
+	__m128i sumVector = zero;
+	for (; i + 16 <= length; i += 16)
+	{
+		__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+		maxVector = _mm_max_epu8(maxVector, values);
+		// sum of absolute differences against zero adds up each half of the bytes
+		sumVector = _mm_add_epi64(sumVector, _mm_sad_epu8(values, zero));
+	}
+
+	alignas(16) uint8_t maxLanes[16];
+	alignas(16) uint64_t sumLanes[2];
+	_mm_store_si128(reinterpret_cast<__m128i*>(maxLanes), maxVector);
+	_mm_store_si128(reinterpret_cast<__m128i*>(sumLanes), sumVector);
+	for (uint32_t lane = 0; lane < 16; lane++)
+		maxValue = std::max(maxValue, maxLanes[lane]);
+	total = sumLanes[0] + sumLanes[1];
+#endif
+	for (; i < length; i++)
+	{
+		maxValue = std::max(maxValue, row[i]);
+		total += row[i];
+	}
+	maximum = maxValue;
+	sum = static_cast<uint32_t>(total);
+}
+
+void VolumeProjections::Initialize(const VolumeDimensions& dimensions)
+{
+	mDimensions = dimensions;
+	mAddedSlices = 0;
+
+	const size_t sizes[3] = {
+		static_cast<size_t>(dimensions.height) * dimensions.depth,
+		static_cast<size_t>(dimensions.width) * dimensions.depth,
+		static_cast<size_t>(dimensions.width) * dimensions.height };
+	for (size_t axis = 0; axis < 3; axis++)
+	{
+		mMaximum[axis].assign(sizes[axis], 0);
+		mSum[axis].assign(sizes[axis], 0);
+	}
+}
+
+void VolumeProjections::AddSlab(const uint8_t* slices, uint32_t firstSlice, uint32_t sliceCount)
+{
+	assert(firstSlice + sliceCount <= mDimensions.depth);
+
+	// x and z: every band of rows owns its part of both images
+	const uint32_t bandCount = DivideRoundUp(mDimensions.height, BRICK_SIZE);
+	ThreadPool::Get().ParallelFor(bandCount, [&](uint32_t band) {
+		AddRows(slices, firstSlice, sliceCount, band * BRICK_SIZE, std::min((band + 1) * BRICK_SIZE, mDimensions.height));
+	});
+
+	// y: every slice owns its row of the image, the slab is still in cache from the pass above
+	const size_t sliceSize = static_cast<size_t>(mDimensions.width) * mDimensions.height;
+	ThreadPool::Get().ParallelFor(sliceCount, [&](uint32_t slice) {
+		AddSlice(slices + slice * sliceSize, firstSlice + slice);
+	});
+
+	mAddedSlices += sliceCount;
+}
+
+void VolumeProjections::AddRows(const uint8_t* slices, uint32_t firstSlice, uint32_t sliceCount, uint32_t beginY, uint32_t endY)
+{
+	const uint32_t width = mDimensions.width;
+	const uint32_t height = mDimensions.height;
+	for (uint32_t y = beginY; y < endY; y++)
+	{
+		uint8_t* maximumZ = &mMaximum[GetAxisIndex(ProjectionAxis::Z)][static_cast<size_t>(y) * width];
+		uint32_t* sumZ = &mSum[GetAxisIndex(ProjectionAxis::Z)][static_cast<size_t>(y) * width];
+		for (uint32_t slice = 0; slice < sliceCount; slice++)
+		{
+			const uint8_t* row = slices + (static_cast<size_t>(slice) * height + y) * width;
+			MaxRow(maximumZ, row, width);
+			AddRow(sumZ, row, width);
+
+			const size_t indexX = y + static_cast<size_t>(height) * (firstSlice + slice);
+			ReduceRow(row, width, mMaximum[GetAxisIndex(ProjectionAxis::X)][indexX], mSum[GetAxisIndex(ProjectionAxis::X)][indexX]);
+		}
+	}
+}
+
+void VolumeProjections::AddSlice(const uint8_t* slice, uint32_t z)
+{
+	const uint32_t width = mDimensions.width;
+	uint8_t* maximumY = &mMaximum[GetAxisIndex(ProjectionAxis::Y)][static_cast<size_t>(z) * width];
+	uint32_t* sumY = &mSum[GetAxisIndex(ProjectionAxis::Y)][static_cast<size_t>(z) * width];
+	for (uint32_t y = 0; y < mDimensions.height; y++)
+	{
+		const uint8_t* row = slice + static_cast<size_t>(y) * width;
+		MaxRow(maximumY, row, width);
+		AddRow(sumY, row, width);
+	}
+}
+
+static void GetImageSize(const VolumeDimensions& dimensions, ProjectionAxis axis, uint32_t& width, uint32_t& height, uint32_t& sampleCount)
+{
+	switch (axis)
+	{
+	case ProjectionAxis::X:
+		width = dimensions.height;
+		height = dimensions.depth;
+		sampleCount = dimensions.width;
+		break;
+	case ProjectionAxis::Y:
+		width = dimensions.width;
+		height = dimensions.depth;
+		sampleCount = dimensions.height;
+		break;
+	case ProjectionAxis::Z:
+		width = dimensions.width;
+		height = dimensions.height;
+		sampleCount = dimensions.depth;
+		break;
+	}
+}
+
+ProjectionImage VolumeProjections::GetMaximum(ProjectionAxis axis) const
+{
+	ProjectionImage image;
+	uint32_t sampleCount = 0;
+	GetImageSize(mDimensions, axis, image.width, image.height, sampleCount);
+	image.pixels = mMaximum[GetAxisIndex(axis)];
+	return image;
+}
+
+ProjectionImage VolumeProjections::GetAverage(ProjectionAxis axis) const
+{
+	ProjectionImage image;
+	uint32_t sampleCount = 0;
+	GetImageSize(mDimensions, axis, image.width, image.height, sampleCount);
+
+	const std::vector<uint32_t>& sum = mSum[GetAxisIndex(axis)];
+	image.pixels.resize(sum.size());
+	for (size_t i = 0; i < sum.size(); i++)
+		image.pixels[i] = static_cast<uint8_t>((sum[i] + sampleCount / 2) / std::max(sampleCount, 1u));
+	return image;
+}
+
+// box filter by a whole factor, keeping the maximum of every box for MIPs so thin bright structures survive
+static ProjectionImage Downsample(const ProjectionImage& image, uint32_t maxSize, bool isMaximum)
+{
+	const uint32_t factor = DivideRoundUp(std::max(image.width, image.height), std::max(maxSize, 1u));
+	if (factor <= 1)
+		return image;
+
+	const uint32_t width = DivideRoundUp(image.width, factor);
+	const uint32_t height = DivideRoundUp(image.height, factor);
+	ProjectionImage result{
+		.width = width,
+		.height = height,
+		.pixels = std::vector<uint8_t>(static_cast<size_t>(width) * height) };
+	for (uint32_t y = 0; y < result.height; y++)
+	{
+		for (uint32_t x = 0; x < result.width; x++)
+		{
+			uint32_t value = 0;
+			uint32_t count = 0;
+			for (uint32_t sourceY = y * factor; sourceY < std::min((y + 1) * factor, image.height); sourceY++)
+			{
+				for (uint32_t sourceX = x * factor; sourceX < std::min((x + 1) * factor, image.width); sourceX++)
+				{
+					const uint8_t source = image.pixels[static_cast<size_t>(sourceY) * image.width + sourceX];
+					value = isMaximum ? std::max<uint32_t>(value, source) : value + source;
+					count++;
+				}
+			}
+			result.pixels[static_cast<size_t>(y) * result.width + x] = static_cast<uint8_t>(isMaximum ? value : (value + count / 2) / count);
+		}
+	}
+	return result;
+}
+
+static bool WriteImage(const ProjectionImage& image, const std::filesystem::path& filePath)
+{
+	CapturedImage rgba{
+		.width = image.width,
+		.height = image.height,
+		.rowPitch = image.width * 4,
+		.pixels = std::vector<uint8_t>(static_cast<size_t>(image.width) * 4 * image.height) };
+	for (size_t i = 0; i < image.pixels.size(); i++)
+	{
+		rgba.pixels[i * 4 + 0] = image.pixels[i];
+		rgba.pixels[i * 4 + 1] = image.pixels[i];
+		rgba.pixels[i * 4 + 2] = image.pixels[i];
+		rgba.pixels[i * 4 + 3] = UINT8_MAX;
+	}
+	return ImageEncoder::WriteBmp(rgba, filePath);
+}
+
+bool VolumeProjections::WriteImages(const std::filesystem::path& datasetPath, uint32_t maxSize) const
+{
+	assert(IsComplete());
+
+	static constexpr const char* AXIS_NAMES[3] = { "x", "y", "z" };
+	bool isWritten = true;
+	for (size_t axis = 0; axis < 3; axis++)
+	{
+		const ProjectionAxis projectionAxis = static_cast<ProjectionAxis>(axis);
+		std::filesystem::path maximumPath = datasetPath;
+		std::filesystem::path averagePath = datasetPath;
+		maximumPath.replace_extension(std::string(".mip_") + AXIS_NAMES[axis] + ".bmp");
+		averagePath.replace_extension(std::string(".avg_") + AXIS_NAMES[axis] + ".bmp");
+		isWritten &= WriteImage(Downsample(GetMaximum(projectionAxis), maxSize, true), maximumPath);
+		isWritten &= WriteImage(Downsample(GetAverage(projectionAxis), maxSize, false), averagePath);
+	}
+	return isWritten;
+}
+
+bool VolumeProjections::WriteImagesForFile(const std::filesystem::path& datasetPath, const VolumeDimensions& dimensions, uint32_t maxSize)
+{
+	std::ifstream file(datasetPath, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	VolumeProjections projections;
+	projections.Initialize(dimensions);
+
+	const size_t sliceSize = static_cast<size_t>(dimensions.width) * dimensions.height;
+	std::vector<uint8_t> slab(sliceSize * BRICK_SIZE);
+	for (uint32_t z = 0; z < dimensions.depth; z += BRICK_SIZE)
+	{
+		const uint32_t sliceCount = std::min(BRICK_SIZE, dimensions.depth - z);
+		file.read(reinterpret_cast<char*>(slab.data()), static_cast<std::streamsize>(sliceSize * sliceCount));
+		if (static_cast<size_t>(file.gcount()) != sliceSize * sliceCount)
+			return false;
+		projections.AddSlab(slab.data(), z, sliceCount);
+	}
+	return projections.WriteImages(datasetPath, maxSize);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "VolumeTypes.h"
+
+#include <filesystem>
+#include <vector>
+
+enum class ProjectionAxis : uint8_t {
+	X, // image is height x depth
+	Y, // image is width x depth
+	Z  // image is width x height
+};
+
+struct ProjectionImage {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<uint8_t> pixels;
+};
+
+// Maximum intensity and average projections of a volume along all three axes. They are built slab
+// by slab while the volume streams in, so getting them doesn't take a second read of the dataset.
+class VolumeProjections {
+public:
+	void Initialize(const VolumeDimensions& dimensions);
+
+	// sliceCount consecutive full resolution slices starting at firstSlice, every slice has to be added exactly once
+	void AddSlab(const uint8_t* slices, uint32_t firstSlice, uint32_t sliceCount);
+	bool IsComplete() const { return mAddedSlices == mDimensions.depth; }
+
+	ProjectionImage GetMaximum(ProjectionAxis axis) const;
+	ProjectionImage GetAverage(ProjectionAxis axis) const;
+
+	// <dataset>.mip_<axis>.bmp and <dataset>.avg_<axis>.bmp next to datasetPath, scaled down to at most maxSize on a side
+	bool WriteImages(const std::filesystem::path& datasetPath, uint32_t maxSize) const;
+
+	// reads a raw 8 bit volume slab by slab and writes its images, for cataloguing datasets without the renderer
+	static bool WriteImagesForFile(const std::filesystem::path& datasetPath, const VolumeDimensions& dimensions, uint32_t maxSize);
+
+private:
+	void AddRows(const uint8_t* slices, uint32_t firstSlice, uint32_t sliceCount, uint32_t beginY, uint32_t endY);
+	void AddSlice(const uint8_t* slice, uint32_t z);
+
+private:
+	VolumeDimensions mDimensions{};
+	uint32_t mAddedSlices = 0;
+
+	// maxima and sums per axis, laid out like the images
+	std::vector<uint8_t> mMaximum[3];
+	std::vector<uint32_t> mSum[3];
+};
@@ -0,0 +1,242 @@
+#include "VolumeResampler.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+AffineTransform AffineTransform::Scale(const Float3& scale)
+{
+	AffineTransform transform;
+	transform.m[0][0] = scale.x;
+	transform.m[1][1] = scale.y;
+	transform.m[2][2] = scale.z;
+	return transform;
+}
+
+AffineTransform AffineTransform::FromSpacing(const Float3& spacing, const Float3& origin)
+{
+	AffineTransform transform = Scale(spacing);
+	transform.m[0][3] = origin.x;
+	transform.m[1][3] = origin.y;
+	transform.m[2][3] = origin.z;
+	return transform;
+}
+
+Float3 AffineTransform::Apply(const Float3& p) const
+{
+	const Float3 linear = ApplyLinear(p);
+	return { linear.x + m[0][3], linear.y + m[1][3], linear.z + m[2][3] };
+}
+
+Float3 AffineTransform::ApplyLinear(const Float3& d) const
+{
+	return {
+		m[0][0] * d.x + m[0][1] * d.y + m[0][2] * d.z,
+		m[1][0] * d.x + m[1][1] * d.y + m[1][2] * d.z,
+		m[2][0] * d.x + m[2][1] * d.y + m[2][2] * d.z };
+}
+
+AffineTransform AffineTransform::Inverse() const
+{
+	const float cofactor00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+	const float cofactor01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+	const float cofactor02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+	const float determinant = m[0][0] * cofactor00 + m[0][1] * cofactor01 + m[0][2] * cofactor02;
+	assert(determinant != 0.0f && "Transform can't be inverted");
+	const float inverseDeterminant = 1.0f / determinant;
+
+	AffineTransform inverse;
+	inverse.m[0][0] = cofactor00 * inverseDeterminant;
+	inverse.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inverseDeterminant;
+	inverse.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inverseDeterminant;
+	inverse.m[1][0] = cofactor01 * inverseDeterminant;
+	inverse.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inverseDeterminant;
+	inverse.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inverseDeterminant;
+	inverse.m[2][0] = cofactor02 * inverseDeterminant;
+	inverse.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inverseDeterminant;
+	inverse.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inverseDeterminant;
+
+	const Float3 translation = inverse.ApplyLinear({ m[0][3], m[1][3], m[2][3] });
+	inverse.m[0][3] = -translation.x;
+	inverse.m[1][3] = -translation.y;
+	inverse.m[2][3] = -translation.z;
+	return inverse;
+}
+
+AffineTransform AffineTransform::operator*(const AffineTransform& other) const
+{
+	AffineTransform result;
+	for (uint32_t row = 0; row < 3; row++)
+	{
+		for (uint32_t column = 0; column < 4; column++)
+		{
+			result.m[row][column] = m[row][0] * other.m[0][column] + m[row][1] * other.m[1][column] + m[row][2] * other.m[2][column];
+			if (column == 3)
+				result.m[row][column] += m[row][3];
+		}
+	}
+	return result;
+}
+
+static float Lerp(float a, float b, float t)
+{
+	return a + (b - a) * t;
+}
+
+float VolumeResampler::Sample(const uint8_t* source, const VolumeDimensions& sourceDimensions, const Float3& position)
+{
+	const float maxX = static_cast<float>(sourceDimensions.width - 1);
+	const float maxY = static_cast<float>(sourceDimensions.height - 1);
+	const float maxZ = static_cast<float>(sourceDimensions.depth - 1);
+	if (!(position.x >= 0.0f && position.x <= maxX && position.y >= 0.0f && position.y <= maxY && position.z >= 0.0f && position.z <= maxZ))
+		return 0.0f;
+
+	// the cell is moved back from the last voxel, which is then reached with a fraction of 1
+	const float baseX = std::min(std::trunc(position.x), maxX - 1.0f);
+	const float baseY = std::min(std::trunc(position.y), maxY - 1.0f);
+	const float baseZ = std::min(std::trunc(position.z), maxZ - 1.0f);
+	const float fractionX = position.x - baseX;
+	const float fractionY = position.y - baseY;
+	const float fractionZ = position.z - baseZ;
+
+	const size_t rowSize = sourceDimensions.width;
+	const size_t sliceSize = rowSize * sourceDimensions.height;
+	const uint8_t* corner = source + sourceDimensions.GetIndex(static_cast<uint32_t>(baseX), static_cast<uint32_t>(baseY), static_cast<uint32_t>(baseZ));
+	const float x00 = Lerp(corner[0], corner[1], fractionX);
+	const float x10 = Lerp(corner[rowSize], corner[rowSize + 1], fractionX);
+	const float x01 = Lerp(corner[sliceSize], corner[sliceSize + 1], fractionX);
+	const float x11 = Lerp(corner[sliceSize + rowSize], corner[sliceSize + rowSize + 1], fractionX);
+	return Lerp(Lerp(x00, x10, fractionY), Lerp(x01, x11, fractionY), fractionZ);
+}
+
+// count destination voxels along a row, the source position of voxel i is start + i * step
+static void ResampleRow(const uint8_t* source, const VolumeDimensions& sourceDimensions, const Float3& start, const Float3& step,
+	uint32_t count, uint8_t* destination, uint32_t destinationStride)
+{
+	uint32_t i = 0;
+#ifdef VOLUME_SSE2
+	const __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 maxX = _mm_set1_ps(static_cast<float>(sourceDimensions.width - 1));
+	const __m128 maxY = _mm_set1_ps(static_cast<float>(sourceDimensions.height - 1));
+	const __m128 maxZ = _mm_set1_ps(static_cast<float>(sourceDimensions.depth - 1));
+	const size_t rowSize = sourceDimensions.width;
+	const size_t sliceSize = rowSize * sourceDimensions.height;
+
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 index = _mm_add_ps(_mm_set1_ps(static_cast<float>(i)), lanes);
+		const __m128 x = _mm_add_ps(_mm_set1_ps(start.x), _mm_mul_ps(index, _mm_set1_ps(step.x)));
+		const __m128 y = _mm_add_ps(_mm_set1_ps(start.y), _mm_mul_ps(index, _mm_set1_ps(step.y)));
+		const __m128 z = _mm_add_ps(_mm_set1_ps(start.z), _mm_mul_ps(index, _mm_set1_ps(step.z)));
+
+		const __m128 inside = _mm_and_ps(
+			_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(x, zero), _mm_cmple_ps(x, maxX)), _mm_and_ps(_mm_cmpge_ps(y, zero), _mm_cmple_ps(y, maxY))),
+			_mm_and_ps(_mm_cmpge_ps(z, zero), _mm_cmple_ps(z, maxZ)));
+		if (_mm_movemask_ps(inside) == 0)
+		{
+			for (uint32_t lane = 0; lane < 4; lane++)
+				destination[(i + lane) * destinationStride] = 0;
+			continue;
+		}
+
+		// lanes outside are clamped in so their loads stay in the volume, the mask zeroes them after
+		const __m128 clampedX = _mm_min_ps(_mm_max_ps(x, zero), maxX);
+		const __m128 clampedY = _mm_min_ps(_mm_max_ps(y, zero), maxY);
+		const __m128 clampedZ = _mm_min_ps(_mm_max_ps(z, zero), maxZ);
+		const __m128 baseX = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(clampedX)), _mm_sub_ps(maxX, one));
+		const __m128 baseY = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(clampedY)), _mm_sub_ps(maxY, one));
+		const __m128 baseZ = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(clampedZ)), _mm_sub_ps(maxZ, one));
+		const __m128 fractionX = _mm_sub_ps(clampedX, baseX);
+		const __m128 fractionY = _mm_sub_ps(clampedY, baseY);
+		const __m128 fractionZ = _mm_sub_ps(clampedZ, baseZ);
+
+		alignas(16) int32_t cornerX[4];
+		alignas(16) int32_t cornerY[4];
+		alignas(16) int32_t cornerZ[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(cornerX), _mm_cvttps_epi32(baseX));
+		_mm_store_si128(reinterpret_cast<__m128i*>(cornerY), _mm_cvttps_epi32(baseY));
+		_mm_store_si128(reinterpret_cast<__m128i*>(cornerZ), _mm_cvttps_epi32(baseZ));
+
+		// SSE2 has no gather, the eight corners of every lane are loaded one by one
+		alignas(16) float corners[8][4];
+		for (uint32_t lane = 0; lane < 4; lane++)
+		{
+			const uint8_t* corner = source + sourceDimensions.GetIndex(cornerX[lane], cornerY[lane], cornerZ[lane]);
+			corners[0][lane] = corner[0];
+			corners[1][lane] = corner[1];
+			corners[2][lane] = corner[rowSize];
+			corners[3][lane] = corner[rowSize + 1];
+			corners[4][lane] = corner[sliceSize];
+			corners[5][lane] = corner[sliceSize + 1];
+			corners[6][lane] = corner[sliceSize + rowSize];
+			corners[7][lane] = corner[sliceSize + rowSize + 1];
+		}
+
+		auto lerp = [](__m128 a, __m128 b, __m128 t) { return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t)); };
+		const __m128 x00 = lerp(_mm_load_ps(corners[0]), _mm_load_ps(corners[1]), fractionX);
+		const __m128 x10 = lerp(_mm_load_ps(corners[2]), _mm_load_ps(corners[3]), fractionX);
+		const __m128 x01 = lerp(_mm_load_ps(corners[4]), _mm_load_ps(corners[5]), fractionX);
+		const __m128 x11 = lerp(_mm_load_ps(corners[6]), _mm_load_ps(corners[7]), fractionX);
+		const __m128 value = _mm_and_ps(inside, lerp(lerp(x00, x10, fractionY), lerp(x01, x11, fractionY), fractionZ));
+
+		alignas(16) int32_t rounded[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(rounded), _mm_cvttps_epi32(_mm_add_ps(value, _mm_set1_ps(0.5f))));
+		for (uint32_t lane = 0; lane < 4; lane++)
+			destination[(i + lane) * destinationStride] = static_cast<uint8_t>(rounded[lane]);
+	}
+#endif
+	for (; i < count; i++)
+	{
+		const float index = static_cast<float>(i);
+		const Float3 position = { start.x + index * step.x, start.y + index * step.y, start.z + index * step.z };
+		destination[i * destinationStride] = static_cast<uint8_t>(VolumeResampler::Sample(source, sourceDimensions, position) + 0.5f);
+	}
+}
+
+void VolumeResampler::Resample(const uint8_t* source, const VolumeDimensions& sourceDimensions, const AffineTransform& destinationToSource,
+	uint8_t* destination, const VolumeDimensions& destinationDimensions, uint32_t destinationStride)
+{
+	assert(sourceDimensions.width > 1 && sourceDimensions.height > 1 && sourceDimensions.depth > 1);
+
+	const VolumeDimensions brickGrid = {
+		.width = (destinationDimensions.width + BRICK_SIZE - 1) / BRICK_SIZE,
+		.height = (destinationDimensions.height + BRICK_SIZE - 1) / BRICK_SIZE,
+		.depth = (destinationDimensions.depth + BRICK_SIZE - 1) / BRICK_SIZE };
+	const Float3 step = destinationToSource.ApplyLinear({ 1.0f, 0.0f, 0.0f });
+
+	// a brick's rows are short, but its source footprint is small enough to stay in cache
+	ThreadPool::Get().ParallelFor(static_cast<uint32_t>(brickGrid.GetVoxelCount()), [&](uint32_t brick) {
+		const uint32_t beginX = brick % brickGrid.width * BRICK_SIZE;
+		const uint32_t beginY = (brick / brickGrid.width) % brickGrid.height * BRICK_SIZE;
+		const uint32_t beginZ = brick / (brickGrid.width * brickGrid.height) * BRICK_SIZE;
+		const uint32_t rowLength = std::min(BRICK_SIZE, destinationDimensions.width - beginX);
+		const uint32_t endY = std::min(beginY + BRICK_SIZE, destinationDimensions.height);
+		const uint32_t endZ = std::min(beginZ + BRICK_SIZE, destinationDimensions.depth);
+		for (uint32_t z = beginZ; z < endZ; z++)
+		{
+			for (uint32_t y = beginY; y < endY; y++)
+			{
+				const Float3 start = destinationToSource.Apply({ static_cast<float>(beginX), static_cast<float>(y), static_cast<float>(z) });
+				ResampleRow(source, sourceDimensions, start, step, rowLength,
+					destination + destinationDimensions.GetIndex(beginX, y, z) * destinationStride, destinationStride);
+			}
+		}
+	});
+}
+
+void VolumeResampler::Fuse(const uint8_t* primary, const VolumeDimensions& primaryDimensions,
+	const uint8_t* secondary, const VolumeDimensions& secondaryDimensions, const AffineTransform& primaryToSecondary, uint8_t* fused)
+{
+	const size_t voxelCount = primaryDimensions.GetVoxelCount();
+	const uint32_t sliceSize = primaryDimensions.width * primaryDimensions.height;
+	ThreadPool::Get().ParallelFor(primaryDimensions.depth, [&](uint32_t z) {
+		const size_t begin = static_cast<size_t>(z) * sliceSize;
+		const size_t end = std::min(begin + sliceSize, voxelCount);
+		for (size_t voxel = begin; voxel < end; voxel++)
+			fused[voxel * 2] = primary[voxel];
+	});
+	Resample(secondary, secondaryDimensions, primaryToSecondary, fused + 1, primaryDimensions, 2);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "VolumeTypes.h"
+
+// Affine map between coordinate spaces, p' = m * (p, 1) with m row major.
+struct AffineTransform {
+	float m[3][4] = {
+		{ 1.0f, 0.0f, 0.0f, 0.0f },
+		{ 0.0f, 1.0f, 0.0f, 0.0f },
+		{ 0.0f, 0.0f, 1.0f, 0.0f } };
+
+	static AffineTransform Scale(const Float3& scale);
+	// voxel to world coordinates of a grid with this voxel spacing whose first voxel is at origin
+	static AffineTransform FromSpacing(const Float3& spacing, const Float3& origin);
+
+	Float3 Apply(const Float3& p) const;
+	// transforms a direction, the translation is left out
+	Float3 ApplyLinear(const Float3& d) const;
+	AffineTransform Inverse() const;
+	// applies other first, then this
+	AffineTransform operator*(const AffineTransform& other) const;
+};
+
+// Resamples a volume onto another volume's grid, for fusing co-registered scans (PET/MR onto CT)
+// before rendering instead of transforming every sample in the shader. Voxel centers are at
+// integer coordinates, anything outside [0, dimension - 1] of the source reads as 0.
+class VolumeResampler {
+public:
+	// trilinear sample at source voxel coordinates, the reference the SIMD path follows
+	static float Sample(const uint8_t* source, const VolumeDimensions& sourceDimensions, const Float3& position);
+
+	// Every destination voxel p gets source sampled at destinationToSource(p), written destinationStride
+	// bytes apart so the result can go straight into an interleaved volume. Parallel over bricks.
+	static void Resample(const uint8_t* source, const VolumeDimensions& sourceDimensions, const AffineTransform& destinationToSource,
+		uint8_t* destination, const VolumeDimensions& destinationDimensions, uint32_t destinationStride = 1);
+
+	// two bytes per primary voxel, the primary itself and the secondary resampled onto its grid
+	static void Fuse(const uint8_t* primary, const VolumeDimensions& primaryDimensions,
+		const uint8_t* secondary, const VolumeDimensions& secondaryDimensions, const AffineTransform& primaryToSecondary, uint8_t* fused);
+};
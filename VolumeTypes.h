@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// SSE2 is part of x64, other targets fall back to the scalar paths
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define VOLUME_SSE2 1
+#endif
+
+// Plain types shared by the CPU-side volume processing code. These intentionally don't
+// depend on Windows/DirectX so that the processing can be built and run anywhere.
+
+constexpr uint32_t BRICK_SIZE = 16;
+
+struct Float3 {
+	float x = 0.0f;
+	float y = 0.0f;
+	float z = 0.0f;
+
+	bool operator==(const Float3&) const = default;
+};
+
+struct VolumeDimensions {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t depth = 0;
+
+	size_t GetVoxelCount() const { return static_cast<size_t>(width) * height * depth; }
+	size_t GetIndex(uint32_t x, uint32_t y, uint32_t z) const { return x + width * (y + static_cast<size_t>(height) * z); }
+
+	bool operator==(const VolumeDimensions&) const = default;
+};
+
+// bricks tile the cells (voxel to voxel+1) of a volume, so a dimension of n voxels has n - 1 cells
+inline uint32_t GetBrickCount(uint32_t voxelCount, uint32_t brickSize = BRICK_SIZE)
+{
+	return voxelCount > 1 ? (voxelCount - 1 + brickSize - 1) / brickSize : 1;
+}
+
+// half open box of voxels, [min, max) on every axis
+struct VolumeBox {
+	uint32_t minX = 0;
+	uint32_t minY = 0;
+	uint32_t minZ = 0;
+	uint32_t maxX = 0;
+	uint32_t maxY = 0;
+	uint32_t maxZ = 0;
+
+	bool IsEmpty() const { return minX >= maxX || minY >= maxY || minZ >= maxZ; }
+	size_t GetVoxelCount() const { return IsEmpty() ? 0 : static_cast<size_t>(maxX - minX) * (maxY - minY) * (maxZ - minZ); }
+};
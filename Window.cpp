@@ -28,15 +28,14 @@ LRESULT WINAPI Window::WndProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam
         if (app->mIsInitialized)
         {
             SetCapture(hwnd);
-            app->GetCamera().mRmbIsPressed = true;
+            app->mInput.isRightButtonPressed = true;
         }
         break;
     case WM_RBUTTONUP:
         if (app->mIsInitialized)
         {
             ReleaseCapture();
-            app->GetCamera().mRmbIsPressed = false;
-            app->GetCamera().mPrevDragState.inProgress = false;
+            app->mInput.isRightButtonPressed = false;
         }
         break;
     case WM_KEYUP: